@@ -0,0 +1,121 @@
+// Compares the Base64 codec against the std::string/std::vector version that
+// ZKFPM_BlobToBase64 / ZKFPM_Base64ToBlob used before.
+#include "base64.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace {
+
+std::string LegacyEncode(const uint8_t *data, size_t len) {
+  static const char kB64[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  std::string out;
+  out.reserve(((len + 2) / 3) * 4);
+  for (size_t i = 0; i < len; i += 3) {
+    uint32_t v = data[i] << 16;
+    if (i + 1 < len) v |= data[i + 1] << 8;
+    if (i + 2 < len) v |= data[i + 2];
+    out.push_back(kB64[(v >> 18) & 0x3F]);
+    out.push_back(kB64[(v >> 12) & 0x3F]);
+    out.push_back(i + 1 < len ? kB64[(v >> 6) & 0x3F] : '=');
+    out.push_back(i + 2 < len ? kB64[v & 0x3F] : '=');
+  }
+  return out;
+}
+
+bool LegacyIsBase64Char(char c) {
+  return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c == '+' || c == '/' ||
+         c == '=';
+}
+
+bool LegacyDecode(const char *input, std::vector<uint8_t> &out) {
+  auto decode_val = [](char c) -> int {
+    if (c >= 'A' && c <= 'Z') return c - 'A';
+    if (c >= 'a' && c <= 'z') return c - 'a' + 26;
+    if (c >= '0' && c <= '9') return c - '0' + 52;
+    if (c == '+') return 62;
+    if (c == '/') return 63;
+    return -1;
+  };
+  size_t len = std::strlen(input);
+  if ((len & 3) != 0) return false;
+  for (size_t i = 0; i < len; ++i) {
+    if (!LegacyIsBase64Char(input[i])) return false;
+  }
+  out.clear();
+  out.reserve((len / 4) * 3);
+  for (size_t i = 0; i < len; i += 4) {
+    int v0 = decode_val(input[i]);
+    int v1 = decode_val(input[i + 1]);
+    if (v0 < 0 || v1 < 0) return false;
+    int v2 = input[i + 2] == '=' ? -1 : decode_val(input[i + 2]);
+    int v3 = input[i + 3] == '=' ? -1 : decode_val(input[i + 3]);
+    uint32_t triple = (v0 << 18) | (v1 << 12) | ((v2 < 0 ? 0 : v2) << 6) | (v3 < 0 ? 0 : v3);
+    out.push_back((triple >> 16) & 0xFF);
+    if (input[i + 2] != '=') out.push_back((triple >> 8) & 0xFF);
+    if (input[i + 3] != '=') out.push_back(triple & 0xFF);
+  }
+  return true;
+}
+
+template <typename Fn>
+double NsPerOp(int iters, Fn &&fn) {
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < iters; ++i) {
+    fn();
+  }
+  auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::nano>(end - start).count() / iters;
+}
+
+volatile size_t g_sink = 0;
+
+} // namespace
+
+int main(int argc, char **argv) {
+  int iters = argc > 1 ? std::atoi(argv[1]) : 200000;
+  std::cout << "kernel: " << zkfp::Base64Kernel() << "\n";
+
+  for (size_t len : {64u, 512u, 1664u, 16384u}) {
+    std::vector<uint8_t> blob(len);
+    for (size_t i = 0; i < len; ++i) {
+      blob[i] = static_cast<uint8_t>(std::rand());
+    }
+    std::string text = LegacyEncode(blob.data(), len);
+    std::vector<char> enc_buf(zkfp::Base64EncodedLen(len) + 1);
+    std::vector<uint8_t> dec_buf(len);
+    std::vector<uint8_t> legacy_out;
+
+    int n = static_cast<int>(iters * 64 / len) + 1;
+    double legacy_enc = NsPerOp(n, [&] {
+      std::string s = LegacyEncode(blob.data(), len);
+      std::memcpy(enc_buf.data(), s.data(), s.size());
+      g_sink = s.size();
+    });
+    double new_enc = NsPerOp(n, [&] {
+      zkfp::Base64Encode(blob.data(), len, enc_buf.data());
+      g_sink = enc_buf[0];
+    });
+    double legacy_dec = NsPerOp(n, [&] {
+      std::vector<uint8_t> decoded;
+      LegacyDecode(text.c_str(), decoded);
+      std::memcpy(dec_buf.data(), decoded.data(), decoded.size());
+      g_sink = decoded.size();
+    });
+    double new_dec = NsPerOp(n, [&] {
+      size_t text_len = std::strlen(text.c_str());
+      zkfp::Base64Decode(text.c_str(), text_len, dec_buf.data());
+      g_sink = dec_buf[0];
+    });
+
+    std::cout << len << " bytes: encode " << legacy_enc << " -> " << new_enc << " ns ("
+              << legacy_enc / new_enc << "x), decode " << legacy_dec << " -> " << new_dec << " ns ("
+              << legacy_dec / new_dec << "x)\n";
+  }
+  return 0;
+}
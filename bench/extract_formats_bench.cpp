@@ -0,0 +1,71 @@
+// Dual-format extraction through the BIOKEY entry points, against the in-tree
+// mock IEngine (-DZKFP_MOCK_IENGINE=ON): BIOKEY_EXTRACT_BY_FORMAT once per format
+// against one BIOKEY_EXTRACT_FORMATS call for both. ZKFP_MOCK_EXTRACT_NS sets
+// what one feature extraction costs; it defaults to 1 ms here.
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <vector>
+
+extern "C" {
+int64_t BIOKEY_INIT(int64_t a1, uint16_t *cfg, int64_t, int64_t, int64_t a5);
+int64_t BIOKEY_CLOSE(void *ctx);
+int64_t BIOKEY_EXTRACT_BY_FORMAT(void *ctx, const void *raw, void *out, int out_len, unsigned int fmt);
+int64_t BIOKEY_EXTRACT_FORMATS(void *ctx, const void *raw, const unsigned int *fmts, void *const *outs,
+                               const int *caps, int *lens, int count, int *quality);
+}
+
+int main(int argc, char **argv) {
+  int frames = argc > 1 ? std::atoi(argv[1]) : 200;
+  setenv("ZKFP_MOCK_EXTRACT_NS", "1000000", 0);
+
+  constexpr int kWidth = 300;
+  constexpr int kHeight = 400;
+  uint16_t cfg[36] = {0};
+  cfg[0] = cfg[20] = kWidth;
+  cfg[1] = cfg[21] = kHeight;
+  void *ctx = reinterpret_cast<void *>(BIOKEY_INIT(0, cfg, 0, 0, 128));
+  if (!ctx) {
+    std::cerr << "BIOKEY_INIT failed\n";
+    return 1;
+  }
+
+  std::mt19937 rng(1);
+  std::vector<uint8_t> raw(static_cast<size_t>(kWidth) * kHeight);
+  for (uint8_t &p : raw) {
+    p = static_cast<uint8_t>(rng());
+  }
+
+  const unsigned int fmts[2] = {1, 2};
+  std::vector<uint8_t> native(2048);
+  std::vector<uint8_t> iso(2048);
+  void *outs[2] = {native.data(), iso.data()};
+  const int caps[2] = {2048, 2048};
+  int lens[2] = {0, 0};
+
+  auto start = std::chrono::steady_clock::now();
+  int64_t bytes_apart = 0;
+  for (int f = 0; f < frames; ++f) {
+    for (int i = 0; i < 2; ++i) {
+      bytes_apart += BIOKEY_EXTRACT_BY_FORMAT(ctx, raw.data(), outs[i], caps[i], fmts[i]);
+    }
+  }
+  auto mid = std::chrono::steady_clock::now();
+  int64_t bytes_once = 0;
+  for (int f = 0; f < frames; ++f) {
+    int quality = 0;
+    BIOKEY_EXTRACT_FORMATS(ctx, raw.data(), fmts, outs, caps, lens, 2, &quality);
+    bytes_once += lens[0] + lens[1];
+  }
+  auto end = std::chrono::steady_clock::now();
+
+  double apart = std::chrono::duration<double, std::micro>(mid - start).count() / frames;
+  double once = std::chrono::duration<double, std::micro>(end - mid).count() / frames;
+  std::cout << "2 formats, per frame: " << apart << " us by format, " << once << " us in one pass ("
+            << bytes_apart / frames << " / " << bytes_once / frames << " bytes)\n";
+  BIOKEY_CLOSE(ctx);
+  return 0;
+}
@@ -0,0 +1,200 @@
+// Times the linear correction map against the per-pixel arithmetic it
+// replaced (CorrectFingerLinear, kept verbatim below), and checks that nearest
+// sampling still produces the same bytes.
+#include "finger_linear.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+namespace {
+
+int LegacyCorrectFingerLinear(const uint8_t *src, uint8_t *dst, uint16_t *a3, unsigned int a4) {
+  int v6 = static_cast<int16_t>(a3[3]);
+  if (a3[3] == a3[5] && (static_cast<int16_t>(a3[7]) == a3[9])) {
+    int v28 = static_cast<int16_t>(a3[7]);
+    int v55 = 0;
+    int v49 = 0;
+    if (a4 & 2) {
+      v55 = a3[0];
+      v49 = a3[1];
+    } else {
+      v49 = a3[0];
+      v55 = a3[1];
+    }
+
+    int v29 = a3[21];
+    if (a3[21]) {
+      int v50 = 0;
+      int v53 = a4 & 1;
+      while (1) {
+        int v30 = static_cast<int16_t>(a3[6]);
+        int v31 = static_cast<int16_t>(a3[4]);
+        int v54 = static_cast<int16_t>(a3[2]);
+        int v32 = v54 - v31;
+        int v33 = static_cast<int16_t>(a3[8]) - v30;
+        int v34 = (v54 - v31) * -v29;
+        int v35 = v34 + v50 * (v33 + v54 - v31);
+        int v36 = (v35 / 2 + v28 * v34 + v50 * (v33 * v6 + v28 * (v54 - v31))) / v35;
+        int v51 = v36;
+        if (v55 <= v36 || v36 < 0) {
+          if (a3[20]) {
+            for (int i = 0; i < a3[20]; ++i) {
+              *dst++ = 0xFF;
+            }
+            v29 = a3[21];
+          }
+        } else {
+          int v37 = static_cast<int16_t>(a3[8]) * v54 - v30 * v31;
+          int v38 = a3[20];
+          int v39 = v50 * v37;
+          int v40 = a3[20];
+          if (v40) {
+            uint8_t *v41 = dst;
+            int v42 = 0;
+            while (1) {
+              int v46 = (v35 / 2 + v39 - v32 * (v30 + (v42 + (v40 >> 1)) / v38) * v29) / v35;
+              if (v49 <= v46 || v46 < 0) {
+                *v41 = 0xFF;
+              } else {
+                int v43 = a3[0];
+                int v44 = (a4 & 2) ? v51 + v43 * v46 : v51 * v43 + v46;
+                uint8_t v45 = src[v44];
+                if (v53) {
+                  v45 = static_cast<uint8_t>(~v45);
+                }
+                *v41 = v45;
+              }
+              v38 = a3[20];
+              ++v41;
+              v42 += v33;
+              v40 = a3[20];
+              if (v38 <= (v41 - dst)) {
+                break;
+              }
+              v29 = a3[21];
+              v30 = static_cast<int16_t>(a3[6]);
+            }
+            v29 = a3[21];
+            dst = v41;
+          }
+        }
+        if (++v50 >= v29) {
+          break;
+        }
+        v28 = static_cast<int16_t>(a3[7]);
+        v6 = static_cast<int16_t>(a3[3]);
+      }
+    }
+    return a4;
+  }
+
+  int v7 = a3[21];
+  int v8 = a3[20];
+  int v9 = v7 * v8;
+  int v48 = (v7 * v8) >> 1;
+  if (a3[21]) {
+    int v11 = 0;
+    while (1) {
+      int v12 = a3[2];
+      int v13 = a3[6];
+      int v14 = v12 - v11 * (v12 - v13) / v7;
+      int v15 = a3[4] - v12;
+      int v16 = a3[3];
+      int v17 = v7 * v15 - v11 * (v15 + v13 - a3[8]);
+      int v18 = a3[7];
+      int v19 = v16 - v11 * (v16 - v18) / v7;
+      int v20 = v7 * (a3[5] - v16) - v11 * (a3[5] - v16 + v18 - a3[9]);
+      if (static_cast<uint16_t>(v8)) {
+        int v21 = v48;
+        int v22 = 0;
+        int v23 = v48;
+        do {
+          ++v22;
+          int v25 = v21 >> 31;
+          int v24 = v21;
+          ++dst;
+          v21 += v20;
+          int v26 = static_cast<int>(a3[0] * (v19 + static_cast<int64_t>(static_cast<uint64_t>(v24) | (static_cast<uint64_t>(v25) << 32)) / v9));
+          int v27 = v23;
+          v23 += v17;
+          dst[-1] = src[v26 + v14 + v27 / v9];
+        } while (a3[20] > v22);
+        v7 = a3[21];
+      }
+      if (v7 <= ++v11) {
+        break;
+      }
+      v8 = a3[20];
+    }
+  }
+  return v7 * v8;
+}
+
+template <typename Fn>
+double UsPerOp(int iters, Fn &&fn) {
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < iters; ++i) {
+    fn();
+  }
+  auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::micro>(end - start).count() / iters;
+}
+
+volatile uint8_t g_sink = 0;
+
+} // namespace
+
+int main(int argc, char **argv) {
+  int iters = argc > 1 ? std::atoi(argv[1]) : 1000;
+  std::cout << "kernel: " << zkfp::FingerLinearKernel() << "\n";
+
+  const int src_w = 300;
+  const int src_h = 400;
+  std::vector<uint8_t> frame(static_cast<size_t>(src_w) * src_h);
+  for (auto &b : frame) {
+    b = static_cast<uint8_t>(std::rand());
+  }
+
+  struct Case {
+    const char *name;
+    uint16_t corners[8];
+  };
+  for (const Case &c : {Case{"trapezoid", {30, 20, 270, 20, 10, 380, 290, 380}},
+                        Case{"quad", {30, 20, 270, 30, 15, 380, 285, 370}}}) {
+    uint16_t params[zkfp::kFingerLinearParams] = {};
+    params[0] = src_w;
+    params[1] = src_h;
+    std::memcpy(params + 2, c.corners, sizeof(c.corners));
+    params[20] = 280;
+    params[21] = 360;
+    std::vector<uint8_t> legacy(280 * 360);
+    std::vector<uint8_t> out(legacy.size());
+
+    zkfp::FingerLinearMap map;
+    double build = UsPerOp(iters / 10 + 1, [&] { map.Build(params, 0); });
+    map.Apply(frame.data(), out.data());
+    LegacyCorrectFingerLinear(frame.data(), legacy.data(), params, 0);
+    bool same = legacy == out;
+
+    double before = UsPerOp(iters, [&] {
+      LegacyCorrectFingerLinear(frame.data(), legacy.data(), params, 0);
+      g_sink = legacy[0];
+    });
+    double nearest = UsPerOp(iters, [&] {
+      map.Apply(frame.data(), out.data());
+      g_sink = out[0];
+    });
+    map.Build(params, zkfp::kFingerLinearBilinear);
+    double bilinear = UsPerOp(iters, [&] {
+      map.Apply(frame.data(), out.data());
+      g_sink = out[0];
+    });
+    std::cout << c.name << ": per-pixel " << before << " us -> map " << nearest << " us (same " << same
+              << "), bilinear " << bilinear << " us, build " << build << " us\n";
+  }
+  return 0;
+}
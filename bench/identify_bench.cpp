@@ -0,0 +1,126 @@
+// 1:N identification through the BIOKEY entry points, against the in-tree mock
+// IEngine (-DZKFP_MOCK_IENGINE=ON): enrolls `users` synthetic fingers, then
+// identifies noisy copies of them. ZKFP_MOCK_MATCH_NS sets what one comparison
+// costs, so the wrapper's own overhead can be told apart from the engine's.
+//
+// The engine's own search is timed first, then the sharded gallery at 1, 2, 4,
+// ... up to `max_threads` threads (BIOKEY_SET_PARAMETER 5014).
+#include "template_codec.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <vector>
+
+extern "C" {
+int64_t BIOKEY_INIT(int64_t a1, uint16_t *cfg, int64_t, int64_t, int64_t a5);
+int64_t BIOKEY_CLOSE(void *ctx);
+int BIOKEY_SET_PARAMETER(void *ctx, unsigned int code, unsigned int value);
+int BIOKEY_MATCHINGPARAM(void *ctx, int64_t, int val);
+int BIOKEY_DB_ADD(void *ctx, unsigned int uid, int len, void *templ);
+int64_t BIOKEY_IDENTIFYTEMP_EX(void *ctx, const char *templ, const char *tag, int threshold, int *uid, int *score);
+}
+
+namespace {
+
+// Mock template layout: 24-byte ICRS2 header, one 'M' record of a 16x16 grid.
+constexpr int kFeatures = 256;
+constexpr int kRecordLen = 5 + kFeatures;
+constexpr int kTemplateLen = 24 + kRecordLen;
+
+std::vector<uint8_t> MakeTemplate(const int8_t *features) {
+  std::vector<uint8_t> t(kTemplateLen, 0);
+  std::memcpy(t.data(), "ICRS21", 6);
+  t[8] = static_cast<uint8_t>(kTemplateLen >> 8);
+  t[9] = static_cast<uint8_t>(kTemplateLen);
+  t[10] = 1;
+  t[16] = 0xC5;
+  t[18] = 0xC5;
+  t[20] = 0x18;
+  t[22] = 0x68;
+  uint8_t *r = t.data() + 24;
+  r[0] = 'M';
+  r[1] = 80;
+  r[3] = static_cast<uint8_t>(kRecordLen >> 8);
+  r[4] = static_cast<uint8_t>(kRecordLen);
+  std::memcpy(r + 5, features, kFeatures);
+  zkfp::EncodeTemplate(t.data(), t.size());
+  return t;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  int users = argc > 1 ? std::atoi(argv[1]) : 20000;
+  int probes = argc > 2 ? std::atoi(argv[2]) : 50;
+  int max_threads = argc > 3 ? std::atoi(argv[3]) : 64;
+
+  uint16_t cfg[36] = {0};
+  cfg[0] = cfg[20] = 300;
+  cfg[1] = cfg[21] = 400;
+  void *ctx = reinterpret_cast<void *>(BIOKEY_INIT(0, cfg, 0, 0, 128));
+  if (!ctx) {
+    std::cerr << "BIOKEY_INIT failed\n";
+    return 1;
+  }
+  BIOKEY_MATCHINGPARAM(ctx, 0, 1);
+
+  std::mt19937 rng(1);
+  std::uniform_int_distribution<int> feature(-100, 100);
+  std::uniform_int_distribution<int> noise(-20, 20);
+  std::vector<std::vector<int8_t>> fingers(users, std::vector<int8_t>(kFeatures));
+  for (int u = 0; u < users; ++u) {
+    for (int8_t &f : fingers[u]) {
+      f = static_cast<int8_t>(feature(rng));
+    }
+    std::vector<uint8_t> t = MakeTemplate(fingers[u].data());
+    if (!BIOKEY_DB_ADD(ctx, static_cast<unsigned int>(u + 1), kTemplateLen, t.data())) {
+      std::cerr << "BIOKEY_DB_ADD failed at " << u << "\n";
+      return 1;
+    }
+  }
+
+  std::vector<std::vector<uint8_t>> queries;
+  std::vector<int> expect;
+  for (int p = 0; p < probes; ++p) {
+    int u = static_cast<int>(rng() % users);
+    int8_t noisy[kFeatures];
+    for (int i = 0; i < kFeatures; ++i) {
+      noisy[i] = static_cast<int8_t>(fingers[u][i] + noise(rng));
+    }
+    queries.push_back(MakeTemplate(noisy));
+    expect.push_back(u + 1);
+  }
+
+  std::cout << users << " users, " << probes << " probes\n";
+  for (int threads = 0; threads <= max_threads; threads = threads ? threads * 2 : 1) {
+    BIOKEY_SET_PARAMETER(ctx, 5014, static_cast<unsigned int>(threads));
+    // The first search after switching the gallery on builds it; keep that out
+    // of the timing.
+    int uid = 0;
+    int score = 0;
+    BIOKEY_IDENTIFYTEMP_EX(ctx, reinterpret_cast<const char *>(queries[0].data()), nullptr, 0, &uid, &score);
+
+    int hits = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int p = 0; p < probes; ++p) {
+      uid = 0;
+      BIOKEY_IDENTIFYTEMP_EX(ctx, reinterpret_cast<const char *>(queries[p].data()), nullptr, 0, &uid, &score);
+      hits += uid == expect[p];
+    }
+    auto end = std::chrono::steady_clock::now();
+    double us = std::chrono::duration<double, std::micro>(end - start).count() / probes;
+
+    if (threads) {
+      std::cout << "  gallery, " << threads << " threads: ";
+    } else {
+      std::cout << "  engine: ";
+    }
+    std::cout << us << " us per identify, " << hits << "/" << probes << " found\n";
+  }
+  BIOKEY_CLOSE(ctx);
+  return 0;
+}
@@ -0,0 +1,127 @@
+// Compares the image geometry kernels against what BIOKEY_EXTRACT did before
+// (memset of the whole engine buffer, then a row-by-row centre crop) and
+// against a per-pixel floating-point bilinear resampler.
+#include "image_geom.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+namespace {
+
+constexpr int kEngineWidth = 280;
+constexpr int kEngineHeight = 360;
+
+void LegacyCrop(const uint8_t *src, int src_w, int src_h, uint8_t *dst, int out_w, int out_h) {
+  std::memset(dst, 0xFF, static_cast<size_t>(out_w) * out_h);
+  int oy = (src_h - out_h) / 2;
+  int ox = (src_w - out_w) / 2;
+  for (int y = 0; y < out_h; ++y) {
+    int sy = y + oy;
+    if (sy < 0 || sy >= src_h) {
+      continue;
+    }
+    const uint8_t *row = src + static_cast<size_t>(sy) * src_w;
+    if (ox >= 0) {
+      std::memcpy(dst + static_cast<size_t>(y) * out_w, row + ox, out_w);
+    } else {
+      std::memcpy(dst + static_cast<size_t>(y) * out_w - ox, row, src_w);
+    }
+  }
+}
+
+void NaiveBilinear(const uint8_t *src, int src_w, int src_h, double scale, uint8_t *dst, int out_w, int out_h) {
+  for (int y = 0; y < out_h; ++y) {
+    double v = (y + 0.5 - out_h / 2.0) / scale + src_h / 2.0;
+    for (int x = 0; x < out_w; ++x) {
+      double u = (x + 0.5 - out_w / 2.0) / scale + src_w / 2.0;
+      uint8_t &out = dst[static_cast<size_t>(y) * out_w + x];
+      if (u < 0 || u >= src_w || v < 0 || v >= src_h) {
+        out = 0xFF;
+        continue;
+      }
+      double fx = std::floor(u - 0.5);
+      double fy = std::floor(v - 0.5);
+      double ax = u - 0.5 - fx;
+      double ay = v - 0.5 - fy;
+      int x0 = std::max(static_cast<int>(fx), 0);
+      int y0 = std::max(static_cast<int>(fy), 0);
+      int x1 = std::min(static_cast<int>(fx) + 1, src_w - 1);
+      int y1 = std::min(static_cast<int>(fy) + 1, src_h - 1);
+      double top = src[y0 * src_w + x0] * (1 - ax) + src[y0 * src_w + x1] * ax;
+      double bottom = src[y1 * src_w + x0] * (1 - ax) + src[y1 * src_w + x1] * ax;
+      out = static_cast<uint8_t>(top * (1 - ay) + bottom * ay + 0.5);
+    }
+  }
+}
+
+template <typename Fn>
+double UsPerOp(int iters, Fn &&fn) {
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < iters; ++i) {
+    fn();
+  }
+  auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::micro>(end - start).count() / iters;
+}
+
+volatile uint8_t g_sink = 0;
+
+} // namespace
+
+int main(int argc, char **argv) {
+  int iters = argc > 1 ? std::atoi(argv[1]) : 2000;
+  std::cout << "kernel: " << zkfp::ImageGeomKernel() << "\n";
+
+  std::vector<uint8_t> out(static_cast<size_t>(kEngineWidth) * kEngineHeight);
+
+  // Same-DPI sensor frames: the crop every extraction does.
+  for (auto dims : {std::pair<int, int>{300, 400}, std::pair<int, int>{256, 288}}) {
+    std::vector<uint8_t> frame(static_cast<size_t>(dims.first) * dims.second);
+    for (auto &b : frame) {
+      b = static_cast<uint8_t>(std::rand());
+    }
+    double legacy = UsPerOp(iters, [&] {
+      LegacyCrop(frame.data(), dims.first, dims.second, out.data(), kEngineWidth, kEngineHeight);
+      g_sink = out[0];
+    });
+    double crop = UsPerOp(iters, [&] {
+      zkfp::CropCenter(frame.data(), dims.first, dims.second, dims.first, out.data(), kEngineWidth, kEngineHeight,
+                       false);
+      g_sink = out[0];
+    });
+    std::cout << dims.first << "x" << dims.second << " crop: legacy " << legacy << " -> " << crop << " us\n";
+  }
+
+  // Sensors at other resolutions, converted to the engine's 500 DPI.
+  for (int dpi : {1000, 569, 400}) {
+    int w = zkfp::ScaledExtent(300, 500, dpi);
+    int h = zkfp::ScaledExtent(400, 500, dpi);
+    std::vector<uint8_t> frame(static_cast<size_t>(w) * h);
+    for (auto &b : frame) {
+      b = static_cast<uint8_t>(std::rand());
+    }
+    int n = iters / 4 + 1;
+    double naive = UsPerOp(n, [&] {
+      NaiveBilinear(frame.data(), w, h, 500.0 / dpi, out.data(), kEngineWidth, kEngineHeight);
+      g_sink = out[0];
+    });
+    double bilinear = UsPerOp(n, [&] {
+      zkfp::ResampleCenter(frame.data(), w, h, w, dpi, out.data(), kEngineWidth, kEngineHeight, 500,
+                           zkfp::ResampleFilter::Bilinear, false);
+      g_sink = out[0];
+    });
+    double area = UsPerOp(n, [&] {
+      zkfp::ResampleCenter(frame.data(), w, h, w, dpi, out.data(), kEngineWidth, kEngineHeight, 500,
+                           zkfp::ResampleFilter::Area, false);
+      g_sink = out[0];
+    });
+    std::cout << w << "x" << h << " @" << dpi << " dpi: naive bilinear " << naive << " us, bilinear " << bilinear
+              << " us, area " << area << " us\n";
+  }
+  return 0;
+}
@@ -0,0 +1,159 @@
+// Accuracy against speed of the 1:N sketch prefilter, through the BIOKEY entry
+// points and the in-tree mock IEngine (-DZKFP_MOCK_IENGINE=ON). Enrolls `users`
+// synthetic fingers and identifies `probes` noisy copies of enrolled ones plus
+// as many fingers that were never enrolled. For each share of users kept
+// (BIOKEY_SET_PARAMETER 5016, per mille) it reports the time per search, how
+// many genuine probes were still found, how many searches of either kind
+// returned the user (and score) the full search returns, and how many
+// impostors were matched to someone.
+#include "template_codec.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+extern "C" {
+int64_t BIOKEY_INIT(int64_t a1, uint16_t *cfg, int64_t, int64_t, int64_t a5);
+int64_t BIOKEY_CLOSE(void *ctx);
+int BIOKEY_MATCHINGPARAM(void *ctx, int64_t, int val);
+int BIOKEY_SET_PARAMETER(void *ctx, unsigned int code, unsigned int value);
+int BIOKEY_DB_ADD(void *ctx, unsigned int uid, int len, void *templ);
+int64_t BIOKEY_IDENTIFYTEMP_EX(void *ctx, const char *templ, const char *tag, int threshold, int *uid, int *score);
+}
+
+namespace {
+
+// Mock template layout: 24-byte ICRS2 header, one 'M' record of a 16x16 grid.
+constexpr int kFeatures = 256;
+constexpr int kRecordLen = 5 + kFeatures;
+constexpr int kTemplateLen = 24 + kRecordLen;
+
+std::vector<uint8_t> MakeTemplate(const int8_t *features, uint8_t quality) {
+  std::vector<uint8_t> t(kTemplateLen, 0);
+  std::memcpy(t.data(), "ICRS21", 6);
+  t[8] = static_cast<uint8_t>(kTemplateLen >> 8);
+  t[9] = static_cast<uint8_t>(kTemplateLen);
+  t[10] = 1;
+  t[16] = 0xC5;
+  t[18] = 0xC5;
+  t[20] = 0x18;
+  t[22] = 0x68;
+  uint8_t *r = t.data() + 24;
+  r[0] = 'M';
+  r[1] = quality;
+  r[3] = static_cast<uint8_t>(kRecordLen >> 8);
+  r[4] = static_cast<uint8_t>(kRecordLen);
+  std::memcpy(r + 5, features, kFeatures);
+  zkfp::EncodeTemplate(t.data(), t.size());
+  return t;
+}
+
+int8_t Clamp(int v) {
+  return static_cast<int8_t>(v > 127 ? 127 : v < -127 ? -127 : v);
+}
+
+struct Result {
+  int uid;
+  int score;
+};
+
+} // namespace
+
+int main(int argc, char **argv) {
+  int users = argc > 1 ? std::atoi(argv[1]) : 20000;
+  int probes = argc > 2 ? std::atoi(argv[2]) : 200;
+  int noise = argc > 3 ? std::atoi(argv[3]) : 30;
+
+  uint16_t cfg[36] = {0};
+  cfg[0] = cfg[20] = 300;
+  cfg[1] = cfg[21] = 400;
+  void *ctx = reinterpret_cast<void *>(BIOKEY_INIT(0, cfg, 0, 0, 128));
+  if (!ctx) {
+    std::fprintf(stderr, "BIOKEY_INIT failed\n");
+    return 1;
+  }
+  // The identification threshold of zkfp's default FP_MTHRESHOLD_CODE.
+  BIOKEY_MATCHINGPARAM(ctx, 0, 55);
+
+  std::mt19937 rng(7);
+  std::uniform_int_distribution<int> feature(-100, 100);
+  std::uniform_int_distribution<int> jitter(-noise, noise);
+  std::uniform_int_distribution<int> quality(40, 100);
+  std::vector<std::vector<int8_t>> fingers(users, std::vector<int8_t>(kFeatures));
+  for (int u = 0; u < users; ++u) {
+    for (int8_t &f : fingers[u]) {
+      f = static_cast<int8_t>(feature(rng));
+    }
+    std::vector<uint8_t> t = MakeTemplate(fingers[u].data(), static_cast<uint8_t>(quality(rng)));
+    if (!BIOKEY_DB_ADD(ctx, static_cast<unsigned int>(u + 1), kTemplateLen, t.data())) {
+      std::fprintf(stderr, "BIOKEY_DB_ADD failed at %d\n", u);
+      return 1;
+    }
+  }
+
+  // Genuine probes first, then impostors.
+  std::vector<std::vector<uint8_t>> queries;
+  std::vector<int> expect;
+  for (int p = 0; p < probes; ++p) {
+    int u = static_cast<int>(rng() % users);
+    int8_t noisy[kFeatures];
+    for (int i = 0; i < kFeatures; ++i) {
+      noisy[i] = Clamp(fingers[u][i] + jitter(rng));
+    }
+    queries.push_back(MakeTemplate(noisy, static_cast<uint8_t>(quality(rng))));
+    expect.push_back(u + 1);
+  }
+  for (int p = 0; p < probes; ++p) {
+    int8_t other[kFeatures];
+    for (int8_t &f : other) {
+      f = static_cast<int8_t>(feature(rng));
+    }
+    queries.push_back(MakeTemplate(other, static_cast<uint8_t>(quality(rng))));
+  }
+
+  std::printf("%d users, %d genuine + %d impostor probes, noise +-%d\n", users, probes, probes, noise);
+  std::printf("%8s %10s %10s %10s %10s\n", "keep", "us/search", "found", "same", "false+");
+  std::vector<Result> full;
+  const unsigned kKeep[] = {0, 500, 200, 100, 50, 20, 10, 5, 2, 1};
+  for (unsigned keep : kKeep) {
+    BIOKEY_SET_PARAMETER(ctx, 5016, keep);
+    std::vector<Result> got(queries.size());
+    auto start = std::chrono::steady_clock::now();
+    for (size_t q = 0; q < queries.size(); ++q) {
+      got[q] = {0, 0};
+      BIOKEY_IDENTIFYTEMP_EX(ctx, reinterpret_cast<const char *>(queries[q].data()), nullptr, 0, &got[q].uid,
+                             &got[q].score);
+    }
+    auto end = std::chrono::steady_clock::now();
+    double us = std::chrono::duration<double, std::micro>(end - start).count() / static_cast<double>(queries.size());
+    if (!keep) {
+      full = got;
+    }
+
+    int found = 0;
+    int same = 0;
+    int false_pos = 0;
+    for (size_t q = 0; q < queries.size(); ++q) {
+      if (q < static_cast<size_t>(probes)) {
+        found += got[q].uid == expect[q];
+      } else {
+        false_pos += got[q].uid != 0;
+      }
+      same += got[q].uid == full[q].uid && (!got[q].uid || got[q].score == full[q].score);
+    }
+    char label[16];
+    if (keep) {
+      std::snprintf(label, sizeof(label), "%.1f%%", keep / 10.0);
+    } else {
+      std::snprintf(label, sizeof(label), "all");
+    }
+    std::printf("%8s %10.1f %7d/%-3d %6zu/%-3zu %7d\n", label, us, found, probes, static_cast<size_t>(same),
+                queries.size(), false_pos);
+  }
+  BIOKEY_CLOSE(ctx);
+  return 0;
+}
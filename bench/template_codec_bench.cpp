@@ -0,0 +1,132 @@
+// Compares the template codec against the byte-at-a-time `i % 10` loop that
+// bio_DecodeData / bio_EncodeData ran before, and the header-only length parse
+// against the decode + re-encode BIOKEY_TEMPLATELEN used to do.
+#include "template_codec.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+namespace {
+
+void LegacyXor(uint8_t *t, unsigned int len, const uint8_t *key) {
+  for (unsigned int i = 0; i < len; ++i) {
+    t[i] ^= key[i % 10];
+  }
+}
+
+void LegacyDecode(uint8_t *t) {
+  unsigned int len = (t[8] << 8) | t[9];
+  uint8_t k[10];
+  std::memcpy(k, t + 8, 10);
+  for (int i = 2; i < 10; ++i) {
+    uint8_t v = static_cast<uint8_t>(k[i - 1] ^ i);
+    k[i] ^= static_cast<uint8_t>(v + v % 5);
+  }
+  LegacyXor(t, len, k);
+  std::memcpy(t + 8, k, 10);
+}
+
+void LegacyEncode(uint8_t *t) {
+  unsigned int len = (t[8] << 8) | t[9];
+  uint8_t k[10];
+  uint8_t e[10];
+  std::memcpy(k, t + 8, 10);
+  LegacyXor(t, len, k);
+  std::memcpy(e, k, 10);
+  for (int i = 2; i < 10; ++i) {
+    uint8_t v = static_cast<uint8_t>(k[i - 1] ^ i);
+    e[i] = k[i] ^ static_cast<uint8_t>(v + v % 5);
+  }
+  std::memcpy(t + 8, e, 10);
+}
+
+std::vector<uint8_t> MakeTemplate(unsigned int len) {
+  std::vector<uint8_t> t(len);
+  for (auto &b : t) {
+    b = static_cast<uint8_t>(std::rand());
+  }
+  std::memcpy(t.data(), "ICRS2", 5);
+  t[8] = static_cast<uint8_t>(len >> 8);
+  t[9] = static_cast<uint8_t>(len);
+  zkfp::EncodeTemplate(t.data(), len);
+  return t;
+}
+
+template <typename Fn>
+double NsPerOp(int iters, Fn &&fn) {
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < iters; ++i) {
+    fn();
+  }
+  auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::nano>(end - start).count() / iters;
+}
+
+volatile size_t g_sink = 0;
+
+} // namespace
+
+int main(int argc, char **argv) {
+  int iters = argc > 1 ? std::atoi(argv[1]) : 200000;
+  std::cout << "kernel: " << zkfp::TemplateCodecKernel() << "\n";
+
+  for (unsigned int len : {64u, 512u, 1200u, 1664u}) {
+    std::vector<uint8_t> t = MakeTemplate(len);
+    int n = static_cast<int>(iters * 64 / len) + 1;
+
+    // Decode followed by encode, so every iteration starts from the same bytes.
+    double legacy = NsPerOp(n, [&] {
+      LegacyDecode(t.data());
+      LegacyEncode(t.data());
+      g_sink = t[0];
+    });
+    double codec = NsPerOp(n, [&] {
+      zkfp::DecodeTemplate(t.data(), len);
+      zkfp::EncodeTemplate(t.data(), len);
+      g_sink = t[0];
+    });
+    double legacy_len = NsPerOp(n, [&] {
+      LegacyDecode(t.data());
+      g_sink = (t[8] << 8) | t[9];
+      LegacyEncode(t.data());
+    });
+    double header_len = NsPerOp(n, [&] { g_sink = zkfp::TemplateLength(t.data(), len); });
+
+    std::cout << len << " bytes: decode+encode " << legacy << " -> " << codec << " ns (" << legacy / codec
+              << "x), length " << legacy_len << " -> " << header_len << " ns\n";
+  }
+
+  // Batch decode of a gallery-sized set, against one call per template.
+  constexpr size_t kBatch = 1024;
+  std::vector<std::vector<uint8_t>> gallery;
+  std::vector<uint8_t *> ptrs;
+  for (size_t i = 0; i < kBatch; ++i) {
+    gallery.push_back(MakeTemplate(1200));
+  }
+  for (auto &t : gallery) {
+    ptrs.push_back(t.data());
+  }
+  int n = iters / 1000 + 1;
+  double batch = NsPerOp(n, [&] {
+    g_sink = zkfp::DecodeTemplates(ptrs.data(), kBatch, 1664, nullptr);
+    for (uint8_t *p : ptrs) {
+      zkfp::EncodeTemplate(p, 1664);
+    }
+  });
+  double loop = NsPerOp(n, [&] {
+    for (uint8_t *p : ptrs) {
+      LegacyDecode(p);
+    }
+    for (uint8_t *p : ptrs) {
+      LegacyEncode(p);
+    }
+    g_sink = ptrs[0][0];
+  });
+  std::cout << kBatch << " x 1200 bytes: legacy " << loop / kBatch << " -> batch " << batch / kBatch
+            << " ns per template (decode+encode)\n";
+  return 0;
+}
@@ -0,0 +1,139 @@
+// Splits and re-merges multi-finger records the way a record-normalization
+// pass does, against the old BIOKEY_SPLIT_TEMPLATE / BIOKEY_MERGE_TEMPLATE
+// scheme: a zeroed 16 KB scratch vector per call, the inputs decoded in place,
+// copied, and encoded again afterwards.
+#include "template_codec.h"
+#include "template_merge.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+namespace {
+
+constexpr size_t kFingers = 3;
+constexpr size_t kRecordLen = 400;
+
+std::vector<uint8_t> MakeTemplate(size_t fingers) {
+  size_t len = 24 + fingers * kRecordLen;
+  std::vector<uint8_t> t(len, 0);
+  std::memcpy(t.data(), "ICRS21", 6);
+  t[8] = static_cast<uint8_t>(len >> 8);
+  t[9] = static_cast<uint8_t>(len);
+  t[10] = static_cast<uint8_t>(fingers);
+  t[16] = 0xC5;
+  t[18] = 0xC5;
+  for (size_t f = 0; f < fingers; ++f) {
+    uint8_t *r = t.data() + 24 + f * kRecordLen;
+    for (size_t i = 5; i < kRecordLen; ++i) {
+      r[i] = static_cast<uint8_t>(std::rand());
+    }
+    r[0] = 'M';
+    r[1] = 80;
+    r[2] = static_cast<uint8_t>(f);
+    r[3] = static_cast<uint8_t>(kRecordLen >> 8);
+    r[4] = static_cast<uint8_t>(kRecordLen);
+  }
+  zkfp::EncodeTemplate(t.data(), zkfp::kMergedTemplateMax);
+  return t;
+}
+
+size_t LegacySplit(uint8_t *templ, uint8_t *const *outs) {
+  std::vector<uint8_t> s(0x4000);
+  std::memset(s.data(), 0, s.size());
+  std::memcpy(s.data(), "ICRS21", 6);
+  s[16] = 0xC5;
+  s[18] = 0xC5;
+  zkfp::DecodeTemplate(templ, 0x8000);
+  size_t n = templ[10];
+  size_t at = 24;
+  for (size_t f = 0; f < n; ++f) {
+    size_t len = ((templ[at + 3] & 0xF) << 8) | templ[at + 4];
+    std::memcpy(outs[f], s.data(), 24);
+    std::memcpy(outs[f] + 24, templ + at, len);
+    outs[f][8] = static_cast<uint8_t>((len + 24) >> 8);
+    outs[f][9] = static_cast<uint8_t>(len + 24);
+    outs[f][10] = 1;
+    std::memcpy(outs[f] + 20, templ + 20, 4);
+    outs[f][26] = 0;
+    zkfp::EncodeTemplate(outs[f], 0x8000);
+    at += len;
+  }
+  zkfp::EncodeTemplate(templ, 0x8000);
+  return n;
+}
+
+size_t LegacyMerge(uint8_t *const *temps, size_t count, uint8_t *out) {
+  std::vector<uint8_t> s(0x4000);
+  std::memset(s.data(), 0, s.size());
+  std::memcpy(s.data(), "ICRS21", 6);
+  s[16] = 0xC5;
+  s[18] = 0xC5;
+  zkfp::DecodeTemplates(temps, count, 0x680, nullptr);
+  size_t len = 24;
+  for (size_t i = 0; i < count; ++i) {
+    size_t body = ((temps[i][8] << 8) | temps[i][9]) - 24;
+    temps[i][26] = static_cast<uint8_t>(i);
+    std::memcpy(s.data() + len, temps[i] + 24, body);
+    len += body;
+  }
+  s[8] = static_cast<uint8_t>(len >> 8);
+  s[9] = static_cast<uint8_t>(len);
+  s[10] = static_cast<uint8_t>(count);
+  std::memcpy(s.data() + 20, temps[0] + 20, 4);
+  std::memcpy(out, s.data(), len);
+  zkfp::EncodeTemplate(out, 0x8000);
+  for (size_t i = 0; i < count; ++i) {
+    zkfp::EncodeTemplate(temps[i], 0x8000);
+  }
+  return len;
+}
+
+template <typename Fn>
+double NsPerOp(int iters, Fn &&fn) {
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < iters; ++i) {
+    fn();
+  }
+  auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::nano>(end - start).count() / iters;
+}
+
+volatile size_t g_sink = 0;
+
+} // namespace
+
+int main(int argc, char **argv) {
+  int iters = argc > 1 ? std::atoi(argv[1]) : 100000;
+  std::cout << "kernel: " << zkfp::TemplateCodecKernel() << ", " << kFingers << " fingers of " << kRecordLen
+            << " bytes\n";
+
+  std::vector<uint8_t> record = MakeTemplate(kFingers);
+  std::vector<uint8_t> merged(zkfp::kMergedTemplateMax);
+  std::vector<std::vector<uint8_t>> parts(kFingers, std::vector<uint8_t>(2048));
+  uint8_t *outs[kFingers];
+  for (size_t f = 0; f < kFingers; ++f) {
+    outs[f] = parts[f].data();
+  }
+
+  double legacy = NsPerOp(iters, [&] {
+    LegacySplit(record.data(), outs);
+    g_sink = LegacyMerge(outs, kFingers, merged.data());
+  });
+  std::vector<uint8_t> legacy_out(merged.begin(), merged.begin() + record.size());
+
+  uint32_t sizes[kFingers];
+  double views = NsPerOp(iters, [&] {
+    zkfp::SplitTemplate(record.data(), outs, sizes, kFingers);
+    g_sink = zkfp::MergeTemplates(outs, kFingers, merged.data(), merged.size());
+  });
+
+  bool same = std::memcmp(legacy_out.data(), merged.data(), record.size()) == 0 &&
+              std::memcmp(record.data(), merged.data(), record.size()) == 0;
+  std::cout << "split + merge: legacy " << legacy << " ns -> " << views << " ns (" << legacy / views
+            << "x), round trip " << (same ? "identical" : "DIFFERS") << "\n";
+  return 0;
+}
@@ -20,6 +20,10 @@ ZKINTERFACE int APICALL ZKFPM_GetCaptureParamsEx(HANDLE hDevice, unsigned int *w
 ZKINTERFACE int APICALL ZKFPM_AcquireFingerprint(HANDLE hDevice, unsigned char *fpImage, unsigned int cbFPImage,
                                                  unsigned char *fpTemplate, unsigned int *cbTemplate);
 ZKINTERFACE int APICALL ZKFPM_AcquireFingerprintImage(HANDLE hDevice, unsigned char *fpImage, unsigned int cbFPImage);
+/* Capture, extract and 1:N identify in one call. The next frame is prefetched while this one is
+   processed; fpImage is optional and receives the frame that was identified. */
+ZKINTERFACE int APICALL ZKFPM_AcquireAndIdentify(HANDLE hDevice, HANDLE hDBCache, unsigned char *fpImage,
+                                                 unsigned int cbFPImage, unsigned int *FID, unsigned int *score);
 
 ZKINTERFACE HANDLE APICALL ZKFPM_DBInit();
 ZKINTERFACE int APICALL ZKFPM_DBFree(HANDLE hDBCache);
@@ -44,18 +48,63 @@ ZKINTERFACE int APICALL ZKFPM_ClearDBCache(HANDLE hDBCache);
 ZKINTERFACE int APICALL ZKFPM_GetDBCacheCount(HANDLE hDBCache, unsigned int *fpCount);
 ZKINTERFACE int APICALL ZKFPM_AddRegTemplateToDBCache(HANDLE hDBCache, unsigned int fid, unsigned char *fpTemplate, unsigned int cbTemplate);
 ZKINTERFACE int APICALL ZKFPM_DelRegTemplateFromDBCache(HANDLE hDBCache, unsigned int fid);
+/* Binary snapshot of the whole cache. Load replaces the cache contents and fails
+   without loading anything if the file is damaged. */
+ZKINTERFACE int APICALL ZKFPM_DBSave(HANDLE hDBCache, const char *path);
+ZKINTERFACE int APICALL ZKFPM_DBLoad(HANDLE hDBCache, const char *path);
+/* Durable cache kept in `dir` as zkfp.snap plus a write-ahead journal, zkfp.wal.
+   Open rebuilds the cache from both, or adopts the current contents when `dir` holds
+   neither; from then on every add, delete and clear returns once it is on disk.
+   Compact folds the journal into the snapshot, which also happens in the background
+   once the journal grows past 64 MB. */
+ZKINTERFACE int APICALL ZKFPM_DBOpenJournal(HANDLE hDBCache, const char *dir);
+ZKINTERFACE int APICALL ZKFPM_DBCloseJournal(HANDLE hDBCache);
+ZKINTERFACE int APICALL ZKFPM_DBCompact(HANDLE hDBCache);
+/* Replication between nodes. Export writes the journaled changes after `afterSeq`
+   to a change-log file and returns the newest sequence number in it; when they have
+   been compacted away it fails with ZKFP_ERR_INVALID_PARAM, and the peer is re-seeded
+   from a ZKFPM_DBSave snapshot instead. Apply ingests either file as one batch, with
+   the journal open recording it locally, and returns the sequence to export from next. */
+ZKINTERFACE int APICALL ZKFPM_DBExportChanges(HANDLE hDBCache, unsigned long long afterSeq, const char *path,
+                                              unsigned long long *lastSeq);
+ZKINTERFACE int APICALL ZKFPM_DBApplyChanges(HANDLE hDBCache, const char *path, unsigned long long fromSeq,
+                                             unsigned long long *lastSeq);
 ZKINTERFACE int APICALL ZKFPM_GenRegTemplate(HANDLE hDBCache, unsigned char *temp1, unsigned char *temp2, unsigned char *temp3,
                                              unsigned char *regTemp, unsigned int *cbRegTemp);
 ZKINTERFACE int APICALL ZKFPM_Identify(HANDLE hDBCache, unsigned char *fpTemplate, unsigned int cbTemplate,
                                        unsigned int *FID, unsigned int *score);
+/* Tags partition the cache, by group, door or site: a fid may carry several, and
+   ZKFPM_IdentifyByTag compares the probe only with the fids tagged `tag`, so its
+   cost follows the partition size. Tags are 1..FP_TAG_MAX_LEN letters, digits or
+   '_'. Re-adding or deleting a fid drops its tags; they are not kept by
+   ZKFPM_DBSave or the journal. */
+ZKINTERFACE int APICALL ZKFPM_DBSetTag(HANDLE hDBCache, unsigned int fid, const char *tag);
+ZKINTERFACE int APICALL ZKFPM_IdentifyByTag(HANDLE hDBCache, const char *tag, unsigned char *fpTemplate,
+                                            unsigned int cbTemplate, unsigned int *FID, unsigned int *score);
 ZKINTERFACE int APICALL ZKFPM_MatchFinger(HANDLE hDBCache, unsigned char *template1, unsigned int cbTemplate1,
                                           unsigned char *template2, unsigned int cbTemplate2);
 ZKINTERFACE int APICALL ZKFPM_VerifyByID(HANDLE hDBCache, unsigned int fid, unsigned char *fpTemplate, unsigned int cbTemplate);
+/* Sequence number of the newest extraction image, 0 if none was kept. */
 ZKINTERFACE int APICALL ZKFPM_GetLastExtractImage();
+/* Pins frame seq (0 = newest) without copying; fails with ZKFP_ERR_LOADIMAGE once it was overwritten. */
+ZKINTERFACE int APICALL ZKFPM_AcquireExtractImage(HANDLE hDBCache, unsigned int seq, TZKFPImageView *view);
+ZKINTERFACE int APICALL ZKFPM_ReleaseExtractImage(HANDLE hDBCache, TZKFPImageView *view);
 
+/* Passing a NULL output buffer returns the outLen the call needs. Otherwise
+   Base64ToBlob returns the bytes decoded, and BlobToBase64 the characters
+   written not counting the NUL it appends: one less than its size query. */
 ZKINTERFACE int APICALL ZKFPM_Base64ToBlob(const char *base64, void *outBlob, unsigned int outLen);
 ZKINTERFACE int APICALL ZKFPM_BlobToBase64(const void *blob, int blobLen, char *outBase64, unsigned int outLen);
 
+/* Chunked Base64: Update calls return the bytes written (no NUL); input may be split anywhere. */
+ZKINTERFACE int APICALL ZKFPM_Base64StreamInit(TZKFPBase64Stream *stream);
+ZKINTERFACE int APICALL ZKFPM_Base64EncodeUpdate(TZKFPBase64Stream *stream, const void *blob, unsigned int blobLen,
+                                                 char *outBase64, unsigned int outLen);
+ZKINTERFACE int APICALL ZKFPM_Base64EncodeFinal(TZKFPBase64Stream *stream, char *outBase64, unsigned int outLen);
+ZKINTERFACE int APICALL ZKFPM_Base64DecodeUpdate(TZKFPBase64Stream *stream, const char *base64, unsigned int base64Len,
+                                                 void *outBlob, unsigned int outLen);
+ZKINTERFACE int APICALL ZKFPM_Base64DecodeFinal(TZKFPBase64Stream *stream);
+
 #ifdef __cplusplus
 }
 #endif
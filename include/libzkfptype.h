@@ -5,6 +5,36 @@
 
 #define FP_THRESHOLD_CODE  1
 #define FP_MTHRESHOLD_CODE 2
+
+/* ZKFPM_DBSetParameter / ZKFPM_DBGetParameter tuning knobs (uint32 values). */
+#define FP_WORKER_THREADS_CODE      101  /* 1:N worker threads, 0/1 = engine search */
+#define FP_SHARD_COUNT_CODE         102  /* gallery shards, 0 = one per worker */
+#define FP_PROBE_CACHE_SIZE_CODE    103  /* decoded-template cache entries, 0 = off */
+#define FP_EARLY_EXIT_SCORE_CODE    104  /* stop gallery/prefilter 1:N at this score, 0 = off */
+#define FP_CAPTURE_QUEUE_DEPTH_CODE 105  /* prefetched capture frames */
+#define FP_IDENTIFY_BUDGET_CODE     106  /* 1:N ms counted as over budget, 0 = never */
+#define FP_PREFILTER_KEEP_CODE      107  /* 1:N candidates fully matched, per mille, 0 = all */
+
+/* Read-only counters (uint64 when cbParamValue >= 8). Writing 0 resets. */
+#define FP_STAT_IDENTIFY_CODE       201
+#define FP_STAT_IDENTIFY_US_CODE    202
+#define FP_STAT_OVER_BUDGET_CODE    203
+#define FP_STAT_VERIFY_CODE         204
+#define FP_STAT_PROBE_CACHE_HIT_CODE  205  /* 1:1 templates found already imported */
+#define FP_STAT_PROBE_CACHE_MISS_CODE 206
+
+/* ZKFPM_SetParameters / ZKFPM_GetParameters: per-device preprocessing ahead of
+   extraction, a uint32 of FP_ENHANCE_* bits (0 = off). */
+#define FP_ENHANCE_CODE     10002
+#define FP_ENHANCE_FLATTEN  0x1  /* even out uneven background illumination */
+#define FP_ENHANCE_INVERT   0x2  /* negative image */
+#define FP_ENHANCE_STRETCH  0x4  /* global contrast stretch */
+#define FP_ENHANCE_EQUALIZE 0x8  /* CLAHE-style local equalization */
+#define FP_ENHANCE_ALL      0xF
+
+/* Longest tag accepted by ZKFPM_DBSetTag / ZKFPM_IdentifyByTag. */
+#define FP_TAG_MAX_LEN 32
+
 #ifndef MAX_TEMPLATE_SIZE
 #define MAX_TEMPLATE_SIZE 2048
 #endif
@@ -19,4 +49,22 @@ typedef struct _ZKFPCapParams {
   unsigned int nDPI;
 } TZKFPCapParams, *PZKFPCapParams;
 
+/* Carry-over state for the chunked Base64 calls; set up with ZKFPM_Base64StreamInit. */
+typedef struct _ZKFPBase64Stream {
+  unsigned char pending[4];
+  unsigned int pendingLen;
+  unsigned int finished;
+} TZKFPBase64Stream, *PZKFPBase64Stream;
+
+/* Borrowed view of an image the library converted for extraction. The buffers
+   belong to the library and stay valid until ZKFPM_ReleaseExtractImage. */
+typedef struct _ZKFPImageView {
+  unsigned int seq;             /* frame sequence number, 0 = empty view */
+  unsigned int width;
+  unsigned int height;
+  unsigned int bmpSize;
+  const unsigned char *bmp;     /* 8-bit BMP as handed to the engine */
+  const unsigned char *pixels;  /* pixel array inside bmp */
+} TZKFPImageView, *PZKFPImageView;
+
 #endif
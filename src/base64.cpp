@@ -0,0 +1,298 @@
+#include "base64.h"
+
+#include <array>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define ZKFP_BASE64_X86 1
+#include <immintrin.h>
+#else
+#define ZKFP_BASE64_X86 0
+#endif
+
+namespace zkfp {
+namespace {
+
+constexpr char kB64[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+constexpr uint8_t kInvalid = 0xFF;
+
+constexpr std::array<uint8_t, 256> MakeDecodeTable() {
+  std::array<uint8_t, 256> table{};
+  for (auto &v : table) {
+    v = kInvalid;
+  }
+  for (int i = 0; i < 64; ++i) {
+    table[static_cast<uint8_t>(kB64[i])] = static_cast<uint8_t>(i);
+  }
+  return table;
+}
+
+constexpr std::array<uint8_t, 256> kDecode = MakeDecodeTable();
+
+// Kernels consume whole blocks from the front of the input and return how much
+// they took; the scalar loops finish the rest.
+using EncodeKernel = size_t (*)(const uint8_t *in, size_t len, char *out);
+using DecodeKernel = size_t (*)(const char *in, size_t len, uint8_t *out, size_t out_cap);
+
+size_t EncodeScalar(const uint8_t *in, size_t len, char *out) {
+  size_t i = 0;
+  for (; i + 3 <= len; i += 3) {
+    uint32_t v = (static_cast<uint32_t>(in[i]) << 16) | (static_cast<uint32_t>(in[i + 1]) << 8) | in[i + 2];
+    out[0] = kB64[(v >> 18) & 0x3F];
+    out[1] = kB64[(v >> 12) & 0x3F];
+    out[2] = kB64[(v >> 6) & 0x3F];
+    out[3] = kB64[v & 0x3F];
+    out += 4;
+  }
+  return i;
+}
+
+size_t DecodeScalar(const char *in, size_t len, uint8_t *out, size_t) {
+  size_t i = 0;
+  for (; i + 4 <= len; i += 4) {
+    uint32_t a = kDecode[static_cast<uint8_t>(in[i])];
+    uint32_t b = kDecode[static_cast<uint8_t>(in[i + 1])];
+    uint32_t c = kDecode[static_cast<uint8_t>(in[i + 2])];
+    uint32_t d = kDecode[static_cast<uint8_t>(in[i + 3])];
+    if ((a | b | c | d) & 0x80) {
+      break;
+    }
+    uint32_t v = (a << 18) | (b << 12) | (c << 6) | d;
+    out[0] = static_cast<uint8_t>(v >> 16);
+    out[1] = static_cast<uint8_t>(v >> 8);
+    out[2] = static_cast<uint8_t>(v);
+    out += 3;
+  }
+  return i;
+}
+
+#if ZKFP_BASE64_X86
+
+// Vector kernels after W. Mula / D. Lemire, "Faster Base64 Encoding and
+// Decoding Using AVX2 Instructions": shuffle 3-byte groups into 32-bit lanes,
+// split 6-bit fields with multiplies, and map to ASCII through a nibble LUT.
+
+__attribute__((target("sse4.1"))) inline __m128i EncodeLookup128(__m128i indices) {
+  const __m128i shift_lut = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                          '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+  __m128i result = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+  __m128i less = _mm_cmpgt_epi8(_mm_set1_epi8(26), indices);
+  result = _mm_or_si128(result, _mm_and_si128(less, _mm_set1_epi8(13)));
+  return _mm_add_epi8(_mm_shuffle_epi8(shift_lut, result), indices);
+}
+
+__attribute__((target("sse4.1"))) size_t EncodeSse4(const uint8_t *in, size_t len, char *out) {
+  const __m128i shuf = _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1);
+  size_t i = 0;
+  // Each 16-byte load uses 12 bytes, so keep 4 bytes of slack past the block.
+  for (; i + 16 <= len; i += 12) {
+    __m128i v = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i)), shuf);
+    __m128i t0 = _mm_and_si128(v, _mm_set1_epi32(0x0fc0fc00));
+    __m128i t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+    __m128i t2 = _mm_and_si128(v, _mm_set1_epi32(0x003f03f0));
+    __m128i t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out), EncodeLookup128(_mm_or_si128(t1, t3)));
+    out += 16;
+  }
+  return i;
+}
+
+__attribute__((target("sse4.1"))) size_t DecodeSse4(const char *in, size_t len, uint8_t *out, size_t out_cap) {
+  const __m128i lut_lo = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A,
+                                       0x1B, 0x1B, 0x1B, 0x1A);
+  const __m128i lut_hi = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10,
+                                       0x10, 0x10, 0x10, 0x10);
+  const __m128i lut_roll = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+  const __m128i pack = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+  const __m128i mask_2f = _mm_set1_epi8(0x2F);
+
+  size_t i = 0;
+  size_t o = 0;
+  // The 16-byte store carries 4 bytes of garbage, so it needs that much room.
+  for (; i + 16 <= len && o + 16 <= out_cap; i += 16, o += 12) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i));
+    __m128i hi_nibbles = _mm_and_si128(_mm_srli_epi32(v, 4), mask_2f);
+    __m128i lo_nibbles = _mm_and_si128(v, mask_2f);
+    __m128i lo = _mm_shuffle_epi8(lut_lo, lo_nibbles);
+    __m128i hi = _mm_shuffle_epi8(lut_hi, hi_nibbles);
+    if (!_mm_testz_si128(lo, hi)) {
+      break;
+    }
+    __m128i eq_2f = _mm_cmpeq_epi8(v, mask_2f);
+    __m128i roll = _mm_shuffle_epi8(lut_roll, _mm_add_epi8(eq_2f, hi_nibbles));
+    v = _mm_add_epi8(v, roll);
+    __m128i merged = _mm_maddubs_epi16(v, _mm_set1_epi32(0x01400140));
+    merged = _mm_madd_epi16(merged, _mm_set1_epi32(0x00011000));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out + o), _mm_shuffle_epi8(merged, pack));
+  }
+  return i;
+}
+
+__attribute__((target("avx2"))) inline __m256i EncodeLookup256(__m256i indices) {
+  const __m256i shift_lut = _mm256_setr_epi8(
+      'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+      '+' - 62, '/' - 63, 'A', 0, 0, 'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+      '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+  __m256i result = _mm256_subs_epu8(indices, _mm256_set1_epi8(51));
+  __m256i less = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), indices);
+  result = _mm256_or_si256(result, _mm256_and_si256(less, _mm256_set1_epi8(13)));
+  return _mm256_add_epi8(_mm256_shuffle_epi8(shift_lut, result), indices);
+}
+
+__attribute__((target("avx2"))) size_t EncodeAvx2(const uint8_t *in, size_t len, char *out) {
+  const __m256i shuf = _mm256_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1, 10, 11, 9, 10, 7, 8, 6, 7,
+                                       4, 5, 3, 4, 1, 2, 0, 1);
+  size_t i = 0;
+  // Two 16-byte loads at +0 and +12, so 28 bytes must be readable.
+  for (; i + 28 <= len; i += 24) {
+    __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i));
+    __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i + 12));
+    __m256i v = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+    v = _mm256_shuffle_epi8(v, shuf);
+    __m256i t0 = _mm256_and_si256(v, _mm256_set1_epi32(0x0fc0fc00));
+    __m256i t1 = _mm256_mulhi_epu16(t0, _mm256_set1_epi32(0x04000040));
+    __m256i t2 = _mm256_and_si256(v, _mm256_set1_epi32(0x003f03f0));
+    __m256i t3 = _mm256_mullo_epi16(t2, _mm256_set1_epi32(0x01000010));
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(out), EncodeLookup256(_mm256_or_si256(t1, t3)));
+    out += 32;
+  }
+  return i + EncodeSse4(in + i, len - i, out);
+}
+
+__attribute__((target("avx2"))) size_t DecodeAvx2(const char *in, size_t len, uint8_t *out, size_t out_cap) {
+  const __m256i lut_lo = _mm256_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A,
+                                          0x1B, 0x1B, 0x1B, 0x1A, 0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                          0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+  const __m256i lut_hi = _mm256_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10,
+                                          0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                                          0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+  const __m256i lut_roll = _mm256_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0, 0, 16, 19, 4,
+                                            -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+  const __m256i pack = _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1, 2, 1, 0, 6, 5, 4,
+                                        10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+  const __m256i mask_2f = _mm256_set1_epi8(0x2F);
+
+  size_t i = 0;
+  size_t o = 0;
+  for (; i + 32 <= len && o + 32 <= out_cap; i += 32, o += 24) {
+    __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(in + i));
+    __m256i hi_nibbles = _mm256_and_si256(_mm256_srli_epi32(v, 4), mask_2f);
+    __m256i lo_nibbles = _mm256_and_si256(v, mask_2f);
+    __m256i lo = _mm256_shuffle_epi8(lut_lo, lo_nibbles);
+    __m256i hi = _mm256_shuffle_epi8(lut_hi, hi_nibbles);
+    if (!_mm256_testz_si256(lo, hi)) {
+      break;
+    }
+    __m256i eq_2f = _mm256_cmpeq_epi8(v, mask_2f);
+    __m256i roll = _mm256_shuffle_epi8(lut_roll, _mm256_add_epi8(eq_2f, hi_nibbles));
+    v = _mm256_add_epi8(v, roll);
+    __m256i merged = _mm256_maddubs_epi16(v, _mm256_set1_epi32(0x01400140));
+    merged = _mm256_madd_epi16(merged, _mm256_set1_epi32(0x00011000));
+    merged = _mm256_shuffle_epi8(merged, pack);
+    merged = _mm256_permutevar8x32_epi32(merged, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7));
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + o), merged);
+  }
+  return i + DecodeSse4(in + i, len - i, out + o, out_cap - o);
+}
+
+#endif
+
+struct Kernels {
+  EncodeKernel encode;
+  DecodeKernel decode;
+  const char *name;
+};
+
+Kernels PickKernels() {
+#if ZKFP_BASE64_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return {EncodeAvx2, DecodeAvx2, "avx2"};
+  }
+  if (__builtin_cpu_supports("sse4.1")) {
+    return {EncodeSse4, DecodeSse4, "sse4"};
+  }
+#endif
+  return {EncodeScalar, DecodeScalar, "scalar"};
+}
+
+const Kernels &ActiveKernels() {
+  static const Kernels kernels = PickKernels();
+  return kernels;
+}
+
+} // namespace
+
+size_t Base64DecodedLen(const char *in, size_t len) {
+  if (len == 0 || (len & 3) != 0) {
+    return 0;
+  }
+  size_t out = (len / 4) * 3;
+  if (in[len - 1] == '=') {
+    --out;
+    if (in[len - 2] == '=') {
+      --out;
+    }
+  }
+  return out;
+}
+
+void Base64Encode(const uint8_t *in, size_t len, char *out) {
+  size_t done = ActiveKernels().encode(in, len, out);
+  done += EncodeScalar(in + done, len - done, out + (done / 3) * 4);
+  out += (done / 3) * 4;
+
+  size_t rest = len - done;
+  if (rest) {
+    uint32_t v = static_cast<uint32_t>(in[done]) << 16;
+    if (rest > 1) {
+      v |= static_cast<uint32_t>(in[done + 1]) << 8;
+    }
+    out[0] = kB64[(v >> 18) & 0x3F];
+    out[1] = kB64[(v >> 12) & 0x3F];
+    out[2] = rest > 1 ? kB64[(v >> 6) & 0x3F] : '=';
+    out[3] = '=';
+  }
+}
+
+bool Base64Decode(const char *in, size_t len, uint8_t *out) {
+  if ((len & 3) != 0) {
+    return false;
+  }
+  if (len == 0) {
+    return true;
+  }
+
+  // Everything but the last quad is unpadded and goes through the kernels.
+  size_t body = len - 4;
+  size_t out_cap = Base64DecodedLen(in, len);
+  size_t done = ActiveKernels().decode(in, body, out, out_cap);
+  done += DecodeScalar(in + done, body - done, out + (done / 4) * 3, 0);
+  if (done != body) {
+    return false;
+  }
+  out += (done / 4) * 3;
+
+  const char *q = in + body;
+  uint32_t a = kDecode[static_cast<uint8_t>(q[0])];
+  uint32_t b = kDecode[static_cast<uint8_t>(q[1])];
+  uint32_t c = q[2] == '=' ? 0 : kDecode[static_cast<uint8_t>(q[2])];
+  uint32_t d = q[3] == '=' ? 0 : kDecode[static_cast<uint8_t>(q[3])];
+  if ((a | b | c | d) & 0x80 || (q[2] == '=' && q[3] != '=')) {
+    return false;
+  }
+  uint32_t v = (a << 18) | (b << 12) | (c << 6) | d;
+  out[0] = static_cast<uint8_t>(v >> 16);
+  if (q[2] != '=') {
+    out[1] = static_cast<uint8_t>(v >> 8);
+  }
+  if (q[3] != '=') {
+    out[2] = static_cast<uint8_t>(v);
+  }
+  return true;
+}
+
+const char *Base64Kernel() {
+  return ActiveKernels().name;
+}
+
+} // namespace zkfp
@@ -0,0 +1,31 @@
+#ifndef ZKFP_BASE64_H
+#define ZKFP_BASE64_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace zkfp {
+
+// Encoded length of `len` bytes, padding included, NUL excluded.
+constexpr size_t Base64EncodedLen(size_t len) {
+  return ((len + 2) / 3) * 4;
+}
+
+// Decoded length of a padded Base64 string, or 0 if `len` is not a multiple of 4.
+// Only the trailing padding is inspected; the characters are not validated.
+size_t Base64DecodedLen(const char *in, size_t len);
+
+// Writes exactly Base64EncodedLen(len) characters to `out` (no NUL).
+void Base64Encode(const uint8_t *in, size_t len, char *out);
+
+// Decodes `len` characters into `out`, which must hold Base64DecodedLen(in, len)
+// bytes. Returns false on a bad length, a non-alphabet character or padding
+// anywhere but the final quad.
+bool Base64Decode(const char *in, size_t len, uint8_t *out);
+
+// Name of the kernel picked at runtime ("avx2", "sse4" or "scalar").
+const char *Base64Kernel();
+
+} // namespace zkfp
+
+#endif
@@ -0,0 +1,44 @@
+#include "bmp_image.h"
+
+#include <cstring>
+
+namespace zkfp {
+namespace {
+
+uint32_t GetU32(const uint8_t *p) {
+  uint32_t v;
+  std::memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+uint16_t GetU16(const uint8_t *p) {
+  uint16_t v;
+  std::memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+} // namespace
+
+bool ParseBmp(const uint8_t *data, size_t len, ImageView *view) {
+  *view = ImageView{};
+  if (!data || len < 0x36 || data[0] != 'B' || data[1] != 'M' || GetU16(data + 0x1C) != 8 ||
+      GetU32(data + 0x1E) != 0) {
+    return false;
+  }
+  uint32_t offset = GetU32(data + 0x0A);
+  int32_t width = static_cast<int32_t>(GetU32(data + 0x12));
+  int32_t height = static_cast<int32_t>(GetU32(data + 0x16));
+  if (width <= 0 || height == 0 || height == INT32_MIN || offset > len) {
+    return false;
+  }
+  view->bottom_up = height > 0;
+  view->width = width;
+  view->stride = BmpStride(width);
+  size_t rows = (len - offset) / view->stride;
+  size_t want = static_cast<size_t>(height < 0 ? -height : height);
+  view->height = static_cast<int>(rows < want ? rows : want);
+  view->pixels = data + offset;
+  return true;
+}
+
+} // namespace zkfp
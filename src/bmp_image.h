@@ -0,0 +1,62 @@
+#ifndef ZKFP_BMP_IMAGE_H
+#define ZKFP_BMP_IMAGE_H
+
+#include "image_geom.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace zkfp {
+
+// 8-bit grayscale BMP: file and info headers, a 256-entry gray palette, then
+// bottom-up rows padded to 4 bytes starting at kBmpHeaderLen.
+constexpr size_t kBmpHeaderLen = 0x436;
+
+using BmpHeader = std::array<uint8_t, kBmpHeaderLen>;
+
+constexpr size_t BmpStride(int width) {
+  return (static_cast<size_t>(width < 0 ? 0 : width) + 3) & ~static_cast<size_t>(3);
+}
+
+namespace bmp_detail {
+
+constexpr void PutLe32(BmpHeader &h, size_t off, uint32_t v) {
+  h[off + 0] = static_cast<uint8_t>(v);
+  h[off + 1] = static_cast<uint8_t>(v >> 8);
+  h[off + 2] = static_cast<uint8_t>(v >> 16);
+  h[off + 3] = static_cast<uint8_t>(v >> 24);
+}
+
+} // namespace bmp_detail
+
+// Builds the whole header, palette included; usable at compile time for a
+// fixed resolution.
+constexpr BmpHeader MakeBmpHeader(int width, int height) {
+  BmpHeader h{};
+  uint32_t image_size = static_cast<uint32_t>(BmpStride(width) * static_cast<uint32_t>(height < 0 ? 0 : height));
+  h[0x00] = 'B';
+  h[0x01] = 'M';
+  bmp_detail::PutLe32(h, 0x02, image_size + kBmpHeaderLen);
+  bmp_detail::PutLe32(h, 0x0A, kBmpHeaderLen);
+  bmp_detail::PutLe32(h, 0x0E, 40);
+  bmp_detail::PutLe32(h, 0x12, static_cast<uint32_t>(width));
+  bmp_detail::PutLe32(h, 0x16, static_cast<uint32_t>(height));
+  h[0x1A] = 1;
+  h[0x1C] = 8;
+  bmp_detail::PutLe32(h, 0x22, image_size);
+  for (size_t i = 0; i < 256; ++i) {
+    h[0x36 + i * 4 + 0] = static_cast<uint8_t>(i);
+    h[0x36 + i * 4 + 1] = static_cast<uint8_t>(i);
+    h[0x36 + i * 4 + 2] = static_cast<uint8_t>(i);
+  }
+  return h;
+}
+
+// Parses an uncompressed 8-bit BMP held in `data`. A file cut short keeps the
+// rows it has; false when the header is missing or not 8-bit.
+bool ParseBmp(const uint8_t *data, size_t len, ImageView *view);
+
+} // namespace zkfp
+
+#endif
@@ -0,0 +1,139 @@
+#include "capture_queue.h"
+
+#include <chrono>
+#include <new>
+#include <system_error>
+
+namespace zkfp {
+
+namespace {
+
+// How long the worker keeps capturing after the last Pop, and how old a
+// prefetched frame may be before it no longer counts as the current finger.
+constexpr uint64_t kPrefetchWindowUs = 500 * 1000;
+
+uint64_t NowUs() {
+  return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+                                   std::chrono::steady_clock::now().time_since_epoch())
+                                   .count());
+}
+
+std::chrono::steady_clock::time_point ToTimePoint(uint64_t us) {
+  return std::chrono::steady_clock::time_point(std::chrono::microseconds(us));
+}
+
+} // namespace
+
+CaptureQueue *CaptureQueue::Create(CaptureFn capture, void *sensor, std::mutex *sensor_lock, size_t frame_bytes,
+                                   size_t depth) {
+  auto *queue = new (std::nothrow) CaptureQueue(capture, sensor, sensor_lock, frame_bytes, depth ? depth : 1);
+  if (!queue) {
+    return nullptr;
+  }
+  try {
+    queue->worker_ = std::thread(&CaptureQueue::Run, queue);
+  } catch (const std::system_error &) {
+    delete queue;
+    return nullptr;
+  }
+  return queue;
+}
+
+CaptureQueue::CaptureQueue(CaptureFn capture, void *sensor, std::mutex *sensor_lock, size_t frame_bytes,
+                           size_t depth)
+    : capture_(capture), sensor_(sensor), sensor_lock_(sensor_lock), frame_bytes_(frame_bytes), frames_(depth) {
+  for (Frame &frame : frames_) {
+    frame.image.resize(frame_bytes_);
+    free_.push_back(&frame);
+  }
+}
+
+CaptureQueue::~CaptureQueue() {
+  Stop();
+}
+
+void CaptureQueue::Stop() {
+  {
+    std::lock_guard<std::mutex> guard(lock_);
+    stop_ = true;
+  }
+  cv_.notify_all();
+  if (worker_.joinable()) {
+    worker_.join();
+  }
+}
+
+CaptureQueue::Frame *CaptureQueue::Pop(unsigned int timeout_ms) {
+  std::unique_lock<std::mutex> lk(lock_);
+  uint64_t now = NowUs();
+  active_until_us_ = now + kPrefetchWindowUs;
+  cv_.notify_all();
+
+  uint64_t deadline = now + static_cast<uint64_t>(timeout_ms) * 1000;
+  for (;;) {
+    if (stop_) {
+      return nullptr;
+    }
+    now = NowUs();
+    while (!ready_.empty() && ready_.front()->captured_us + kPrefetchWindowUs < now) {
+      free_.push_back(ready_.front());
+      ready_.pop_front();
+      cv_.notify_all();
+    }
+    if (!ready_.empty()) {
+      Frame *frame = ready_.front();
+      ready_.pop_front();
+      return frame;
+    }
+    if (now >= deadline) {
+      return nullptr;
+    }
+    cv_.wait_until(lk, ToTimePoint(deadline));
+  }
+}
+
+void CaptureQueue::Recycle(Frame *frame) {
+  if (!frame) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> guard(lock_);
+    free_.push_back(frame);
+  }
+  cv_.notify_all();
+}
+
+void CaptureQueue::Run() {
+  std::unique_lock<std::mutex> lk(lock_);
+  while (!stop_) {
+    if (free_.empty()) {
+      cv_.wait(lk);
+      continue;
+    }
+    if (NowUs() >= active_until_us_) {
+      cv_.wait(lk);
+      continue;
+    }
+
+    Frame *frame = free_.back();
+    free_.pop_back();
+    lk.unlock();
+    int res;
+    {
+      std::lock_guard<std::mutex> sensor(*sensor_lock_);
+      res = capture_(sensor_, frame->image.data(), static_cast<unsigned int>(frame_bytes_));
+    }
+    uint64_t captured = NowUs();
+    lk.lock();
+
+    if (res > 0) {
+      frame->captured_us = captured;
+      ready_.push_back(frame);
+    } else {
+      free_.push_back(frame);
+    }
+    cv_.notify_all();
+  }
+}
+
+} // namespace zkfp
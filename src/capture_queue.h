@@ -0,0 +1,71 @@
+#ifndef ZKFP_CAPTURE_QUEUE_H
+#define ZKFP_CAPTURE_QUEUE_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace zkfp {
+
+using CaptureFn = int (*)(void *sensor, unsigned char *image, unsigned int size);
+
+// Background capture for one sensor: while a consumer is active the worker keeps
+// up to `depth` frames in flight, so the next USB transfer overlaps the current
+// frame's extraction and search. The worker goes idle once no frame has been
+// asked for within the prefetch window, and frames older than it are dropped.
+class CaptureQueue {
+public:
+  struct Frame {
+    std::vector<unsigned char> image;
+    uint64_t captured_us = 0;
+  };
+
+  // Returns nullptr if the worker thread cannot be started. The worker holds
+  // `sensor_lock` across each capture, so callers that take it too never drive
+  // the sensor at the same time as the worker.
+  static CaptureQueue *Create(CaptureFn capture, void *sensor, std::mutex *sensor_lock, size_t frame_bytes,
+                              size_t depth);
+  ~CaptureQueue();
+
+  CaptureQueue(const CaptureQueue &) = delete;
+  CaptureQueue &operator=(const CaptureQueue &) = delete;
+
+  // Oldest fresh frame, waiting up to `timeout_ms` for one. Hand it back with
+  // Recycle once the image is no longer needed.
+  Frame *Pop(unsigned int timeout_ms);
+  void Recycle(Frame *frame);
+
+  // Joins the worker, so the sensor is no longer touched, and wakes any Pop,
+  // which then returns no frame. Frames already popped stay valid until the
+  // queue is destroyed. Calls must not overlap.
+  void Stop();
+
+  size_t FrameBytes() const { return frame_bytes_; }
+  size_t Depth() const { return frames_.size(); }
+
+private:
+  CaptureQueue(CaptureFn capture, void *sensor, std::mutex *sensor_lock, size_t frame_bytes, size_t depth);
+  void Run();
+
+  CaptureFn capture_;
+  void *sensor_;
+  std::mutex *sensor_lock_;
+  size_t frame_bytes_;
+  std::vector<Frame> frames_;
+
+  std::mutex lock_;
+  std::condition_variable cv_;
+  std::vector<Frame *> free_;
+  std::deque<Frame *> ready_;
+  uint64_t active_until_us_ = 0;
+  bool stop_ = false;
+  std::thread worker_;
+};
+
+} // namespace zkfp
+
+#endif
@@ -0,0 +1,76 @@
+#include "crc32c.h"
+
+#include <array>
+#include <cstring>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define ZKFP_CRC32C_X86 1
+#include <immintrin.h>
+#else
+#define ZKFP_CRC32C_X86 0
+#endif
+
+namespace zkfp {
+namespace {
+
+constexpr uint32_t kPoly = 0x82F63B78u;
+
+constexpr std::array<uint32_t, 256> MakeTable() {
+  std::array<uint32_t, 256> table{};
+  for (uint32_t i = 0; i < 256; ++i) {
+    uint32_t c = i;
+    for (int k = 0; k < 8; ++k) {
+      c = (c & 1) ? (c >> 1) ^ kPoly : c >> 1;
+    }
+    table[i] = c;
+  }
+  return table;
+}
+
+constexpr std::array<uint32_t, 256> kTable = MakeTable();
+
+using CrcKernel = uint32_t (*)(uint32_t crc, const uint8_t *p, size_t len);
+
+uint32_t CrcScalar(uint32_t crc, const uint8_t *p, size_t len) {
+  for (size_t i = 0; i < len; ++i) {
+    crc = kTable[(crc ^ p[i]) & 0xFF] ^ (crc >> 8);
+  }
+  return crc;
+}
+
+#if ZKFP_CRC32C_X86
+
+__attribute__((target("sse4.2"))) uint32_t CrcSse42(uint32_t crc, const uint8_t *p, size_t len) {
+  uint64_t c = crc;
+  for (; len >= 8; p += 8, len -= 8) {
+    uint64_t v;
+    std::memcpy(&v, p, 8);
+    c = _mm_crc32_u64(c, v);
+  }
+  uint32_t c32 = static_cast<uint32_t>(c);
+  for (; len; ++p, --len) {
+    c32 = _mm_crc32_u8(c32, *p);
+  }
+  return c32;
+}
+
+#endif
+
+CrcKernel PickKernel() {
+#if ZKFP_CRC32C_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("sse4.2")) {
+    return CrcSse42;
+  }
+#endif
+  return CrcScalar;
+}
+
+} // namespace
+
+uint32_t Crc32c(uint32_t crc, const void *data, size_t len) {
+  static const CrcKernel kernel = PickKernel();
+  return ~kernel(~crc, static_cast<const uint8_t *>(data), len);
+}
+
+} // namespace zkfp
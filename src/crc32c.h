@@ -0,0 +1,15 @@
+#ifndef ZKFP_CRC32C_H
+#define ZKFP_CRC32C_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace zkfp {
+
+// CRC-32C (Castagnoli). Pass the previous result as `crc` to continue a running
+// checksum; start from 0.
+uint32_t Crc32c(uint32_t crc, const void *data, size_t len);
+
+} // namespace zkfp
+
+#endif
@@ -0,0 +1,407 @@
+#include "db_journal.h"
+
+#include "crc32c.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <new>
+#include <sys/stat.h>
+#include <system_error>
+#include <unistd.h>
+#include <utility>
+
+namespace zkfp {
+namespace {
+
+constexpr char kJournalMagic[8] = {'Z', 'K', 'F', 'P', 'W', 'A', 'L', '1'};
+constexpr uint32_t kJournalVersion = 1;
+constexpr uint32_t kMaxRecordLen = 0x8000;
+
+struct JournalFileHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t reserved;
+};
+static_assert(sizeof(JournalFileHeader) == 16, "JournalFileHeader size");
+
+struct JournalRecordHeader {
+  uint32_t crc;
+  uint32_t len;
+  uint64_t seq;
+  uint32_t fid;
+  uint8_t op;
+  uint8_t pad[3];
+};
+static_assert(sizeof(JournalRecordHeader) == 24, "JournalRecordHeader size");
+
+uint32_t RecordCrc(const JournalRecordHeader &h, const uint8_t *data) {
+  uint32_t crc = Crc32c(0, &h.len, sizeof(h) - sizeof(h.crc));
+  return Crc32c(crc, data, h.len);
+}
+
+bool ReadAll(int fd, std::vector<uint8_t> *out) {
+  struct stat st {};
+  if (::fstat(fd, &st) != 0) {
+    return false;
+  }
+  out->resize(static_cast<size_t>(st.st_size));
+  size_t done = 0;
+  while (done < out->size()) {
+    ssize_t n = ::pread(fd, out->data() + done, out->size() - done, static_cast<off_t>(done));
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    done += static_cast<size_t>(n);
+  }
+  return true;
+}
+
+bool WriteAll(int fd, const uint8_t *data, size_t len) {
+  while (len) {
+    ssize_t n = ::write(fd, data, len);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    data += n;
+    len -= static_cast<size_t>(n);
+  }
+  return true;
+}
+
+bool HasJournalHeader(const std::vector<uint8_t> &image) {
+  JournalFileHeader header;
+  if (image.size() < sizeof(header)) {
+    return false;
+  }
+  std::memcpy(&header, image.data(), sizeof(header));
+  return std::memcmp(header.magic, kJournalMagic, sizeof(header.magic)) == 0 && header.version == kJournalVersion;
+}
+
+// Makes a create or rename of `path` itself durable.
+void SyncParentDir(const std::string &path) {
+  size_t slash = path.find_last_of('/');
+  std::string dir = slash == std::string::npos ? "." : slash == 0 ? "/" : path.substr(0, slash);
+  int fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd >= 0) {
+    ::fsync(fd);
+    ::close(fd);
+  }
+}
+
+// Decodes the record at `off`; false at the end of the file or at the first
+// torn or corrupt record.
+bool ParseRecord(const std::vector<uint8_t> &image, size_t off, JournalRecord *rec, size_t *next) {
+  JournalRecordHeader h;
+  if (image.size() - off < sizeof(h)) {
+    return false;
+  }
+  std::memcpy(&h, image.data() + off, sizeof(h));
+  const uint8_t *data = image.data() + off + sizeof(h);
+  if (h.len > kMaxRecordLen || image.size() - off - sizeof(h) < h.len || h.op < 1 || h.op > 3 ||
+      h.crc != RecordCrc(h, data)) {
+    return false;
+  }
+  rec->seq = h.seq;
+  rec->op = static_cast<JournalOp>(h.op);
+  rec->fid = h.fid;
+  rec->len = h.len;
+  rec->data = data;
+  *next = off + sizeof(h) + h.len;
+  return true;
+}
+
+} // namespace
+
+DBJournal *DBJournal::Open(const char *path, uint64_t after_seq, JournalReplayFn replay, void *user) {
+  if (!path || !*path) {
+    return nullptr;
+  }
+  int fd = ::open(path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    return nullptr;
+  }
+  std::vector<uint8_t> image;
+  if (!ReadAll(fd, &image)) {
+    ::close(fd);
+    return nullptr;
+  }
+
+  if (image.empty()) {
+    JournalFileHeader header{};
+    std::memcpy(header.magic, kJournalMagic, sizeof(header.magic));
+    header.version = kJournalVersion;
+    if (!WriteAll(fd, reinterpret_cast<const uint8_t *>(&header), sizeof(header)) || ::fdatasync(fd) != 0) {
+      ::close(fd);
+      return nullptr;
+    }
+    SyncParentDir(path);
+    image.assign(reinterpret_cast<const uint8_t *>(&header), reinterpret_cast<const uint8_t *>(&header + 1));
+  } else if (!HasJournalHeader(image)) {
+    ::close(fd);
+    return nullptr;
+  }
+
+  uint64_t base_seq = after_seq;
+  uint64_t last_seq = after_seq;
+  size_t off = sizeof(JournalFileHeader);
+  size_t next = off;
+  JournalRecord rec;
+  while (ParseRecord(image, off, &rec, &next)) {
+    if (off == sizeof(JournalFileHeader) && rec.seq - 1 < base_seq) {
+      base_seq = rec.seq - 1;
+    }
+    if (rec.seq > after_seq) {
+      replay(rec, user);
+    }
+    if (rec.seq > last_seq) {
+      last_seq = rec.seq;
+    }
+    off = next;
+  }
+  // Whatever follows the last intact record is a write cut short by a crash.
+  if (off != image.size() && (::ftruncate(fd, static_cast<off_t>(off)) != 0 || ::fdatasync(fd) != 0)) {
+    ::close(fd);
+    return nullptr;
+  }
+
+  auto *journal = new (std::nothrow) DBJournal(fd, path, base_seq, last_seq, off);
+  if (!journal) {
+    ::close(fd);
+    return nullptr;
+  }
+  try {
+    journal->writer_ = std::thread(&DBJournal::Run, journal);
+  } catch (const std::system_error &) {
+    delete journal;
+    return nullptr;
+  }
+  return journal;
+}
+
+DBJournal::DBJournal(int fd, std::string path, uint64_t base_seq, uint64_t last_seq, uint64_t bytes)
+    : path_(std::move(path)), fd_(fd), base_seq_(base_seq), last_seq_(last_seq), durable_seq_(last_seq),
+      bytes_(bytes) {}
+
+DBJournal::~DBJournal() {
+  {
+    std::lock_guard<std::mutex> guard(lock_);
+    stop_ = true;
+  }
+  queued_cv_.notify_all();
+  if (writer_.joinable()) {
+    writer_.join();
+  }
+  ::close(fd_);
+}
+
+uint64_t DBJournal::Append(JournalOp op, uint32_t fid, const uint8_t *data, uint32_t len) {
+  if (len > kMaxRecordLen || (len && !data)) {
+    return 0;
+  }
+  JournalRecordHeader h{};
+  h.len = len;
+  h.fid = fid;
+  h.op = static_cast<uint8_t>(op);
+
+  std::lock_guard<std::mutex> guard(lock_);
+  if (failed_) {
+    return 0;
+  }
+  h.seq = ++last_seq_;
+  h.crc = RecordCrc(h, data);
+  const auto *head = reinterpret_cast<const uint8_t *>(&h);
+  queued_.insert(queued_.end(), head, head + sizeof(h));
+  queued_.insert(queued_.end(), data, data + len);
+  queued_cv_.notify_one();
+  return h.seq;
+}
+
+bool DBJournal::WaitDurable(uint64_t seq) {
+  std::unique_lock<std::mutex> lk(lock_);
+  durable_cv_.wait(lk, [&] { return durable_seq_ >= seq || failed_; });
+  return durable_seq_ >= seq;
+}
+
+bool DBJournal::Truncate(uint64_t seq) {
+  std::lock_guard<std::mutex> file(file_lock_);
+  std::vector<uint8_t> image;
+  if (!ReadAll(fd_, &image) || image.size() < sizeof(JournalFileHeader)) {
+    return false;
+  }
+  size_t keep = sizeof(JournalFileHeader);
+  size_t end = keep;
+  size_t next = keep;
+  JournalRecord rec;
+  while (ParseRecord(image, end, &rec, &next)) {
+    if (rec.seq <= seq) {
+      keep = next;
+    }
+    end = next;
+  }
+
+  std::string tmp_path = path_ + ".tmp";
+  int fd = ::open(tmp_path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    return false;
+  }
+  if (!WriteAll(fd, image.data(), sizeof(JournalFileHeader)) || !WriteAll(fd, image.data() + keep, end - keep) ||
+      ::fdatasync(fd) != 0 || std::rename(tmp_path.c_str(), path_.c_str()) != 0) {
+    ::close(fd);
+    ::unlink(tmp_path.c_str());
+    return false;
+  }
+  SyncParentDir(path_);
+  ::close(fd_);
+  fd_ = fd;
+
+  std::lock_guard<std::mutex> guard(lock_);
+  bytes_ = sizeof(JournalFileHeader) + (end - keep);
+  if (seq > base_seq_) {
+    base_seq_ = seq;
+  }
+  return true;
+}
+
+ChangeLogStatus DBJournal::Export(uint64_t after_seq, const char *path, uint64_t *last_seq) {
+  if (!path || !*path) {
+    return ChangeLogStatus::Failed;
+  }
+  std::vector<uint8_t> image;
+  {
+    // Under the file lock the file holds exactly the records already synced.
+    std::lock_guard<std::mutex> file(file_lock_);
+    {
+      std::lock_guard<std::mutex> guard(lock_);
+      if (after_seq < base_seq_) {
+        return ChangeLogStatus::Gap;
+      }
+    }
+    if (!ReadAll(fd_, &image) || !HasJournalHeader(image)) {
+      return ChangeLogStatus::Failed;
+    }
+  }
+
+  std::vector<uint8_t> out(image.begin(), image.begin() + sizeof(JournalFileHeader));
+  uint64_t last = after_seq;
+  size_t off = sizeof(JournalFileHeader);
+  size_t next = off;
+  JournalRecord rec;
+  while (ParseRecord(image, off, &rec, &next)) {
+    if (rec.seq > after_seq) {
+      out.insert(out.end(), image.begin() + off, image.begin() + next);
+      last = rec.seq;
+    }
+    off = next;
+  }
+
+  std::string tmp_path = std::string(path) + ".tmp";
+  int fd = ::open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    return ChangeLogStatus::Failed;
+  }
+  bool ok = WriteAll(fd, out.data(), out.size()) && ::fdatasync(fd) == 0;
+  ok = ::close(fd) == 0 && ok;
+  if (!ok || std::rename(tmp_path.c_str(), path) != 0) {
+    ::unlink(tmp_path.c_str());
+    return ChangeLogStatus::Failed;
+  }
+  *last_seq = last;
+  return ChangeLogStatus::Ok;
+}
+
+ChangeLogStatus DBJournal::ReadChangeLog(const char *path, uint64_t after_seq, JournalReplayFn apply, void *user,
+                                         uint64_t *last_seq) {
+  if (!path) {
+    return ChangeLogStatus::Failed;
+  }
+  int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return ChangeLogStatus::Failed;
+  }
+  std::vector<uint8_t> image;
+  bool read = ReadAll(fd, &image);
+  ::close(fd);
+  if (!read) {
+    return ChangeLogStatus::Failed;
+  }
+  if (!HasJournalHeader(image)) {
+    return ChangeLogStatus::Foreign;
+  }
+
+  // A copy cut short in transit is rejected whole rather than half applied.
+  uint64_t expect = after_seq + 1;
+  size_t off = sizeof(JournalFileHeader);
+  size_t next = off;
+  JournalRecord rec;
+  while (ParseRecord(image, off, &rec, &next)) {
+    if (rec.seq > after_seq) {
+      if (rec.seq != expect) {
+        return ChangeLogStatus::Gap;
+      }
+      ++expect;
+    }
+    off = next;
+  }
+  if (off != image.size()) {
+    return ChangeLogStatus::Failed;
+  }
+
+  off = sizeof(JournalFileHeader);
+  while (ParseRecord(image, off, &rec, &next)) {
+    if (rec.seq > after_seq) {
+      apply(rec, user);
+    }
+    off = next;
+  }
+  *last_seq = expect - 1;
+  return ChangeLogStatus::Ok;
+}
+
+uint64_t DBJournal::LastSeq() {
+  std::lock_guard<std::mutex> guard(lock_);
+  return last_seq_;
+}
+
+uint64_t DBJournal::Bytes() {
+  std::lock_guard<std::mutex> guard(lock_);
+  return bytes_;
+}
+
+void DBJournal::Run() {
+  std::vector<uint8_t> batch;
+  std::unique_lock<std::mutex> lk(lock_);
+  for (;;) {
+    queued_cv_.wait(lk, [this] { return stop_ || !queued_.empty(); });
+    if (queued_.empty()) {
+      return;
+    }
+    batch.swap(queued_);
+    uint64_t seq = last_seq_;
+    bool skip = failed_;
+    lk.unlock();
+
+    {
+      std::lock_guard<std::mutex> file(file_lock_);
+      bool ok = !skip && WriteAll(fd_, batch.data(), batch.size()) && ::fdatasync(fd_) == 0;
+      lk.lock();
+      if (ok) {
+        durable_seq_ = seq;
+        bytes_ += batch.size();
+      } else {
+        failed_ = true;
+      }
+    }
+    batch.clear();
+    durable_cv_.notify_all();
+  }
+}
+
+} // namespace zkfp
@@ -0,0 +1,105 @@
+#ifndef ZKFP_DB_JOURNAL_H
+#define ZKFP_DB_JOURNAL_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace zkfp {
+
+// Append-only log of DB cache changes, all fields little-endian:
+//
+//   header   { char magic[8] "ZKFPWAL1"; uint32 version; uint32 reserved }
+//   records  { uint32 crc; uint32 len; uint64 seq; uint32 fid; uint8 op; pad[3]; uint8 data[len] }
+//
+// `crc` is the CRC-32C of everything in the record after itself. Sequence
+// numbers increase by one per record and carry on across compactions, so a
+// snapshot tagged with seq N plus the records after N is the full database.
+enum class JournalOp : uint8_t { Add = 1, Del = 2, Clear = 3 };
+
+struct JournalRecord {
+  uint64_t seq;
+  JournalOp op;
+  uint32_t fid;
+  uint32_t len;
+  const uint8_t *data;
+};
+
+using JournalReplayFn = void (*)(const JournalRecord &record, void *user);
+
+// Outcome of exporting or reading a change log, the journal format cut down to
+// the records after some sequence number and shipped to a peer.
+enum class ChangeLogStatus {
+  Ok,
+  Gap,      // the records right after the requested sequence are not in the log
+  Foreign,  // not a change log at all
+  Failed,   // I/O error, or a damaged or truncated file
+};
+
+// Group commit: Append only queues the record, and a single writer thread hands
+// everything queued since its last flush to one write + fdatasync. Callers that
+// need durability wait for their sequence number, so concurrent writers share
+// the cost of a sync instead of paying one each.
+class DBJournal {
+public:
+  // Opens or creates the journal at `path`, replays every intact record with a
+  // sequence number above `after_seq` through `replay`, and cuts off a torn
+  // tail left by a crash. Returns nullptr if the file is unusable.
+  static DBJournal *Open(const char *path, uint64_t after_seq, JournalReplayFn replay, void *user);
+  // Flushes whatever is still queued before closing the file.
+  ~DBJournal();
+
+  DBJournal(const DBJournal &) = delete;
+  DBJournal &operator=(const DBJournal &) = delete;
+
+  // Queues a record and returns its sequence number, or 0 once the journal has
+  // failed a write (it then stays failed until reopened).
+  uint64_t Append(JournalOp op, uint32_t fid, const uint8_t *data, uint32_t len);
+  // Blocks until `seq` is on disk; false if the journal failed first.
+  bool WaitDurable(uint64_t seq);
+
+  // Rewrites the file without the records up to `seq`, once a snapshot covers
+  // them.
+  bool Truncate(uint64_t seq);
+
+  // Writes the on-disk records after `after_seq` to a change log at `path` and
+  // stores the newest sequence number in it. Gap once compaction has dropped
+  // records after `after_seq`.
+  ChangeLogStatus Export(uint64_t after_seq, const char *path, uint64_t *last_seq);
+  // Validates the whole change log at `path`, then hands its records after
+  // `after_seq` to `apply` in order. They have to continue at `after_seq + 1`.
+  static ChangeLogStatus ReadChangeLog(const char *path, uint64_t after_seq, JournalReplayFn apply, void *user,
+                                       uint64_t *last_seq);
+
+  uint64_t LastSeq();
+  uint64_t Bytes();
+
+private:
+  DBJournal(int fd, std::string path, uint64_t base_seq, uint64_t last_seq, uint64_t bytes);
+  void Run();
+
+  std::string path_;
+
+  std::mutex file_lock_;  // held around every write to, or swap of, fd_
+  int fd_;
+
+  std::mutex lock_;
+  std::condition_variable queued_cv_;
+  std::condition_variable durable_cv_;
+  std::vector<uint8_t> queued_;
+  uint64_t base_seq_;  // records up to here were compacted out of the file
+  uint64_t last_seq_;
+  uint64_t durable_seq_;
+  uint64_t bytes_;
+  bool failed_ = false;
+  bool stop_ = false;
+  std::thread writer_;
+};
+
+} // namespace zkfp
+
+#endif
@@ -0,0 +1,210 @@
+#include "db_snapshot.h"
+
+#include "crc32c.h"
+
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace zkfp {
+namespace {
+
+constexpr uint32_t kMaxRecordLen = 0x8000;
+
+size_t Padded(size_t len) {
+  return (len + 7) & ~static_cast<size_t>(7);
+}
+
+uint32_t HeaderCrc(const SnapshotHeader &h) {
+  return Crc32c(0, &h, offsetof(SnapshotHeader, header_crc));
+}
+
+// Makes the rename onto `path` durable, so a caller may drop what the snapshot
+// replaces once Commit returns.
+bool SyncParentDir(const std::string &path) {
+  size_t slash = path.find_last_of('/');
+  std::string dir = slash == std::string::npos ? "." : slash == 0 ? "/" : path.substr(0, slash);
+  int fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd < 0) {
+    return false;
+  }
+  bool ok = ::fsync(fd) == 0;
+  return ::close(fd) == 0 && ok;
+}
+
+} // namespace
+
+SnapshotWriter::~SnapshotWriter() {
+  Discard();
+}
+
+bool SnapshotWriter::Open(const char *path) {
+  Discard();
+  if (!path || !*path) {
+    return false;
+  }
+  path_ = path;
+  tmp_path_ = path_ + ".tmp";
+  file_ = std::fopen(tmp_path_.c_str(), "wb");
+  if (!file_) {
+    return false;
+  }
+  count_ = 0;
+  payload_bytes_ = 0;
+  payload_crc_ = 0;
+
+  // Placeholder; the real header is written by Commit once the totals are known.
+  SnapshotHeader header{};
+  if (std::fwrite(&header, sizeof(header), 1, file_) != 1) {
+    Discard();
+    return false;
+  }
+  return true;
+}
+
+bool SnapshotWriter::Append(uint32_t fid, const uint8_t *templ, uint32_t len) {
+  if (!file_ || !templ || !len || len > kMaxRecordLen) {
+    return false;
+  }
+  static const uint8_t kZero[8] = {0};
+  uint32_t head[2] = {fid, len};
+  size_t pad = Padded(len) - len;
+  if (std::fwrite(head, sizeof(head), 1, file_) != 1 || std::fwrite(templ, len, 1, file_) != 1 ||
+      (pad && std::fwrite(kZero, pad, 1, file_) != 1)) {
+    Discard();
+    return false;
+  }
+  payload_crc_ = Crc32c(payload_crc_, head, sizeof(head));
+  payload_crc_ = Crc32c(payload_crc_, templ, len);
+  payload_crc_ = Crc32c(payload_crc_, kZero, pad);
+  payload_bytes_ += sizeof(head) + len + pad;
+  ++count_;
+  return true;
+}
+
+bool SnapshotWriter::Commit(uint64_t seq) {
+  if (!file_) {
+    return false;
+  }
+  SnapshotHeader header{};
+  std::memcpy(header.magic, kSnapshotMagic, sizeof(header.magic));
+  header.version = kSnapshotVersion;
+  header.header_size = sizeof(SnapshotHeader);
+  header.count = count_;
+  header.payload_bytes = payload_bytes_;
+  header.payload_crc = payload_crc_;
+  header.seq = seq;
+  header.header_crc = HeaderCrc(header);
+
+  bool ok = std::fflush(file_) == 0 && std::fseek(file_, 0, SEEK_SET) == 0 &&
+            std::fwrite(&header, sizeof(header), 1, file_) == 1 && std::fflush(file_) == 0 &&
+            ::fsync(fileno(file_)) == 0;
+  ok = std::fclose(file_) == 0 && ok;
+  file_ = nullptr;
+  if (!ok || std::rename(tmp_path_.c_str(), path_.c_str()) != 0) {
+    std::remove(tmp_path_.c_str());
+    return false;
+  }
+  return SyncParentDir(path_);
+}
+
+void SnapshotWriter::Discard() {
+  if (file_) {
+    std::fclose(file_);
+    file_ = nullptr;
+    std::remove(tmp_path_.c_str());
+  }
+}
+
+SnapshotReader::~SnapshotReader() {
+  Close();
+}
+
+bool SnapshotReader::Open(const char *path) {
+  Close();
+  if (!path) {
+    return false;
+  }
+  int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat st {};
+  if (::fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(SnapshotHeader)) {
+    ::close(fd);
+    return false;
+  }
+  size_t size = static_cast<size_t>(st.st_size);
+  void *mem = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (mem == MAP_FAILED) {
+    return false;
+  }
+  base_ = static_cast<uint8_t *>(mem);
+  size_ = size;
+
+  SnapshotHeader header;
+  std::memcpy(&header, base_, sizeof(header));
+  if (std::memcmp(header.magic, kSnapshotMagic, sizeof(header.magic)) != 0 || header.version != kSnapshotVersion ||
+      header.header_size != sizeof(SnapshotHeader) || header.header_crc != HeaderCrc(header) ||
+      header.payload_bytes != size_ - sizeof(SnapshotHeader)) {
+    Close();
+    return false;
+  }
+  ::madvise(base_, size_, MADV_SEQUENTIAL);
+  if (Crc32c(0, base_ + sizeof(SnapshotHeader), header.payload_bytes) != header.payload_crc) {
+    Close();
+    return false;
+  }
+
+  // Walk the record chain once so Next never has to bounds-check.
+  size_t off = sizeof(SnapshotHeader);
+  for (uint64_t i = 0; i < header.count; ++i) {
+    uint32_t len;
+    if (size_ - off < 8) {
+      Close();
+      return false;
+    }
+    std::memcpy(&len, base_ + off + 4, sizeof(len));
+    if (!len || len > kMaxRecordLen || size_ - off - 8 < Padded(len)) {
+      Close();
+      return false;
+    }
+    off += 8 + Padded(len);
+  }
+  if (off != size_) {
+    Close();
+    return false;
+  }
+
+  count_ = header.count;
+  seq_ = header.seq;
+  cursor_ = sizeof(SnapshotHeader);
+  return true;
+}
+
+bool SnapshotReader::Next(SnapshotRecord *record) {
+  if (!base_ || cursor_ >= size_) {
+    return false;
+  }
+  std::memcpy(&record->fid, base_ + cursor_, sizeof(uint32_t));
+  std::memcpy(&record->len, base_ + cursor_ + 4, sizeof(uint32_t));
+  record->templ = base_ + cursor_ + 8;
+  cursor_ += 8 + Padded(record->len);
+  return true;
+}
+
+void SnapshotReader::Close() {
+  if (base_) {
+    ::munmap(base_, size_);
+  }
+  base_ = nullptr;
+  size_ = 0;
+  cursor_ = 0;
+  count_ = 0;
+  seq_ = 0;
+}
+
+} // namespace zkfp
@@ -0,0 +1,101 @@
+#ifndef ZKFP_DB_SNAPSHOT_H
+#define ZKFP_DB_SNAPSHOT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+namespace zkfp {
+
+// On-disk template snapshot, all fields little-endian:
+//
+//   header   SnapshotHeader (64 bytes)
+//   records  count x { uint32 fid; uint32 len; uint8 templ[len]; pad to 8 }
+//
+// Templates are stored decoded (engine "ICRS2" form) and were length-checked on
+// save, so loading only has to verify the checksums before handing each record
+// to the engine straight out of the mapping.
+constexpr char kSnapshotMagic[8] = {'Z', 'K', 'F', 'P', 'S', 'N', 'A', 'P'};
+constexpr uint32_t kSnapshotVersion = 1;
+
+struct SnapshotHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t header_size;
+  uint64_t count;
+  uint64_t payload_bytes;
+  uint32_t payload_crc;  // CRC-32C of the record area
+  uint32_t reserved0;
+  uint64_t seq;          // last journal record folded in, 0 without a journal
+  uint8_t reserved[12];
+  uint32_t header_crc;   // CRC-32C of the bytes before this field
+};
+static_assert(sizeof(SnapshotHeader) == 64, "SnapshotHeader size");
+
+struct SnapshotRecord {
+  uint32_t fid;
+  uint32_t len;
+  const uint8_t *templ;
+};
+
+// Streams records into `<path>.tmp` and renames it over `path` on Commit, so a
+// crash mid-save never leaves a truncated snapshot behind. Commit also syncs
+// the directory: once it returns, the new snapshot survives a crash.
+class SnapshotWriter {
+public:
+  SnapshotWriter() = default;
+  ~SnapshotWriter();
+
+  SnapshotWriter(const SnapshotWriter &) = delete;
+  SnapshotWriter &operator=(const SnapshotWriter &) = delete;
+
+  bool Open(const char *path);
+  bool Append(uint32_t fid, const uint8_t *templ, uint32_t len);
+  bool Commit(uint64_t seq);
+
+  uint64_t Count() const { return count_; }
+
+private:
+  void Discard();
+
+  std::FILE *file_ = nullptr;
+  std::string path_;
+  std::string tmp_path_;
+  uint64_t count_ = 0;
+  uint64_t payload_bytes_ = 0;
+  uint32_t payload_crc_ = 0;
+};
+
+// Read-only view of a snapshot file through mmap. Open verifies both checksums
+// and every record bound before any record is handed out.
+class SnapshotReader {
+public:
+  SnapshotReader() = default;
+  ~SnapshotReader();
+
+  SnapshotReader(const SnapshotReader &) = delete;
+  SnapshotReader &operator=(const SnapshotReader &) = delete;
+
+  bool Open(const char *path);
+  uint64_t Count() const { return count_; }
+  uint64_t Seq() const { return seq_; }
+
+  // Walks the records in file order; returns false after the last one. The
+  // template pointer aims into a private copy-on-write mapping, so the engine
+  // may parse it in place.
+  bool Next(SnapshotRecord *record);
+
+private:
+  void Close();
+
+  uint8_t *base_ = nullptr;
+  size_t size_ = 0;
+  size_t cursor_ = 0;
+  uint64_t count_ = 0;
+  uint64_t seq_ = 0;
+};
+
+} // namespace zkfp
+
+#endif
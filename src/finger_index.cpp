@@ -0,0 +1,90 @@
+#include "finger_index.h"
+
+#include <algorithm>
+
+namespace zkfp {
+
+void FingerIndex::Reset(bool ready) {
+  std::lock_guard<std::mutex> guard(lock_);
+  users_.clear();
+  ready_ = ready;
+}
+
+bool FingerIndex::Ready() {
+  std::lock_guard<std::mutex> guard(lock_);
+  return ready_;
+}
+
+void FingerIndex::Put(uint32_t fid, unsigned fingers, uint32_t bytes) {
+  uint32_t slot = FingerSlot(fid);
+  if (slot >= kFingerSlots) {
+    return;
+  }
+  std::lock_guard<std::mutex> guard(lock_);
+  if (!ready_) {
+    return;
+  }
+  Entry &e = users_[FingerBase(fid)];
+  uint16_t bit = static_cast<uint16_t>(1u << slot);
+  if (e.used & bit) {
+    e.total -= e.fingers[slot];
+  }
+  e.used |= bit;
+  e.fingers[slot] = static_cast<uint8_t>(std::min(fingers, 255u));
+  e.bytes[slot] = bytes;
+  e.total += e.fingers[slot];
+}
+
+void FingerIndex::Remove(uint32_t fid) {
+  uint32_t slot = FingerSlot(fid);
+  if (slot >= kFingerSlots) {
+    return;
+  }
+  std::lock_guard<std::mutex> guard(lock_);
+  auto it = users_.find(FingerBase(fid));
+  uint16_t bit = static_cast<uint16_t>(1u << slot);
+  if (it == users_.end() || !(it->second.used & bit)) {
+    return;
+  }
+  Entry &e = it->second;
+  e.used &= static_cast<uint16_t>(~bit);
+  e.total -= e.fingers[slot];
+  e.fingers[slot] = 0;
+  e.bytes[slot] = 0;
+  if (!e.used) {
+    users_.erase(it);
+  }
+}
+
+bool FingerIndex::Find(uint32_t fid, unsigned *fingers, uint32_t *bytes) {
+  uint32_t slot = FingerSlot(fid);
+  if (slot >= kFingerSlots) {
+    return false;
+  }
+  std::lock_guard<std::mutex> guard(lock_);
+  if (!ready_) {
+    return false;
+  }
+  auto it = users_.find(FingerBase(fid));
+  if (it == users_.end() || !(it->second.used & (1u << slot))) {
+    return false;
+  }
+  *fingers = it->second.fingers[slot];
+  *bytes = it->second.bytes[slot];
+  return true;
+}
+
+bool FingerIndex::BaseFingers(uint32_t base, unsigned *fingers) {
+  if (base > 0xFFFF) {
+    return false;
+  }
+  std::lock_guard<std::mutex> guard(lock_);
+  if (!ready_) {
+    return false;
+  }
+  auto it = users_.find(base);
+  *fingers = it == users_.end() ? 0 : it->second.total;
+  return true;
+}
+
+} // namespace zkfp
@@ -0,0 +1,58 @@
+#ifndef ZKFP_FINGER_INDEX_H
+#define ZKFP_FINGER_INDEX_H
+
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+
+namespace zkfp {
+
+// A user's fingers are enrolled as separate fids: the base user ID in the low
+// 16 bits and the finger slot (0..15) above it.
+constexpr unsigned kFingerSlots = 16;
+
+inline uint32_t FingerBase(uint32_t fid) {
+  return fid & 0xFFFF;
+}
+
+inline uint32_t FingerSlot(uint32_t fid) {
+  return fid >> 16;
+}
+
+// What the engine holds for each slot of each base user ID, mirrored from the
+// wrapper's add/delete paths so per-user counts need no engine round trip.
+// Until Reset(true) or a Rebuild the index is not ready and every lookup
+// misses, which callers answer from the engine as before.
+class FingerIndex {
+public:
+  // Empties the index; `ready` says the engine is known to be empty too.
+  void Reset(bool ready);
+  bool Ready();
+
+  // Records `fid` with its fingerprint count and template length, replacing
+  // what the slot held. Fids beyond the 16 slots are not indexed.
+  void Put(uint32_t fid, unsigned fingers, uint32_t bytes);
+  void Remove(uint32_t fid);
+
+  // Fingerprint count and template length of `fid`; false when the fid is not
+  // enrolled or the index cannot tell.
+  bool Find(uint32_t fid, unsigned *fingers, uint32_t *bytes);
+  // Fingerprints over all 16 slots of `base`; false when the index cannot tell.
+  bool BaseFingers(uint32_t base, unsigned *fingers);
+
+private:
+  struct Entry {
+    uint16_t used = 0;  // one bit per occupied slot
+    unsigned total = 0; // fingerprints over the occupied slots
+    uint8_t fingers[kFingerSlots] = {};
+    uint32_t bytes[kFingerSlots] = {};
+  };
+
+  std::mutex lock_;
+  bool ready_ = false;
+  std::unordered_map<uint32_t, Entry> users_;
+};
+
+} // namespace zkfp
+
+#endif
@@ -0,0 +1,261 @@
+#include "finger_linear.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define ZKFP_FINGER_LINEAR_X86 1
+#include <immintrin.h>
+#else
+#define ZKFP_FINGER_LINEAR_X86 0
+#endif
+
+namespace zkfp {
+namespace {
+
+// Bilinear weights are 1.7 fixed point so a pair fits one uint16 map entry.
+constexpr int kOne = 128;
+constexpr int kRound = kOne * kOne / 2;
+
+using BilinearKernel = void (*)(const uint8_t *src, size_t stride, const int32_t *index, const uint16_t *weight,
+                                uint8_t mask, uint8_t *dst, size_t n);
+
+inline int Lerp(int a, int b, int w) {
+  return a * kOne + (b - a) * w;
+}
+
+void BilinearScalar(const uint8_t *src, size_t stride, const int32_t *index, const uint16_t *weight, uint8_t mask,
+                    uint8_t *dst, size_t n) {
+  for (size_t i = 0; i < n; ++i) {
+    int32_t at = index[i];
+    if (at < 0) {
+      dst[i] = 0xFF;
+      continue;
+    }
+    const uint8_t *p = src + at;
+    int fx = weight[i] & 0xFF;
+    int fy = weight[i] >> 8;
+    int top = Lerp(p[0], p[1], fx);
+    int bottom = Lerp(p[stride], p[stride + 1], fx);
+    dst[i] = static_cast<uint8_t>(((top * kOne + (bottom - top) * fy + kRound) >> 14) ^ mask);
+  }
+}
+
+#if ZKFP_FINGER_LINEAR_X86
+
+// Two dword gathers per eight pixels fetch the 2x2 neighbourhoods. The lower
+// row is gathered from two bytes early so neither read can leave the frame:
+// the map keeps every offset at least one row and column inside.
+__attribute__((target("avx2"))) void BilinearAvx2(const uint8_t *src, size_t stride, const int32_t *index,
+                                                  const uint16_t *weight, uint8_t mask, uint8_t *dst, size_t n) {
+  const __m256i byte = _mm256_set1_epi32(0xFF);
+  const __m256i round = _mm256_set1_epi32(kRound);
+  const __m256i vmask = _mm256_set1_epi32(mask);
+  const int *upper = reinterpret_cast<const int *>(src);
+  const int *lower = reinterpret_cast<const int *>(src + stride - 2);
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256i at = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(index + i));
+    __m256i pad = _mm256_cmpgt_epi32(_mm256_setzero_si256(), at);
+    at = _mm256_max_epi32(at, _mm256_setzero_si256());
+    __m256i top = _mm256_i32gather_epi32(upper, at, 1);
+    __m256i bottom = _mm256_i32gather_epi32(lower, at, 1);
+    __m256i w = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(weight + i)));
+    __m256i fx = _mm256_and_si256(w, byte);
+    __m256i fy = _mm256_srli_epi32(w, 8);
+
+    __m256i p00 = _mm256_and_si256(top, byte);
+    __m256i p01 = _mm256_and_si256(_mm256_srli_epi32(top, 8), byte);
+    __m256i p10 = _mm256_and_si256(_mm256_srli_epi32(bottom, 16), byte);
+    __m256i p11 = _mm256_srli_epi32(bottom, 24);
+    __m256i t = _mm256_add_epi32(_mm256_slli_epi32(p00, 7), _mm256_mullo_epi32(_mm256_sub_epi32(p01, p00), fx));
+    __m256i b = _mm256_add_epi32(_mm256_slli_epi32(p10, 7), _mm256_mullo_epi32(_mm256_sub_epi32(p11, p10), fx));
+    __m256i v = _mm256_add_epi32(_mm256_slli_epi32(t, 7), _mm256_mullo_epi32(_mm256_sub_epi32(b, t), fy));
+    v = _mm256_xor_si256(_mm256_srai_epi32(_mm256_add_epi32(v, round), 14), vmask);
+    v = _mm256_or_si256(v, _mm256_and_si256(pad, byte));
+
+    __m128i packed = _mm_packus_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    _mm_storel_epi64(reinterpret_cast<__m128i *>(dst + i), _mm_packus_epi16(packed, packed));
+  }
+  BilinearScalar(src, stride, index + i, weight + i, mask, dst + i, n - i);
+}
+
+#endif
+
+struct Kernel {
+  BilinearKernel fn;
+  const char *name;
+};
+
+Kernel PickKernel() {
+#if ZKFP_FINGER_LINEAR_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return {BilinearAvx2, "avx2"};
+  }
+#endif
+  return {BilinearScalar, "scalar"};
+}
+
+const Kernel &ActiveKernel() {
+  static const Kernel kernel = PickKernel();
+  return kernel;
+}
+
+// One output row: the sensor's rounded sample for each column, and the exact
+// position it was rounded from. `row`/`col` are in the computed frame, before
+// any transpose.
+struct Sample {
+  int64_t row;
+  int64_t col;
+  double row_f;
+  double col_f;
+};
+
+} // namespace
+
+bool FingerLinearMap::Build(const uint16_t *params, unsigned flags) {
+  built_ = false;
+  index_.clear();
+  weight_.clear();
+  if (!params) {
+    return false;
+  }
+  std::copy(params, params + kFingerLinearParams, params_.begin());
+  flags_ = flags;
+
+  const uint16_t *p = params;
+  int64_t width = p[20];
+  int64_t height = p[21];
+  int64_t src_w = p[0];
+  int64_t src_h = p[1];
+  if (!width || !height || !src_w || !src_h) {
+    return false;
+  }
+  bool transposed = (flags & kFingerLinearTransposed) != 0;
+  bool bilinear = (flags & kFingerLinearBilinear) != 0 && src_w >= 2 && src_h >= 2;
+  // Limits of the computed row and column; transposed, rows run along memory.
+  int64_t row_limit = transposed ? src_w : src_h;
+  int64_t col_limit = transposed ? src_h : src_w;
+
+  width_ = static_cast<int>(width);
+  height_ = static_cast<int>(height);
+  stride_ = static_cast<size_t>(src_w);
+  size_t count = static_cast<size_t>(width) * static_cast<size_t>(height);
+  index_.assign(count, -1);
+  if (bilinear) {
+    weight_.assign(count, 0);
+  }
+
+  auto store = [&](size_t at, const Sample &s) {
+    if (s.row < 0 || s.row >= row_limit || s.col < 0 || s.col >= col_limit) {
+      return;
+    }
+    int64_t mem_row = transposed ? s.col : s.row;
+    int64_t mem_col = transposed ? s.row : s.col;
+    if (!bilinear) {
+      index_[at] = static_cast<int32_t>(mem_row * src_w + mem_col);
+      return;
+    }
+    // Top-left of the 2x2 neighbourhood, kept one row and column inside.
+    double fr = transposed ? s.col_f : s.row_f;
+    double fc = transposed ? s.row_f : s.col_f;
+    int64_t r0 = std::clamp<int64_t>(static_cast<int64_t>(std::floor(fr)), 0, src_h - 2);
+    int64_t c0 = std::clamp<int64_t>(static_cast<int64_t>(std::floor(fc)), 0, src_w - 2);
+    int fy = static_cast<int>(std::lround(std::clamp(fr - static_cast<double>(r0), 0.0, 1.0) * kOne));
+    int fx = static_cast<int>(std::lround(std::clamp(fc - static_cast<double>(c0), 0.0, 1.0) * kOne));
+    index_[at] = static_cast<int32_t>(r0 * src_w + c0);
+    weight_[at] = static_cast<uint16_t>(fx | fy << 8);
+  };
+
+  if (p[3] == p[5] && static_cast<int16_t>(p[7]) == p[9]) {
+    // Trapezoid with level top and bottom edges: each output row is a fixed
+    // source row, the column is a perspective divide.
+    int64_t top_y = static_cast<int16_t>(p[3]);
+    int64_t bottom_y = static_cast<int16_t>(p[7]);
+    int64_t x0 = static_cast<int16_t>(p[2]);
+    int64_t x1 = static_cast<int16_t>(p[4]);
+    int64_t x2 = static_cast<int16_t>(p[6]);
+    int64_t x3 = static_cast<int16_t>(p[8]);
+    int64_t top_span = x0 - x1;
+    int64_t bottom_w = x3 - x2;
+    int64_t base = top_span * -height;
+    int64_t cross = x3 * x0 - x2 * x1;
+    for (int64_t r = 0; r < height; ++r) {
+      int64_t denom = base + r * (bottom_w + top_span);
+      if (!denom) {
+        continue;
+      }
+      int64_t y_num = bottom_y * base + r * (bottom_w * top_y + bottom_y * top_span);
+      Sample s{};
+      s.row = (denom / 2 + y_num) / denom;
+      s.row_f = static_cast<double>(y_num) / static_cast<double>(denom);
+      if (s.row >= row_limit || s.row < 0) {
+        continue;
+      }
+      for (int64_t c = 0; c < width; ++c) {
+        int64_t xs = x2 + (c * bottom_w + (width >> 1)) / width;
+        s.col = (denom / 2 + r * cross - top_span * xs * height) / denom;
+        double xs_f = static_cast<double>(x2) + static_cast<double>(c * bottom_w) / static_cast<double>(width);
+        s.col_f = (static_cast<double>(r * cross) - static_cast<double>(top_span * height) * xs_f) /
+                  static_cast<double>(denom);
+        store(static_cast<size_t>(r * width + c), s);
+      }
+    }
+  } else {
+    // General quadrilateral: both edges are interpolated linearly down the rows
+    // and each row linearly across.
+    int64_t x0 = p[2], y0 = p[3], x1 = p[4], y1 = p[5];
+    int64_t x2 = p[6], y2 = p[7], x3 = p[8], y3 = p[9];
+    int64_t area = height * width;
+    int64_t half = area >> 1;
+    int64_t top_w = x1 - x0;
+    int64_t top_h = y1 - y0;
+    for (int64_t r = 0; r < height; ++r) {
+      int64_t left_x = x0 - r * (x0 - x2) / height;
+      int64_t left_y = y0 - r * (y0 - y2) / height;
+      int64_t step_x = height * top_w - r * (top_w + x2 - x3);
+      int64_t step_y = height * top_h - r * (top_h + y2 - y3);
+      double left_xf = static_cast<double>(x0) - static_cast<double>(r * (x0 - x2)) / static_cast<double>(height);
+      double left_yf = static_cast<double>(y0) - static_cast<double>(r * (y0 - y2)) / static_cast<double>(height);
+      for (int64_t c = 0; c < width; ++c) {
+        Sample s{};
+        s.row = left_y + (half + c * step_y) / area;
+        s.col = left_x + (half + c * step_x) / area;
+        s.row_f = left_yf + static_cast<double>(c * step_y) / static_cast<double>(area);
+        s.col_f = left_xf + static_cast<double>(c * step_x) / static_cast<double>(area);
+        store(static_cast<size_t>(r * width + c), s);
+      }
+    }
+  }
+  built_ = true;
+  return true;
+}
+
+bool FingerLinearMap::Matches(const uint16_t *params, unsigned flags) const {
+  return built_ && params && flags == flags_ &&
+         std::memcmp(params, params_.data(), kFingerLinearParams * sizeof(uint16_t)) == 0;
+}
+
+void FingerLinearMap::Apply(const uint8_t *src, uint8_t *dst) const {
+  if (!built_) {
+    return;
+  }
+  uint8_t mask = (flags_ & kFingerLinearInvert) ? 0xFF : 0x00;
+  size_t n = index_.size();
+  if (!weight_.empty()) {
+    ActiveKernel().fn(src, stride_, index_.data(), weight_.data(), mask, dst, n);
+    return;
+  }
+  const int32_t *index = index_.data();
+  for (size_t i = 0; i < n; ++i) {
+    dst[i] = index[i] < 0 ? 0xFF : static_cast<uint8_t>(src[index[i]] ^ mask);
+  }
+}
+
+const char *FingerLinearKernel() {
+  return ActiveKernel().name;
+}
+
+} // namespace zkfp
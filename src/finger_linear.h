@@ -0,0 +1,54 @@
+#ifndef ZKFP_FINGER_LINEAR_H
+#define ZKFP_FINGER_LINEAR_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace zkfp {
+
+// Calibration block of the sensor's linear correction, as uint16 words:
+//   [0], [1]    source width and height
+//   [2]..[9]    corners x0,y0 x1,y1 x2,y2 x3,y3 of the finger area in the source
+//   [20], [21]  output width and height
+// With both corner pairs level (y0 == y1, y2 == y3) the area is a trapezoid
+// corrected for perspective; otherwise it is mapped bilinearly.
+constexpr size_t kFingerLinearParams = 22;
+
+constexpr unsigned kFingerLinearInvert = 0x1;      // negative output
+constexpr unsigned kFingerLinearTransposed = 0x2;  // the source is stored column-major
+constexpr unsigned kFingerLinearBilinear = 0x4;    // interpolate instead of taking the nearest pixel
+
+// Source position of every output pixel, worked out once per calibration so a
+// frame costs one gather per pixel. Nearest sampling reproduces the sensor's
+// original per-pixel arithmetic exactly; output outside the source is white.
+class FingerLinearMap {
+public:
+  // False when the block describes no output or a degenerate area.
+  bool Build(const uint16_t *params, unsigned flags);
+  bool Matches(const uint16_t *params, unsigned flags) const;
+
+  // `src` holds params[0] x params[1] bytes; `dst` receives Width() x Height().
+  void Apply(const uint8_t *src, uint8_t *dst) const;
+
+  int Width() const { return width_; }
+  int Height() const { return height_; }
+
+private:
+  std::array<uint16_t, kFingerLinearParams> params_{};
+  unsigned flags_ = 0;
+  bool built_ = false;
+  int width_ = 0;
+  int height_ = 0;
+  size_t stride_ = 0;
+  std::vector<int32_t> index_;    // source offset, or -1 for white
+  std::vector<uint16_t> weight_;  // bilinear only: fx | fy << 8, each out of 128
+};
+
+// Name of the interpolation kernel picked at runtime ("avx2" or "scalar").
+const char *FingerLinearKernel();
+
+} // namespace zkfp
+
+#endif
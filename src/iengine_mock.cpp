@@ -0,0 +1,493 @@
+// In-tree stand-in for the IEngine library behind zkfinger10, selected with
+// -DZKFP_MOCK_IENGINE=ON. It exists so the stack can be built, tested and
+// benchmarked without libidkit; it is not a fingerprint matcher.
+//
+// A fingerprint is reduced to a 16x16 grid of cell means around the image
+// mean, scaled to int8. Scores are the cosine similarity of two grids times
+// 400 (0 when negative), so an image always scores 400 against itself and the
+// 3.x threshold mapping in zkfinger10 applies. Templates use the ICRS2 layout
+// the wrapper expects: a 24-byte header, then one 'M' record per finger.
+//
+// Environment, read by IEngine_InitModule:
+//   ZKFP_MOCK_MATCH_NS    busy-wait per fingerprint comparison (default 0)
+//   ZKFP_MOCK_EXTRACT_NS  busy-wait per IEngine_AddFingerprint (default 0)
+//   ZKFP_MOCK_USER_LIMIT  enrolled users before RegisterUserAs fails (1000000)
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace {
+
+constexpr int kGrid = 16;
+constexpr int kFeatures = kGrid * kGrid;
+constexpr int kRecordLen = 5 + kFeatures;
+constexpr int kHeaderLen = 24;
+constexpr int kMaxFingers = 10;
+constexpr int kScoreScale = 400;
+constexpr size_t kBmpPixels = 0x436;  // 8-bit BMP: headers plus palette
+
+constexpr int kErrParam = 1101;
+constexpr int kErrImage = 1116;
+constexpr int kErrNoUser = 1127;
+constexpr int kErrFull = 1129;
+constexpr int kErrTemplate = 1135;
+constexpr int kErrQuality = 1137;
+
+struct Finger {
+  int8_t features[kFeatures];
+  int quality;
+  int64_t norm;  // sum of squared features
+};
+
+struct User {
+  std::vector<Finger> fingers;
+  std::string custom;
+  std::map<std::string, std::string> tags;
+};
+
+std::mutex g_lock;  // guards the enrolled users
+std::map<unsigned int, User> g_users;
+std::map<long, long> g_params;
+int64_t g_match_ns = 0;
+int64_t g_extract_ns = 0;
+long g_user_limit = 1000000;
+
+long EnvLong(const char *name, long fallback) {
+  const char *val = std::getenv(name);
+  if (!val || !*val) {
+    return fallback;
+  }
+  char *end = nullptr;
+  long parsed = std::strtol(val, &end, 10);
+  return end && *end == '\0' && parsed >= 0 ? parsed : fallback;
+}
+
+// Stands in for engine work; spins rather than sleeps so it costs CPU.
+void Spin(int64_t ns) {
+  if (ns <= 0) {
+    return;
+  }
+  auto until = std::chrono::steady_clock::now() + std::chrono::nanoseconds(ns);
+  while (std::chrono::steady_clock::now() < until) {
+  }
+}
+
+int Score(const Finger &a, const Finger &b) {
+  Spin(g_match_ns);
+  if (!a.norm || !b.norm) {
+    return 0;
+  }
+  int64_t dot = 0;
+  for (int i = 0; i < kFeatures; ++i) {
+    dot += a.features[i] * b.features[i];
+  }
+  if (dot <= 0) {
+    return 0;
+  }
+  double cos = static_cast<double>(dot) / std::sqrt(static_cast<double>(a.norm) * static_cast<double>(b.norm));
+  return static_cast<int>(cos * kScoreScale + 0.5);
+}
+
+int BestScore(const User &a, const User &b) {
+  int best = 0;
+  for (const Finger &x : a.fingers) {
+    for (const Finger &y : b.fingers) {
+      int s = Score(x, y);
+      if (s > best) {
+        best = s;
+      }
+    }
+  }
+  return best;
+}
+
+void Normalize(Finger *f) {
+  f->norm = 0;
+  for (int i = 0; i < kFeatures; ++i) {
+    f->norm += f->features[i] * f->features[i];
+  }
+}
+
+// Best enrolled match; with `tag_key` set only users carrying that tag value
+// take part. Ties go to the lowest user ID.
+int Find(const User &probe, const std::string *tag_key, const std::string *tag_value, int *uid, int *score) {
+  std::lock_guard<std::mutex> guard(g_lock);
+  int best = 0;
+  unsigned int best_uid = 0;
+  for (const auto &entry : g_users) {
+    if (tag_key) {
+      auto tag = entry.second.tags.find(*tag_key);
+      if (tag == entry.second.tags.end() || tag->second != *tag_value) {
+        continue;
+      }
+    }
+    int s = BestScore(probe, entry.second);
+    if (s > best) {
+      best = s;
+      best_uid = entry.first;
+    }
+  }
+  auto threshold = g_params.find(1);
+  *score = best;
+  *uid = threshold == g_params.end() || best >= threshold->second ? static_cast<int>(best_uid) : 0;
+  return 0;
+}
+
+User *AsUser(void *user) {
+  return static_cast<User *>(user);
+}
+
+} // namespace
+
+extern "C" {
+
+int IEngine_SetParameter(long code, long value) {
+  std::lock_guard<std::mutex> guard(g_lock);
+  g_params[code] = value;
+  return 0;
+}
+
+int IEngine_GetUserLimit(int *out) {
+  *out = static_cast<int>(EnvLong("ZKFP_MOCK_USER_LIMIT", g_user_limit));
+  return 0;
+}
+
+void IEngine_GetVersionInfo(unsigned int *out) {
+  out[0] = 3;
+  out[1] = 0;
+}
+
+int IEngine_InitModule() {
+  g_match_ns = EnvLong("ZKFP_MOCK_MATCH_NS", 0);
+  g_extract_ns = EnvLong("ZKFP_MOCK_EXTRACT_NS", 0);
+  g_user_limit = EnvLong("ZKFP_MOCK_USER_LIMIT", 1000000);
+  return 0;
+}
+
+int IEngine_TerminateModule() {
+  std::lock_guard<std::mutex> guard(g_lock);
+  g_users.clear();
+  return 0;
+}
+
+int IEngine_InitWithLicense(const void *, long) {
+  return 0;
+}
+
+// Every connection is an in-memory database.
+int IEngine_Connect(const char *, const char *) {
+  return 0;
+}
+
+void *IEngine_InitUser() {
+  return new User();
+}
+
+int IEngine_FreeUser(void *user) {
+  delete AsUser(user);
+  return 0;
+}
+
+int IEngine_ClearUser(void *user) {
+  if (!user) {
+    return kErrParam;
+  }
+  *AsUser(user) = User();
+  return 0;
+}
+
+int IEngine_ClearDatabase() {
+  std::lock_guard<std::mutex> guard(g_lock);
+  g_users.clear();
+  return 0;
+}
+
+int IEngine_AddFingerprint(void *user, long, void *bmp) {
+  Spin(g_extract_ns);
+  const auto *b = static_cast<const uint8_t *>(bmp);
+  int32_t w = 0;
+  int32_t h = 0;
+  std::memcpy(&w, b + 0x12, 4);
+  std::memcpy(&h, b + 0x16, 4);
+  if (w <= 0 || h <= 0 || AsUser(user)->fingers.size() >= kMaxFingers) {
+    return kErrImage;
+  }
+  const uint8_t *px = b + kBmpPixels;
+  size_t stride = (static_cast<size_t>(w) + 3) & ~static_cast<size_t>(3);
+
+  double cells[kFeatures] = {};
+  int counts[kFeatures] = {};
+  double mean = 0;
+  for (int y = 0; y < h; ++y) {
+    const uint8_t *row = px + stride * (h - 1 - y);  // rows are stored bottom-up
+    for (int x = 0; x < w; ++x) {
+      int c = (y * kGrid / h) * kGrid + x * kGrid / w;
+      cells[c] += row[x];
+      counts[c]++;
+      mean += row[x];
+    }
+  }
+  mean /= static_cast<double>(w) * h;
+  double spread = 0;
+  for (int i = 0; i < kFeatures; ++i) {
+    cells[i] = counts[i] ? cells[i] / counts[i] - mean : 0;
+    spread += cells[i] * cells[i];
+  }
+  spread = std::sqrt(spread / kFeatures);
+  if (spread < 1) {
+    return kErrQuality;  // flat image, nothing on the sensor
+  }
+
+  Finger f;
+  for (int i = 0; i < kFeatures; ++i) {
+    double v = cells[i] / spread * 40;
+    f.features[i] = static_cast<int8_t>(v > 127 ? 127 : v < -127 ? -127 : v);
+  }
+  f.quality = spread > 50 ? 100 : static_cast<int>(spread * 2);
+  Normalize(&f);
+  AsUser(user)->fingers.push_back(f);
+  return 0;
+}
+
+// With `out` null only the length is reported.
+int IEngine_ExportUserTemplate(void *user, long, void *out, int *len) {
+  const User &u = *AsUser(user);
+  if (u.fingers.empty()) {
+    return kErrNoUser;
+  }
+  int need = kHeaderLen + kRecordLen * static_cast<int>(u.fingers.size());
+  if (!out) {
+    *len = need;
+    return 0;
+  }
+  if (*len < need) {
+    *len = need;
+    return kErrTemplate;
+  }
+  auto *o = static_cast<uint8_t *>(out);
+  std::memset(o, 0, kHeaderLen);
+  std::memcpy(o, "ICRS21", 6);
+  o[8] = static_cast<uint8_t>(need >> 8);
+  o[9] = static_cast<uint8_t>(need);
+  o[10] = static_cast<uint8_t>(u.fingers.size());
+  o[16] = 0xC5;
+  o[18] = 0xC5;
+  o[20] = 0x18;
+  o[22] = 0x68;
+  uint8_t *rec = o + kHeaderLen;
+  for (size_t i = 0; i < u.fingers.size(); ++i) {
+    rec[0] = 'M';
+    rec[1] = static_cast<uint8_t>(u.fingers[i].quality);
+    rec[2] = static_cast<uint8_t>(i);
+    rec[3] = static_cast<uint8_t>((kRecordLen >> 8) & 0xF);
+    rec[4] = static_cast<uint8_t>(kRecordLen);
+    std::memcpy(rec + 5, u.fingers[i].features, kFeatures);
+    rec += kRecordLen;
+  }
+  *len = need;
+  return 0;
+}
+
+int IEngine_GetFingerprintQuality(void *user, long index, int *out) {
+  const User &u = *AsUser(user);
+  if (index < 0 || index >= static_cast<long>(u.fingers.size())) {
+    return kErrNoUser;
+  }
+  *out = u.fingers[index].quality;
+  return 0;
+}
+
+// Appends the template's fingers to `user`.
+int IEngine_ImportUserTemplate(void *user, long, void *templ) {
+  const auto *t = static_cast<const uint8_t *>(templ);
+  if (std::memcmp(t, "ICRS2", 5)) {
+    return kErrTemplate;
+  }
+  int len = (t[8] << 8) | t[9];
+  int fingers = t[10];
+  User &u = *AsUser(user);
+  if (u.fingers.size() + fingers > kMaxFingers) {
+    return kErrTemplate;
+  }
+  int at = kHeaderLen;
+  for (int i = 0; i < fingers; ++i) {
+    if (at + kRecordLen > len || t[at] != 'M' || (((t[at + 3] & 0xF) << 8) | t[at + 4]) != kRecordLen) {
+      return kErrTemplate;
+    }
+    at += kRecordLen;
+  }
+  at = kHeaderLen;
+  for (int i = 0; i < fingers; ++i) {
+    Finger f;
+    f.quality = t[at + 1];
+    std::memcpy(f.features, t + at + 5, kFeatures);
+    Normalize(&f);
+    u.fingers.push_back(f);
+    at += kRecordLen;
+  }
+  return 0;
+}
+
+int IEngine_MatchUsers(void *user1, void *user2, int *score) {
+  *score = BestScore(*AsUser(user1), *AsUser(user2));
+  return 0;
+}
+
+int IEngine_MatchUser(void *user, unsigned int uid, int *score, void *) {
+  std::lock_guard<std::mutex> guard(g_lock);
+  auto it = g_users.find(uid);
+  if (it == g_users.end()) {
+    *score = 0;
+    return kErrNoUser;
+  }
+  *score = BestScore(*AsUser(user), it->second);
+  return 0;
+}
+
+int IEngine_MatchFingerprints(void *user1, long idx1, void *user2, long idx2, int *score) {
+  const User &a = *AsUser(user1);
+  const User &b = *AsUser(user2);
+  if (idx1 < 0 || idx2 < 0 || idx1 >= static_cast<long>(a.fingers.size()) ||
+      idx2 >= static_cast<long>(b.fingers.size())) {
+    *score = 0;
+    return kErrNoUser;
+  }
+  *score = Score(a.fingers[idx1], b.fingers[idx2]);
+  return 0;
+}
+
+int IEngine_FindUser(void *user, int *uid, int *score) {
+  return Find(*AsUser(user), nullptr, nullptr, uid, score);
+}
+
+// Understands the one query the wrapper sends:
+//   SELECT USERID FROM TAG_CACHE WHERE <key>='<value>'
+int IEngine_FindUserByQuery(void *user, const char *query, int *uid, int *score) {
+  const char *where = std::strstr(query, "WHERE ");
+  const char *eq = where ? std::strchr(where, '=') : nullptr;
+  if (!eq || eq[1] != '\'') {
+    return kErrParam;
+  }
+  std::string key(where + 6, eq);
+  std::string value(eq + 2);
+  if (value.empty() || value.back() != '\'') {
+    return kErrParam;
+  }
+  value.pop_back();
+  return Find(*AsUser(user), &key, &value, uid, score);
+}
+
+int IEngine_GetFingerprintCount(void *user, int *count) {
+  *count = static_cast<int>(AsUser(user)->fingers.size());
+  return 0;
+}
+
+int IEngine_GetUserCount(int *count) {
+  std::lock_guard<std::mutex> guard(g_lock);
+  *count = static_cast<int>(g_users.size());
+  return 0;
+}
+
+int IEngine_GetUserIDs(int *ids, int count) {
+  std::lock_guard<std::mutex> guard(g_lock);
+  int i = 0;
+  for (auto it = g_users.begin(); it != g_users.end() && i < count; ++it) {
+    ids[i++] = static_cast<int>(it->first);
+  }
+  return 0;
+}
+
+int IEngine_GetUser(void *user, unsigned int uid) {
+  std::lock_guard<std::mutex> guard(g_lock);
+  auto it = g_users.find(uid);
+  if (it == g_users.end()) {
+    return kErrNoUser;
+  }
+  *AsUser(user) = it->second;
+  return 0;
+}
+
+// Enrolls `user` under `uid`, replacing any user already there.
+int IEngine_RegisterUserAs(void *user, unsigned int uid) {
+  std::lock_guard<std::mutex> guard(g_lock);
+  if (static_cast<long>(g_users.size()) >= g_user_limit && !g_users.count(uid)) {
+    return kErrFull;
+  }
+  g_users[uid] = *AsUser(user);
+  g_users[uid].tags.clear();
+  return 0;
+}
+
+int IEngine_RemoveUser(unsigned int uid) {
+  std::lock_guard<std::mutex> guard(g_lock);
+  return g_users.erase(uid) ? 0 : kErrNoUser;
+}
+
+int IEngine_SetCustomData(void *user, const void *data, unsigned int len) {
+  AsUser(user)->custom.assign(static_cast<const char *>(data), len);
+  return 0;
+}
+
+int IEngine_GetCustomData(void *user, void *data, void *len) {
+  const std::string &custom = AsUser(user)->custom;
+  std::memcpy(data, custom.data(), custom.size());
+  *static_cast<int *>(len) = static_cast<int>(custom.size());
+  return 0;
+}
+
+int IEngine_UpdateUser(void *user, unsigned int uid) {
+  std::lock_guard<std::mutex> guard(g_lock);
+  auto it = g_users.find(uid);
+  if (it == g_users.end()) {
+    return kErrNoUser;
+  }
+  it->second = *AsUser(user);
+  return 0;
+}
+
+int IEngine_SetStringTag(void *user, const char *key, const char *value) {
+  AsUser(user)->tags[key] = value;
+  return 0;
+}
+
+int IEngine_ConvertRawImage2Bmp(const void *raw, int w, int h, void *bmp, int *len) {
+  if (w <= 0 || h <= 0) {
+    return kErrParam;
+  }
+  size_t stride = (static_cast<size_t>(w) + 3) & ~static_cast<size_t>(3);
+  size_t need = kBmpPixels + stride * h;
+  if (*len < 0 || static_cast<size_t>(*len) < need) {
+    return kErrImage;
+  }
+  auto *b = static_cast<uint8_t *>(bmp);
+  std::memset(b, 0, need);
+  uint32_t v = static_cast<uint32_t>(need);
+  b[0] = 'B';
+  b[1] = 'M';
+  std::memcpy(b + 2, &v, 4);
+  v = kBmpPixels;
+  std::memcpy(b + 10, &v, 4);
+  v = 40;
+  std::memcpy(b + 14, &v, 4);
+  std::memcpy(b + 0x12, &w, 4);
+  std::memcpy(b + 0x16, &h, 4);
+  b[0x1A] = 1;
+  b[0x1C] = 8;
+  for (int i = 0; i < 256; ++i) {
+    b[0x36 + i * 4] = b[0x36 + i * 4 + 1] = b[0x36 + i * 4 + 2] = static_cast<uint8_t>(i);
+  }
+  const auto *src = static_cast<const uint8_t *>(raw);
+  for (int y = 0; y < h; ++y) {
+    std::memcpy(b + kBmpPixels + stride * (h - 1 - y), src + static_cast<size_t>(y) * w, w);
+  }
+  *len = static_cast<int>(need);
+  return 0;
+}
+
+} // extern "C"
@@ -0,0 +1,452 @@
+#include "image_enhance.h"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define ZKFP_IMAGE_ENHANCE_X86 1
+#include <immintrin.h>
+#else
+#define ZKFP_IMAGE_ENHANCE_X86 0
+#endif
+
+namespace zkfp {
+namespace {
+
+constexpr int kMaxTiles = 8;
+constexpr int kMinTileSide = 16;
+constexpr int kOne = 256;  // interpolation weights are 8.8 fixed point
+
+// Background level of a tile: the valleys and bare glass are its lightest tenth.
+constexpr uint32_t kBackgroundPercent = 90;
+constexpr uint32_t kStretchLowPercent = 1;
+constexpr uint32_t kStretchHighPercent = 99;
+// CLAHE clip limit, as a multiple of the mean bin count of a tile.
+constexpr uint32_t kClipFactor = 3;
+
+// dst = min(src + lift, 255) ^ mask over one row.
+using LiftKernel = void (*)(const uint8_t *src, const uint8_t *lift, uint8_t mask, uint8_t *dst, size_t n);
+
+// dst = (base[t] * kOne + step[t] * wx + round) >> 16 with t = tile[i]: a row
+// of background lift from its value at each tile column (kMaxTiles entries).
+using RampKernel = void (*)(const int *base, const int *step, const uint8_t *tile, const uint16_t *wx, uint8_t *dst,
+                            size_t n);
+
+// Bilinear blend of four tile maps, packed one byte each into `quad` entries
+// indexed by tile column * 256 + pixel; see Scratch::quad.
+using EqualizeKernel = void (*)(const uint32_t *quad, const uint8_t *tile, const uint16_t *wx, unsigned wy,
+                                uint8_t *row, size_t n);
+
+void LiftScalar(const uint8_t *src, const uint8_t *lift, uint8_t mask, uint8_t *dst, size_t n) {
+  if (lift) {
+    for (size_t i = 0; i < n; ++i) {
+      unsigned v = src[i] + lift[i];
+      dst[i] = static_cast<uint8_t>((v > 255 ? 255 : v) ^ mask);
+    }
+  } else {
+    for (size_t i = 0; i < n; ++i) {
+      dst[i] = static_cast<uint8_t>(src[i] ^ mask);
+    }
+  }
+}
+
+// a + (b - a) * w in 8.8 fixed point: a single multiply per blend.
+inline int Lerp(int a, int b, int w) {
+  return a * kOne + (b - a) * w;
+}
+
+void RampScalar(const int *base, const int *step, const uint8_t *tile, const uint16_t *wx, uint8_t *dst, size_t n) {
+  for (size_t i = 0; i < n; ++i) {
+    dst[i] = static_cast<uint8_t>((base[tile[i]] * kOne + step[tile[i]] * wx[i] + kOne * kOne / 2) >> 16);
+  }
+}
+
+void EqualizeScalar(const uint32_t *quad, const uint8_t *tile, const uint16_t *wx, unsigned wy, uint8_t *row,
+                    size_t n) {
+  for (size_t i = 0; i < n; ++i) {
+    uint32_t q = quad[tile[i] * 256u + row[i]];
+    int top = Lerp(q & 0xFF, (q >> 8) & 0xFF, wx[i]);
+    int bottom = Lerp((q >> 16) & 0xFF, q >> 24, wx[i]);
+    row[i] = static_cast<uint8_t>((top * kOne + (bottom - top) * static_cast<int>(wy) + kOne * kOne / 2) >> 16);
+  }
+}
+
+#if ZKFP_IMAGE_ENHANCE_X86
+
+__attribute__((target("avx2"))) void LiftAvx2(const uint8_t *src, const uint8_t *lift, uint8_t mask, uint8_t *dst,
+                                              size_t n) {
+  const __m256i vm = _mm256_set1_epi8(static_cast<char>(mask));
+  size_t i = 0;
+  if (lift) {
+    for (; i + 32 <= n; i += 32) {
+      __m256i s = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i));
+      __m256i l = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(lift + i));
+      _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), _mm256_xor_si256(_mm256_adds_epu8(s, l), vm));
+    }
+    LiftScalar(src + i, lift + i, mask, dst + i, n - i);
+  } else {
+    for (; i + 32 <= n; i += 32) {
+      __m256i s = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i));
+      _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), _mm256_xor_si256(s, vm));
+    }
+    LiftScalar(src + i, nullptr, mask, dst + i, n - i);
+  }
+}
+
+// With at most eight tile columns the per-tile values fit one register, and a
+// lane permute stands in for the lookup.
+__attribute__((target("avx2"))) void RampAvx2(const int *base, const int *step, const uint8_t *tile, const uint16_t *wx,
+                                              uint8_t *dst, size_t n) {
+  static_assert(kMaxTiles == 8, "one ymm register per tile row");
+  const __m256i vbase = _mm256_slli_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(base)), 8);
+  const __m256i vstep = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(step));
+  const __m256i half = _mm256_set1_epi32(kOne * kOne / 2);
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256i t = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(tile + i)));
+    __m256i w = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(wx + i)));
+    __m256i v = _mm256_add_epi32(_mm256_permutevar8x32_epi32(vbase, t),
+                                 _mm256_mullo_epi32(_mm256_permutevar8x32_epi32(vstep, t), w));
+    v = _mm256_srli_epi32(_mm256_add_epi32(v, half), 16);
+    __m128i packed = _mm_packus_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    _mm_storel_epi64(reinterpret_cast<__m128i *>(dst + i), _mm_packus_epi16(packed, packed));
+  }
+  RampScalar(base, step, tile + i, wx + i, dst + i, n - i);
+}
+
+// Eight pixels per step: one gather fetches all four maps of each pixel.
+__attribute__((target("avx2"))) void EqualizeAvx2(const uint32_t *quad, const uint8_t *tile, const uint16_t *wx,
+                                                  unsigned wy, uint8_t *row, size_t n) {
+  const __m256i byte = _mm256_set1_epi32(0xFF);
+  const __m256i vwy = _mm256_set1_epi32(static_cast<int>(wy));
+  const __m256i half = _mm256_set1_epi32(kOne * kOne / 2);
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256i v = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(row + i)));
+    __m256i t = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(tile + i)));
+    __m256i w = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(wx + i)));
+    __m256i index = _mm256_add_epi32(_mm256_slli_epi32(t, 8), v);
+    __m256i q = _mm256_i32gather_epi32(reinterpret_cast<const int *>(quad), index, 4);
+    __m256i a = _mm256_and_si256(q, byte);
+    __m256i b = _mm256_and_si256(_mm256_srli_epi32(q, 8), byte);
+    __m256i c = _mm256_and_si256(_mm256_srli_epi32(q, 16), byte);
+    __m256i d = _mm256_srli_epi32(q, 24);
+    __m256i top = _mm256_add_epi32(_mm256_slli_epi32(a, 8), _mm256_mullo_epi32(_mm256_sub_epi32(b, a), w));
+    __m256i bottom = _mm256_add_epi32(_mm256_slli_epi32(c, 8), _mm256_mullo_epi32(_mm256_sub_epi32(d, c), w));
+    __m256i out = _mm256_add_epi32(_mm256_slli_epi32(top, 8), _mm256_mullo_epi32(_mm256_sub_epi32(bottom, top), vwy));
+    out = _mm256_srli_epi32(_mm256_add_epi32(out, half), 16);
+    __m128i packed = _mm_packus_epi32(_mm256_castsi256_si128(out), _mm256_extracti128_si256(out, 1));
+    _mm_storel_epi64(reinterpret_cast<__m128i *>(row + i), _mm_packus_epi16(packed, packed));
+  }
+  EqualizeScalar(quad, tile + i, wx + i, wy, row + i, n - i);
+}
+
+#endif
+
+struct Kernel {
+  LiftKernel lift;
+  RampKernel ramp;
+  EqualizeKernel equalize;
+  const char *name;
+};
+
+Kernel PickKernel() {
+#if ZKFP_IMAGE_ENHANCE_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return {LiftAvx2, RampAvx2, EqualizeAvx2, "avx2"};
+  }
+#endif
+  return {LiftScalar, RampScalar, EqualizeScalar, "scalar"};
+}
+
+const Kernel &ActiveKernel() {
+  static const Kernel kernel = PickKernel();
+  return kernel;
+}
+
+// Tiles along one axis and, for every pixel on it, the tile centre at or before
+// it and how far it sits towards the next one.
+struct Axis {
+  int tiles = 0;
+  int bound[kMaxTiles + 1] = {};
+  std::vector<uint8_t> lo;
+  std::vector<uint16_t> weight;  // share of tile lo + 1, out of kOne
+
+  void Prepare(int extent) {
+    tiles = std::clamp(extent / kMinTileSide, 1, kMaxTiles);
+    int centre[kMaxTiles];
+    for (int t = 0; t <= tiles; ++t) {
+      bound[t] = static_cast<int>(static_cast<int64_t>(t) * extent / tiles);
+    }
+    for (int t = 0; t < tiles; ++t) {
+      centre[t] = (bound[t] + bound[t + 1]) / 2;
+    }
+    lo.resize(extent);
+    weight.resize(extent);
+    int t = 0;
+    for (int p = 0; p < extent; ++p) {
+      while (t + 1 < tiles && p >= centre[t + 1]) {
+        ++t;
+      }
+      lo[p] = static_cast<uint8_t>(t);
+      weight[p] = p <= centre[t] || t + 1 == tiles
+                      ? 0
+                      : static_cast<uint16_t>((p - centre[t]) * kOne / (centre[t + 1] - centre[t]));
+    }
+  }
+
+  int Next(int t) const { return t + 1 < tiles ? t + 1 : t; }
+};
+
+// Smallest value whose cumulative count reaches `percent` of `total`.
+int Percentile(const uint32_t *hist, uint64_t total, uint32_t percent) {
+  uint64_t want = (total * percent + 99) / 100;
+  uint64_t sum = 0;
+  for (int v = 0; v < 256; ++v) {
+    sum += hist[v];
+    if (sum >= want && sum) {
+      return v;
+    }
+  }
+  return 255;
+}
+
+struct Scratch {
+  Axis x;
+  Axis y;
+  std::vector<uint32_t> hist;  // per tile, 256 bins, raw then stage values
+  std::vector<uint8_t> map;    // per tile: stage value -> output
+  // Per tile, per stage value: its own map and those of the tiles right, below
+  // and diagonal, one byte each, so a pixel needs one load for all four.
+  std::vector<uint32_t> quad;
+  std::vector<uint8_t> lift;  // per tile
+  std::vector<uint8_t> row_lift;
+  uint8_t stretch[256];
+
+  uint32_t *Hist(int ty, int tx) { return hist.data() + (static_cast<size_t>(ty) * x.tiles + tx) * 256; }
+  uint8_t *Map(int ty, int tx) { return map.data() + (static_cast<size_t>(ty) * x.tiles + tx) * 256; }
+  uint32_t *Quad(int ty, int tx) { return quad.data() + (static_cast<size_t>(ty) * x.tiles + tx) * 256; }
+};
+
+// Tile by tile into four interleaved sub-histograms, so runs of equal pixels do
+// not serialise on one counter.
+void GatherHistograms(Scratch &s, const uint8_t *src, size_t stride) {
+  s.hist.resize(static_cast<size_t>(s.x.tiles) * s.y.tiles * 256);
+  uint32_t sub[4][256];
+  for (int ty = 0; ty < s.y.tiles; ++ty) {
+    for (int tx = 0; tx < s.x.tiles; ++tx) {
+      std::memset(sub, 0, sizeof(sub));
+      int x0 = s.x.bound[tx];
+      int x1 = s.x.bound[tx + 1];
+      for (int y = s.y.bound[ty]; y < s.y.bound[ty + 1]; ++y) {
+        const uint8_t *row = src + static_cast<size_t>(y) * stride;
+        int x = x0;
+        for (; x + 4 <= x1; x += 4) {
+          ++sub[0][row[x]];
+          ++sub[1][row[x + 1]];
+          ++sub[2][row[x + 2]];
+          ++sub[3][row[x + 3]];
+        }
+        for (; x < x1; ++x) {
+          ++sub[0][row[x]];
+        }
+      }
+      uint32_t *h = s.Hist(ty, tx);
+      for (int v = 0; v < 256; ++v) {
+        h[v] = sub[0][v] + sub[1][v] + sub[2][v] + sub[3][v];
+      }
+    }
+  }
+}
+
+// Rewrites every tile histogram from raw values to the values the lift/invert
+// pass produces. The lift is taken as constant over the tile, which is exact
+// at its centre and close enough elsewhere for the statistics.
+void ShiftHistograms(Scratch &s, uint8_t mask) {
+  uint32_t shifted[256];
+  for (int ty = 0; ty < s.y.tiles; ++ty) {
+    for (int tx = 0; tx < s.x.tiles; ++tx) {
+      uint32_t *h = s.Hist(ty, tx);
+      int lift = s.lift[static_cast<size_t>(ty) * s.x.tiles + tx];
+      std::memset(shifted, 0, sizeof(shifted));
+      for (int v = 0; v < 256; ++v) {
+        shifted[std::min(v + lift, 255) ^ mask] += h[v];
+      }
+      std::memcpy(h, shifted, sizeof(shifted));
+    }
+  }
+}
+
+void BuildStretch(Scratch &s, bool enabled) {
+  for (int v = 0; v < 256; ++v) {
+    s.stretch[v] = static_cast<uint8_t>(v);
+  }
+  if (!enabled) {
+    return;
+  }
+  uint32_t global[256] = {};
+  uint64_t total = 0;
+  for (size_t t = 0; t < static_cast<size_t>(s.x.tiles) * s.y.tiles; ++t) {
+    const uint32_t *h = s.hist.data() + t * 256;
+    for (int v = 0; v < 256; ++v) {
+      global[v] += h[v];
+      total += h[v];
+    }
+  }
+  int lo = Percentile(global, total, kStretchLowPercent);
+  int hi = Percentile(global, total, kStretchHighPercent);
+  if (hi <= lo) {
+    return;
+  }
+  for (int v = 0; v < 256; ++v) {
+    int out = (v - lo) * 255 / (hi - lo);
+    s.stretch[v] = static_cast<uint8_t>(std::clamp(out, 0, 255));
+  }
+}
+
+// Per tile, stretch then clipped-histogram equalization folded into one table.
+void BuildTileMaps(Scratch &s) {
+  s.map.resize(static_cast<size_t>(s.x.tiles) * s.y.tiles * 256);
+  uint32_t h[256];
+  for (int ty = 0; ty < s.y.tiles; ++ty) {
+    for (int tx = 0; tx < s.x.tiles; ++tx) {
+      const uint32_t *src = s.Hist(ty, tx);
+      std::memset(h, 0, sizeof(h));
+      uint64_t total = 0;
+      for (int v = 0; v < 256; ++v) {
+        h[s.stretch[v]] += src[v];
+        total += src[v];
+      }
+      uint8_t *map = s.Map(ty, tx);
+      if (!total) {
+        std::memcpy(map, s.stretch, 256);
+        continue;
+      }
+      uint32_t limit = static_cast<uint32_t>(std::max<uint64_t>(1, kClipFactor * total / 256));
+      uint64_t excess = 0;
+      for (int v = 0; v < 256; ++v) {
+        if (h[v] > limit) {
+          excess += h[v] - limit;
+          h[v] = limit;
+        }
+      }
+      uint32_t bonus = static_cast<uint32_t>(excess / 256);
+      uint64_t kept = total - excess + static_cast<uint64_t>(bonus) * 256;
+      // cdf * 255 / kept, rounded, with the division done once per tile.
+      uint8_t eq[256];
+      uint64_t cdf = 0;
+      uint64_t scale = ((uint64_t{255} << 32) + kept / 2) / kept;
+      for (int v = 0; v < 256; ++v) {
+        cdf += h[v] + bonus;
+        eq[v] = static_cast<uint8_t>(std::min<uint64_t>(255, (cdf * scale + (uint64_t{1} << 31)) >> 32));
+      }
+      for (int v = 0; v < 256; ++v) {
+        map[v] = eq[s.stretch[v]];
+      }
+    }
+  }
+
+  s.quad.resize(s.map.size());
+  for (int ty = 0; ty < s.y.tiles; ++ty) {
+    for (int tx = 0; tx < s.x.tiles; ++tx) {
+      const uint8_t *a = s.Map(ty, tx);
+      const uint8_t *b = s.Map(ty, s.x.Next(tx));
+      const uint8_t *c = s.Map(s.y.Next(ty), tx);
+      const uint8_t *d = s.Map(s.y.Next(ty), s.x.Next(tx));
+      uint32_t *q = s.Quad(ty, tx);
+      for (int v = 0; v < 256; ++v) {
+        q[v] = a[v] | b[v] << 8 | c[v] << 16 | static_cast<uint32_t>(d[v]) << 24;
+      }
+    }
+  }
+}
+
+// Background lift of every pixel in row `y`, interpolated between tile centres.
+void RowLift(Scratch &s, const Kernel &kernel, int y, int width) {
+  int ty = s.y.lo[y];
+  const uint8_t *top = s.lift.data() + static_cast<size_t>(ty) * s.x.tiles;
+  const uint8_t *bottom = s.lift.data() + static_cast<size_t>(s.y.Next(ty)) * s.x.tiles;
+  int wy = s.y.weight[y];
+  int base[kMaxTiles] = {};
+  int step[kMaxTiles] = {};
+  for (int t = 0; t < s.x.tiles; ++t) {
+    base[t] = Lerp(top[t], bottom[t], wy);
+  }
+  for (int t = 0; t < s.x.tiles; ++t) {
+    step[t] = base[s.x.Next(t)] - base[t];
+  }
+  kernel.ramp(base, step, s.x.lo.data(), s.x.weight.data(), s.row_lift.data(), static_cast<size_t>(width));
+}
+
+} // namespace
+
+void EnhanceImage(const uint8_t *src, size_t src_stride, uint8_t *dst, size_t dst_stride, int width, int height,
+                  uint32_t ops) {
+  if (!src || !dst || width <= 0 || height <= 0) {
+    return;
+  }
+  ops &= kEnhanceAll;
+  uint8_t mask = (ops & kEnhanceInvert) ? 0xFF : 0x00;
+  const Kernel &kernel = ActiveKernel();
+  if (!(ops & (kEnhanceFlatten | kEnhanceStretch | kEnhanceEqualize))) {
+    if (src_stride == static_cast<size_t>(width) && dst_stride == src_stride) {
+      kernel.lift(src, nullptr, mask, dst, static_cast<size_t>(width) * static_cast<size_t>(height));
+      return;
+    }
+    for (int y = 0; y < height; ++y) {
+      kernel.lift(src + static_cast<size_t>(y) * src_stride, nullptr, mask, dst + static_cast<size_t>(y) * dst_stride,
+                  static_cast<size_t>(width));
+    }
+    return;
+  }
+
+  thread_local Scratch s;
+  s.x.Prepare(width);
+  s.y.Prepare(height);
+  GatherHistograms(s, src, src_stride);
+
+  s.lift.assign(static_cast<size_t>(s.x.tiles) * s.y.tiles, 0);
+  if (ops & kEnhanceFlatten) {
+    for (int ty = 0; ty < s.y.tiles; ++ty) {
+      for (int tx = 0; tx < s.x.tiles; ++tx) {
+        uint64_t total = static_cast<uint64_t>(s.x.bound[tx + 1] - s.x.bound[tx]) *
+                         static_cast<uint64_t>(s.y.bound[ty + 1] - s.y.bound[ty]);
+        s.lift[static_cast<size_t>(ty) * s.x.tiles + tx] =
+            static_cast<uint8_t>(255 - Percentile(s.Hist(ty, tx), total, kBackgroundPercent));
+      }
+    }
+    s.row_lift.resize(static_cast<size_t>(width));
+  }
+  ShiftHistograms(s, mask);
+  BuildStretch(s, (ops & kEnhanceStretch) != 0);
+  bool equalize = (ops & kEnhanceEqualize) != 0;
+  if (equalize) {
+    BuildTileMaps(s);
+  }
+
+  for (int y = 0; y < height; ++y) {
+    uint8_t *out = dst + static_cast<size_t>(y) * dst_stride;
+    const uint8_t *lift = nullptr;
+    if (ops & kEnhanceFlatten) {
+      RowLift(s, kernel, y, width);
+      lift = s.row_lift.data();
+    }
+    kernel.lift(src + static_cast<size_t>(y) * src_stride, lift, mask, out, static_cast<size_t>(width));
+    if (equalize) {
+      kernel.equalize(s.Quad(s.y.lo[y], 0), s.x.lo.data(), s.x.weight.data(), s.y.weight[y], out,
+                      static_cast<size_t>(width));
+    } else if (ops & kEnhanceStretch) {
+      for (int x = 0; x < width; ++x) {
+        out[x] = s.stretch[out[x]];
+      }
+    }
+  }
+}
+
+const char *ImageEnhanceKernel() {
+  return ActiveKernel().name;
+}
+
+} // namespace zkfp
@@ -0,0 +1,28 @@
+#ifndef ZKFP_IMAGE_ENHANCE_H
+#define ZKFP_IMAGE_ENHANCE_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace zkfp {
+
+// Preprocessing steps, the FP_ENHANCE_* bits of libzkfptype.h. Whatever the
+// combination, they apply in this order.
+constexpr uint32_t kEnhanceFlatten = 0x1;   // lift the background to even white
+constexpr uint32_t kEnhanceInvert = 0x2;    // negative image, for sensors with light ridges
+constexpr uint32_t kEnhanceStretch = 0x4;   // map the 1st..99th percentile onto 0..255
+constexpr uint32_t kEnhanceEqualize = 0x8;  // contrast-limited equalization over an 8x8 tile grid
+constexpr uint32_t kEnhanceAll = 0xF;
+
+// Runs the steps in `ops` over an 8-bit image: one read pass gathers per-tile
+// histograms when a step needs them, then each row is written once. `src` may
+// be `dst` when the strides agree.
+void EnhanceImage(const uint8_t *src, size_t src_stride, uint8_t *dst, size_t dst_stride, int width, int height,
+                  uint32_t ops);
+
+// Name of the row kernel picked at runtime ("avx2" or "scalar").
+const char *ImageEnhanceKernel();
+
+} // namespace zkfp
+
+#endif
@@ -0,0 +1,132 @@
+#include "image_file.h"
+
+#include "bmp_image.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace zkfp {
+namespace {
+
+bool IsSpace(uint8_t c) {
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+}
+
+// Reads one decimal header field, skipping whitespace and '#' comments.
+bool PgmField(const uint8_t *data, size_t len, size_t *pos, int *value) {
+  size_t p = *pos;
+  while (p < len && (IsSpace(data[p]) || data[p] == '#')) {
+    if (data[p] == '#') {
+      while (p < len && data[p] != '\n') {
+        ++p;
+      }
+    } else {
+      ++p;
+    }
+  }
+  if (p == len || data[p] < '0' || data[p] > '9') {
+    return false;
+  }
+  long v = 0;
+  while (p < len && data[p] >= '0' && data[p] <= '9') {
+    v = v * 10 + (data[p++] - '0');
+    if (v > 0xFFFF) {
+      return false;
+    }
+  }
+  *value = static_cast<int>(v);
+  *pos = p;
+  return true;
+}
+
+} // namespace
+
+bool ParsePgm(const uint8_t *data, size_t len, ImageView *view) {
+  *view = ImageView{};
+  if (!data || len < 3 || data[0] != 'P' || data[1] != '5') {
+    return false;
+  }
+  size_t pos = 2;
+  int width = 0;
+  int height = 0;
+  int maxval = 0;
+  if (!PgmField(data, len, &pos, &width) || !PgmField(data, len, &pos, &height) ||
+      !PgmField(data, len, &pos, &maxval)) {
+    return false;
+  }
+  // A single whitespace byte separates the header from the pixels.
+  if (!width || !height || !maxval || maxval > 255 || pos == len || !IsSpace(data[pos])) {
+    return false;
+  }
+  ++pos;
+  size_t rows = (len - pos) / static_cast<size_t>(width);
+  view->pixels = data + pos;
+  view->width = width;
+  view->height = static_cast<int>(rows < static_cast<size_t>(height) ? rows : height);
+  view->stride = static_cast<size_t>(width);
+  view->bottom_up = false;
+  return true;
+}
+
+ImageFile::~ImageFile() {
+  Close();
+}
+
+bool ImageFile::Open(const char *path, int raw_w, int raw_h) {
+  Close();
+  if (!path) {
+    return false;
+  }
+  int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat st {};
+  if (::fstat(fd, &st) != 0 || st.st_size <= 0) {
+    ::close(fd);
+    return false;
+  }
+  size_t size = static_cast<size_t>(st.st_size);
+  void *mem = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (mem == MAP_FAILED) {
+    return false;
+  }
+  base_ = static_cast<uint8_t *>(mem);
+  size_ = size;
+  // The image is read once front to back by the crop/resample pass; start the
+  // read-ahead now, which matters most on network mounts.
+  ::madvise(base_, size_, MADV_SEQUENTIAL);
+  ::madvise(base_, size_, MADV_WILLNEED);
+
+  if (ParsePgm(base_, size_, &view_)) {
+    format_ = ImageFormat::Pgm;
+  } else if (ParseBmp(base_, size_, &view_)) {
+    format_ = ImageFormat::Bmp;
+  } else if (raw_w > 0 && raw_h > 0 && size_ == static_cast<size_t>(raw_w) * raw_h) {
+    format_ = ImageFormat::Raw;
+    view_ = ImageView{base_, raw_w, raw_h, static_cast<size_t>(raw_w), false};
+  } else {
+    Close();
+    return false;
+  }
+  if (view_.height <= 0) {
+    Close();
+    return false;
+  }
+  return true;
+}
+
+void ImageFile::Close() {
+  if (base_) {
+    ::munmap(base_, size_);
+  }
+  base_ = nullptr;
+  size_ = 0;
+  format_ = ImageFormat::None;
+  view_ = ImageView{};
+}
+
+} // namespace zkfp
@@ -0,0 +1,50 @@
+#ifndef ZKFP_IMAGE_FILE_H
+#define ZKFP_IMAGE_FILE_H
+
+#include "image_geom.h"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace zkfp {
+
+enum class ImageFormat {
+  None,
+  Pgm,  // binary "P5", maxval up to 255
+  Bmp,  // uncompressed 8-bit
+  Raw,  // headerless, rows top-down with no padding
+};
+
+// Read-only mapping of an 8-bit grayscale image file. The view points into the
+// mapping, so the pixels reach the crop/resample stage without being copied.
+class ImageFile {
+public:
+  ImageFile() = default;
+  ~ImageFile();
+
+  ImageFile(const ImageFile &) = delete;
+  ImageFile &operator=(const ImageFile &) = delete;
+
+  // Maps and parses `path`. A file that is neither PGM nor BMP is taken as raw
+  // when it holds exactly raw_w x raw_h bytes.
+  bool Open(const char *path, int raw_w, int raw_h);
+
+  ImageFormat Format() const { return format_; }
+  const ImageView &View() const { return view_; }
+
+private:
+  void Close();
+
+  uint8_t *base_ = nullptr;
+  size_t size_ = 0;
+  ImageFormat format_ = ImageFormat::None;
+  ImageView view_;
+};
+
+// Parses a binary 8-bit PGM held in `data`; a file cut short keeps the rows it
+// has.
+bool ParsePgm(const uint8_t *data, size_t len, ImageView *view);
+
+} // namespace zkfp
+
+#endif
@@ -0,0 +1,295 @@
+#include "image_geom.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define ZKFP_IMAGE_GEOM_X86 1
+#include <immintrin.h>
+#else
+#define ZKFP_IMAGE_GEOM_X86 0
+#endif
+
+namespace zkfp {
+namespace {
+
+// Filter weights are 8.8 fixed point and sum to exactly kOne per destination
+// pixel, so a vertical pass of 8-bit rows fits a uint16 accumulator.
+constexpr int kOne = 256;
+
+// acc = (first ? 0 : acc) + src * w over one row span.
+using AccumulateKernel = void (*)(const uint8_t *src, uint16_t *acc, size_t n, uint16_t w, bool first);
+
+void AccumulateScalar(const uint8_t *src, uint16_t *acc, size_t n, uint16_t w, bool first) {
+  if (first) {
+    for (size_t i = 0; i < n; ++i) {
+      acc[i] = static_cast<uint16_t>(src[i] * w);
+    }
+  } else {
+    for (size_t i = 0; i < n; ++i) {
+      acc[i] = static_cast<uint16_t>(acc[i] + src[i] * w);
+    }
+  }
+}
+
+#if ZKFP_IMAGE_GEOM_X86
+
+__attribute__((target("avx2"))) void AccumulateAvx2(const uint8_t *src, uint16_t *acc, size_t n, uint16_t w,
+                                                    bool first) {
+  const __m256i vw = _mm256_set1_epi16(static_cast<short>(w));
+  size_t i = 0;
+  if (first) {
+    for (; i + 16 <= n; i += 16) {
+      __m256i s = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i)));
+      _mm256_storeu_si256(reinterpret_cast<__m256i *>(acc + i), _mm256_mullo_epi16(s, vw));
+    }
+  } else {
+    for (; i + 16 <= n; i += 16) {
+      __m256i s = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i)));
+      __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(acc + i));
+      _mm256_storeu_si256(reinterpret_cast<__m256i *>(acc + i), _mm256_add_epi16(a, _mm256_mullo_epi16(s, vw)));
+    }
+  }
+  AccumulateScalar(src + i, acc + i, n - i, w, first);
+}
+
+#endif
+
+struct Kernel {
+  AccumulateKernel fn;
+  const char *name;
+};
+
+Kernel PickKernel() {
+#if ZKFP_IMAGE_GEOM_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return {AccumulateAvx2, "avx2"};
+  }
+#endif
+  return {AccumulateScalar, "scalar"};
+}
+
+const Kernel &ActiveKernel() {
+  static const Kernel kernel = PickKernel();
+  return kernel;
+}
+
+// Source taps of every destination pixel along one axis, `width` per pixel:
+// pixel d reads index[d * width + k] with weight[d * width + k], padded with
+// zero weights. Pixels outside [begin, end) have no taps and are padded white.
+struct Taps {
+  int begin = 0;
+  int end = 0;
+  int width = 0;
+  int lowest = 0;
+  int highest = -1;
+  std::vector<int> index;
+  std::vector<uint16_t> weight;
+
+  void Build(int src_n, int dst_n, double scale, ResampleFilter filter) {
+    // Widest footprint any pixel can have, plus one for a straddled boundary.
+    width = filter == ResampleFilter::Bilinear ? 2 : static_cast<int>(std::ceil(1 / scale)) + 1;
+    begin = dst_n;
+    end = 0;
+    index.assign(static_cast<size_t>(dst_n) * width, 0);
+    weight.assign(static_cast<size_t>(dst_n) * width, 0);
+    lowest = src_n;
+    highest = -1;
+    for (int d = 0; d < dst_n; ++d) {
+      // Destination pixel d covers [d, d + 1); map that footprint into source
+      // coordinates with the two centres lined up.
+      double lo = (d - dst_n / 2.0) / scale + src_n / 2.0;
+      double hi = (d + 1 - dst_n / 2.0) / scale + src_n / 2.0;
+      double centre = (lo + hi) / 2;
+      if (centre < 0 || centre >= src_n) {
+        continue;
+      }
+      begin = std::min(begin, d);
+      end = d + 1;
+      int *idx = &index[static_cast<size_t>(d) * width];
+      uint16_t *w = &weight[static_cast<size_t>(d) * width];
+      int n = filter == ResampleFilter::Bilinear
+                  ? Bilinear(src_n, centre - 0.5, idx, w)
+                  : Area(src_n, std::max(lo, 0.0), std::min(hi, static_cast<double>(src_n)), idx, w);
+      for (int k = n; k < width; ++k) {
+        idx[k] = idx[0];
+      }
+      lowest = std::min(lowest, idx[0]);
+      highest = std::max(highest, idx[n - 1]);
+    }
+    if (begin > end) {
+      begin = end = 0;
+      lowest = 0;
+    }
+  }
+
+private:
+  static int Bilinear(int src_n, double pos, int *idx, uint16_t *w) {
+    double base = std::floor(pos);
+    int w1 = static_cast<int>(std::lround((pos - base) * kOne));
+    idx[0] = std::clamp(static_cast<int>(base), 0, src_n - 1);
+    idx[1] = std::clamp(static_cast<int>(base) + 1, 0, src_n - 1);
+    w[0] = static_cast<uint16_t>(kOne - w1);
+    w[1] = static_cast<uint16_t>(w1);
+    return 2;
+  }
+
+  // Coverage weights, rounded on the running total so they sum to kOne.
+  int Area(int src_n, double lo, double hi, int *idx, uint16_t *w) const {
+    double span = hi - lo;
+    int first = std::clamp(static_cast<int>(std::floor(lo)), 0, src_n - 1);
+    int last = std::clamp(static_cast<int>(std::ceil(hi)) - 1, first, std::min(src_n - 1, first + width - 1));
+    int given = 0;
+    int n = 0;
+    for (int i = first; i <= last; ++i) {
+      double covered = std::min(hi, i + 1.0) - lo;
+      int upto = i == last ? kOne : static_cast<int>(std::lround(covered / span * kOne));
+      if (upto > given) {
+        idx[n] = i;
+        w[n++] = static_cast<uint16_t>(upto - given);
+        given = upto;
+      }
+    }
+    return n;
+  }
+};
+
+// Taps are rebuilt only when the geometry changes, which for a sensor stream
+// is once.
+struct Plan {
+  int src_w = -1;
+  int src_h = -1;
+  int dst_w = -1;
+  int dst_h = -1;
+  double scale = 0;
+  ResampleFilter filter = ResampleFilter::Auto;
+  Taps x;
+  Taps y;
+  std::vector<uint16_t> acc;
+
+  void Prepare(int sw, int sh, int dw, int dh, double s, ResampleFilter f) {
+    if (sw == src_w && sh == src_h && dw == dst_w && dh == dst_h && s == scale && f == filter) {
+      return;
+    }
+    src_w = sw;
+    src_h = sh;
+    dst_w = dw;
+    dst_h = dh;
+    scale = s;
+    filter = f;
+    x.Build(sw, dw, s, f);
+    y.Build(sh, dh, s, f);
+    // The accumulated row starts at source column x.lowest.
+    for (int &i : x.index) {
+      i -= x.lowest;
+    }
+    acc.resize(static_cast<size_t>(std::max(x.highest - x.lowest + 1, 0)));
+  }
+};
+
+// Horizontal pass over one accumulated row, with the tap count fixed at compile
+// time for the common filters (K = 0 takes it from `width`).
+template <int K>
+void FilterRow(const uint16_t *acc, const int *index, const uint16_t *weight, int width, int begin, int end,
+               uint8_t *out) {
+  int n = K ? K : width;
+  for (int x = begin; x < end; ++x) {
+    const int *i = index + static_cast<size_t>(x) * n;
+    const uint16_t *w = weight + static_cast<size_t>(x) * n;
+    uint32_t sum = 0;
+    for (int k = 0; k < n; ++k) {
+      sum += static_cast<uint32_t>(acc[i[k]]) * w[k];
+    }
+    out[x] = static_cast<uint8_t>((sum + kOne * kOne / 2) >> 16);
+  }
+}
+
+void PadRows(uint8_t *dst, int dst_w, int from, int to) {
+  if (to > from) {
+    std::memset(dst + static_cast<size_t>(from) * dst_w, kImagePadValue, static_cast<size_t>(to - from) * dst_w);
+  }
+}
+
+} // namespace
+
+void CropCenter(const uint8_t *src, int src_w, int src_h, size_t src_stride, uint8_t *dst, int dst_w, int dst_h,
+                bool flip) {
+  if (dst_w <= 0 || dst_h <= 0) {
+    return;
+  }
+  int ox = (src_w - dst_w) / 2;
+  int oy = (src_h - dst_h) / 2;
+  int x0 = std::clamp(-ox, 0, dst_w);
+  int x1 = std::clamp(src_w - ox, x0, dst_w);
+  int y0 = std::clamp(-oy, 0, dst_h);
+  int y1 = std::clamp(src_h - oy, y0, dst_h);
+
+  PadRows(dst, dst_w, 0, y0);
+  for (int y = y0; y < y1; ++y) {
+    int sy = flip ? src_h - 1 - (y + oy) : y + oy;
+    uint8_t *out = dst + static_cast<size_t>(y) * dst_w;
+    std::memset(out, kImagePadValue, x0);
+    std::memcpy(out + x0, src + sy * src_stride + (x0 + ox), x1 - x0);
+    std::memset(out + x1, kImagePadValue, dst_w - x1);
+  }
+  PadRows(dst, dst_w, y1, dst_h);
+}
+
+void ResampleCenter(const uint8_t *src, int src_w, int src_h, size_t src_stride, int src_dpi, uint8_t *dst, int dst_w,
+                    int dst_h, int dst_dpi, ResampleFilter filter, bool flip) {
+  if (src_dpi <= 0 || dst_dpi <= 0 || src_dpi == dst_dpi) {
+    CropCenter(src, src_w, src_h, src_stride, dst, dst_w, dst_h, flip);
+    return;
+  }
+  if (dst_w <= 0 || dst_h <= 0) {
+    return;
+  }
+  double scale = static_cast<double>(dst_dpi) / src_dpi;
+  if (filter == ResampleFilter::Auto) {
+    filter = scale < 1 ? ResampleFilter::Area : ResampleFilter::Bilinear;
+  }
+
+  thread_local Plan plan;
+  plan.Prepare(src_w, src_h, dst_w, dst_h, scale, filter);
+  const Taps &tx = plan.x;
+  const Taps &ty = plan.y;
+  AccumulateKernel accumulate = ActiveKernel().fn;
+  size_t span = plan.acc.size();
+  uint16_t *acc = plan.acc.data();
+  auto filter_row = tx.width == 2 ? FilterRow<2> : tx.width == 3 ? FilterRow<3> : FilterRow<0>;
+
+  PadRows(dst, dst_w, 0, ty.begin);
+  for (int y = ty.begin; y < ty.end; ++y) {
+    // Vertical pass: weighted sum of the source rows over the columns in use.
+    for (int k = 0; k < ty.width; ++k) {
+      size_t t = static_cast<size_t>(y) * ty.width + k;
+      if (k && !ty.weight[t]) {
+        break;
+      }
+      int sy = flip ? src_h - 1 - ty.index[t] : ty.index[t];
+      accumulate(src + sy * src_stride + tx.lowest, acc, span, ty.weight[t], k == 0);
+    }
+    // Horizontal pass over the accumulated row.
+    uint8_t *out = dst + static_cast<size_t>(y) * dst_w;
+    std::memset(out, kImagePadValue, tx.begin);
+    filter_row(acc, tx.index.data(), tx.weight.data(), tx.width, tx.begin, tx.end, out);
+    std::memset(out + tx.end, kImagePadValue, dst_w - tx.end);
+  }
+  PadRows(dst, dst_w, ty.end, dst_h);
+}
+
+int ScaledExtent(int extent, int src_dpi, int dst_dpi) {
+  if (src_dpi <= 0 || dst_dpi <= 0) {
+    return extent;
+  }
+  return static_cast<int>((static_cast<int64_t>(extent) * dst_dpi + src_dpi / 2) / src_dpi);
+}
+
+const char *ImageGeomKernel() {
+  return ActiveKernel().name;
+}
+
+} // namespace zkfp
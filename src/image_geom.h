@@ -0,0 +1,48 @@
+#ifndef ZKFP_IMAGE_GEOM_H
+#define ZKFP_IMAGE_GEOM_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace zkfp {
+
+// 8-bit grayscale geometry used to turn sensor frames into engine input. Every
+// call reads the source where it lies (a raw USB frame, a BMP body) and writes
+// the destination exactly once; whatever the source does not cover is padded
+// with white, the background the engine expects.
+constexpr uint8_t kImagePadValue = 0xFF;
+
+// Strided 8-bit image read in place, e.g. out of a mapped file.
+struct ImageView {
+  const uint8_t *pixels = nullptr;  // first row in memory order
+  int width = 0;
+  int height = 0;
+  size_t stride = 0;
+  bool bottom_up = false;  // rows run bottom to top, as in a BMP
+};
+
+enum class ResampleFilter {
+  Auto,      // Area when shrinking, Bilinear otherwise
+  Bilinear,
+  Area,      // box average over each destination pixel's footprint
+};
+
+// Copies the centre of a src_w x src_h image into dst_w x dst_h, cropping or
+// padding each axis as needed. `flip` reads the source rows bottom-up.
+void CropCenter(const uint8_t *src, int src_w, int src_h, size_t src_stride, uint8_t *dst, int dst_w, int dst_h,
+                bool flip);
+
+// Rescales by dst_dpi / src_dpi around the image centre and crops or pads the
+// result into dst_w x dst_h. Equal resolutions fall through to CropCenter.
+void ResampleCenter(const uint8_t *src, int src_w, int src_h, size_t src_stride, int src_dpi, uint8_t *dst, int dst_w,
+                    int dst_h, int dst_dpi, ResampleFilter filter, bool flip);
+
+// Length of `extent` source pixels at src_dpi once converted to dst_dpi.
+int ScaledExtent(int extent, int src_dpi, int dst_dpi);
+
+// Name of the row kernel picked at runtime ("avx2" or "scalar").
+const char *ImageGeomKernel();
+
+} // namespace zkfp
+
+#endif
@@ -0,0 +1,89 @@
+#include "image_ring.h"
+
+namespace zkfp {
+
+ImageRing::ImageRing(size_t slots) : slots_(slots ? slots : 1) {}
+
+uint8_t *ImageRing::BeginWrite(size_t bytes) {
+  std::lock_guard<std::mutex> guard(lock_);
+  writing_ = nullptr;
+  for (size_t i = 0; i < slots_.size(); ++i) {
+    Slot &slot = slots_[(next_ + i) % slots_.size()];
+    if (slot.refs) {
+      continue;
+    }
+    next_ = (next_ + i + 1) % slots_.size();
+    if (slot.data.size() < bytes) {
+      slot.data.resize(bytes);
+    }
+    slot.seq = 0;
+    slot.bytes = 0;
+    writing_ = &slot;
+    return slot.data.data();
+  }
+  return nullptr;
+}
+
+uint32_t ImageRing::Commit(uint32_t width, uint32_t height, size_t bytes) {
+  std::lock_guard<std::mutex> guard(lock_);
+  if (!writing_) {
+    return 0;
+  }
+  if (++last_seq_ == 0) {
+    last_seq_ = 1;
+  }
+  writing_->width = width;
+  writing_->height = height;
+  writing_->bytes = bytes;
+  writing_->seq = last_seq_;
+  writing_ = nullptr;
+  return last_seq_;
+}
+
+void ImageRing::Abort() {
+  std::lock_guard<std::mutex> guard(lock_);
+  writing_ = nullptr;
+}
+
+uint32_t ImageRing::Acquire(uint32_t seq, const uint8_t **data, size_t *bytes, uint32_t *width, uint32_t *height) {
+  std::lock_guard<std::mutex> guard(lock_);
+  Slot *slot = FindLocked(seq ? seq : last_seq_);
+  if (!slot) {
+    return 0;
+  }
+  ++slot->refs;
+  *data = slot->data.data();
+  *bytes = slot->bytes;
+  *width = slot->width;
+  *height = slot->height;
+  return slot->seq;
+}
+
+bool ImageRing::Release(uint32_t seq) {
+  std::lock_guard<std::mutex> guard(lock_);
+  Slot *slot = FindLocked(seq);
+  if (!slot || !slot->refs) {
+    return false;
+  }
+  --slot->refs;
+  return true;
+}
+
+uint32_t ImageRing::LastSeq() const {
+  std::lock_guard<std::mutex> guard(lock_);
+  return last_seq_;
+}
+
+ImageRing::Slot *ImageRing::FindLocked(uint32_t seq) {
+  if (!seq) {
+    return nullptr;
+  }
+  for (Slot &slot : slots_) {
+    if (slot.seq == seq) {
+      return &slot;
+    }
+  }
+  return nullptr;
+}
+
+} // namespace zkfp
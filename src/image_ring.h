@@ -0,0 +1,62 @@
+#ifndef ZKFP_IMAGE_RING_H
+#define ZKFP_IMAGE_RING_H
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace zkfp {
+
+// Fixed set of frame buffers the extractor converts into, so the last few
+// engine-ready images stay available without a copy. Readers pin a frame by
+// sequence number; a pinned slot is never reused until every pin is released.
+class ImageRing {
+public:
+  explicit ImageRing(size_t slots);
+
+  ImageRing(const ImageRing &) = delete;
+  ImageRing &operator=(const ImageRing &) = delete;
+
+  // Hands out an unpinned slot with at least `bytes` of room, or nullptr when
+  // every slot is pinned (the caller then converts into its own scratch buffer).
+  // The previous contents of that slot are dropped immediately.
+  uint8_t *BeginWrite(size_t bytes);
+
+  // Publishes the slot from the last BeginWrite and returns its sequence number.
+  uint32_t Commit(uint32_t width, uint32_t height, size_t bytes);
+
+  // Drops the slot from the last BeginWrite without publishing it.
+  void Abort();
+
+  // Pins frame `seq` (0 = newest). Returns the pinned sequence number, or 0 if
+  // the frame has been overwritten or nothing was recorded yet.
+  uint32_t Acquire(uint32_t seq, const uint8_t **data, size_t *bytes, uint32_t *width, uint32_t *height);
+
+  // Unpins a frame returned by Acquire. Returns false for an unknown sequence.
+  bool Release(uint32_t seq);
+
+  uint32_t LastSeq() const;
+
+private:
+  struct Slot {
+    std::vector<uint8_t> data;
+    size_t bytes = 0;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint32_t seq = 0;  // 0 while empty or being written
+    uint32_t refs = 0;
+  };
+
+  Slot *FindLocked(uint32_t seq);
+
+  mutable std::mutex lock_;
+  std::vector<Slot> slots_;
+  size_t next_ = 0;
+  Slot *writing_ = nullptr;
+  uint32_t last_seq_ = 0;
+};
+
+} // namespace zkfp
+
+#endif
@@ -0,0 +1,213 @@
+#include "log.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <system_error>
+#include <thread>
+
+namespace zkfp {
+namespace {
+
+constexpr size_t kRingSlots = 256;  // power of two
+constexpr size_t kLineMax = 192;
+constexpr uint32_t kPerSecond = 200;  // records per level per second
+constexpr auto kIdleWait = std::chrono::milliseconds(100);
+
+const char kLevelTag[] = {'D', 'I', 'W', 'E'};
+
+int64_t NowUs() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::system_clock::now().time_since_epoch())
+      .count();
+}
+
+LogLevel RuntimeLevel() {
+  const char *v = std::getenv("ZKFP_LOG_LEVEL");
+  if (!v || !*v) {
+    return LogLevel::Info;
+  }
+  static const char *const kNames[] = {"debug", "info", "warn", "error", "off"};
+  for (int i = 0; i <= static_cast<int>(LogLevel::Off); ++i) {
+    if (!std::strcmp(v, kNames[i]) || (v[0] == '0' + i && !v[1])) {
+      return static_cast<LogLevel>(i);
+    }
+  }
+  return LogLevel::Info;
+}
+
+// Bounded multi-producer ring with one consumer, the drain thread. A writer
+// claims a slot by advancing head_ and publishes it by bumping the slot's
+// sequence; nothing on the write side takes a lock.
+class LogRing {
+public:
+  LogRing() : level_(RuntimeLevel()) {
+    for (size_t i = 0; i < kRingSlots; ++i) {
+      slots_[i].seq.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  ~LogRing() {
+    if (drain_.joinable()) {
+      stop_.store(true);
+      {
+        std::lock_guard<std::mutex> guard(wait_lock_);
+      }
+      wake_.notify_one();
+      drain_.join();
+    }
+    Flush();
+  }
+
+  LogRing(const LogRing &) = delete;
+  LogRing &operator=(const LogRing &) = delete;
+
+  void Write(LogLevel level, const char *fmt, va_list args) {
+    int lv = static_cast<int>(level);
+    if (level < level_ || !Admit(lv)) {
+      return;
+    }
+    std::call_once(started_, [this] { Start(); });
+
+    uint64_t pos = head_.load(std::memory_order_relaxed);
+    Slot *slot;
+    for (;;) {
+      slot = &slots_[pos & (kRingSlots - 1)];
+      uint64_t seq = slot->seq.load(std::memory_order_acquire);
+      int64_t diff = static_cast<int64_t>(seq - pos);
+      if (diff == 0) {
+        if (head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (diff < 0) {
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        return;
+      } else {
+        pos = head_.load(std::memory_order_relaxed);
+      }
+    }
+    slot->level = lv;
+    slot->time_us = NowUs();
+    std::vsnprintf(slot->text, sizeof(slot->text), fmt, args);
+    slot->seq.store(pos + 1, std::memory_order_release);
+
+    if (sleeping_.load(std::memory_order_acquire)) {
+      wake_.notify_one();
+    }
+  }
+
+private:
+  struct Slot {
+    std::atomic<uint64_t> seq{0};
+    int level = 0;
+    int64_t time_us = 0;
+    char text[kLineMax];
+  };
+
+  // Per-level budget over one-second windows.
+  bool Admit(int lv) {
+    uint64_t now = static_cast<uint64_t>(NowUs() / 1000000);
+    uint64_t window = window_[lv].load(std::memory_order_relaxed);
+    if (window != now && window_[lv].compare_exchange_strong(window, now, std::memory_order_relaxed)) {
+      budget_[lv].store(0, std::memory_order_relaxed);
+    }
+    if (budget_[lv].fetch_add(1, std::memory_order_relaxed) < kPerSecond) {
+      return true;
+    }
+    dropped_.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+
+  void Start() {
+    try {
+      drain_ = std::thread(&LogRing::Run, this);
+    } catch (const std::system_error &) {
+      // Records stay in the ring until it is flushed at exit.
+    }
+  }
+
+  void Run() {
+    while (!stop_.load()) {
+      if (Flush()) {
+        continue;
+      }
+      std::unique_lock<std::mutex> guard(wait_lock_);
+      sleeping_.store(true);
+      wake_.wait_for(guard, kIdleWait, [this] { return stop_.load() || Pending(); });
+      sleeping_.store(false);
+    }
+  }
+
+  bool Pending() const {
+    const Slot &slot = slots_[tail_ & (kRingSlots - 1)];
+    return slot.seq.load(std::memory_order_acquire) == tail_ + 1;
+  }
+
+  // Writes every published record in one stream write; false when there was
+  // nothing to write.
+  bool Flush() {
+    char out[kRingSlots / 4 * (kLineMax + 32)];
+    size_t used = 0;
+    uint64_t dropped = dropped_.exchange(0, std::memory_order_relaxed);
+    if (dropped) {
+      used += std::snprintf(out, sizeof(out), "zkfp W %llu log records dropped\n",
+                            static_cast<unsigned long long>(dropped));
+    }
+    while (Pending() && used + kLineMax + 32 <= sizeof(out)) {
+      Slot &slot = slots_[tail_ & (kRingSlots - 1)];
+      int n = std::snprintf(out + used, sizeof(out) - used, "zkfp %c %lld.%06lld %s\n", kLevelTag[slot.level],
+                            static_cast<long long>(slot.time_us / 1000000),
+                            static_cast<long long>(slot.time_us % 1000000), slot.text);
+      used += std::min(static_cast<size_t>(n), sizeof(out) - used - 1);
+      slot.seq.store(tail_ + kRingSlots, std::memory_order_release);
+      ++tail_;
+    }
+    if (!used) {
+      return false;
+    }
+    std::fwrite(out, 1, used, stderr);
+    std::fflush(stderr);
+    return true;
+  }
+
+  const LogLevel level_;
+  Slot slots_[kRingSlots];
+  std::atomic<uint64_t> head_{0};
+  uint64_t tail_ = 0;  // drain side only
+  std::atomic<uint64_t> dropped_{0};
+  std::atomic<uint64_t> window_[4] = {};
+  std::atomic<uint32_t> budget_[4] = {};
+
+  std::once_flag started_;
+  std::thread drain_;
+  std::atomic<bool> stop_{false};
+  std::atomic<bool> sleeping_{false};
+  std::mutex wait_lock_;
+  std::condition_variable wake_;
+};
+
+LogRing &Ring() {
+  static LogRing ring;
+  return ring;
+}
+
+} // namespace
+
+void LogWrite(LogLevel level, const char *fmt, ...) {
+  if (level >= LogLevel::Off) {
+    return;
+  }
+  va_list args;
+  va_start(args, fmt);
+  Ring().Write(level, fmt, args);
+  va_end(args);
+}
+
+} // namespace zkfp
@@ -0,0 +1,59 @@
+#ifndef ZKFP_LOG_H
+#define ZKFP_LOG_H
+
+namespace zkfp {
+
+enum class LogLevel : int { Debug = 0, Info, Warn, Error, Off };
+
+// Lowest level compiled in. Release builds (NDEBUG) drop Debug sites entirely;
+// -DZKFP_LOG_LEVEL=<0..4> overrides.
+#ifndef ZKFP_LOG_LEVEL
+#ifdef NDEBUG
+#define ZKFP_LOG_LEVEL 1
+#else
+#define ZKFP_LOG_LEVEL 0
+#endif
+#endif
+constexpr LogLevel kLogFloor = static_cast<LogLevel>(ZKFP_LOG_LEVEL);
+
+// Formats one record into the log ring; a background thread writes the ring to
+// stderr, so callers never wait on the stream. Records below the runtime level
+// (ZKFP_LOG_LEVEL in the environment: debug, info, warn, error or off; info by
+// default), past a level's per-second budget, or arriving while the ring is
+// full are dropped, and the drops are counted in the next line written.
+void LogWrite(LogLevel level, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+template <LogLevel L, typename... Args>
+inline void Log(const char *fmt, Args... args) {
+  if constexpr (L >= kLogFloor && L != LogLevel::Off) {
+    if constexpr (sizeof...(Args) == 0) {
+      LogWrite(L, "%s", fmt);
+    } else {
+      LogWrite(L, fmt, args...);
+    }
+  }
+}
+
+template <typename... Args>
+inline void LogDebug(const char *fmt, Args... args) {
+  Log<LogLevel::Debug>(fmt, args...);
+}
+
+template <typename... Args>
+inline void LogInfo(const char *fmt, Args... args) {
+  Log<LogLevel::Info>(fmt, args...);
+}
+
+template <typename... Args>
+inline void LogWarn(const char *fmt, Args... args) {
+  Log<LogLevel::Warn>(fmt, args...);
+}
+
+template <typename... Args>
+inline void LogError(const char *fmt, Args... args) {
+  Log<LogLevel::Error>(fmt, args...);
+}
+
+} // namespace zkfp
+
+#endif
@@ -0,0 +1,298 @@
+#include "prefilter_index.h"
+
+#include "template_codec.h"
+
+#include <algorithm>
+#include <unordered_set>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define ZKFP_PREFILTER_X86 1
+#include <immintrin.h>
+#else
+#define ZKFP_PREFILTER_X86 0
+#endif
+
+namespace zkfp {
+namespace {
+
+constexpr size_t kRecordHeader = 5;
+constexpr size_t kBands = kSketchLanes - 2;
+constexpr uint16_t kFar = 0xFFFF;
+
+// Folds the distance from every row to `probe` into dist[row], keeping the
+// smaller. Lanes stay within +-4095, so a lane difference fits an int16 and
+// the sum saturates at kFar.
+using DistanceKernel = void (*)(const int16_t *const *lanes, const uint32_t *format, size_t rows,
+                                const FingerSketch &probe, uint16_t *dist);
+
+void DistanceScalar(const int16_t *const *lanes, const uint32_t *format, size_t rows, const FingerSketch &probe,
+                    uint16_t *dist) {
+  for (size_t r = 0; r < rows; ++r) {
+    uint32_t d = kFar;
+    if (format[r] == probe.format) {
+      d = 0;
+      for (size_t l = 0; l < kSketchLanes; ++l) {
+        int diff = lanes[l][r] - probe.lane[l];
+        d += static_cast<uint32_t>(diff < 0 ? -diff : diff);
+      }
+    }
+    dist[r] = std::min(dist[r], static_cast<uint16_t>(std::min<uint32_t>(d, kFar)));
+  }
+}
+
+#if ZKFP_PREFILTER_X86
+
+__attribute__((target("avx2"))) void DistanceAvx2(const int16_t *const *lanes, const uint32_t *format, size_t rows,
+                                                  const FingerSketch &probe, uint16_t *dist) {
+  const __m256i want = _mm256_set1_epi32(static_cast<int>(probe.format));
+  const __m256i ones = _mm256_set1_epi32(-1);
+  __m256i p[kSketchLanes];
+  for (size_t l = 0; l < kSketchLanes; ++l) {
+    p[l] = _mm256_set1_epi16(probe.lane[l]);
+  }
+  size_t r = 0;
+  for (; r + 16 <= rows; r += 16) {
+    __m256i acc = _mm256_setzero_si256();
+    for (size_t l = 0; l < kSketchLanes; ++l) {
+      __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(lanes[l] + r));
+      acc = _mm256_adds_epu16(acc, _mm256_abs_epi16(_mm256_sub_epi16(v, p[l])));
+    }
+    // Format matches, narrowed to one 16-bit flag per row; the pack interleaves
+    // 128-bit halves, which the permute puts back in row order.
+    __m256i f0 = _mm256_cmpeq_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(format + r)), want);
+    __m256i f1 = _mm256_cmpeq_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(format + r + 8)), want);
+    __m256i same = _mm256_permute4x64_epi64(_mm256_packs_epi32(f0, f1), 0xD8);
+    acc = _mm256_or_si256(acc, _mm256_andnot_si256(same, ones));
+    __m256i *out = reinterpret_cast<__m256i *>(dist + r);
+    _mm256_storeu_si256(out, _mm256_min_epu16(_mm256_loadu_si256(out), acc));
+  }
+  if (r < rows) {
+    const int16_t *tail[kSketchLanes];
+    for (size_t l = 0; l < kSketchLanes; ++l) {
+      tail[l] = lanes[l] + r;
+    }
+    DistanceScalar(tail, format + r, rows - r, probe, dist + r);
+  }
+}
+
+#endif
+
+struct Kernel {
+  DistanceKernel fn;
+  const char *name;
+};
+
+Kernel PickKernel() {
+#if ZKFP_PREFILTER_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return {DistanceAvx2, "avx2"};
+  }
+#endif
+  return {DistanceScalar, "scalar"};
+}
+
+const Kernel &ActiveKernel() {
+  static const Kernel kernel = PickKernel();
+  return kernel;
+}
+
+} // namespace
+
+size_t SketchTemplate(const uint8_t *templ, size_t max_len, FingerSketch *out, size_t max_out) {
+  uint8_t header[kTemplateHeaderLen];
+  uint8_t key[kTemplateKeyLen];
+  if (!templ || !PeekTemplate(templ, max_len, header, key)) {
+    return 0;
+  }
+  auto byte = [&](size_t at) { return static_cast<uint8_t>(templ[at] ^ key[at % kTemplateKeyLen]); };
+  size_t len = (static_cast<size_t>(header[8]) << 8) | header[9];
+  size_t fingers = header[10];
+  if (fingers > max_out) {
+    return 0;
+  }
+  uint32_t format = (static_cast<uint32_t>(header[20]) << 24) | (static_cast<uint32_t>(header[21]) << 16) |
+                    (static_cast<uint32_t>(header[22]) << 8) | header[23];
+
+  size_t at = kTemplateHeaderLen;
+  for (size_t f = 0; f < fingers; ++f) {
+    if (at + kRecordHeader > len) {
+      return 0;
+    }
+    size_t size = (static_cast<size_t>(byte(at + 3) & 0xF) << 8) | byte(at + 4);
+    if (size < kRecordHeader || at + size > len) {
+      return 0;
+    }
+    FingerSketch &s = out[f];
+    s.format = format;
+    s.lane[0] = static_cast<int16_t>(size >> 2);
+    s.lane[1] = static_cast<int16_t>(byte(at + 1) >> 2);
+    size_t body = size - kRecordHeader;
+    for (size_t b = 0; b < kBands; ++b) {
+      size_t from = body * b / kBands;
+      size_t to = body * (b + 1) / kBands;
+      int sum = 0;
+      for (size_t i = from; i < to; ++i) {
+        sum += static_cast<int8_t>(byte(at + kRecordHeader + i));
+      }
+      s.lane[2 + b] = static_cast<int16_t>(to > from ? sum * 4 / static_cast<int>(to - from) : 0);
+    }
+    at += size;
+  }
+  return fingers;
+}
+
+void PrefilterIndex::Reset(bool ready) {
+  std::lock_guard<std::mutex> guard(lock_);
+  ready_ = ready;
+  fid_.clear();
+  format_.clear();
+  for (std::vector<int16_t> &lane : lanes_) {
+    lane.clear();
+  }
+  rows_.clear();
+}
+
+bool PrefilterIndex::Ready() {
+  std::lock_guard<std::mutex> guard(lock_);
+  return ready_;
+}
+
+void PrefilterIndex::Put(uint32_t fid, const FingerSketch *sketches, size_t count) {
+  std::lock_guard<std::mutex> guard(lock_);
+  if (!ready_) {
+    return;
+  }
+  RemoveLocked(fid);
+  if (!count) {
+    return;
+  }
+  std::vector<uint32_t> &rows = rows_[fid];
+  for (size_t i = 0; i < count; ++i) {
+    rows.push_back(static_cast<uint32_t>(fid_.size()));
+    fid_.push_back(fid);
+    format_.push_back(sketches[i].format);
+    for (size_t l = 0; l < kSketchLanes; ++l) {
+      lanes_[l].push_back(sketches[i].lane[l]);
+    }
+  }
+}
+
+void PrefilterIndex::Remove(uint32_t fid) {
+  std::lock_guard<std::mutex> guard(lock_);
+  RemoveLocked(fid);
+}
+
+size_t PrefilterIndex::Users() {
+  std::lock_guard<std::mutex> guard(lock_);
+  return rows_.size();
+}
+
+// Each row of `fid` is filled from the last row, highest first so the rows
+// still to go never move.
+void PrefilterIndex::RemoveLocked(uint32_t fid) {
+  auto it = rows_.find(fid);
+  if (it == rows_.end()) {
+    return;
+  }
+  std::vector<uint32_t> gone = std::move(it->second);
+  rows_.erase(it);
+  std::sort(gone.begin(), gone.end(), [](uint32_t a, uint32_t b) { return a > b; });
+  for (uint32_t row : gone) {
+    size_t last = fid_.size() - 1;
+    if (row != last) {
+      uint32_t moved = fid_[last];
+      fid_[row] = moved;
+      format_[row] = format_[last];
+      for (std::vector<int16_t> &lane : lanes_) {
+        lane[row] = lane[last];
+      }
+      std::vector<uint32_t> &rows = rows_[moved];
+      *std::find(rows.begin(), rows.end(), static_cast<uint32_t>(last)) = row;
+    }
+    fid_.pop_back();
+    format_.pop_back();
+    for (std::vector<int16_t> &lane : lanes_) {
+      lane.pop_back();
+    }
+  }
+}
+
+bool PrefilterIndex::Candidates(const FingerSketch *probe, size_t count, size_t keep, std::vector<uint32_t> *out) {
+  out->clear();
+  std::lock_guard<std::mutex> guard(lock_);
+  if (!ready_) {
+    return false;
+  }
+  size_t rows = fid_.size();
+  if (!rows || !keep) {
+    return true;
+  }
+  dist_.assign(rows, kFar);
+  const int16_t *lanes[kSketchLanes];
+  for (size_t l = 0; l < kSketchLanes; ++l) {
+    lanes[l] = lanes_[l].data();
+  }
+  DistanceKernel kernel = ActiveKernel().fn;
+  for (size_t i = 0; i < count; ++i) {
+    kernel(lanes, format_.data(), rows, probe[i], dist_.data());
+  }
+
+  // A fid with several fingers takes several of the nearest rows, so widen the
+  // selection until it holds `keep` distinct fids.
+  bool one_each = rows_.size() == rows;
+  std::unordered_set<uint32_t> seen;
+  for (size_t take = std::min(keep, rows);; take = std::min(take * 2, rows)) {
+    SelectNearestLocked(take);
+    if (!one_each) {
+      std::sort(order_.begin(), order_.end());
+    }
+    out->clear();
+    seen.clear();
+    for (size_t i = 0; i < order_.size() && out->size() < keep; ++i) {
+      uint32_t fid = static_cast<uint32_t>(order_[i]);
+      if (one_each || seen.insert(fid).second) {
+        out->push_back(fid);
+      }
+    }
+    if (out->size() == keep || take == rows) {
+      return true;
+    }
+  }
+}
+
+// Leaves the (distance, fid) keys of the `take` nearest rows in order_. A
+// histogram of the distances finds the bin the cut falls in, so only that
+// bin's rows need ranking.
+void PrefilterIndex::SelectNearestLocked(size_t take) {
+  constexpr int kShift = 6;
+  uint32_t hist[(kFar >> kShift) + 1] = {};
+  size_t rows = dist_.size();
+  for (size_t r = 0; r < rows; ++r) {
+    ++hist[dist_[r] >> kShift];
+  }
+  size_t below = 0;
+  uint32_t cut = 0;
+  while (below + hist[cut] < take) {
+    below += hist[cut++];
+  }
+
+  order_.clear();
+  edge_.clear();
+  for (size_t r = 0; r < rows; ++r) {
+    uint32_t bin = dist_[r] >> kShift;
+    if (bin <= cut) {
+      uint64_t key = (static_cast<uint64_t>(dist_[r]) << 32) | fid_[r];
+      (bin < cut ? order_ : edge_).push_back(key);
+    }
+  }
+  size_t rest = take - below;
+  std::nth_element(edge_.begin(), edge_.begin() + static_cast<std::ptrdiff_t>(rest - 1), edge_.end());
+  order_.insert(order_.end(), edge_.begin(), edge_.begin() + static_cast<std::ptrdiff_t>(rest));
+}
+
+const char *PrefilterKernel() {
+  return ActiveKernel().name;
+}
+
+} // namespace zkfp
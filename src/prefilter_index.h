@@ -0,0 +1,69 @@
+#ifndef ZKFP_PREFILTER_INDEX_H
+#define ZKFP_PREFILTER_INDEX_H
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace zkfp {
+
+// Coarse description of one finger record, cheap to compare: the record's
+// length and quality, then the mean of each of 14 equal bands of its minutiae
+// bytes (read as signed). `format` is header bytes 20..23; fingers of different
+// formats are never close.
+constexpr size_t kSketchLanes = 16;
+
+struct FingerSketch {
+  uint32_t format;
+  int16_t lane[kSketchLanes];
+};
+
+// Sketches every finger record of an encoded or decoded template into `out`.
+// Returns the finger count, or 0 when the template is invalid or has more than
+// `max_out` fingers.
+size_t SketchTemplate(const uint8_t *templ, size_t max_len, FingerSketch *out, size_t max_out);
+
+// Sketches of every enrolled finger, mirrored from the wrapper's add/delete
+// paths like the finger index, and kept column by column: one array per lane,
+// so a 1:N pre-screen streams 16 fingers per vector step and only the nearest
+// candidates go on to full matching. Until Reset(true) the index is not ready
+// and Candidates fails.
+class PrefilterIndex {
+public:
+  // Empties the index; `ready` says the engine is known to be empty too.
+  void Reset(bool ready);
+  bool Ready();
+
+  // Replaces `fid`'s fingers with `count` sketches.
+  void Put(uint32_t fid, const FingerSketch *sketches, size_t count);
+  void Remove(uint32_t fid);
+  size_t Users();
+
+  // The `keep` fids, or all there are, whose nearest finger lies closest (L1
+  // over the lanes) to any of the probe's `count` fingers, ties to the lower
+  // fid, in no particular order. False when the index cannot tell.
+  bool Candidates(const FingerSketch *probe, size_t count, size_t keep, std::vector<uint32_t> *out);
+
+private:
+  void RemoveLocked(uint32_t fid);
+  void SelectNearestLocked(size_t take);
+
+  std::mutex lock_;
+  bool ready_ = false;
+  std::vector<uint32_t> fid_;
+  std::vector<uint32_t> format_;
+  std::vector<int16_t> lanes_[kSketchLanes];
+  std::unordered_map<uint32_t, std::vector<uint32_t>> rows_;  // fid -> its rows
+  std::vector<uint16_t> dist_;                                // Candidates scratch
+  std::vector<uint64_t> order_;
+  std::vector<uint64_t> edge_;
+};
+
+// Name of the distance kernel picked at runtime ("avx2" or "scalar").
+const char *PrefilterKernel();
+
+} // namespace zkfp
+
+#endif
@@ -0,0 +1,208 @@
+#include "shard_gallery.h"
+
+#include <atomic>
+#include <mutex>
+
+namespace zkfp {
+namespace {
+
+struct ShardBest {
+  uint32_t fid = 0;
+  int score = 0;
+};
+
+bool Better(int score, uint32_t fid, const ShardBest &best) {
+  return score > best.score || (score == best.score && score > 0 && fid < best.fid);
+}
+
+} // namespace
+
+ShardedGallery::~ShardedGallery() {
+  std::unique_lock<std::shared_mutex> guard(lock_);
+  ClearLocked();
+}
+
+void ShardedGallery::Configure(size_t threads, size_t shards) {
+  std::unique_lock<std::shared_mutex> guard(lock_);
+  if (!threads) {
+    ClearLocked();
+    enabled_ = false;
+    ready_ = false;
+    pool_.Resize(1);
+    return;
+  }
+  pool_.Resize(threads);
+  if (!enabled_) {
+    enabled_ = true;
+    ready_ = false;
+  }
+  ReshardLocked(shards ? shards : pool_.Participants());
+}
+
+bool ShardedGallery::Enabled() {
+  std::shared_lock<std::shared_mutex> guard(lock_);
+  return enabled_;
+}
+
+void ShardedGallery::Reset(bool ready) {
+  std::unique_lock<std::shared_mutex> guard(lock_);
+  ClearLocked();
+  ready_ = enabled_ && ready;
+}
+
+void ShardedGallery::Put(uint32_t fid) {
+  std::unique_lock<std::shared_mutex> guard(lock_);
+  if (!enabled_ || !ready_) {
+    return;
+  }
+  auto it = where_.find(fid);
+  void *user = it != where_.end() ? shards_[it->second.shard][it->second.pos].user : engine_.init_user();
+  if (user && !engine_.load_user(user, fid)) {
+    if (it == where_.end()) {
+      AddLocked(fid, user);
+    }
+    return;
+  }
+  // The engine copy cannot be read back: drop this one and rebuild later.
+  if (user && it == where_.end()) {
+    engine_.free_user(user);
+  }
+  ClearLocked();
+  ready_ = false;
+}
+
+void ShardedGallery::Remove(uint32_t fid) {
+  std::unique_lock<std::shared_mutex> guard(lock_);
+  RemoveLocked(fid);
+}
+
+bool ShardedGallery::Search(void *probe, int stop_at, uint32_t *fid, int *score) {
+  *fid = 0;
+  *score = 0;
+  std::shared_lock<std::shared_mutex> shared(lock_);
+  while (!ready_) {
+    if (!enabled_) {
+      return false;
+    }
+    shared.unlock();
+    {
+      std::unique_lock<std::shared_mutex> guard(lock_);
+      if (enabled_ && !ready_ && !SeedLocked()) {
+        return false;
+      }
+    }
+    shared.lock();
+  }
+
+  struct Job {
+    const ShardedGallery *gallery;
+    void *probe;
+    int stop_at;
+    std::atomic<bool> stop;
+    ShardBest *best;
+  };
+  std::vector<ShardBest> best(shards_.size());
+  Job job{this, probe, stop_at, {false}, best.data()};
+  pool_.Run(
+      shards_.size(),
+      [](void *arg, size_t shard) {
+        auto *job = static_cast<Job *>(arg);
+        ShardBest &out = job->best[shard];
+        for (const Entry &e : job->gallery->shards_[shard]) {
+          if (job->stop.load(std::memory_order_relaxed)) {
+            return;
+          }
+          int s = 0;
+          if (!job->gallery->engine_.match(job->probe, e.user, &s) && Better(s, e.fid, out)) {
+            out.score = s;
+            out.fid = e.fid;
+            if (job->stop_at && s >= job->stop_at) {
+              job->stop.store(true, std::memory_order_relaxed);
+            }
+          }
+        }
+      },
+      &job);
+
+  ShardBest merged;
+  for (const ShardBest &b : best) {
+    if (Better(b.score, b.fid, merged)) {
+      merged = b;
+    }
+  }
+  *fid = merged.fid;
+  *score = merged.score;
+  return true;
+}
+
+void ShardedGallery::ClearLocked() {
+  for (std::vector<Entry> &shard : shards_) {
+    for (const Entry &e : shard) {
+      engine_.free_user(e.user);
+    }
+    shard.clear();
+  }
+  where_.clear();
+}
+
+void ShardedGallery::AddLocked(uint32_t fid, void *user) {
+  uint32_t shard = static_cast<uint32_t>(fid % shards_.size());
+  where_[fid] = {shard, static_cast<uint32_t>(shards_[shard].size())};
+  shards_[shard].push_back({fid, user});
+}
+
+void ShardedGallery::RemoveLocked(uint32_t fid) {
+  auto it = where_.find(fid);
+  if (it == where_.end()) {
+    return;
+  }
+  std::vector<Entry> &shard = shards_[it->second.shard];
+  uint32_t pos = it->second.pos;
+  engine_.free_user(shard[pos].user);
+  if (pos + 1 != shard.size()) {
+    shard[pos] = shard.back();
+    where_[shard[pos].fid].pos = pos;
+  }
+  shard.pop_back();
+  where_.erase(it);
+}
+
+void ShardedGallery::ReshardLocked(size_t shards) {
+  if (shards == shards_.size()) {
+    return;
+  }
+  std::vector<std::vector<Entry>> old;
+  old.swap(shards_);
+  shards_.resize(shards);
+  where_.clear();
+  for (const std::vector<Entry> &shard : old) {
+    for (const Entry &e : shard) {
+      AddLocked(e.fid, e.user);
+    }
+  }
+}
+
+bool ShardedGallery::SeedLocked() {
+  ClearLocked();
+  std::vector<uint32_t> fids;
+  if (engine_.list_users(&fids)) {
+    return false;
+  }
+  for (uint32_t fid : fids) {
+    void *user = engine_.init_user();
+    if (!user) {
+      ClearLocked();
+      return false;
+    }
+    if (engine_.load_user(user, fid)) {
+      engine_.free_user(user);
+      ClearLocked();
+      return false;
+    }
+    AddLocked(fid, user);
+  }
+  ready_ = true;
+  return true;
+}
+
+} // namespace zkfp
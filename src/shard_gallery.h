@@ -0,0 +1,85 @@
+#ifndef ZKFP_SHARD_GALLERY_H
+#define ZKFP_SHARD_GALLERY_H
+
+#include "worker_pool.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <shared_mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace zkfp {
+
+// Engine entry points the gallery works through; each returns 0 on success.
+struct GalleryEngine {
+  void *(*init_user)();
+  void (*free_user)(void *user);
+  int (*load_user)(void *user, uint32_t fid);  // replaces `user` with enrolled `fid`
+  int (*list_users)(std::vector<uint32_t> *fids);
+  int (*match)(void *probe, void *user, int *score);
+};
+
+// The wrapper's own copy of every enrolled fid as an engine user, split by fid
+// into shards that a 1:N search scores in parallel on a WorkerPool with the
+// engine's pairwise matcher, merging the per-shard bests.
+//
+// The gallery is off until Configure gives it workers. While on, it follows the
+// DB_* entry points through Put and Remove; after Reset(false) it is rebuilt
+// from the engine on the next search.
+class ShardedGallery {
+public:
+  explicit ShardedGallery(const GalleryEngine &engine) : engine_(engine) {}
+  ~ShardedGallery();
+
+  ShardedGallery(const ShardedGallery &) = delete;
+  ShardedGallery &operator=(const ShardedGallery &) = delete;
+
+  // `threads` searching (0 turns the gallery off and frees it) over `shards`
+  // shards (0 = one per thread). More shards than threads gives idle threads
+  // something to steal.
+  void Configure(size_t threads, size_t shards);
+  bool Enabled();
+
+  // Empties the gallery; `ready` says the engine holds no users either.
+  void Reset(bool ready);
+  // Loads `fid` from the engine, replacing the gallery's copy. A gallery that
+  // is off or not ready ignores it.
+  void Put(uint32_t fid);
+  void Remove(uint32_t fid);
+
+  // Best enrolled match for `probe`; ties go to the lower fid, and `fid` is 0
+  // when nothing scored. Once any shard scores `stop_at` or more (0 = never)
+  // the other shards stop too, and the best found so far is returned. False
+  // when the gallery is off or cannot be built, in which case the caller
+  // searches through the engine.
+  bool Search(void *probe, int stop_at, uint32_t *fid, int *score);
+
+private:
+  struct Entry {
+    uint32_t fid;
+    void *user;
+  };
+  struct Slot {
+    uint32_t shard;
+    uint32_t pos;
+  };
+
+  void ClearLocked();
+  void AddLocked(uint32_t fid, void *user);
+  void RemoveLocked(uint32_t fid);
+  void ReshardLocked(size_t shards);
+  bool SeedLocked();
+
+  GalleryEngine engine_;
+  std::shared_mutex lock_;  // shared while searching, exclusive to change entries
+  bool enabled_ = false;
+  bool ready_ = false;
+  std::vector<std::vector<Entry>> shards_;
+  std::unordered_map<uint32_t, Slot> where_;
+  WorkerPool pool_;
+};
+
+} // namespace zkfp
+
+#endif
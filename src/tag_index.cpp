@@ -0,0 +1,60 @@
+#include "tag_index.h"
+
+#include <algorithm>
+
+namespace zkfp {
+
+void TagIndex::Reset(bool ready) {
+  std::lock_guard<std::mutex> guard(lock_);
+  partitions_.clear();
+  tags_.clear();
+  ready_ = ready;
+}
+
+void TagIndex::Add(uint32_t fid, const std::string &tag) {
+  std::lock_guard<std::mutex> guard(lock_);
+  if (!ready_) {
+    return;
+  }
+  std::vector<std::string> &own = tags_[fid];
+  if (std::find(own.begin(), own.end(), tag) != own.end()) {
+    return;
+  }
+  own.push_back(tag);
+  partitions_[tag].push_back(fid);
+}
+
+void TagIndex::Remove(uint32_t fid) {
+  std::lock_guard<std::mutex> guard(lock_);
+  auto it = tags_.find(fid);
+  if (it == tags_.end()) {
+    return;
+  }
+  for (const std::string &tag : it->second) {
+    auto part = partitions_.find(tag);
+    if (part == partitions_.end()) {
+      continue;
+    }
+    std::vector<uint32_t> &members = part->second;
+    members.erase(std::find(members.begin(), members.end(), fid));
+    if (members.empty()) {
+      partitions_.erase(part);
+    }
+  }
+  tags_.erase(it);
+}
+
+bool TagIndex::Members(const std::string &tag, std::vector<uint32_t> *out) {
+  out->clear();
+  std::lock_guard<std::mutex> guard(lock_);
+  if (!ready_) {
+    return false;
+  }
+  auto it = partitions_.find(tag);
+  if (it != partitions_.end()) {
+    out->assign(it->second.begin(), it->second.end());
+  }
+  return true;
+}
+
+} // namespace zkfp
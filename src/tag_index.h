@@ -0,0 +1,38 @@
+#ifndef ZKFP_TAG_INDEX_H
+#define ZKFP_TAG_INDEX_H
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace zkfp {
+
+// Members of each string tag (a group, door or site), mirrored from the
+// wrapper's tag and delete paths so a tagged 1:N search only visits its own
+// partition. A user may carry several tags. Until Reset(true) the index is not
+// ready and Members always fails, leaving the search to the engine's tag query.
+class TagIndex {
+public:
+  // Empties the index; `ready` says the engine holds no tagged users either.
+  void Reset(bool ready);
+
+  void Add(uint32_t fid, const std::string &tag);
+  // Takes `fid` out of every partition.
+  void Remove(uint32_t fid);
+
+  // Copies the partition into `out`, in tagging order; an unknown tag is empty.
+  // False when the index cannot tell.
+  bool Members(const std::string &tag, std::vector<uint32_t> *out);
+
+private:
+  std::mutex lock_;
+  bool ready_ = false;
+  std::unordered_map<std::string, std::vector<uint32_t>> partitions_;
+  std::unordered_map<uint32_t, std::vector<std::string>> tags_;  // fid -> its partitions
+};
+
+} // namespace zkfp
+
+#endif
@@ -0,0 +1,117 @@
+#include "template_cache.h"
+
+#include "crc32c.h"
+
+#include <cstring>
+
+namespace zkfp {
+namespace {
+
+uint64_t TemplateKey(const uint8_t *templ, size_t len) {
+  return (static_cast<uint64_t>(len) << 32) | Crc32c(0, templ, len);
+}
+
+} // namespace
+
+TemplateCache::TemplateCache(InitUserFn init_user, FreeUserFn free_user)
+    : init_user_(init_user), free_user_(free_user) {}
+
+TemplateCache::~TemplateCache() {
+  SetCapacity(0);
+}
+
+void TemplateCache::SetCapacity(size_t entries) {
+  std::vector<void *> freed;
+  {
+    std::lock_guard<std::mutex> guard(lock_);
+    capacity_ = entries;
+    EvictOverflowLocked(&freed);
+  }
+  for (void *user : freed) {
+    free_user_(user);
+  }
+}
+
+void *TemplateCache::Take(const uint8_t *templ, size_t len, bool *hit) {
+  *hit = false;
+  uint64_t key = TemplateKey(templ, len);
+  {
+    std::lock_guard<std::mutex> guard(lock_);
+    if (!capacity_) {
+      return nullptr;
+    }
+    auto it = index_.find(key);
+    if (it != index_.end() && it->second->templ.size() == len && !std::memcmp(it->second->templ.data(), templ, len)) {
+      void *user = it->second->user;
+      lru_.erase(it->second);
+      index_.erase(it);
+      ++hits_;
+      *hit = true;
+      return user;
+    }
+    ++misses_;
+    // A full cache recycles its oldest user for the import instead of
+    // allocating; the entry is lost either way once this one is put back.
+    if (lru_.size() >= capacity_ && !lru_.empty()) {
+      Entry &oldest = lru_.back();
+      void *user = oldest.user;
+      index_.erase(oldest.key);
+      lru_.pop_back();
+      return user;
+    }
+  }
+  return init_user_();
+}
+
+void TemplateCache::Put(const uint8_t *templ, size_t len, void *user) {
+  uint64_t key = TemplateKey(templ, len);
+  std::vector<void *> freed;
+  {
+    std::lock_guard<std::mutex> guard(lock_);
+    if (!capacity_ || index_.count(key)) {
+      // Turned off meanwhile, or another thread imported the same template.
+      freed.push_back(user);
+    } else {
+      lru_.push_front(Entry{key, std::vector<uint8_t>(templ, templ + len), user});
+      index_[key] = lru_.begin();
+      EvictOverflowLocked(&freed);
+    }
+  }
+  for (void *u : freed) {
+    free_user_(u);
+  }
+}
+
+void TemplateCache::Discard(void *user) {
+  if (user) {
+    free_user_(user);
+  }
+}
+
+uint64_t TemplateCache::Hits(bool reset) {
+  std::lock_guard<std::mutex> guard(lock_);
+  uint64_t v = hits_;
+  if (reset) {
+    hits_ = 0;
+  }
+  return v;
+}
+
+uint64_t TemplateCache::Misses(bool reset) {
+  std::lock_guard<std::mutex> guard(lock_);
+  uint64_t v = misses_;
+  if (reset) {
+    misses_ = 0;
+  }
+  return v;
+}
+
+void TemplateCache::EvictOverflowLocked(std::vector<void *> *freed) {
+  while (lru_.size() > capacity_) {
+    freed->push_back(lru_.back().user);
+    index_.erase(lru_.back().key);
+    lru_.pop_back();
+  }
+}
+
+} // namespace zkfp
@@ -0,0 +1,65 @@
+#ifndef ZKFP_TEMPLATE_CACHE_H
+#define ZKFP_TEMPLATE_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace zkfp {
+
+// Bounded LRU of engine users that already hold an imported template, keyed by
+// a CRC-32C of the encoded template bytes (and compared in full on a hit).
+// Users are handed out exclusively: Take removes the entry, and Put returns it
+// as most recently used once the match is done, so two threads never share one.
+class TemplateCache {
+public:
+  using InitUserFn = void *(*)();
+  using FreeUserFn = void (*)(void *user);
+
+  TemplateCache(InitUserFn init_user, FreeUserFn free_user);
+  ~TemplateCache();
+
+  TemplateCache(const TemplateCache &) = delete;
+  TemplateCache &operator=(const TemplateCache &) = delete;
+
+  // 0 turns the cache off and frees every entry.
+  void SetCapacity(size_t entries);
+
+  // With the cache off returns nullptr. Otherwise returns the user holding
+  // `templ` (*hit = true), or a cleared-out user to import it into: the evicted
+  // least recently used one or a new one.
+  void *Take(const uint8_t *templ, size_t len, bool *hit);
+  // Returns a user from Take that now holds `templ`.
+  void Put(const uint8_t *templ, size_t len, void *user);
+  // Returns a user from Take whose import failed.
+  void Discard(void *user);
+
+  uint64_t Hits(bool reset);
+  uint64_t Misses(bool reset);
+
+private:
+  struct Entry {
+    uint64_t key;
+    std::vector<uint8_t> templ;
+    void *user;
+  };
+
+  void EvictOverflowLocked(std::vector<void *> *freed);
+
+  InitUserFn init_user_;
+  FreeUserFn free_user_;
+
+  std::mutex lock_;
+  size_t capacity_ = 0;
+  std::list<Entry> lru_;  // most recently used first
+  std::unordered_map<uint64_t, std::list<Entry>::iterator> index_;
+  uint64_t hits_ = 0;
+  uint64_t misses_ = 0;
+};
+
+} // namespace zkfp
+
+#endif
@@ -0,0 +1,269 @@
+#include "template_codec.h"
+
+#include <cstring>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define ZKFP_TEMPLATE_CODEC_X86 1
+#include <immintrin.h>
+#else
+#define ZKFP_TEMPLATE_CODEC_X86 0
+#endif
+
+namespace zkfp {
+namespace {
+
+constexpr char kMagic[5] = {'I', 'C', 'R', 'S', '2'};
+constexpr size_t kKeyOffset = 8;
+
+// Smallest run of keystream that is a whole number of keys and of 32-byte
+// vectors, so the kernels can walk it with aligned-to-block offsets.
+constexpr size_t kBlock = 160;
+
+// XORs `len` bytes of `src` with the keystream into `dst`, which may be `src`.
+using XorKernel = void (*)(const uint8_t *src, uint8_t *dst, size_t len, const uint8_t *ks);
+
+unsigned int HeaderLength(const uint8_t *t) {
+  return (static_cast<unsigned int>(t[8]) << 8) | t[9];
+}
+
+uint8_t KeyStep(uint8_t prev, size_t i) {
+  uint8_t v = static_cast<uint8_t>(prev ^ i);
+  return static_cast<uint8_t>(v + v % 5);
+}
+
+// Undoes the chaining of the stored key for its first `n` bytes.
+void UnchainKey(const uint8_t *stored, uint8_t *key, size_t n) {
+  key[0] = stored[0];
+  key[1] = stored[1];
+  for (size_t i = 2; i < n; ++i) {
+    key[i] = stored[i] ^ KeyStep(key[i - 1], i);
+  }
+}
+
+void ChainKey(const uint8_t *key, uint8_t *stored) {
+  stored[0] = key[0];
+  stored[1] = key[1];
+  for (size_t i = 2; i < kTemplateKeyLen; ++i) {
+    stored[i] = key[i] ^ KeyStep(key[i - 1], i);
+  }
+}
+
+void FillKeystream(const uint8_t *key, uint8_t *ks) {
+  for (size_t i = 0; i < kBlock; i += kTemplateKeyLen) {
+    std::memcpy(ks + i, key, kTemplateKeyLen);
+  }
+}
+
+void XorWord(const uint8_t *src, uint8_t *dst, size_t len, const uint8_t *ks) {
+  size_t i = 0;
+  for (; i + kBlock <= len; i += kBlock) {
+    for (size_t j = 0; j < kBlock; j += 8) {
+      uint64_t a;
+      uint64_t b;
+      std::memcpy(&a, src + i + j, 8);
+      std::memcpy(&b, ks + j, 8);
+      a ^= b;
+      std::memcpy(dst + i + j, &a, 8);
+    }
+  }
+  size_t j = 0;
+  for (; i + 8 <= len; i += 8, j += 8) {
+    uint64_t a;
+    uint64_t b;
+    std::memcpy(&a, src + i, 8);
+    std::memcpy(&b, ks + j, 8);
+    a ^= b;
+    std::memcpy(dst + i, &a, 8);
+  }
+  for (; i < len; ++i, ++j) {
+    dst[i] = src[i] ^ ks[j];
+  }
+}
+
+#if ZKFP_TEMPLATE_CODEC_X86
+
+__attribute__((target("avx2"))) void XorAvx2(const uint8_t *src, uint8_t *dst, size_t len, const uint8_t *ks) {
+  const __m256i k0 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(ks));
+  const __m256i k1 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(ks + 32));
+  const __m256i k2 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(ks + 64));
+  const __m256i k3 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(ks + 96));
+  const __m256i k4 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(ks + 128));
+  size_t i = 0;
+  for (; i + kBlock <= len; i += kBlock) {
+    const auto *in = reinterpret_cast<const __m256i *>(src + i);
+    auto *out = reinterpret_cast<__m256i *>(dst + i);
+    _mm256_storeu_si256(out + 0, _mm256_xor_si256(_mm256_loadu_si256(in + 0), k0));
+    _mm256_storeu_si256(out + 1, _mm256_xor_si256(_mm256_loadu_si256(in + 1), k1));
+    _mm256_storeu_si256(out + 2, _mm256_xor_si256(_mm256_loadu_si256(in + 2), k2));
+    _mm256_storeu_si256(out + 3, _mm256_xor_si256(_mm256_loadu_si256(in + 3), k3));
+    _mm256_storeu_si256(out + 4, _mm256_xor_si256(_mm256_loadu_si256(in + 4), k4));
+  }
+  // The tail starts on a block boundary, so it lines up with ks[0]. GCC emits
+  // no vzeroupper ahead of the tail call, and the dirty upper halves would
+  // stall the caller's next SSE instruction.
+  _mm256_zeroupper();
+  XorWord(src + i, dst + i, len - i, ks);
+}
+
+#endif
+
+struct Kernel {
+  XorKernel fn;
+  const char *name;
+};
+
+Kernel PickKernel() {
+#if ZKFP_TEMPLATE_CODEC_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return {XorAvx2, "avx2"};
+  }
+#endif
+  return {XorWord, "word"};
+}
+
+const Kernel &ActiveKernel() {
+  static const Kernel kernel = PickKernel();
+  return kernel;
+}
+
+void XorKeystream(const uint8_t *src, uint8_t *dst, size_t len, const uint8_t *key) {
+  alignas(32) uint8_t ks[kBlock];
+  FillKeystream(key, ks);
+  ActiveKernel().fn(src, dst, len, ks);
+}
+
+} // namespace
+
+bool DecodeTemplate(uint8_t *templ, size_t max_len) {
+  if (!templ) {
+    return false;
+  }
+  if (!std::memcmp(templ, kMagic, sizeof(kMagic))) {
+    return true;
+  }
+  size_t len = HeaderLength(templ);
+  if (len < 50 || len > max_len) {
+    return false;
+  }
+  uint8_t key[kTemplateKeyLen];
+  UnchainKey(templ + kKeyOffset, key, kTemplateKeyLen);
+  for (size_t i = 0; i < sizeof(kMagic); ++i) {
+    if ((templ[i] ^ key[i]) != static_cast<uint8_t>(kMagic[i])) {
+      return false;
+    }
+  }
+  XorKeystream(templ, templ, len, key);
+  std::memcpy(templ + kKeyOffset, key, kTemplateKeyLen);
+  return true;
+}
+
+bool EncodeTemplate(uint8_t *templ, size_t max_len) {
+  if (!templ || std::memcmp(templ, kMagic, sizeof(kMagic))) {
+    return false;
+  }
+  size_t len = HeaderLength(templ);
+  if (len < kTemplateHeaderLen || len > max_len) {
+    return false;
+  }
+  uint8_t key[kTemplateKeyLen];
+  std::memcpy(key, templ + kKeyOffset, kTemplateKeyLen);
+  XorKeystream(templ, templ, len, key);
+  ChainKey(key, templ + kKeyOffset);
+  return true;
+}
+
+size_t DecodeTemplates(uint8_t *const *templs, size_t count, size_t max_len, bool *ok) {
+  size_t decoded = 0;
+  for (size_t i = 0; i < count; ++i) {
+    if (i + 1 < count && templs[i + 1]) {
+      __builtin_prefetch(templs[i + 1], 1);
+    }
+    bool done = DecodeTemplate(templs[i], max_len);
+    if (ok) {
+      ok[i] = done;
+    }
+    decoded += done;
+  }
+  return decoded;
+}
+
+unsigned int TemplateLength(const uint8_t *templ, size_t max_len) {
+  if (!templ) {
+    return 0;
+  }
+  unsigned int len = HeaderLength(templ);
+  if (!std::memcmp(templ, kMagic, sizeof(kMagic))) {
+    return len;
+  }
+  if (len < 50 || len > max_len) {
+    return 0;
+  }
+  uint8_t key[sizeof(kMagic)];
+  UnchainKey(templ + kKeyOffset, key, sizeof(key));
+  for (size_t i = 0; i < sizeof(kMagic); ++i) {
+    if ((templ[i] ^ key[i]) != static_cast<uint8_t>(kMagic[i])) {
+      return 0;
+    }
+  }
+  return len;
+}
+
+bool PeekTemplate(const uint8_t *templ, size_t max_len, uint8_t *header, uint8_t *key) {
+  if (!templ) {
+    return false;
+  }
+  size_t len = HeaderLength(templ);
+  if (!std::memcmp(templ, kMagic, sizeof(kMagic))) {
+    if (len < kTemplateHeaderLen || len > max_len) {
+      return false;
+    }
+    std::memcpy(header, templ, kTemplateHeaderLen);
+    std::memset(key, 0, kTemplateKeyLen);
+    return true;
+  }
+  if (len < 50 || len > max_len) {
+    return false;
+  }
+  UnchainKey(templ + kKeyOffset, key, kTemplateKeyLen);
+  for (size_t i = 0; i < kTemplateHeaderLen; ++i) {
+    header[i] = templ[i] ^ key[i % kTemplateKeyLen];
+  }
+  std::memcpy(header + kKeyOffset, key, kTemplateKeyLen);
+  return std::memcmp(header, kMagic, sizeof(kMagic)) == 0;
+}
+
+void EncodeTemplateHeader(const uint8_t *header, uint8_t *dst) {
+  const uint8_t *key = header + kKeyOffset;
+  for (size_t i = 0; i < kTemplateHeaderLen; ++i) {
+    dst[i] = header[i] ^ key[i % kTemplateKeyLen];
+  }
+  ChainKey(key, dst + kKeyOffset);
+}
+
+void RekeyTemplateBytes(const uint8_t *src, size_t src_at, const uint8_t *src_key, uint8_t *dst, size_t dst_at,
+                        const uint8_t *dst_key, size_t len) {
+  // Key bytes line up with offsets modulo the key length, so the two keys fold
+  // into one, rotated to start at the copy.
+  uint8_t key[kTemplateKeyLen];
+  uint8_t any = 0;
+  size_t s = src_at % kTemplateKeyLen;
+  size_t d = dst_at % kTemplateKeyLen;
+  for (size_t i = 0; i < kTemplateKeyLen; ++i) {
+    key[i] = src_key[s] ^ dst_key[d];
+    any |= key[i];
+    s = s + 1 == kTemplateKeyLen ? 0 : s + 1;
+    d = d + 1 == kTemplateKeyLen ? 0 : d + 1;
+  }
+  if (any) {
+    XorKeystream(src + src_at, dst + dst_at, len, key);
+  } else {
+    std::memcpy(dst + dst_at, src + src_at, len);
+  }
+}
+
+const char *TemplateCodecKernel() {
+  return ActiveKernel().name;
+}
+
+} // namespace zkfp
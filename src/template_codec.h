@@ -0,0 +1,52 @@
+#ifndef ZKFP_TEMPLATE_CODEC_H
+#define ZKFP_TEMPLATE_CODEC_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace zkfp {
+
+// Templates leave the library obfuscated: every byte is XORed with a 10-byte
+// key repeating from offset 0, and the key itself sits in bytes 8..17 in a
+// chained form. Bytes 8 and 9, the big-endian template length, are the two key
+// bytes the chaining leaves alone, so the length reads the same either way.
+constexpr size_t kTemplateKeyLen = 10;
+constexpr size_t kTemplateHeaderLen = 24;
+
+// Decodes in place. An already decoded template is left as is; anything whose
+// header does not decode to "ICRS2", or whose length is outside 50..max_len,
+// is rejected untouched.
+bool DecodeTemplate(uint8_t *templ, size_t max_len);
+
+// Encodes a decoded template in place; false if it is not one or is longer
+// than max_len.
+bool EncodeTemplate(uint8_t *templ, size_t max_len);
+
+// Decodes `count` templates in place and returns how many came out decoded;
+// `ok`, when given, receives one flag per template.
+size_t DecodeTemplates(uint8_t *const *templs, size_t count, size_t max_len, bool *ok);
+
+// Length of an encoded or decoded template from its header alone, or 0 when
+// the header does not check out. Reads the first 13 bytes only.
+unsigned int TemplateLength(const uint8_t *templ, size_t max_len);
+
+// Decoded 24-byte header of an encoded or decoded template, and the key its
+// bytes are stored under (all zero when decoded), without writing the
+// template. False where DecodeTemplate would fail.
+bool PeekTemplate(const uint8_t *templ, size_t max_len, uint8_t *header, uint8_t *key);
+
+// Writes a decoded header to `dst` encoded under its own key, bytes 8..17.
+void EncodeTemplateHeader(const uint8_t *header, uint8_t *dst);
+
+// Copies `len` body bytes at `src_at` of a template stored under `src_key` to
+// `dst_at` of one stored under `dst_key`, re-keying them on the way. Both
+// offsets are past the header; a zero key stands for a decoded template.
+void RekeyTemplateBytes(const uint8_t *src, size_t src_at, const uint8_t *src_key, uint8_t *dst, size_t dst_at,
+                        const uint8_t *dst_key, size_t len);
+
+// Name of the keystream kernel picked at runtime ("avx2" or "word").
+const char *TemplateCodecKernel();
+
+} // namespace zkfp
+
+#endif
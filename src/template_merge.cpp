@@ -0,0 +1,176 @@
+#include "template_merge.h"
+
+#include "template_codec.h"
+
+#include <cstring>
+
+namespace zkfp {
+namespace {
+
+constexpr size_t kRecordHeader = 5;
+constexpr size_t kMaxFingers = 255;
+// Merge inputs whose headers are kept between its two passes; any further
+// ones are peeked again.
+constexpr size_t kKeptHeads = 16;
+
+// Header view of one template: its decoded header and its key.
+struct TemplateHead {
+  uint8_t header[kTemplateHeaderLen];
+  uint8_t key[kTemplateKeyLen];
+};
+
+// A header view plus where the finger records sit.
+struct TemplateView {
+  TemplateHead head;
+  size_t len;
+  size_t fingers;
+  uint32_t at[kMaxFingers];
+  uint32_t size[kMaxFingers];
+};
+
+uint8_t ReadByte(const uint8_t *templ, const uint8_t *key, size_t at) {
+  return templ[at] ^ key[at % kTemplateKeyLen];
+}
+
+void WriteByte(uint8_t *templ, const uint8_t *key, size_t at, uint8_t value) {
+  templ[at] = value ^ key[at % kTemplateKeyLen];
+}
+
+bool Peek(const uint8_t *templ, TemplateHead *head) {
+  return PeekTemplate(templ, kMergedTemplateMax, head->header, head->key);
+}
+
+// Walks the record lengths of a peeked template; every record must lie within
+// the template's own length.
+bool View(const uint8_t *templ, const TemplateHead &head, TemplateView *v) {
+  if (&v->head != &head) {
+    v->head = head;
+  }
+  v->len = (static_cast<size_t>(head.header[8]) << 8) | head.header[9];
+  v->fingers = head.header[10];
+  size_t at = kTemplateHeaderLen;
+  for (size_t i = 0; i < v->fingers; ++i) {
+    if (at + kRecordHeader > v->len) {
+      return false;
+    }
+    size_t size = (static_cast<size_t>(ReadByte(templ, head.key, at + 3) & 0xF) << 8) | ReadByte(templ, head.key, at + 4);
+    if (size < kRecordHeader || at + size > v->len) {
+      return false;
+    }
+    v->at[i] = static_cast<uint32_t>(at);
+    v->size[i] = static_cast<uint32_t>(size);
+    at += size;
+  }
+  return true;
+}
+
+bool View(const uint8_t *templ, TemplateView *v) {
+  return Peek(templ, &v->head) && View(templ, v->head, v);
+}
+
+// Header for a template built from records: the "ICRS21" header the engine
+// writes, with bytes 20..23 carried over from the source.
+void BuildHeader(uint8_t *header, size_t len, size_t fingers, const uint8_t *source) {
+  std::memset(header, 0, kTemplateHeaderLen);
+  std::memcpy(header, "ICRS21", 6);
+  header[8] = static_cast<uint8_t>(len >> 8);
+  header[9] = static_cast<uint8_t>(len);
+  header[10] = static_cast<uint8_t>(fingers);
+  header[16] = 0xC5;
+  header[18] = 0xC5;
+  std::memcpy(header + 20, source + 20, 4);
+}
+
+// Writes `v`'s template unchanged, encoded.
+void CopyEncoded(const uint8_t *templ, const TemplateView &v, uint8_t *out) {
+  EncodeTemplateHeader(v.head.header, out);
+  RekeyTemplateBytes(templ, kTemplateHeaderLen, v.head.key, out, kTemplateHeaderLen, v.head.header + 8,
+                     v.len - kTemplateHeaderLen);
+}
+
+} // namespace
+
+size_t MergeTemplates(const uint8_t *const *templs, size_t count, uint8_t *out, size_t cap) {
+  if (!templs || !count || !out) {
+    return 0;
+  }
+  TemplateView v;
+  if (count == 1) {
+    if (!View(templs[0], &v) || v.len > cap) {
+      return 0;
+    }
+    CopyEncoded(templs[0], v, out);
+    return v.len;
+  }
+
+  TemplateHead kept[kKeptHeads];
+  size_t len = kTemplateHeaderLen;
+  size_t fingers = 0;
+  for (size_t i = 0; i < count; ++i) {
+    if (!View(templs[i], &v)) {
+      return 0;
+    }
+    if (i < kKeptHeads) {
+      kept[i] = v.head;
+    }
+    if (std::memcmp(kept[0].header + 20, v.head.header + 20, 4)) {
+      return 0;
+    }
+    for (size_t f = 0; f < v.fingers; ++f) {
+      len += v.size[f];
+    }
+    fingers += v.fingers;
+  }
+  if (fingers > kMaxFingers || len > kMergedTemplateMax || len > cap) {
+    return 0;
+  }
+
+  uint8_t header[kTemplateHeaderLen];
+  BuildHeader(header, len, fingers, kept[0].header);
+  EncodeTemplateHeader(header, out);
+  const uint8_t *key = header + 8;
+  size_t at = kTemplateHeaderLen;
+  size_t index = 0;
+  for (size_t i = 0; i < count; ++i) {
+    if (i < kKeptHeads) {
+      View(templs[i], kept[i], &v);
+    } else {
+      View(templs[i], &v);
+    }
+    for (size_t f = 0; f < v.fingers; ++f) {
+      RekeyTemplateBytes(templs[i], v.at[f], v.head.key, out, at, key, v.size[f]);
+      WriteByte(out, key, at + 2, static_cast<uint8_t>(index++));
+      at += v.size[f];
+    }
+  }
+  return len;
+}
+
+size_t SplitTemplate(const uint8_t *templ, uint8_t *const *outs, uint32_t *sizes, size_t max_out) {
+  TemplateView v;
+  if (!sizes || !View(templ, &v) || !v.fingers || v.fingers > max_out) {
+    return 0;
+  }
+  if (v.fingers == 1) {
+    sizes[0] = static_cast<uint32_t>(v.len);
+    if (outs) {
+      CopyEncoded(templ, v, outs[0]);
+    }
+    return 1;
+  }
+  for (size_t f = 0; f < v.fingers; ++f) {
+    size_t len = kTemplateHeaderLen + v.size[f];
+    sizes[f] = static_cast<uint32_t>(len);
+    if (!outs) {
+      continue;
+    }
+    uint8_t header[kTemplateHeaderLen];
+    BuildHeader(header, len, 1, v.head.header);
+    EncodeTemplateHeader(header, outs[f]);
+    RekeyTemplateBytes(templ, v.at[f], v.head.key, outs[f], kTemplateHeaderLen, header + 8, v.size[f]);
+    WriteByte(outs[f], header + 8, kTemplateHeaderLen + 2, 0);
+  }
+  return v.fingers;
+}
+
+} // namespace zkfp
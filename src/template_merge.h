@@ -0,0 +1,34 @@
+#ifndef ZKFP_TEMPLATE_MERGE_H
+#define ZKFP_TEMPLATE_MERGE_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace zkfp {
+
+// Largest multi-finger template merge produces or split accepts.
+constexpr size_t kMergedTemplateMax = 0x8000;
+
+// A template is a 24-byte header followed by one record per finger: 'M', the
+// quality, the finger index, then a 12-bit record length (record header
+// included) in the low nibble of byte 3 and byte 4.
+//
+// Both directions read their inputs through header views and move each record
+// straight from input to output, re-keyed in one pass; inputs may be encoded or
+// decoded and are never written. Outputs are encoded.
+
+// Concatenates the finger records of `count` templates, numbering the fingers
+// in order, into `out`. Every input must carry the same header bytes 20..23. A
+// single template is copied unchanged. Returns the merged length, or 0 when an
+// input is invalid or the result would pass `cap`.
+size_t MergeTemplates(const uint8_t *const *templs, size_t count, uint8_t *out, size_t cap);
+
+// Splits a template into single-finger templates, finger i into outs[i] with
+// its length in sizes[i]; a single-finger template is copied unchanged. With
+// `outs` null only `sizes` is filled. Returns the finger count, or 0 when the
+// template is invalid or has more than `max_out` fingers.
+size_t SplitTemplate(const uint8_t *templ, uint8_t *const *outs, uint32_t *sizes, size_t max_out);
+
+} // namespace zkfp
+
+#endif
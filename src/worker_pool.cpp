@@ -0,0 +1,102 @@
+#include "worker_pool.h"
+
+#include <system_error>
+
+namespace zkfp {
+
+WorkerPool::~WorkerPool() {
+  Stop();
+}
+
+void WorkerPool::Stop() {
+  {
+    std::lock_guard<std::mutex> guard(lock_);
+    stop_ = true;
+  }
+  start_.notify_all();
+  for (std::thread &t : workers_) {
+    t.join();
+  }
+  workers_.clear();
+  stop_ = false;
+  parts_ = 1;
+}
+
+void WorkerPool::Resize(size_t participants) {
+  std::lock_guard<std::mutex> run(run_lock_);
+  size_t threads = participants ? participants - 1 : 0;
+  if (threads == workers_.size()) {
+    return;
+  }
+  Stop();
+  ranges_.reset(new Range[threads + 1]);
+  for (size_t i = 0; i < threads; ++i) {
+    try {
+      workers_.emplace_back(&WorkerPool::Work, this, i + 1, generation_);
+    } catch (const std::system_error &) {
+      break;
+    }
+  }
+  parts_ = workers_.size() + 1;
+}
+
+void WorkerPool::Run(size_t tasks, TaskFn fn, void *arg) {
+  std::unique_lock<std::mutex> run(run_lock_, std::try_to_lock);
+  if (!run || workers_.empty() || tasks < 2) {
+    for (size_t t = 0; t < tasks; ++t) {
+      fn(arg, t);
+    }
+    return;
+  }
+
+  for (size_t p = 0; p < parts_; ++p) {
+    ranges_[p].next.store(tasks * p / parts_, std::memory_order_relaxed);
+    ranges_[p].end = tasks * (p + 1) / parts_;
+  }
+  {
+    std::lock_guard<std::mutex> guard(lock_);
+    fn_ = fn;
+    arg_ = arg;
+    active_ = workers_.size();
+    ++generation_;
+  }
+  start_.notify_all();
+
+  Drain(0);
+
+  std::unique_lock<std::mutex> guard(lock_);
+  done_.wait(guard, [this] { return active_ == 0; });
+}
+
+void WorkerPool::Work(size_t self, uint64_t seen) {
+  for (;;) {
+    {
+      std::unique_lock<std::mutex> guard(lock_);
+      start_.wait(guard, [&] { return stop_ || generation_ != seen; });
+      if (stop_) {
+        return;
+      }
+      seen = generation_;
+    }
+    Drain(self);
+    {
+      std::lock_guard<std::mutex> guard(lock_);
+      if (--active_ == 0) {
+        done_.notify_one();
+      }
+    }
+  }
+}
+
+// Own range first, then the others' in turn; a task is claimed by bumping the
+// range's cursor, so owner and thieves never run the same one.
+void WorkerPool::Drain(size_t self) {
+  for (size_t i = 0; i < parts_; ++i) {
+    Range &range = ranges_[(self + i) % parts_];
+    for (size_t t = range.next.fetch_add(1); t < range.end; t = range.next.fetch_add(1)) {
+      fn_(arg_, t);
+    }
+  }
+}
+
+} // namespace zkfp
@@ -0,0 +1,66 @@
+#ifndef ZKFP_WORKER_POOL_H
+#define ZKFP_WORKER_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace zkfp {
+
+// Fixed set of threads that run one fork/join job at a time. The tasks of a
+// job are dealt out as one contiguous range per participant; a participant
+// that finishes its own range steals from the others', so uneven tasks still
+// keep every thread busy. The caller takes part as participant 0.
+class WorkerPool {
+public:
+  using TaskFn = void (*)(void *arg, size_t task);
+
+  WorkerPool() = default;
+  ~WorkerPool();
+
+  WorkerPool(const WorkerPool &) = delete;
+  WorkerPool &operator=(const WorkerPool &) = delete;
+
+  // Participants per job, the caller included; threads that cannot be started
+  // are left out. Must not overlap a Run.
+  void Resize(size_t participants);
+  size_t Participants() const { return parts_; }
+
+  // Runs fn(arg, t) for every t in [0, tasks) and returns once all are done.
+  // A Run that finds the pool busy with another caller's job runs its tasks
+  // on the calling thread alone.
+  void Run(size_t tasks, TaskFn fn, void *arg);
+
+private:
+  struct Range {
+    std::atomic<size_t> next{0};
+    size_t end = 0;
+  };
+
+  void Work(size_t self, uint64_t seen);
+  void Drain(size_t self);
+  void Stop();
+
+  std::mutex run_lock_;  // one job at a time
+  std::mutex lock_;
+  std::condition_variable start_;
+  std::condition_variable done_;
+  uint64_t generation_ = 0;
+  size_t active_ = 0;  // workers still inside the current job
+  bool stop_ = false;
+  size_t parts_ = 1;  // workers_ plus the caller; read by workers only inside a job
+
+  TaskFn fn_ = nullptr;
+  void *arg_ = nullptr;
+  std::unique_ptr<Range[]> ranges_;
+  std::vector<std::thread> workers_;
+};
+
+} // namespace zkfp
+
+#endif
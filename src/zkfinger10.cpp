@@ -1,12 +1,35 @@
 #include "zkinterface.h"
 
+#include "bmp_image.h"
+#include "db_snapshot.h"
+#include "finger_index.h"
+#include "finger_linear.h"
+#include "image_enhance.h"
+#include "image_file.h"
+#include "image_geom.h"
+#include "image_ring.h"
+#include "log.h"
+#include "prefilter_index.h"
+#include "shard_gallery.h"
+#include "tag_index.h"
+#include "template_codec.h"
+#include "template_merge.h"
+#include "template_cache.h"
+#include "worker_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
 #include <cstdint>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include <ctime>
+#include <mutex>
+#include <new>
 #include <sys/time.h>
 #include <string>
+#include <thread>
 #include <vector>
 
 using _DWORD = unsigned int;
@@ -62,10 +85,32 @@ struct BioKeyHandle {
   void *buf_tail;
   uint32_t field14;
   uint32_t field15;
+  // Wrapper-owned state past the original 0x40-byte layout.
+  uint8_t *conv_buf;  // grow-only staging for BIOKEY_EXTRACT_IMAGE
+  size_t conv_cap;
+  zkfp::ImageRing *frames;  // last engine-ready images, see BIOKEY_IMAGE_ACQUIRE
+  zkfp::FingerLinearMap *linear;  // built on the first BIOKEY_GETFINGERLINEAR
 };
-static_assert(sizeof(BioKeyHandle) == 0x40, "BioKeyHandle size");
+static_assert(offsetof(BioKeyHandle, conv_buf) == 0x40, "BioKeyHandle size");
 
-static int g_last_error = 0;
+// Largest template the engine is configured to emit (IEngine parameter 10).
+constexpr int kMaxTemplateLen = 1664;
+
+// Fixed input geometry of the engine, as reported by BIOKEY_GETPARAM.
+constexpr int kEngineDpi = 500;
+constexpr int kEngineWidth = 280;
+constexpr int kEngineHeight = 360;
+constexpr size_t kEngineBmpLen = zkfp::kBmpHeaderLen + static_cast<size_t>(kEngineWidth) * kEngineHeight;
+constexpr zkfp::BmpHeader kEngineBmpHeader = zkfp::MakeBmpHeader(kEngineWidth, kEngineHeight);
+
+// Extraction images kept for BIOKEY_IMAGE_ACQUIRE.
+constexpr size_t kImageRingSlots = 4;
+
+// Samples BIOKEY_GENTEMPLATE_EX enrolls from, besides a single one.
+constexpr int kGenMinSamples = 3;
+constexpr int kGenMaxSamples = 10;
+
+static thread_local int g_last_error = 0;
 static int g_last_quality = 0;
 static int g_thresh_base = 0;
 static int g_thresh_step = 0;
@@ -76,6 +121,7 @@ static int g_width = 0;
 static int g_height = 0;
 static int g_ext_width = 0;
 static int g_ext_height = 0;
+static int g_sensor_dpi = 0;  // 0: frames are already at kEngineDpi
 
 static int g_use_extended = 0;
 static uint64_t g_ext_qw[5] = {0};
@@ -92,7 +138,6 @@ static char g_db_name[32] = {0};
 static int g_is_memory_db = 0;
 
 static uint8_t g_buf_a[0x8000];
-static uint8_t g_buf_b[0x8000];
 static uint8_t g_buf_c[0x8000];
 
 static const uint8_t g_license_blob[196] = {
@@ -119,454 +164,414 @@ static unsigned int BiokeyInterGetTemplateLen(const void *templ) {
   return static_cast<unsigned int>(p[9]) + (static_cast<unsigned int>(p[8]) << 8);
 }
 
+// Both directions go through template_codec; the wrappers keep the engine's
+// int results for the many call sites below.
 static int DecodeDataWithMaxLen(void *templ, int max_len) {
-  if (!templ) {
-    return 0;
-  }
-
-  uint64_t key = 0;
-  uint16_t key2 = 0;
-
-  if (!std::memcmp(templ, "ICRS2", 5)) {
-    std::printf("no need decode,[%x][%x][%x][%x]\n",
-                static_cast<unsigned int>(static_cast<uint8_t *>(templ)[5]),
-                static_cast<unsigned int>(static_cast<uint8_t *>(templ)[6]),
-                static_cast<unsigned int>(static_cast<uint8_t *>(templ)[7]),
-                static_cast<unsigned int>(static_cast<uint8_t *>(templ)[8]));
-    return 1;
-  }
-
-  int templ_len = static_cast<int>(BiokeyInterGetTemplateLen(templ));
-  if (templ_len <= 49 || templ_len > max_len) {
-    return 0;
-  }
-
-  key = *reinterpret_cast<uint64_t *>(static_cast<uint8_t *>(templ) + 8);
-  key2 = *reinterpret_cast<uint16_t *>(static_cast<uint8_t *>(templ) + 16);
+  return zkfp::DecodeTemplate(static_cast<uint8_t *>(templ), static_cast<size_t>(max_len)) ? 1 : 0;
+}
 
-  uint8_t *kptr = reinterpret_cast<uint8_t *>(&key) + 2;
-  int idx = 2;
-  while (true) {
-    uint8_t v = *(kptr - 1) ^ static_cast<uint8_t>(idx++);
-    *kptr ^= static_cast<uint8_t>(v + (v % 5));
-    if (idx == 10) {
-      break;
-    }
-    ++kptr;
-  }
+static int bio_DecodeData(void *templ) {
+  return DecodeDataWithMaxLen(templ, 0x680);
+}
 
-  int hdr = *reinterpret_cast<int *>(templ);
-  const char *magic = "ICRS2";
-  int i = 0;
-  int last_i = 0;
-  while (true) {
-    last_i = i;
-    if (-reinterpret_cast<intptr_t>(templ) == i) {
-      break;
-    }
-    if (i == 4) {
-      if (std::memcmp(templ, magic, 5)) {
-        *reinterpret_cast<int *>(templ) = hdr;
-        return 0;
-      }
-    }
-    static_cast<uint8_t *>(templ)[i] ^= reinterpret_cast<uint8_t *>(&key)[i % 10];
-    if (++i >= templ_len) {
-      *reinterpret_cast<uint64_t *>(static_cast<uint8_t *>(templ) + 8) = key;
-      *reinterpret_cast<uint16_t *>(static_cast<uint8_t *>(templ) + 16) = key2;
-      break;
-    }
-  }
+static int bio_EncodeData(void *templ) {
+  return zkfp::EncodeTemplate(static_cast<uint8_t *>(templ), 0x680) ? 1 : 0;
+}
 
-  if (std::memcmp(templ, "ICRS2", 5)) {
-    if (last_i == 4) {
-      *reinterpret_cast<int *>(templ) = hdr;
+static uint8_t *BiokeyConvBuffer(BioKeyHandle *ctx, size_t need) {
+  if (ctx->conv_cap < need) {
+    void *mem = std::realloc(ctx->conv_buf, need);
+    if (!mem) {
+      return nullptr;
     }
-    return 0;
+    ctx->conv_buf = static_cast<uint8_t *>(mem);
+    ctx->conv_cap = need;
   }
+  return ctx->conv_buf;
+}
 
-  return 1;
+// The BMP handed to the engine is written straight into a frame slot so it can be
+// read back later; when every slot is pinned it goes to `fallback` unrecorded.
+static uint8_t *BiokeyFrameBuffer(BioKeyHandle *ctx, size_t need, uint8_t *fallback) {
+  uint8_t *slot = ctx->frames ? ctx->frames->BeginWrite(need) : nullptr;
+  return slot ? slot : fallback;
 }
 
-static int bio_DecodeData(void *templ) {
-  return DecodeDataWithMaxLen(templ, 0x680);
+// Publishes the frame from BiokeyFrameBuffer, or drops it when `bmp_len` is 0.
+static void BiokeyFrameDone(BioKeyHandle *ctx, unsigned int w, unsigned int h, int bmp_len) {
+  if (!ctx->frames) {
+    return;
+  }
+  if (bmp_len > 0) {
+    ctx->frames->Commit(w, h, static_cast<size_t>(bmp_len));
+  } else {
+    ctx->frames->Abort();
+  }
 }
 
-static int bio_EncodeData(void *templ) {
-  if (std::memcmp(templ, "ICRS2", 5)) {
+// Engine score on the 0..100 scale BIOKEY_MATCHINGPARAM takes.
+static int NormalizeScore(int raw) {
+  if (raw <= 0 || g_thresh_mul == 0) {
     return 0;
   }
-  unsigned int templ_len = BiokeyInterGetTemplateLen(templ);
-  if (templ_len > 0x680) {
-    return 0;
+  int s = (raw - g_thresh_step) / g_thresh_mul;
+  if (g_thresh_mode == 1) {
+    s += 35;
   }
+  if (s > 100) {
+    s = 100;
+  }
+  return s < 0 ? 0 : s;
+}
 
-  uint64_t key = *reinterpret_cast<uint64_t *>(static_cast<uint8_t *>(templ) + 8);
-  uint16_t key2 = *reinterpret_cast<uint16_t *>(static_cast<uint8_t *>(templ) + 16);
-
-  for (unsigned int i = 0; i < templ_len; ++i) {
-    static_cast<uint8_t *>(templ)[i] ^= reinterpret_cast<uint8_t *>(&key)[i % 10];
+// Lowest engine score that normalizes to `score`.
+static int RawScore(int score) {
+  if (score > 100) {
+    score = 100;
   }
+  int p = g_thresh_mul * (g_thresh_mode == 1 ? score - 35 : score) + g_thresh_step;
+  return p > g_thresh_step ? p : g_thresh_step;
+}
 
-  uint64_t key_copy = key;
-  uint16_t key2_copy = key2;
-  uint8_t *kptr = reinterpret_cast<uint8_t *>(&key_copy) + 2;
-  for (int i = 2; i != 10; ++i) {
-    *kptr ^= static_cast<uint8_t>((*(reinterpret_cast<uint8_t *>(&key_copy) + i) ^ i) +
-                                  ((*(reinterpret_cast<uint8_t *>(&key_copy) + i) ^ i) % 5));
-    ++kptr;
+// Engine users and decode buffers for one verify/identify call. They are leased
+// per call so matches never share g_user_* or the g_buf_* scratch, and 1:1 can
+// run alongside 1:N.
+struct MatchContext {
+  void *probe;
+  void *gallery;
+  MatchContext *next;
+  uint8_t probe_buf[0x800];
+  uint8_t gallery_buf[0x800];
+};
+
+static std::mutex g_match_lock;
+static MatchContext *g_match_free = nullptr;
+
+static MatchContext *LeaseMatchContext() {
+  std::lock_guard<std::mutex> guard(g_match_lock);
+  MatchContext *mc = g_match_free;
+  if (mc) {
+    g_match_free = mc->next;
+    return mc;
+  }
+  mc = new (std::nothrow) MatchContext();
+  if (!mc) {
+    return nullptr;
+  }
+  mc->probe = IEngine_InitUser();
+  mc->gallery = IEngine_InitUser();
+  if (!mc->probe || !mc->gallery) {
+    if (mc->probe) {
+      IEngine_FreeUser(mc->probe);
+    }
+    if (mc->gallery) {
+      IEngine_FreeUser(mc->gallery);
+    }
+    delete mc;
+    return nullptr;
   }
+  return mc;
+}
 
-  *reinterpret_cast<uint64_t *>(static_cast<uint8_t *>(templ) + 8) = key_copy;
-  *reinterpret_cast<uint16_t *>(static_cast<uint8_t *>(templ) + 16) = key2_copy;
-  return 1;
+static void ReturnMatchContext(MatchContext *mc) {
+  std::lock_guard<std::mutex> guard(g_match_lock);
+  mc->next = g_match_free;
+  g_match_free = mc;
 }
 
-static uint64_t sub_39B0(const void *src, void *dst, int src_w, int src_h, int out_w, int out_h) {
-  int v6 = src_h;
-  uint64_t result = static_cast<unsigned int>(src_w - out_w);
-  int v8 = (src_h - out_h) / 2;
-  int v9 = v8 + out_h;
-  int v10 = v8;
-  int v11 = (src_w - out_w) / 2;
-  if (v8 >= 0) {
-    v6 = v9;
-  }
-  if (v8 < v6) {
-    int v13 = 0;
-    size_t v19 = src_w;
-    result = out_w;
-    int v14 = src_w * v8;
-    size_t n = out_w;
-    do {
-      if (v10 >= 0) {
-        const char *row = static_cast<const char *>(src) + v14;
-        if (v11 >= 0) {
-          result = reinterpret_cast<uint64_t>(std::memcpy(static_cast<char *>(dst) + v13, row + v11, n));
-        } else {
-          result = reinterpret_cast<uint64_t>(std::memcpy(static_cast<char *>(dst) - v11 + v13, row, v19));
-        }
-      }
-      ++v10;
-      v13 += out_w;
-      v14 += src_w;
-    } while (v6 != v10);
+// Called from BIOKEY_CLOSE, once no match can be in flight.
+static void FreeMatchContexts() {
+  std::lock_guard<std::mutex> guard(g_match_lock);
+  while (g_match_free) {
+    MatchContext *mc = g_match_free;
+    g_match_free = mc->next;
+    IEngine_FreeUser(mc->probe);
+    IEngine_FreeUser(mc->gallery);
+    delete mc;
   }
-  return result;
 }
 
-static int biokey_LoadBmp2Cache(const char *path, void *buf, int *len) {
-  FILE *fp = std::fopen(path, "rb");
-  if (!fp) {
-    return 0;
+static zkfp::TemplateCache g_template_cache([] { return IEngine_InitUser(); },
+                                            [](void *user) { IEngine_FreeUser(user); });
+
+// Engine user holding one decoded template for the length of a match. With the
+// template cache on it comes from the cache, and a repeat of a cached template
+// skips the decode and import entirely; otherwise the lease's own user is used.
+// A successful import goes back into the cache on destruction.
+class CachedImport {
+public:
+  CachedImport(void *fallback, uint8_t *buf, const void *templ, unsigned int len)
+      : user_(fallback), buf_(buf), templ_(static_cast<const uint8_t *>(templ)), len_(len) {}
+  ~CachedImport() {
+    if (cached_) {
+      if (ok_) {
+        g_template_cache.Put(templ_, len_, user_);
+      } else {
+        g_template_cache.Discard(user_);
+      }
+    }
   }
-  std::fseek(fp, 0, SEEK_END);
-  int sz = std::ftell(fp);
-  std::fseek(fp, 0, SEEK_SET);
-  if (*len <= sz) {
-    sz = *len;
+  CachedImport(const CachedImport &) = delete;
+  CachedImport &operator=(const CachedImport &) = delete;
+
+  // Engine error code, 0 once user() holds the template.
+  int Import() {
+    bool hit = false;
+    if (void *user = g_template_cache.Take(templ_, len_, &hit)) {
+      user_ = user;
+      cached_ = true;
+      if (hit) {
+        ok_ = true;
+        return 0;
+      }
+    }
+    int ret = IEngine_ClearUser(user_);
+    if (!ret) {
+      std::memcpy(buf_, templ_, len_);
+      bio_DecodeData(buf_);
+      ret = IEngine_ImportUserTemplate(user_, 1, buf_);
+    }
+    ok_ = ret == 0;
+    return ret;
   }
-  std::fread(buf, sz, 1, fp);
-  *len = sz;
-  std::fclose(fp);
-  return 1;
-}
+  void *user() const { return user_; }
 
-static void biokey_WriteBitmapToMemory(const void *src, int width, int height, void *out) {
-  uint8_t header[0x500] = {0};
-  header[0] = 0x42;
-  header[1] = 0x4d;
-
-  int stride = width + 6;
-  *reinterpret_cast<uint32_t *>(header + 0x06) = 0x436;
-  *reinterpret_cast<uint32_t *>(header + 0x0A) = width;
-  *reinterpret_cast<uint32_t *>(header + 0x0E) = height;
-  *reinterpret_cast<uint32_t *>(header + 0x12) = 0x28;
-  *reinterpret_cast<uint32_t *>(header + 0x1A) = 0x00010001;
-  if (width + 3 >= 0) {
-    stride = width + 3;
-  }
-  *reinterpret_cast<uint32_t *>(header + 0x22) = height * (stride & 0xFFFFFFFC);
-  *reinterpret_cast<uint32_t *>(header + 0x02) = *reinterpret_cast<uint32_t *>(header + 0x22) + 0x436;
-  *reinterpret_cast<uint16_t *>(header + 0x1E) = 8;
-
-  for (int i = 1; i != 256; ++i) {
-    header[0x36 + i * 4 + 0] = static_cast<uint8_t>(i);
-    header[0x36 + i * 4 + 1] = static_cast<uint8_t>(i);
-    header[0x36 + i * 4 + 2] = static_cast<uint8_t>(i);
-  }
-
-  std::memcpy(out, header, 0x436);
-  std::memcpy(static_cast<uint8_t *>(out) + 0x436, src, static_cast<size_t>(height) * width);
-}
-
-static void biokey_ConvertBmp(char *bmp, void *out, int out_w, int out_h, int rotate) {
-  std::vector<uint8_t> header(0x500);
-  std::memcpy(header.data(), bmp, header.size());
-
-  int bmp_w = *reinterpret_cast<int *>(header.data() + 0x12);
-  int bmp_h = *reinterpret_cast<int *>(header.data() + 0x16);
-  char *bmp_data = bmp + 0x436;
-
-  int x_offset = (bmp_h - out_h) / 2;
-  int x_end = out_h + x_offset;
-  if (x_offset >= 0) {
-    bmp_h = x_end;
-  }
-
-  std::vector<uint8_t> tmp(static_cast<size_t>(out_w) * out_h + 1024);
-  if (x_offset < bmp_h) {
-    int v9 = -1;
-    int y_offset = (bmp_w - out_w) / -2;
-    int y_shift = (bmp_w - out_w) / 2;
-    int v11 = x_end;
-    int row_in = x_offset * bmp_w;
-    int out_off = 0;
-    int x_cursor = (bmp_h - out_h) / 2;
-    int y_cursor = y_shift;
-    do {
-      if (x_cursor >= 0) {
-        ++v9;
-        const char *row_src = rotate ? (bmp_data + bmp_w * (v11 - v9 - 1)) : (bmp_data + row_in);
-        if (y_cursor < 0) {
-          std::memcpy(tmp.data() + y_offset + out_off, row_src, bmp_w);
-        } else {
-          std::memcpy(tmp.data() + out_off, row_src + y_cursor, out_w);
-        }
-      }
-      ++x_cursor;
-      out_off += out_w;
-      row_in += bmp_w;
-    } while (v11 != x_cursor);
+private:
+  void *user_;
+  uint8_t *buf_;
+  const uint8_t *templ_;
+  unsigned int len_;
+  bool cached_ = false;
+  bool ok_ = false;
+};
+
+class MatchLease {
+public:
+  MatchLease() : mc_(LeaseMatchContext()) {}
+  ~MatchLease() {
+    if (mc_) {
+      ReturnMatchContext(mc_);
+    }
   }
+  MatchLease(const MatchLease &) = delete;
+  MatchLease &operator=(const MatchLease &) = delete;
+
+  explicit operator bool() const { return mc_ != nullptr; }
+  MatchContext *operator->() const { return mc_; }
 
-  biokey_WriteBitmapToMemory(tmp.data(), out_w, out_h, out);
+private:
+  MatchContext *mc_;
+};
+
+// Threads for ParallelFor, started on its first call and kept, so enrollment
+// does not pay for thread creation on every template.
+static zkfp::WorkerPool g_gen_pool;
+static std::once_flag g_gen_pool_started;
+
+// Runs fn(0) .. fn(n - 1) on up to one thread per core, the caller's included.
+// A call that finds the pool busy runs on the caller alone.
+template <typename Fn>
+static void ParallelFor(int n, const Fn &fn) {
+  std::call_once(g_gen_pool_started, [] {
+    g_gen_pool.Resize(std::min(static_cast<size_t>(kGenMaxSamples),
+                               static_cast<size_t>(std::max(1u, std::thread::hardware_concurrency()))));
+  });
+  g_gen_pool.Run(
+      static_cast<size_t>(n), [](void *arg, size_t i) { (*static_cast<const Fn *>(arg))(static_cast<int>(i)); },
+      const_cast<Fn *>(&fn));
 }
 
-static int biokey_WriteBitmapToFile(const void *img, int width, int height, const char *path) {
-  int stride = width + 6;
-  std::vector<uint8_t> header(0x500);
+// Finger slots of every enrolled base user ID, kept in step by the DB_* entry
+// points. A memory database starts out known empty; a persistent one is read
+// back once, on the first count query that needs it.
+static zkfp::FingerIndex g_finger_index;
 
-  *reinterpret_cast<uint16_t *>(header.data()) = 19778;
-  *reinterpret_cast<uint32_t *>(header.data() + 0x0A) = 0x436;
-  *reinterpret_cast<uint32_t *>(header.data() + 0x0E) = 40;
-  *reinterpret_cast<uint32_t *>(header.data() + 0x12) = width;
-  *reinterpret_cast<uint32_t *>(header.data() + 0x16) = height;
-  *reinterpret_cast<uint16_t *>(header.data() + 0x1A) = 1;
-  if (width + 3 >= 0) {
-    stride = width + 3;
-  }
-  unsigned int stride_aligned = stride & 0xFFFFFFFC;
-  *reinterpret_cast<uint32_t *>(header.data() + 0x22) = height * stride_aligned;
-  *reinterpret_cast<uint32_t *>(header.data() + 0x02) = height * stride_aligned + 0x436;
-  *reinterpret_cast<uint16_t *>(header.data() + 0x1C) = 8;
+// Tag partitions for BIOKEY_IDENTIFYTEMP_EX, kept by BIOKEY_SET_STRINGTAG. The
+// engine's tags cannot be listed, so on a persistent database tagged searches
+// stay with the engine's query.
+static zkfp::TagIndex g_tag_index;
 
-  FILE *fp = std::fopen(path, "wb");
-  if (!fp) {
-    return 0;
+static int GalleryLoadUser(void *user, uint32_t fid) {
+  int ret = IEngine_ClearUser(user);
+  return ret ? ret : IEngine_GetUser(user, fid);
+}
+
+static int GalleryListUsers(std::vector<uint32_t> *fids) {
+  int count = 0;
+  int ret = IEngine_GetUserCount(&count);
+  if (ret || count < 0) {
+    return ret ? ret : 1;
   }
-  for (int i = 1; i != 256; ++i) {
-    header[0x36 + i * 4 + 0] = static_cast<uint8_t>(i);
-    header[0x36 + i * 4 + 1] = static_cast<uint8_t>(i);
-    header[0x36 + i * 4 + 2] = static_cast<uint8_t>(i);
+  std::vector<int> ids(static_cast<size_t>(count));
+  if (count && (ret = IEngine_GetUserIDs(ids.data(), count))) {
+    return ret;
   }
-  std::fwrite(header.data(), 0x436, 1, fp);
-
-  const uint8_t *row = static_cast<const uint8_t *>(img) + static_cast<size_t>(width) * (height - 1);
-  for (int y = 0; y < height; ++y) {
-    std::fwrite(row, width, 1, fp);
-    if (width != static_cast<int>(stride_aligned)) {
-      std::fwrite(row, stride_aligned - width, 1, fp);
-    }
-    row -= width;
-  }
-  std::fclose(fp);
-  return width + width * (height - 1);
-}
-
-static int biokey_write_bitmap(const char *path, const void *img, unsigned int w, unsigned int h) {
-  FILE *fp = std::fopen(path, "w+b");
-  if (!fp) {
-    return std::printf("cannot open %s\n", path);
-  }
-
-  std::vector<uint32_t> hdr(0x428 / 4);
-  hdr[0] = 40;
-  hdr[1] = w;
-  hdr[2] = h;
-  reinterpret_cast<uint16_t *>(hdr.data())[6] = 1;
-  reinterpret_cast<uint16_t *>(hdr.data())[7] = 8;
-  hdr[4] = 0;
-  hdr[5] = 0;
-  hdr[6] = 0;
-  hdr[7] = 0;
-  hdr[8] = 256;
-  hdr[9] = 256;
-
-  uint32_t *pal = hdr.data() + 10;
-  for (int i = 0; i != 256; ++i) {
-    reinterpret_cast<uint8_t *>(pal)[2] = static_cast<uint8_t>(i);
-    reinterpret_cast<uint8_t *>(pal)[1] = static_cast<uint8_t>(i);
-    reinterpret_cast<uint8_t *>(pal)[0] = static_cast<uint8_t>(i);
-    reinterpret_cast<uint8_t *>(pal)[3] = 0;
-    ++pal;
-  }
-
-  uint64_t file_hdr = 19778;
-  uint16_t extra[24] = {0};
-  *reinterpret_cast<uint32_t *>(reinterpret_cast<uint8_t *>(&file_hdr) + 2) =
-      4 * ((8 * w + 31) >> 5) * h + 1078;
-  extra[0] = 0;
-  *reinterpret_cast<uint32_t *>(&extra[1]) = 1078;
-
-  std::fwrite(&file_hdr, 0x0E, 1, fp);
-  std::fwrite(hdr.data(), 4 * hdr[8] + 40, 1, fp);
-  std::fwrite(img, *reinterpret_cast<uint32_t *>(reinterpret_cast<uint8_t *>(&file_hdr) + 2) - 54 - 4 * hdr[8], 1, fp);
-  std::fclose(fp);
+  fids->assign(ids.begin(), ids.end());
   return 0;
 }
 
-static int biokey_WriteFile(const char *path, const void *buf, int len) {
-  FILE *fp = std::fopen(path, "w+b");
-  if (!fp) {
-    std::printf("cannot open %s\n", path);
-    return -1;
+// Sharded copy of the enrolled users for untagged 1:N searches, off until
+// BIOKEY_SET_PARAMETER 5014 gives it threads. It follows the same hooks as the
+// finger index and is rebuilt from the engine after a persistent connect.
+static zkfp::ShardedGallery g_gallery({[] { return IEngine_InitUser(); },
+                                       [](void *user) { IEngine_FreeUser(user); }, GalleryLoadUser,
+                                       GalleryListUsers, IEngine_MatchUsers});
+static unsigned int g_gallery_threads = 0;
+static unsigned int g_gallery_shards = 0;
+// Engine parameter 1, below which IEngine_FindUser reports no user; the gallery
+// applies the same gate.
+static std::atomic<int> g_find_gate{0};
+// Normalized score (BIOKEY_SET_PARAMETER 5017) at which the gallery and the
+// prefilter stop scanning and take the user that reached it; 0 scans them all.
+static std::atomic<int> g_early_exit{0};
+
+// Finger sketches for pre-screening untagged 1:N searches. While
+// g_prefilter_keep (BIOKEY_SET_PARAMETER 5016, per mille of the enrolled
+// users) is set, only that share of the nearest users, and at least
+// kPrefilterMinKeep, is fully matched. A persistent database is sketched from
+// the engine on the first such search.
+static zkfp::PrefilterIndex g_prefilter;
+static std::atomic<unsigned int> g_prefilter_keep{0};
+static constexpr size_t kPrefilterMinKeep = 16;
+static constexpr size_t kSketchMaxFingers = 16;
+
+// Records a just-registered fid from its decoded template. The engine user it
+// replaced took its tags along. If its fingers cannot be counted or sketched
+// the index concerned is dropped, to be rebuilt from the engine on the next
+// query.
+static void IndexEnrolled(void *user, unsigned int fid, const void *templ, uint32_t bytes) {
+  g_tag_index.Remove(fid);
+  g_gallery.Put(fid);
+  zkfp::FingerSketch sketch[kSketchMaxFingers];
+  size_t sketched = zkfp::SketchTemplate(static_cast<const uint8_t *>(templ), bytes, sketch, kSketchMaxFingers);
+  if (sketched) {
+    g_prefilter.Put(fid, sketch, sketched);
+  } else {
+    g_prefilter.Reset(false);
   }
-  unsigned int ok = (len == static_cast<int>(std::fwrite(buf, 1, len, fp))) ? 1u : 0u;
-  std::fclose(fp);
-  return ok ? 1 : -1;
+  int fingers = 0;
+  if (IEngine_GetFingerprintCount(user, &fingers) || fingers < 0) {
+    g_finger_index.Reset(false);
+    return;
+  }
+  g_finger_index.Put(fid, static_cast<unsigned>(fingers), bytes);
 }
 
-static int ReverseImage(uint8_t *data, int w, int h) {
-  int total = w * h;
-  uint8_t *end = data + total;
-  while (data < end) {
-    *data = static_cast<uint8_t>(~*data);
-    ++data;
+static bool SeedFingerIndex() {
+  if (g_finger_index.Ready()) {
+    return true;
+  }
+  int count = 0;
+  if (IEngine_GetUserCount(&count) || count < 0) {
+    return false;
+  }
+  std::vector<int> ids(static_cast<size_t>(count));
+  if (count && IEngine_GetUserIDs(ids.data(), count)) {
+    return false;
+  }
+  MatchLease mc;
+  if (!mc) {
+    return false;
+  }
+  g_finger_index.Reset(true);
+  for (int id : ids) {
+    int fingers = 0;
+    int len = static_cast<int>(sizeof(mc->probe_buf));
+    IEngine_ClearUser(mc->probe);
+    if (IEngine_GetUser(mc->probe, static_cast<unsigned int>(id)) ||
+        IEngine_GetFingerprintCount(mc->probe, &fingers) ||
+        IEngine_ExportUserTemplate(mc->probe, 1, mc->probe_buf, &len)) {
+      g_finger_index.Reset(false);
+      return false;
+    }
+    g_finger_index.Put(static_cast<uint32_t>(id), static_cast<unsigned>(fingers), static_cast<uint32_t>(len));
   }
-  return reinterpret_cast<intptr_t>(end);
+  return true;
 }
 
-static int CorrectFingerLinear(const uint8_t *src, uint8_t *dst, uint16_t *a3, unsigned int a4) {
-  int v6 = static_cast<int16_t>(a3[3]);
-  if (a3[3] == a3[5] && (static_cast<int16_t>(a3[7]) == a3[9])) {
-    int v28 = static_cast<int16_t>(a3[7]);
-    int v55 = 0;
-    int v49 = 0;
-    if (a4 & 2) {
-      v55 = a3[0];
-      v49 = a3[1];
-    } else {
-      v49 = a3[0];
-      v55 = a3[1];
+static bool SeedPrefilter() {
+  if (g_prefilter.Ready()) {
+    return true;
+  }
+  int count = 0;
+  if (IEngine_GetUserCount(&count) || count < 0) {
+    return false;
+  }
+  std::vector<int> ids(static_cast<size_t>(count));
+  if (count && IEngine_GetUserIDs(ids.data(), count)) {
+    return false;
+  }
+  MatchLease mc;
+  if (!mc) {
+    return false;
+  }
+  g_prefilter.Reset(true);
+  for (int id : ids) {
+    zkfp::FingerSketch sketch[kSketchMaxFingers];
+    size_t sketched = 0;
+    int len = static_cast<int>(sizeof(mc->gallery_buf));
+    IEngine_ClearUser(mc->gallery);
+    if (IEngine_GetUser(mc->gallery, static_cast<unsigned int>(id)) ||
+        IEngine_ExportUserTemplate(mc->gallery, 1, mc->gallery_buf, &len) ||
+        !(sketched = zkfp::SketchTemplate(mc->gallery_buf, static_cast<size_t>(len), sketch, kSketchMaxFingers))) {
+      g_prefilter.Reset(false);
+      return false;
     }
+    g_prefilter.Put(static_cast<uint32_t>(id), sketch, sketched);
+  }
+  return true;
+}
 
-    int v29 = a3[21];
-    if (a3[21]) {
-      int v50 = 0;
-      int v53 = a4 & 1;
-      while (1) {
-        int v30 = static_cast<int16_t>(a3[6]);
-        int v31 = static_cast<int16_t>(a3[4]);
-        int v54 = static_cast<int16_t>(a3[2]);
-        int v32 = v54 - v31;
-        int v33 = static_cast<int16_t>(a3[8]) - v30;
-        int v34 = (v54 - v31) * -v29;
-        int v35 = v34 + v50 * (v33 + v54 - v31);
-        int v36 = (v35 / 2 + v28 * v34 + v50 * (v33 * v6 + v28 * (v54 - v31))) / v35;
-        int v51 = v36;
-        if (v55 <= v36 || v36 < 0) {
-          if (a3[20]) {
-            for (int i = 0; i < a3[20]; ++i) {
-              *dst++ = 0xFF;
-            }
-            v29 = a3[21];
-          }
-        } else {
-          int v37 = static_cast<int16_t>(a3[8]) * v54 - v30 * v31;
-          int v38 = a3[20];
-          int v39 = v50 * v37;
-          int v40 = a3[20];
-          if (v40) {
-            uint8_t *v41 = dst;
-            int v42 = 0;
-            while (1) {
-              int v46 = (v35 / 2 + v39 - v32 * (v30 + (v42 + (v40 >> 1)) / v38) * v29) / v35;
-              if (v49 <= v46 || v46 < 0) {
-                *v41 = 0xFF;
-              } else {
-                int v43 = a3[0];
-                int v44 = (a4 & 2) ? v51 + v43 * v46 : v51 * v43 + v46;
-                uint8_t v45 = src[v44];
-                if (v53) {
-                  v45 = static_cast<uint8_t>(~v45);
-                }
-                *v41 = v45;
-              }
-              v38 = a3[20];
-              ++v41;
-              v42 += v33;
-              v40 = a3[20];
-              if (v38 <= (v41 - dst)) {
-                break;
-              }
-              v29 = a3[21];
-              v30 = static_cast<int16_t>(a3[6]);
-            }
-            v29 = a3[21];
-            dst = v41;
-          }
-        }
-        if (++v50 >= v29) {
-          break;
-        }
-        v28 = static_cast<int16_t>(a3[7]);
-        v6 = static_cast<int16_t>(a3[3]);
-      }
-    }
-    return a4;
-  }
-
-  int v7 = a3[21];
-  int v8 = a3[20];
-  int v9 = v7 * v8;
-  int v48 = (v7 * v8) >> 1;
-  if (a3[21]) {
-    int v11 = 0;
-    while (1) {
-      int v12 = a3[2];
-      int v13 = a3[6];
-      int v14 = v12 - v11 * (v12 - v13) / v7;
-      int v15 = a3[4] - v12;
-      int v16 = a3[3];
-      int v17 = v7 * v15 - v11 * (v15 + v13 - a3[8]);
-      int v18 = a3[7];
-      int v19 = v16 - v11 * (v16 - v18) / v7;
-      int v20 = v7 * (a3[5] - v16) - v11 * (a3[5] - v16 + v18 - a3[9]);
-      if (static_cast<uint16_t>(v8)) {
-        int v21 = v48;
-        int v22 = 0;
-        int v23 = v48;
-        do {
-          ++v22;
-          int v25 = v21 >> 31;
-          int v24 = v21;
-          ++dst;
-          v21 += v20;
-          int v26 = static_cast<int>(a3[0] * (v19 + static_cast<int64_t>(static_cast<uint64_t>(v24) | (static_cast<uint64_t>(v25) << 32)) / v9));
-          int v27 = v23;
-          v23 += v17;
-          dst[-1] = src[v26 + v14 + v27 / v9];
-        } while (a3[20] > v22);
-        v7 = a3[21];
-      }
-      if (v7 <= ++v11) {
+// Fully matches `probe` against the prefilter's nearest users only; ties go to
+// the lower fid, as in the engine's search, and a raw score reaching `stop_at`
+// (0 = never) ends the scan. False when the prefilter is off or cannot tell.
+static bool PrefilterSearch(const uint8_t *templ, size_t len, void *probe, int stop_at, uint32_t *fid, int *score) {
+  unsigned int permille = g_prefilter_keep;
+  if (!permille || !SeedPrefilter()) {
+    return false;
+  }
+  zkfp::FingerSketch sketch[kSketchMaxFingers];
+  size_t sketched = zkfp::SketchTemplate(templ, len, sketch, kSketchMaxFingers);
+  if (!sketched) {
+    return false;
+  }
+  size_t keep = std::max(kPrefilterMinKeep, (g_prefilter.Users() * permille + 999) / 1000);
+  std::vector<uint32_t> candidates;
+  if (!g_prefilter.Candidates(sketch, sketched, keep, &candidates)) {
+    return false;
+  }
+  *fid = 0;
+  *score = 0;
+  for (uint32_t c : candidates) {
+    int s = 0;
+    if (!IEngine_MatchUser(probe, c, &s, nullptr) && (s > *score || (s == *score && s > 0 && c < *fid))) {
+      *score = s;
+      *fid = c;
+      if (stop_at && s >= stop_at) {
         break;
       }
-      v8 = a3[20];
     }
   }
-  return v7 * v8;
+  return true;
+}
+
+// Lays a sensor frame out as the engine's fixed-size input: rescaled to the
+// engine's resolution when the sensor runs at another one, then centred.
+static void BiokeyEngineImage(const void *raw, int w, int h, void *dst) {
+  zkfp::ResampleCenter(static_cast<const uint8_t *>(raw), w, h, static_cast<size_t>(w), g_sensor_dpi,
+                       static_cast<uint8_t *>(dst), kEngineWidth, kEngineHeight, kEngineDpi,
+                       zkfp::ResampleFilter::Auto, false);
+}
+
+// Centres an image on the engine canvas and writes it to `out` (kEngineBmpLen
+// bytes) as an engine-ready BMP, in one pass over the pixels. `rotate` flips
+// the rows. An empty view gives a blank canvas.
+static void biokey_ConvertBmp(const zkfp::ImageView &view, uint8_t *out, int rotate) {
+  std::memcpy(out, kEngineBmpHeader.data(), kEngineBmpHeader.size());
+  // The BMP is bottom-up, so top-down rows already come out flipped.
+  bool flip = view.bottom_up ? rotate != 0 : rotate == 0;
+  zkfp::CropCenter(view.pixels, view.width, view.height, view.stride, out + zkfp::kBmpHeaderLen, kEngineWidth,
+                   kEngineHeight, flip);
 }
 
 } // namespace
@@ -598,7 +603,9 @@ ZKINTERFACE _BOOL8 APICALL BIOKEY_SET_PARAMETER(void *ctx, unsigned int code, un
         g_last_error = 1116;
         return 0;
       }
-      if (value - 1 > 1) {
+      // Samples BIOKEY_GENTEMPLATE_EX keeps: 1 for the best only, up to
+      // kGenMaxSamples.
+      if (value - 1 >= static_cast<unsigned int>(kGenMaxSamples)) {
         g_last_error = 1101;
         return 0;
       }
@@ -632,12 +639,62 @@ ZKINTERFACE _BOOL8 APICALL BIOKEY_SET_PARAMETER(void *ctx, unsigned int code, un
       }
       reinterpret_cast<BioKeyHandle *>(ctx)->field14 = value;
       return 1;
+    case 0x1395:
+      // Sensor resolution; frames at any other than kEngineDpi are rescaled.
+      if (value > 4000) {
+        g_last_error = 1101;
+        return 0;
+      }
+      g_sensor_dpi = static_cast<int>(value);
+      return 1;
+    case 0x1396:
+    case 0x1397:
+      // Threads for untagged 1:N searches over the sharded gallery (0 leaves
+      // them to the engine), and the gallery's shard count (0 = one per thread).
+      if (!ctx) {
+        g_last_error = 1116;
+        return 0;
+      }
+      if (value > (code == 0x1396 ? 64u : 256u)) {
+        g_last_error = 1101;
+        return 0;
+      }
+      (code == 0x1396 ? g_gallery_threads : g_gallery_shards) = value;
+      g_gallery.Configure(g_gallery_threads, g_gallery_shards);
+      return 1;
+    case 0x1398:
+      // Per mille of the enrolled users the prefilter passes on to full
+      // matching; 0 matches them all.
+      if (!ctx) {
+        g_last_error = 1116;
+        return 0;
+      }
+      if (value > 1000) {
+        g_last_error = 1101;
+        return 0;
+      }
+      g_prefilter_keep = value;
+      return 1;
+    case 0x1399:
+      if (!ctx) {
+        g_last_error = 1116;
+        return 0;
+      }
+      if (value > 100) {
+        g_last_error = 1101;
+        return 0;
+      }
+      g_early_exit = static_cast<int>(value);
+      return 1;
     default:
       if (!ctx) {
         g_last_error = 1116;
         return 0;
       }
       g_last_error = IEngine_SetParameter(code, value);
+      if (!g_last_error && code == 1) {
+        g_find_gate = static_cast<int>(value);
+      }
       return g_last_error == 0;
   }
 }
@@ -666,6 +723,15 @@ ZKINTERFACE int64_t APICALL BIOKEY_GET_PARAMETER(void *ctx, int code, int *out)
       return ret == 0;
     }
     case 5004: {
+      unsigned fingers = 0;
+      uint32_t bytes = 0;
+      if (SeedFingerIndex() && g_finger_index.Find(static_cast<unsigned int>(*out), &fingers, &bytes)) {
+        g_last_error = 0;
+        *out = static_cast<int>(fingers);
+        return 1;
+      }
+      // Not enrolled, or the index is unavailable: the engine has the answer
+      // and the error code.
       IEngine_ClearUser(g_user_primary);
       g_last_error = IEngine_GetUser(g_user_primary, static_cast<unsigned int>(*out));
       if (g_last_error) {
@@ -687,6 +753,11 @@ ZKINTERFACE int64_t APICALL BIOKEY_GET_PARAMETER(void *ctx, int code, int *out)
     case 5007:
       return 1;
     case 5008: {
+      unsigned fingers = 0;
+      if (SeedFingerIndex() && g_finger_index.BaseFingers(static_cast<unsigned int>(*out), &fingers)) {
+        *out = static_cast<int>(fingers);
+        return 1;
+      }
       int v5 = *out;
       unsigned int v6 = 0;
       int v7 = 0;
@@ -714,6 +785,23 @@ ZKINTERFACE int64_t APICALL BIOKEY_GET_PARAMETER(void *ctx, int code, int *out)
       *out = v7;
       return 1;
     }
+    case 5009: {
+      // Stored template length of the fid in *out, 0 if it is not enrolled.
+      unsigned fingers = 0;
+      uint32_t bytes = 0;
+      if (SeedFingerIndex() && g_finger_index.Find(static_cast<unsigned int>(*out), &fingers, &bytes)) {
+        *out = static_cast<int>(bytes);
+        return 1;
+      }
+      int len = static_cast<int>(sizeof(g_buf_c));
+      IEngine_ClearUser(g_user_primary);
+      g_last_error = IEngine_GetUser(g_user_primary, static_cast<unsigned int>(*out));
+      if (!g_last_error) {
+        g_last_error = IEngine_ExportUserTemplate(g_user_primary, 1, g_buf_c, &len);
+      }
+      *out = g_last_error ? 0 : len;
+      return g_last_error == 0;
+    }
     default:
       return 1;
   }
@@ -723,20 +811,12 @@ ZKINTERFACE _BOOL8 APICALL BIOKEY_MATCHINGPARAM(void *ctx, int64_t, int val) {
   if (!ctx) {
     return 0;
   }
-  if (val > 100) {
-    val = 100;
-  }
-  int v = 0;
-  if (g_thresh_mode == 1) {
-    v = g_thresh_mul * (val - 35);
-  } else {
-    v = g_thresh_mul * val;
-  }
-  int p = v + g_thresh_step;
-  if (g_thresh_step >= p) {
-    p = g_thresh_step;
+  int p = RawScore(val);
+  if (IEngine_SetParameter(1, p)) {
+    return 0;
   }
-  return static_cast<unsigned int>(IEngine_SetParameter(1, p)) == 0;
+  g_find_gate = p;
+  return 1;
 }
 
 ZKINTERFACE int64_t APICALL BIOKEY_INIT(int64_t a1, uint16_t *cfg, int64_t, int64_t, int64_t a5) {
@@ -774,7 +854,7 @@ ZKINTERFACE int64_t APICALL BIOKEY_INIT_SIMPLE(int64_t, int width, int height, i
   IEngine_SetParameter(8, -1);
   IEngine_GetUserLimit(&user_limit);
   IEngine_GetVersionInfo(ver_info);
-  std::printf("10 Algorithm Version:%d.%d, Limit:%d\n", ver_info[0], ver_info[1], user_limit);
+  zkfp::LogInfo("10 Algorithm Version:%d.%d, Limit:%d", ver_info[0], ver_info[1], user_limit);
 
   int inited = IEngine_InitModule();
   unsigned int v5 = 0;
@@ -819,9 +899,10 @@ ZKINTERFACE int64_t APICALL BIOKEY_INIT_SIMPLE(int64_t, int width, int height, i
     }
   }
 
-  auto *ctx = static_cast<BioKeyHandle *>(std::calloc(0x40, 1));
+  auto *ctx = static_cast<BioKeyHandle *>(std::calloc(1, sizeof(BioKeyHandle)));
   ctx->field0 = 0;
   ctx->merge_mode = 1;
+  ctx->frames = new (std::nothrow) zkfp::ImageRing(kImageRingSlots);
 
   g_width = width;
   g_height = height;
@@ -850,16 +931,26 @@ ZKINTERFACE int64_t APICALL BIOKEY_INIT_SIMPLE(int64_t, int width, int height, i
     if (!eq) {
       int ret = IEngine_Connect(g_db_name, cursor);
       g_is_memory_db = 0;
+      g_finger_index.Reset(false);
+      g_tag_index.Reset(false);
+      g_gallery.Reset(false);
+      g_prefilter.Reset(false);
       if (ret) {
         g_last_error = ret;
+        delete ctx->frames;
         std::free(ctx);
         return 0;
       }
     } else {
       int ret = IEngine_Connect("type=memory", cursor);
       g_is_memory_db = 1;
+      g_finger_index.Reset(true);
+      g_tag_index.Reset(true);
+      g_gallery.Reset(true);
+      g_prefilter.Reset(true);
       if (ret) {
         g_last_error = ret;
+        delete ctx->frames;
         std::free(ctx);
         return 0;
       }
@@ -867,8 +958,13 @@ ZKINTERFACE int64_t APICALL BIOKEY_INIT_SIMPLE(int64_t, int width, int height, i
   } else {
     int ret = IEngine_Connect("type=memory", p);
     g_is_memory_db = 1;
+    g_finger_index.Reset(true);
+    g_tag_index.Reset(true);
+    g_gallery.Reset(true);
+    g_prefilter.Reset(true);
     if (ret) {
       g_last_error = ret;
+      delete ctx->frames;
       std::free(ctx);
       return 0;
     }
@@ -916,9 +1012,22 @@ ZKINTERFACE int64_t APICALL BIOKEY_CLOSE(BioKeyHandle *ctx) {
   IEngine_FreeUser(g_user_primary);
   IEngine_FreeUser(g_user_secondary);
   IEngine_FreeUser(g_user_temp);
+  FreeMatchContexts();
+  g_template_cache.SetCapacity(0);
+  g_finger_index.Reset(false);
+  g_tag_index.Reset(false);
+  g_gallery.Configure(0, 0);
+  g_gallery_threads = 0;
+  g_gallery_shards = 0;
+  g_find_gate = 0;
+  g_prefilter.Reset(false);
+  g_prefilter_keep = 0;
   if (ctx->buf_base) {
     std::free(ctx->buf_base);
   }
+  std::free(ctx->conv_buf);
+  delete ctx->frames;
+  delete ctx->linear;
   std::free(ctx);
   IEngine_TerminateModule();
   return 1;
@@ -928,9 +1037,9 @@ ZKINTERFACE int64_t APICALL BIOKEY_GETPARAM(BioKeyHandle *ctx, _DWORD *a2, _DWOR
   if (!ctx) {
     return 0;
   }
-  *a2 = 500;
-  *a3 = 280;
-  *a4 = 360;
+  *a2 = kEngineDpi;
+  *a3 = kEngineWidth;
+  *a4 = kEngineHeight;
   return 1;
 }
 
@@ -945,24 +1054,25 @@ ZKINTERFACE int64_t APICALL BIOKEY_EXTRACT(BioKeyHandle *ctx, const void *raw, v
 
   int v5 = static_cast<int>(ctx->img_buf_size);
   int v6 = static_cast<int>(ctx->buf_total);
-  void *buf = ctx->buf_base2;
 
   tmp[0] = v6 - v5;
-  std::memset(buf, 0xFF, v5);
-  sub_39B0(raw, ctx->buf_base2, g_width, g_height, 280, 360);
+  BiokeyEngineImage(raw, g_width, g_height, ctx->buf_base2);
 
-  if (IEngine_ConvertRawImage2Bmp(ctx->buf_base2, 280, 360, ctx->buf_ptr, tmp)) {
+  uint8_t *bmp = BiokeyFrameBuffer(ctx, tmp[0], static_cast<uint8_t *>(ctx->buf_ptr));
+  if (IEngine_ConvertRawImage2Bmp(ctx->buf_base2, kEngineWidth, kEngineHeight, bmp, tmp)) {
+    BiokeyFrameDone(ctx, 0, 0, 0);
     g_last_error = 0;
-    std::printf("Convert rawimage failed\n:%d", 0);
+    zkfp::LogWarn("Convert rawimage failed");
     return 0;
   }
+  BiokeyFrameDone(ctx, kEngineWidth, kEngineHeight, tmp[0]);
 
   result = IEngine_ClearUser(g_user_primary);
   if (!result) {
-    int v9 = IEngine_AddFingerprint(g_user_primary, 0, ctx->buf_ptr);
+    int v9 = IEngine_AddFingerprint(g_user_primary, 0, bmp);
     if (v9) {
       g_last_error = v9;
-      std::printf("AddFingerprint failed\n:%d", v9);
+      zkfp::LogWarn("AddFingerprint failed: %d", v9);
       return result;
     }
   }
@@ -984,7 +1094,7 @@ ZKINTERFACE int64_t APICALL BIOKEY_EXTRACT(BioKeyHandle *ctx, const void *raw, v
   if (v12 > 0x67E) {
     return result;
   }
-  std::printf("template size invalid :%d\n", tmp[0]);
+  zkfp::LogWarn("template size invalid: %d", tmp[0]);
   return 0;
 }
 
@@ -996,75 +1106,165 @@ ZKINTERFACE int64_t APICALL BIOKEY_EXTRACT_SP(BioKeyHandle *ctx, const void *raw
   return BIOKEY_EXTRACT(ctx, raw, out);
 }
 
+// Crops a sensor frame to the engine's input and extracts it into
+// g_user_primary. False when there is nothing to export.
+static bool BiokeyLoadFrame(BioKeyHandle *ctx, const void *raw) {
+  int info = static_cast<int>(ctx->buf_total) - static_cast<int>(ctx->img_buf_size);
+  BiokeyEngineImage(raw, g_width, g_height, ctx->buf_base2);
+  uint8_t *bmp = BiokeyFrameBuffer(ctx, info, static_cast<uint8_t *>(ctx->buf_ptr));
+  int ret = IEngine_ConvertRawImage2Bmp(ctx->buf_base2, kEngineWidth, kEngineHeight, bmp, &info);
+  BiokeyFrameDone(ctx, kEngineWidth, kEngineHeight, ret ? 0 : info);
+  if (ret) {
+    g_last_error = 0;
+    zkfp::LogWarn("Convert rawimage failed");
+    return false;
+  }
+  if (!IEngine_ClearUser(g_user_primary) && IEngine_AddFingerprint(g_user_primary, 0, bmp) != 0) {
+    g_last_error = 0;
+    return false;
+  }
+  return true;
+}
+
 ZKINTERFACE int64_t APICALL BIOKEY_EXTRACT_BY_FORMAT(BioKeyHandle *ctx, const void *raw, void *out, int out_len, unsigned int fmt) {
-  unsigned int result = 0;
-  int quality = 0;
-  int tmp[11] = {0};
+  if (!ctx || !BiokeyLoadFrame(ctx, raw)) {
+    return 0;
+  }
+  int len = out_len;
+  g_last_error = IEngine_ExportUserTemplate(g_user_primary, fmt, out, &len);
+  if (g_last_error) {
+    if (len <= 0) {
+      return len;
+    }
+    zkfp::LogWarn("template size invalid: %d", len);
+    return 0;
+  }
+  if (len > 0) {
+    int quality = 0;
+    IEngine_GetFingerprintQuality(g_user_primary, 0, &quality);
+    g_last_quality = quality;
+  }
+  return len;
+}
 
-  if (!ctx) {
-    return result;
+// One extraction exported in `count` formats: fmts[i] goes to outs[i], which
+// has room for caps[i] bytes, exactly as BIOKEY_EXTRACT_BY_FORMAT would write
+// it. lens[i] receives its length, or the negated size a short buffer needed,
+// or 0. Returns how many formats were exported; `quality`, when given, receives
+// the fingerprint's quality.
+ZKINTERFACE int64_t APICALL BIOKEY_EXTRACT_FORMATS(BioKeyHandle *ctx, const void *raw, const unsigned int *fmts,
+                                                   void *const *outs, const int *caps, int *lens, int count,
+                                                   int *quality) {
+  if (!ctx || !fmts || !outs || !caps || !lens || count <= 0) {
+    return 0;
+  }
+  for (int i = 0; i < count; ++i) {
+    lens[i] = 0;
+  }
+  if (!BiokeyLoadFrame(ctx, raw)) {
+    return 0;
   }
 
-  int v6 = static_cast<int>(ctx->img_buf_size);
-  int v8 = static_cast<int>(ctx->buf_total);
-  void *buf = ctx->buf_base2;
-  tmp[0] = v8 - v6;
-  std::memset(buf, 0xFF, v6);
-  sub_39B0(raw, ctx->buf_base2, g_width, g_height, 280, 360);
-  result = IEngine_ConvertRawImage2Bmp(ctx->buf_base2, 280, 360, ctx->buf_ptr, tmp);
-  if (result) {
-    result = 0;
-    g_last_error = 0;
-    std::printf("Convert rawimage failed\n:%d", 0);
-  } else if (!IEngine_ClearUser(g_user_primary) && (IEngine_AddFingerprint(g_user_primary, 0, ctx->buf_ptr) != 0)) {
-    g_last_error = 0;
-  } else {
-    tmp[0] = out_len;
-    g_last_error = IEngine_ExportUserTemplate(g_user_primary, fmt, out, tmp);
-    if (g_last_error) {
-      if (tmp[0] <= 0) {
-        return tmp[0];
-      }
-      std::printf("template size invalid :%d\n", tmp[0]);
-    } else {
-      result = tmp[0];
-      if (tmp[0] > 0) {
-        IEngine_GetFingerprintQuality(g_user_primary, 0, &quality);
-        result = tmp[0];
-        g_last_quality = quality;
-      }
+  int exported = 0;
+  int first_error = 0;
+  for (int i = 0; i < count; ++i) {
+    int len = caps[i];
+    int ret = IEngine_ExportUserTemplate(g_user_primary, fmts[i], outs[i], &len);
+    if (ret) {
+      first_error = first_error ? first_error : ret;
+      lens[i] = len > caps[i] ? -len : 0;
+      zkfp::LogWarn("format %u not exported: %d", fmts[i], ret);
+      continue;
+    }
+    lens[i] = len;
+    exported += len > 0;
+  }
+  g_last_error = first_error;
+  if (exported) {
+    int q = 0;
+    IEngine_GetFingerprintQuality(g_user_primary, 0, &q);
+    g_last_quality = q;
+    if (quality) {
+      *quality = q;
     }
   }
-  return result;
+  return exported;
 }
 
-ZKINTERFACE int64_t APICALL BIOKEY_EXTRACT_GRAYSCALEDATA(
-    BioKeyHandle *ctx, const void *raw, unsigned int w, unsigned int h, void *out, int out_len) {
+// Extracts from a strided grayscale image at `dpi` (0 = the engine's) straight
+// into `out`, after the zkfp::kEnhance* steps in `enhance`. Passing a null `out`
+// returns the largest template the engine can produce; a negative result is the
+// size `out_len` fell short of.
+ZKINTERFACE int64_t APICALL BIOKEY_EXTRACT_IMAGE(BioKeyHandle *ctx, const void *pixels, unsigned int w, unsigned int h,
+                                                 unsigned int stride, int bottom_up, unsigned int dpi,
+                                                 unsigned int enhance, void *out, int out_len) {
   int quality = 0;
   if (!ctx) {
     return 0;
   }
-
-  int alloc_len = static_cast<int>(h * w + 2048);
-  void *tmp = std::malloc(alloc_len);
-  if (!tmp) {
+  if (!out) {
+    return kMaxTemplateLen;
+  }
+  if (!pixels || !w || !h || stride < w) {
     return 0;
   }
 
-  int info = alloc_len;
-  std::memset(tmp, 0xFF, alloc_len);
-  unsigned int v12 = IEngine_ConvertRawImage2Bmp(raw, w, h, tmp, &info);
-  if (v12) {
+  // The engine takes any size, so nothing is cropped here. An image at another
+  // resolution is rescaled in full ahead of the BMP, one that is strided or
+  // bottom-up is laid out top-down, and enhancement runs over whatever is
+  // staged; anything else is read where it lies.
+  int src_dpi = dpi ? static_cast<int>(dpi) : kEngineDpi;
+  unsigned int sw = w;
+  unsigned int sh = h;
+  if (src_dpi != kEngineDpi) {
+    sw = static_cast<unsigned int>(zkfp::ScaledExtent(static_cast<int>(w), src_dpi, kEngineDpi));
+    sh = static_cast<unsigned int>(zkfp::ScaledExtent(static_cast<int>(h), src_dpi, kEngineDpi));
+  }
+  bool direct = src_dpi == kEngineDpi && !bottom_up && stride == w;
+  size_t staged = direct && !enhance ? 0 : static_cast<size_t>(sw) * sh;
+
+  const void *image = pixels;
+  int info = static_cast<int>(sh * sw + 2048);
+  uint8_t *bmp = BiokeyFrameBuffer(ctx, static_cast<size_t>(info), nullptr);
+  uint8_t *conv = nullptr;
+  if (staged || !bmp) {
+    conv = BiokeyConvBuffer(ctx, staged + (bmp ? 0 : static_cast<size_t>(info)));
+    if (!conv) {
+      if (bmp) {
+        BiokeyFrameDone(ctx, 0, 0, 0);
+      }
+      return 0;
+    }
+    if (!bmp) {
+      bmp = conv + staged;
+    }
+  }
+  if (staged) {
+    const uint8_t *src = static_cast<const uint8_t *>(pixels);
+    size_t src_stride = stride;
+    if (!direct) {
+      zkfp::ResampleCenter(src, static_cast<int>(w), static_cast<int>(h), stride, src_dpi, conv, static_cast<int>(sw),
+                           static_cast<int>(sh), kEngineDpi, zkfp::ResampleFilter::Auto, bottom_up != 0);
+      src = conv;
+      src_stride = sw;
+    }
+    if (enhance) {
+      zkfp::EnhanceImage(src, src_stride, conv, sw, static_cast<int>(sw), static_cast<int>(sh), enhance);
+    }
+    image = conv;
+  }
+
+  if (IEngine_ConvertRawImage2Bmp(image, sw, sh, bmp, &info)) {
+    BiokeyFrameDone(ctx, 0, 0, 0);
     g_last_error = 0;
-    std::free(tmp);
     return 0;
   }
+  BiokeyFrameDone(ctx, sw, sh, info);
 
   if (!IEngine_ClearUser(g_user_primary)) {
-    int add_ret = IEngine_AddFingerprint(g_user_primary, 0, tmp);
+    int add_ret = IEngine_AddFingerprint(g_user_primary, 0, bmp);
     if (add_ret != 0) {
       g_last_error = add_ret;
-      std::free(tmp);
       return 0;
     }
   }
@@ -1072,20 +1272,48 @@ ZKINTERFACE int64_t APICALL BIOKEY_EXTRACT_GRAYSCALEDATA(
   info = out_len;
   g_last_error = IEngine_ExportUserTemplate(g_user_primary, 1, out, &info);
   if (g_last_error) {
-    if ((unsigned int)(info - 1) >= 0x67F) {
-      v12 = info;
-    }
-  } else {
-    v12 = info;
-    if ((unsigned int)(info - 1) <= 0x67E) {
-      bio_EncodeData(out);
-      IEngine_GetFingerprintQuality(g_user_primary, 0, &quality);
-      v12 = info;
-      g_last_quality = quality;
-    }
+    return info > out_len ? -static_cast<int64_t>(info) : 0;
+  }
+  if (static_cast<unsigned int>(info - 1) <= 0x67E) {
+    bio_EncodeData(out);
+    IEngine_GetFingerprintQuality(g_user_primary, 0, &quality);
+    g_last_quality = quality;
+  }
+  return info;
+}
+
+// A sensor frame: top-down and unpadded, at the sensor's resolution. `flag`
+// carries the device's enhancement steps.
+ZKINTERFACE int64_t APICALL BIOKEY_EXTRACT_GRAYSCALEDATA(
+    BioKeyHandle *ctx, const void *raw, unsigned int w, unsigned int h, void *out, int out_len, int flag) {
+  return BIOKEY_EXTRACT_IMAGE(ctx, raw, w, h, w, 0, static_cast<unsigned int>(g_sensor_dpi),
+                              static_cast<unsigned int>(flag), out, out_len);
+}
+
+// Pins a recorded extraction image (seq 0 = newest): the BMP exactly as handed to
+// the engine. Returns its sequence number, or 0 once it has been overwritten.
+// The buffer stays valid until BIOKEY_IMAGE_RELEASE.
+ZKINTERFACE int64_t APICALL BIOKEY_IMAGE_ACQUIRE(BioKeyHandle *ctx, unsigned int seq, const void **bmp,
+                                                 unsigned int *bmp_len, unsigned int *w, unsigned int *h) {
+  if (!ctx || !ctx->frames || !bmp || !bmp_len || !w || !h) {
+    return 0;
   }
-  std::free(tmp);
-  return v12;
+  const uint8_t *data = nullptr;
+  size_t bytes = 0;
+  uint32_t got = ctx->frames->Acquire(seq, &data, &bytes, w, h);
+  if (got) {
+    *bmp = data;
+    *bmp_len = static_cast<unsigned int>(bytes);
+  }
+  return got;
+}
+
+ZKINTERFACE int64_t APICALL BIOKEY_IMAGE_RELEASE(BioKeyHandle *ctx, unsigned int seq) {
+  return ctx && ctx->frames && ctx->frames->Release(seq);
+}
+
+ZKINTERFACE int64_t APICALL BIOKEY_IMAGE_LASTSEQ(BioKeyHandle *ctx) {
+  return ctx && ctx->frames ? ctx->frames->LastSeq() : 0;
 }
 
 ZKINTERFACE int64_t APICALL BIOKEY_EXTRACT_BMP(BioKeyHandle *ctx, const char *path, void *out) {
@@ -1096,20 +1324,20 @@ ZKINTERFACE int64_t APICALL BIOKEY_EXTRACT_BMP(BioKeyHandle *ctx, const char *pa
     return result;
   }
 
-  std::vector<uint8_t> bmp_cache(0x25800);
-  int len = 153600;
-  biokey_LoadBmp2Cache(path, bmp_cache.data(), &len);
-
-  std::vector<uint8_t> raw(111040);
-  std::memset(raw.data(), 0xFF, raw.size());
-  biokey_ConvertBmp(reinterpret_cast<char *>(bmp_cache.data()), raw.data(), 280, 360, 0);
+  // The file is mapped and centred straight from the mapping into the BMP the
+  // engine gets, recorded like any other extraction image.
+  zkfp::ImageFile file;
+  file.Open(path, g_width, g_height);
+  uint8_t *raw = BiokeyFrameBuffer(ctx, kEngineBmpLen, static_cast<uint8_t *>(ctx->buf_ptr));
+  biokey_ConvertBmp(file.View(), raw, 0);
+  BiokeyFrameDone(ctx, kEngineWidth, kEngineHeight, static_cast<int>(kEngineBmpLen));
 
   result = IEngine_ClearUser(g_user_primary);
   if (!result) {
-    int v5 = IEngine_AddFingerprint(g_user_primary, 0, raw.data());
+    int v5 = IEngine_AddFingerprint(g_user_primary, 0, raw);
     if (v5 != 0) {
       g_last_error = v5;
-      std::printf("AddFingerprint failed\n:%d", v5);
+      zkfp::LogWarn("AddFingerprint failed: %d", v5);
       return 0;
     }
   }
@@ -1128,153 +1356,153 @@ ZKINTERFACE int64_t APICALL BIOKEY_EXTRACT_BMP(BioKeyHandle *ctx, const char *pa
     }
   } else if (v8 <= 0x67E) {
     result = 0;
-    std::printf("template size invalid :%d\n", tmp_len);
+    zkfp::LogWarn("template size invalid: %d", tmp_len);
   }
 
   return result;
 }
 
-ZKINTERFACE int64_t APICALL BIOKEY_GENTEMPLATE(void *ctx, uint64_t *temps, int count, void *out) {
-  int v34 = 0;
-  int v35 = 0;
-  int v36[2] = {0, 0};
-  int v37 = 0;
-  void *v38 = nullptr;
-  void *v39 = nullptr;
-  void *v40 = nullptr;
-
+// Enrolls one template from `count` samples of the same finger. A single
+// sample is copied as is; otherwise 3..kGenMaxSamples samples are imported and
+// scored in parallel, matched pairwise, and the merge_mode best-quality samples
+// among those that agree with most of the others are kept.
+ZKINTERFACE int64_t APICALL BIOKEY_GENTEMPLATE_EX(void *ctx, uint64_t *temps, int count, void *out, int out_len) {
   if (count <= 0 || !ctx) {
     return 0;
   }
 
   if (count == 1) {
     int len = static_cast<int>(BiokeyInterGetTemplateLen(reinterpret_cast<void *>(temps[0])));
+    if (len > out_len) {
+      return -len;
+    }
     std::memcpy(out, reinterpret_cast<void *>(temps[0]), len);
-    v34 = len;
     return 1;
   }
 
-  if (count != 3) {
-    return 0;
-  }
-
-  int ret = IEngine_ClearUser(g_user_primary);
-  g_last_error = ret;
-  if (ret) {
+  if (count < kGenMinSamples || count > kGenMaxSamples) {
     return 0;
   }
 
-  int len1 = static_cast<int>(BiokeyInterGetTemplateLen(reinterpret_cast<void *>(temps[0])));
-  v38 = g_buf_a;
-  std::memcpy(g_buf_a, reinterpret_cast<void *>(temps[0]), len1);
-  bio_DecodeData(g_buf_a);
-  int r1 = IEngine_ImportUserTemplate(g_user_primary, 1, g_buf_a);
-  IEngine_GetFingerprintQuality(g_user_primary, 0, &v36[0]);
-  g_last_error = r1;
-  if (r1) {
-    std::puts("import fingerprint 1 failed");
-  } else {
-    ret = 1;
-  }
-
-  int len2 = static_cast<int>(BiokeyInterGetTemplateLen(reinterpret_cast<void *>(temps[1])));
-  v39 = g_buf_b;
-  std::memcpy(g_buf_b, reinterpret_cast<void *>(temps[1]), len2);
-  bio_DecodeData(g_buf_b);
-  int r2 = IEngine_ImportUserTemplate(g_user_primary, 1, g_buf_b);
-  IEngine_GetFingerprintQuality(g_user_primary, 1, &v36[1]);
-  g_last_error = r2;
-  if (r2) {
-    std::puts("import fingerprint 2 failed");
-    int len3 = static_cast<int>(BiokeyInterGetTemplateLen(reinterpret_cast<void *>(temps[2])));
-    v40 = g_buf_c;
-    std::memcpy(g_buf_c, reinterpret_cast<void *>(temps[2]), len3);
-    bio_DecodeData(g_buf_c);
-    int r3 = IEngine_ImportUserTemplate(g_user_primary, 1, g_buf_c);
-    IEngine_GetFingerprintQuality(g_user_primary, 2, &v37);
-    g_last_error = r3;
-    if (r3) {
-      std::puts("import fingerprint 3 failed");
-      if (g_last_error) {
-        return 0;
+  // Each sample gets a leased context of its own, so no two workers share an
+  // engine user for the import; the decoded sample stays in its probe_buf.
+  struct Sample {
+    MatchContext *mc = nullptr;
+    int error = 0;
+    int quality = 0;
+    int agree = 0;
+  };
+  struct Samples {
+    Sample at[kGenMaxSamples];
+    ~Samples() {
+      for (Sample &s : at) {
+        if (s.mc) {
+          ReturnMatchContext(s.mc);
+        }
       }
     }
-  } else {
-    int len3 = static_cast<int>(BiokeyInterGetTemplateLen(reinterpret_cast<void *>(temps[2])));
-    v40 = g_buf_c;
-    std::memcpy(g_buf_c, reinterpret_cast<void *>(temps[2]), len3);
-    bio_DecodeData(g_buf_c);
-    int r3 = IEngine_ImportUserTemplate(g_user_primary, 1, g_buf_c);
-    IEngine_GetFingerprintQuality(g_user_primary, 2, &v37);
-    g_last_error = r3;
-    if (r3) {
-      std::puts("import fingerprint 3 failed");
-      if (g_last_error) {
-        return 0;
-      }
+  } samples;
+  for (int i = 0; i < count; ++i) {
+    unsigned int len = BiokeyInterGetTemplateLen(reinterpret_cast<void *>(temps[i]));
+    if (len - 50 > 0x64E) {
+      g_last_error = 1135;
+      return 0;
+    }
+    samples.at[i].mc = LeaseMatchContext();
+    if (!samples.at[i].mc) {
+      return 0;
     }
   }
 
-  if (!ret) {
-    int res = v34;
-    if (res < 0) {
+  ParallelFor(count, [&](int i) {
+    Sample &s = samples.at[i];
+    s.error = IEngine_ClearUser(s.mc->probe);
+    if (s.error) {
+      return;
+    }
+    const void *templ = reinterpret_cast<const void *>(temps[i]);
+    std::memcpy(s.mc->probe_buf, templ, BiokeyInterGetTemplateLen(templ));
+    bio_DecodeData(s.mc->probe_buf);
+    s.error = IEngine_ImportUserTemplate(s.mc->probe, 1, s.mc->probe_buf);
+    if (!s.error) {
+      s.error = IEngine_GetFingerprintQuality(s.mc->probe, 0, &s.quality);
+    }
+  });
+  for (int i = 0; i < count; ++i) {
+    if (samples.at[i].error) {
+      g_last_error = samples.at[i].error;
       return 0;
     }
-    return res;
   }
 
-  int score = 0;
-  int matched = IEngine_MatchFingerprints(g_user_primary, 0, g_user_primary, 2, &score);
-  std::printf("index %d, score %d, errorcode:%d\n", 2, score, matched);
-  if (score <= 0) {
-    return 0;
+  // Consistency matrix, one pair per task; matching only reads both users.
+  int pair_a[kGenMaxSamples * (kGenMaxSamples - 1) / 2];
+  int pair_b[kGenMaxSamples * (kGenMaxSamples - 1) / 2];
+  int pair_score[kGenMaxSamples * (kGenMaxSamples - 1) / 2];
+  int pairs = 0;
+  for (int a = 0; a < count; ++a) {
+    for (int b = a + 1; b < count; ++b) {
+      pair_a[pairs] = a;
+      pair_b[pairs] = b;
+      ++pairs;
+    }
   }
-  matched = IEngine_MatchFingerprints(g_user_primary, 0, g_user_primary, 1, &score);
-  std::printf("index %d, score %d, errorcode:%d\n", 1, score, matched);
-  if (score <= 0) {
-    return 0;
+  ParallelFor(pairs, [&](int p) {
+    pair_score[p] = 0;
+    IEngine_MatchFingerprints(samples.at[pair_a[p]].mc->probe, 0, samples.at[pair_b[p]].mc->probe, 0,
+                              &pair_score[p]);
+  });
+  for (int p = 0; p < pairs; ++p) {
+    if (pair_score[p] > 0) {
+      ++samples.at[pair_a[p]].agree;
+      ++samples.at[pair_b[p]].agree;
+    }
   }
 
-  int v23 = (v36[0] <= v36[1]) ? 1 : 0;
-  if (v36[v23] <= v37) {
-    v23 = 2;
+  // A sample is consistent when it matches at least half of the others; keep
+  // the best of those by quality, ties to the earlier sample.
+  int order[kGenMaxSamples];
+  int consistent = 0;
+  for (int i = 0; i < count; ++i) {
+    if (samples.at[i].agree * 2 >= count - 1) {
+      order[consistent++] = i;
+    }
   }
-  int v24 = (v36[0] >= v36[1]) ? 1 : 0;
-  if (v37 <= v36[v24]) {
-    v24 = 2;
+  if (consistent < 2) {
+    return 0;
+  }
+  std::stable_sort(order, order + consistent,
+                   [&](int a, int b) { return samples.at[a].quality > samples.at[b].quality; });
+  int keep = std::min(consistent, static_cast<int>(reinterpret_cast<BioKeyHandle *>(ctx)->merge_mode));
+  bool kept[kGenMaxSamples] = {};
+  for (int i = 0; i < keep; ++i) {
+    kept[order[i]] = true;
   }
 
   g_last_error = IEngine_ClearUser(g_user_primary);
   if (g_last_error) {
     return 0;
   }
-
-  void *templ_bufs[3] = {v38, v39, v40};
-  if (reinterpret_cast<BioKeyHandle *>(ctx)->merge_mode == 1) {
-    IEngine_ImportUserTemplate(g_user_primary, 1, templ_bufs[v23]);
-  } else {
-    for (int i = 0; i != 3; ++i) {
-      if (v24 != i) {
-        IEngine_ImportUserTemplate(g_user_primary, 1, templ_bufs[i]);
-      }
+  for (int i = 0; i < count; ++i) {
+    if (kept[i]) {
+      IEngine_ImportUserTemplate(g_user_primary, 1, samples.at[i].mc->probe_buf);
     }
   }
 
-  int chosen_quality = (v23 == 2) ? v37 : v36[v23];
-  v34 = 2048;
-  g_last_quality = chosen_quality;
-  g_last_error = IEngine_ExportUserTemplate(g_user_primary, 1, out, &v34);
+  int len = out_len;
+  g_last_quality = samples.at[order[0]].quality;
+  g_last_error = IEngine_ExportUserTemplate(g_user_primary, 1, out, &len);
   if (g_last_error) {
-    return 0;
+    return len > out_len ? -len : 0;
   }
-  int result = v34;
-  if (v34 > 0) {
+  if (len > 0) {
     bio_EncodeData(out);
   }
-  if (result < 0) {
-    return 0;
-  }
-  return result;
+  return len < 0 ? 0 : len;
+}
+
+ZKINTERFACE int64_t APICALL BIOKEY_GENTEMPLATE(void *ctx, uint64_t *temps, int count, void *out) {
+  return BIOKEY_GENTEMPLATE_EX(ctx, temps, count, out, 2048);
 }
 
 ZKINTERFACE int64_t APICALL BIOKEY_GENTEMPLATE_SP(void *ctx, void *t1, void *t2, void *t3, unsigned int count, void *out) {
@@ -1282,203 +1510,194 @@ ZKINTERFACE int64_t APICALL BIOKEY_GENTEMPLATE_SP(void *ctx, void *t1, void *t2,
   return BIOKEY_GENTEMPLATE(ctx, temps, static_cast<int>(count), out);
 }
 
-ZKINTERFACE int64_t APICALL BIOKEY_VERIFY(void *ctx, const char *t1, const char *t2) {
-  int score = 0;
+// 1:1 match of two templates. `threshold` (0..100) is applied here instead of
+// through the engine's global parameter; below it the result is 0.
+ZKINTERFACE int64_t APICALL BIOKEY_VERIFY_EX(void *ctx, const char *t1, const char *t2, int threshold) {
   if (!ctx) {
     return 0;
   }
 
-  if (IEngine_ClearUser(g_user_primary) || IEngine_ClearUser(g_user_secondary)) {
-    g_last_error = 0;
-    return 0;
-  }
-
   unsigned int len1 = BiokeyInterGetTemplateLen(t1);
   unsigned int len2 = BiokeyInterGetTemplateLen(t2);
   if (len1 - 50 > 0x64E || len2 - 50 > 0x64E) {
     g_last_error = 1135;
-    std::printf("1:1 fp template len error, 1:%d, 2:%d\n", len1, len2);
+    zkfp::LogWarn("1:1 fp template len error, 1:%d, 2:%d", len1, len2);
     return 0;
   }
 
-  std::memcpy(g_buf_b, t1, len1);
-  std::memcpy(g_buf_c, t2, len2);
-  bio_DecodeData(g_buf_b);
-  bio_DecodeData(g_buf_c);
-
-  unsigned int matched = IEngine_ImportUserTemplate(g_user_primary, 1, g_buf_b);
-  g_last_error = matched;
-  if (matched || ((matched = IEngine_ImportUserTemplate(g_user_secondary, 1, g_buf_c)), (g_last_error = matched) != 0)) {
-    std::printf("import fingerprint failed,lasterror:%d\n", matched);
-    if (score <= 0) {
-      g_last_error = matched;
-      return 0;
-    }
-  } else {
-    matched = IEngine_MatchUsers(g_user_primary, g_user_secondary, &score);
-    if (score <= 0) {
-      g_last_error = matched;
-      if (matched) {
-        return 0;
-      }
-      return 0;
-    }
+  MatchLease mc;
+  if (!mc) {
+    g_last_error = 0;
+    return 0;
   }
 
-  int s = (score - g_thresh_step) / g_thresh_mul;
-  if (g_thresh_mode == 1) {
-    s += 35;
+  CachedImport probe(mc->probe, mc->probe_buf, t1, len1);
+  CachedImport gallery(mc->gallery, mc->gallery_buf, t2, len2);
+  int ret = probe.Import();
+  if (!ret) {
+    ret = gallery.Import();
   }
-  if (s > 100) {
-    s = 100;
+  g_last_error = ret;
+  if (ret) {
+    zkfp::LogWarn("import fingerprint failed, lasterror:%d", ret);
+    return 0;
   }
-  score = s;
 
-  g_last_error = matched;
-  if (matched) {
+  int raw = 0;
+  g_last_error = IEngine_MatchUsers(probe.user(), gallery.user(), &raw);
+  if (g_last_error) {
     return 0;
   }
-  if (score >= 0) {
-    return static_cast<unsigned int>(score);
-  }
-  return matched;
+  int score = NormalizeScore(raw);
+  return score >= threshold ? score : 0;
 }
 
-ZKINTERFACE int64_t APICALL BIOKEY_VERIFYBYID(int ctx, unsigned int uid, const void *templ) {
-  int score = 0;
+ZKINTERFACE int64_t APICALL BIOKEY_VERIFY(void *ctx, const char *t1, const char *t2) {
+  return BIOKEY_VERIFY_EX(ctx, t1, t2, 0);
+}
+
+// 1:1 match against enrolled user `uid`; `threshold` as for BIOKEY_VERIFY_EX.
+ZKINTERFACE int64_t APICALL BIOKEY_VERIFYBYID_EX(void *ctx, unsigned int uid, const void *templ, int threshold) {
   if (!ctx) {
     return 0;
   }
-  g_last_error = IEngine_ClearUser(g_user_primary);
-  if (g_last_error) {
+
+  unsigned int len = BiokeyInterGetTemplateLen(templ);
+  if (len - 50 > 0x64E) {
+    g_last_error = 1135;
     return 0;
   }
 
-  int len = static_cast<int>(BiokeyInterGetTemplateLen(templ));
-  std::memcpy(g_buf_b, templ, len);
-  bio_DecodeData(g_buf_b);
-
-  g_last_error = IEngine_ImportUserTemplate(g_user_primary, 1, g_buf_b);
+  MatchLease mc;
+  if (!mc) {
+    return 0;
+  }
+  CachedImport probe(mc->probe, mc->probe_buf, templ, len);
+  g_last_error = probe.Import();
   if (g_last_error) {
     return 0;
   }
 
-  int matched = IEngine_MatchUser(g_user_primary, uid, &score, nullptr);
-  if (score > 0) {
-    int s = (score - g_thresh_step) / g_thresh_mul;
-    if (g_thresh_mode == 1) {
-      s += 35;
-    }
-    if (s > 100) {
-      s = 100;
-    }
-    score = s;
+  int raw = 0;
+  g_last_error = IEngine_MatchUser(probe.user(), uid, &raw, nullptr);
+  if (g_last_error) {
+    return 0;
   }
-  g_last_error = matched;
-  if (matched) {
+  int score = NormalizeScore(raw);
+  return score >= threshold ? score : 0;
+}
+
+ZKINTERFACE int64_t APICALL BIOKEY_VERIFYBYID(int ctx, unsigned int uid, const void *templ) {
+  if (!ctx) {
     return 0;
   }
-  if (score >= 0) {
-    return static_cast<unsigned int>(score);
+  return BIOKEY_VERIFYBYID_EX(reinterpret_cast<void *>(static_cast<intptr_t>(ctx)), uid, templ, 0);
+}
+
+// Entries in the cache of imported templates used by 1:1 verification; 0 turns
+// it off and frees them all. Cleared again by BIOKEY_CLOSE.
+ZKINTERFACE int64_t APICALL BIOKEY_TEMPLATE_CACHE_SIZE(void *ctx, unsigned int entries) {
+  if (!ctx) {
+    return 0;
   }
-  return 0;
+  g_template_cache.SetCapacity(entries);
+  return 1;
 }
 
-ZKINTERFACE int64_t APICALL BIOKEY_IDENTIFYTEMPBYTAG(void *ctx, const char *templ, int *uid, int *score, const char *tag) {
+// Template cache hits (`which` 0) or misses (1), zeroed after reading with `reset`.
+ZKINTERFACE uint64_t APICALL BIOKEY_TEMPLATE_CACHE_STAT(void *ctx, int which, int reset) {
   if (!ctx) {
     return 0;
   }
+  return which ? g_template_cache.Misses(reset != 0) : g_template_cache.Hits(reset != 0);
+}
+
+// 1:N search, optionally limited to users carrying `tag`: with a memory database
+// only that partition of the tag index is matched. Returns 1 with *uid set
+// when the best normalized *score reaches `threshold`; otherwise *uid is 0 and
+// *score still reports the best candidate.
+ZKINTERFACE int64_t APICALL BIOKEY_IDENTIFYTEMP_EX(void *ctx, const char *templ, const char *tag, int threshold,
+                                                   int *uid, int *score) {
+  if (!ctx || !uid || !score) {
+    return 0;
+  }
+  *uid = 0;
+  *score = 0;
 
-  int ret = IEngine_ClearUser(g_user_primary);
-  g_last_error = ret;
   unsigned int len = BiokeyInterGetTemplateLen(templ);
   if (len - 50 > 0x64E) {
     g_last_error = 1135;
-    std::printf("1:N fp template len error, Len:%d\n", len);
+    zkfp::LogWarn("1:N fp template len error, Len:%d", len);
     return 0;
   }
 
-  std::memcpy(g_buf_a, templ, len);
-  if (!bio_DecodeData(g_buf_a)) {
-    std::puts("DecodeData failed");
+  MatchLease mc;
+  if (!mc) {
+    return 0;
+  }
+  g_last_error = IEngine_ClearUser(mc->probe);
+  if (g_last_error) {
     return 0;
   }
 
-  if (ret) {
-    if (*score > 0) {
-      int s = (*score - g_thresh_step) / g_thresh_mul;
-      if (g_thresh_mode == 1) {
-        s += 35;
-      }
-      if (s > 100) {
-        s = 100;
-      }
-      *score = s;
-      return 0;
-    }
+  std::memcpy(mc->probe_buf, templ, len);
+  if (!bio_DecodeData(mc->probe_buf)) {
+    zkfp::LogWarn("DecodeData failed");
     return 0;
   }
 
-  g_last_error = IEngine_ImportUserTemplate(g_user_primary, 1, g_buf_a);
+  g_last_error = IEngine_ImportUserTemplate(mc->probe, 1, mc->probe_buf);
   if (g_last_error) {
-    if (*score > 0) {
-      int s = (*score - g_thresh_step) / g_thresh_mul;
-      if (g_thresh_mode == 1) {
-        s += 35;
-      }
-      if (s > 100) {
-        s = 100;
-      }
-      *score = s;
-      return 0;
-    }
     return 0;
   }
 
-  *uid = 0;
-  *score = 0;
+  int found = 0;
+  int raw = 0;
   int find_ret = 0;
-  if (tag) {
+  std::vector<uint32_t> members;
+  if (tag && g_tag_index.Members(tag, &members)) {
+    // Only the tag's partition is compared, in tagging order; the first of
+    // equal scores wins.
+    for (uint32_t fid : members) {
+      int s = 0;
+      if (!IEngine_MatchUser(mc->probe, fid, &s, nullptr) && s > raw) {
+        raw = s;
+        found = static_cast<int>(fid);
+      }
+    }
+    // The engine's query reports no user below its gate; neither does this.
+    found = raw >= g_find_gate ? found : 0;
+  } else if (tag) {
     char query[128];
     std::snprintf(query, sizeof(query), "SELECT USERID FROM TAG_CACHE WHERE %s%s='%s'", "F", tag, tag);
-    find_ret = IEngine_FindUserByQuery(g_user_primary, query, uid, score);
+    find_ret = IEngine_FindUserByQuery(mc->probe, query, &found, &raw);
   } else {
-    find_ret = IEngine_FindUser(g_user_primary, uid, score);
-    std::printf("%s(%d), score:%d\n", "BiokeyInterIdentifyTempByTag", 2997, *score);
-  }
-
-  g_last_error = find_ret;
-  if (find_ret || *uid <= 0) {
-    int v = *score;
-    if (*score <= 0) {
-      return 0;
-    }
-    int s = (v - g_thresh_step) / g_thresh_mul;
-    if (g_thresh_mode == 1) {
-      s += 35;
-    }
-    if (s > 100) {
-      s = 100;
+    uint32_t best = 0;
+    // An early exit never stops on a score that would still be rejected.
+    int early = g_early_exit;
+    int stop_at = early ? std::max({RawScore(std::max(early, threshold)), g_find_gate.load(), 1}) : 0;
+    if (PrefilterSearch(mc->probe_buf, len, mc->probe, stop_at, &best, &raw) ||
+        g_gallery.Search(mc->probe, stop_at, &best, &raw)) {
+      found = raw >= g_find_gate ? static_cast<int>(best) : 0;
+    } else {
+      find_ret = IEngine_FindUser(mc->probe, &found, &raw);
     }
-    *score = s;
-    return 0;
+    zkfp::LogDebug("BiokeyInterIdentifyTempByTag score:%d", raw);
   }
 
-  int v = *score;
-  if (*score <= 0) {
+  g_last_error = find_ret;
+  *score = NormalizeScore(raw);
+  if (find_ret || found <= 0 || raw <= 0 || *score < threshold) {
     return 0;
   }
-  int s = (v - g_thresh_step) / g_thresh_mul;
-  if (g_thresh_mode == 1) {
-    s += 35;
-  }
-  if (s > 100) {
-    s = 100;
-  }
-  *score = s;
+  *uid = found;
   return 1;
 }
 
+ZKINTERFACE int64_t APICALL BIOKEY_IDENTIFYTEMPBYTAG(void *ctx, const char *templ, int *uid, int *score, const char *tag) {
+  return BIOKEY_IDENTIFYTEMP_EX(ctx, templ, tag, 0, uid, score);
+}
+
 ZKINTERFACE int64_t APICALL BIOKEY_IDENTIFYTEMP(void *ctx, const char *templ, int *uid, int *score) {
   return BIOKEY_IDENTIFYTEMPBYTAG(ctx, templ, uid, score, nullptr);
 }
@@ -1508,13 +1727,13 @@ ZKINTERFACE _BOOL8 APICALL BIOKEY_DB_ADD(void *ctx, unsigned int uid, int len, v
   }
   unsigned int templ_len = BiokeyInterGetTemplateLen(templ);
   if (templ_len > 1664 || (templ_len > static_cast<unsigned int>(len) && (templ_len - len - 6) > 1)) {
-    std::printf("template lenth failed,template len = %d,TempLength=%d\n", templ_len, len);
+    zkfp::LogWarn("template length failed, template len = %d, TempLength=%d", templ_len, len);
     return 0;
   }
 
   std::memcpy(g_buf_a, templ, templ_len);
   if (!bio_DecodeData(g_buf_a)) {
-    std::puts("DecodeData failed");
+    zkfp::LogWarn("DecodeData failed");
     return 0;
   }
 
@@ -1527,7 +1746,11 @@ ZKINTERFACE _BOOL8 APICALL BIOKEY_DB_ADD(void *ctx, unsigned int uid, int len, v
     v13 = IEngine_RegisterUserAs(g_user_primary, uid);
   }
   g_last_error = v13;
-  return v13 == 0;
+  if (v13) {
+    return 0;
+  }
+  IndexEnrolled(g_user_primary, uid, g_buf_a, templ_len);
+  return 1;
 }
 
 ZKINTERFACE _BOOL8 APICALL BIOKEY_DB_ADDEX(void *ctx, unsigned int uid, int len, void *templ) {
@@ -1536,13 +1759,13 @@ ZKINTERFACE _BOOL8 APICALL BIOKEY_DB_ADDEX(void *ctx, unsigned int uid, int len,
   }
   unsigned int templ_len = BiokeyInterGetTemplateLen(templ);
   if (templ_len > 1664 || (templ_len > static_cast<unsigned int>(len) && (templ_len - len - 6) > 1)) {
-    std::printf("template length invalid len=%d, TempLength=%d\n", templ_len, len);
+    zkfp::LogWarn("template length invalid len=%d, TempLength=%d", templ_len, len);
     return 0;
   }
 
   std::memcpy(g_buf_a, templ, templ_len);
   if (!bio_DecodeData(g_buf_a)) {
-    std::puts("template decode failed");
+    zkfp::LogWarn("template decode failed");
     return 0;
   }
 
@@ -1550,11 +1773,15 @@ ZKINTERFACE _BOOL8 APICALL BIOKEY_DB_ADDEX(void *ctx, unsigned int uid, int len,
   int v14 = IEngine_ImportUserTemplate(g_user_primary, 1, g_buf_a);
   g_last_error = v14;
   if (v14) {
-    std::printf("Import User failed,LastError=%d\n", v14);
+    zkfp::LogWarn("Import User failed, LastError=%d", v14);
     return 0;
   }
   g_last_error = IEngine_RegisterUserAs(g_user_primary, uid);
-  return g_last_error == 0;
+  if (g_last_error) {
+    return 0;
+  }
+  IndexEnrolled(g_user_primary, uid, g_buf_a, templ_len);
+  return 1;
 }
 
 ZKINTERFACE _BOOL8 APICALL BIOKEY_DB_ADD_SP(void *ctx, unsigned int uid, int len, void *templ) {
@@ -1563,13 +1790,13 @@ ZKINTERFACE _BOOL8 APICALL BIOKEY_DB_ADD_SP(void *ctx, unsigned int uid, int len
   }
   unsigned int templ_len = BiokeyInterGetTemplateLen(templ);
   if (templ_len - 1 > 0x67F) {
-    std::puts("template size invalid");
+    zkfp::LogWarn("template size invalid");
     return 0;
   }
 
   std::memcpy(g_buf_a, templ, templ_len);
   if (!bio_DecodeData(g_buf_a)) {
-    std::printf("template format invalid, TID=%d\n", uid);
+    zkfp::LogWarn("template format invalid, TID=%d", uid);
     return 0;
   }
 
@@ -1582,7 +1809,11 @@ ZKINTERFACE _BOOL8 APICALL BIOKEY_DB_ADD_SP(void *ctx, unsigned int uid, int len
     v12 = IEngine_RegisterUserAs(g_user_primary, uid);
   }
   g_last_error = v12;
-  return v12 == 0;
+  if (v12) {
+    return 0;
+  }
+  IndexEnrolled(g_user_primary, uid, g_buf_a, templ_len);
+  return 1;
 }
 
 ZKINTERFACE int64_t APICALL BIOKEY_DB_APPEND() { return 1; }
@@ -1592,7 +1823,14 @@ ZKINTERFACE _BOOL8 APICALL BIOKEY_DB_DEL(void *ctx, unsigned int uid) {
     return 0;
   }
   g_last_error = IEngine_RemoveUser(uid);
-  return g_last_error == 0;
+  if (g_last_error) {
+    return 0;
+  }
+  g_finger_index.Remove(uid);
+  g_tag_index.Remove(uid);
+  g_gallery.Remove(uid);
+  g_prefilter.Remove(uid);
+  return 1;
 }
 
 ZKINTERFACE _BOOL8 APICALL BIOKEY_DB_CLEAR(void *ctx) {
@@ -1601,7 +1839,14 @@ ZKINTERFACE _BOOL8 APICALL BIOKEY_DB_CLEAR(void *ctx) {
   }
   IEngine_ClearUser(g_user_temp);
   g_last_error = IEngine_ClearDatabase();
-  return g_last_error == 0;
+  if (g_last_error) {
+    return 0;
+  }
+  g_finger_index.Reset(true);
+  g_tag_index.Reset(true);
+  g_gallery.Reset(true);
+  g_prefilter.Reset(true);
+  return 1;
 }
 
 ZKINTERFACE _BOOL8 APICALL BIOKEY_DB_CLEAREX(void *ctx) {
@@ -1609,7 +1854,14 @@ ZKINTERFACE _BOOL8 APICALL BIOKEY_DB_CLEAREX(void *ctx) {
     return 0;
   }
   g_last_error = IEngine_ClearDatabase();
-  return g_last_error == 0;
+  if (g_last_error) {
+    return 0;
+  }
+  g_finger_index.Reset(true);
+  g_tag_index.Reset(true);
+  g_gallery.Reset(true);
+  g_prefilter.Reset(true);
+  return 1;
 }
 
 ZKINTERFACE int64_t APICALL BIOKEY_DB_COUNT(void *ctx) {
@@ -1618,7 +1870,101 @@ ZKINTERFACE int64_t APICALL BIOKEY_DB_COUNT(void *ctx) {
   return out;
 }
 
-ZKINTERFACE int64_t APICALL BIOKEY_DB_SAVE() { return 0; }
+// Writes every enrolled user's template to a snapshot at `path` (format in
+// db_snapshot.h), tagged with the caller's journal sequence `seq`. Returns the
+// number of templates written, or -1 on failure, in which case any previous
+// snapshot at `path` is left untouched.
+ZKINTERFACE int64_t APICALL BIOKEY_DB_SAVE(void *ctx, const char *path, uint64_t seq) {
+  if (!ctx || !path) {
+    return -1;
+  }
+
+  int count = 0;
+  g_last_error = IEngine_GetUserCount(&count);
+  if (g_last_error || count < 0) {
+    return -1;
+  }
+  std::vector<int> ids(static_cast<size_t>(count));
+  if (count) {
+    g_last_error = IEngine_GetUserIDs(ids.data(), count);
+    if (g_last_error) {
+      return -1;
+    }
+  }
+
+  MatchLease mc;
+  zkfp::SnapshotWriter writer;
+  if (!mc || !writer.Open(path)) {
+    return -1;
+  }
+  for (int id : ids) {
+    IEngine_ClearUser(mc->probe);
+    if (IEngine_GetUser(mc->probe, static_cast<unsigned int>(id))) {
+      continue;
+    }
+    int len = static_cast<int>(sizeof(mc->probe_buf));
+    int ret = IEngine_ExportUserTemplate(mc->probe, 1, mc->probe_buf, &len);
+    if (ret || static_cast<unsigned int>(len - 50) > 0x64E || std::memcmp(mc->probe_buf, "ICRS2", 5)) {
+      zkfp::LogWarn("UID %d template not saved, len %d, ret %d", id, len, ret);
+      continue;
+    }
+    if (!writer.Append(static_cast<uint32_t>(id), mc->probe_buf, static_cast<uint32_t>(len))) {
+      return -1;
+    }
+  }
+  if (!writer.Commit(seq)) {
+    return -1;
+  }
+  return static_cast<int64_t>(writer.Count());
+}
+
+// Registers every template of the snapshot at `path`, reading each one in place
+// from the mapping. With `replace` the database is cleared first, but only once
+// the file has passed validation. The snapshot's journal sequence goes to `seq`
+// when non-null. Returns the number loaded, or -1 if the file fails validation.
+ZKINTERFACE int64_t APICALL BIOKEY_DB_LOAD(void *ctx, const char *path, int replace, uint64_t *seq) {
+  if (!ctx || !path) {
+    return -1;
+  }
+
+  zkfp::SnapshotReader reader;
+  MatchLease mc;
+  if (!mc || !reader.Open(path)) {
+    return -1;
+  }
+  if (seq) {
+    *seq = reader.Seq();
+  }
+  if (replace) {
+    IEngine_ClearUser(g_user_temp);
+    g_last_error = IEngine_ClearDatabase();
+    if (g_last_error) {
+      return -1;
+    }
+    g_finger_index.Reset(true);
+    g_tag_index.Reset(true);
+    g_gallery.Reset(true);
+    g_prefilter.Reset(true);
+  }
+
+  int64_t loaded = 0;
+  zkfp::SnapshotRecord rec;
+  while (reader.Next(&rec)) {
+    IEngine_ClearUser(mc->probe);
+    int ret = IEngine_ImportUserTemplate(mc->probe, 1, const_cast<uint8_t *>(rec.templ));
+    if (!ret) {
+      ret = IEngine_RegisterUserAs(mc->probe, rec.fid);
+    }
+    if (ret) {
+      g_last_error = ret;
+      zkfp::LogWarn("UID %u not loaded, LastError=%d", rec.fid, ret);
+      continue;
+    }
+    IndexEnrolled(mc->probe, rec.fid, rec.templ, rec.len);
+    ++loaded;
+  }
+  return loaded;
+}
 
 ZKINTERFACE int64_t APICALL BIOKEY_DB_FILTERID() { return 0; }
 
@@ -1635,14 +1981,14 @@ ZKINTERFACE _BOOL8 APICALL BIOKEY_DB_GET_TEMPLATE(int major, int minor, void *ou
   }
   IEngine_ExportUserTemplate(g_user_primary, 1, nullptr, &len);
   if (len > 0x8000) {
-    std::printf("UID %d template lenth %d overflow", uid, len);
+    zkfp::LogWarn("UID %u template length %d overflow", uid, len);
     len = 0;
   } else if (len > 0 && !IEngine_ExportUserTemplate(g_user_primary, 1, out, &len)) {
     bio_EncodeData(out);
     *out_len = len;
     return len > 0;
   }
-  std::puts("Export user template failed,ret ");
+  zkfp::LogWarn("Export user template failed, UID %u", uid);
   return 0;
 }
 
@@ -1687,179 +2033,135 @@ ZKINTERFACE int64_t APICALL BIOKEY_SET_STRINGTAG(void *ctx, unsigned int uid, co
     g_last_error = IEngine_SetStringTag(g_user_primary, key, tag);
     if (!g_last_error) {
       g_last_error = IEngine_UpdateUser(g_user_primary, uid);
-      return g_last_error == 0;
+      if (g_last_error) {
+        return 0;
+      }
+      g_tag_index.Add(uid, tag);
+      return 1;
     }
     return ret;
   }
   return 1;
 }
 
-ZKINTERFACE int64_t APICALL BIOKEY_GETFINGERLINEAR() { return 0; }
+// Applies the sensor's linear correction (see zkfp::FingerLinearMap for the
+// 22-word block and the zkfp::kFingerLinear* flags) from `src` into `dst`. The
+// map is rebuilt only when the block or flags change. Returns the bytes
+// written, params[20] x params[21], or 0.
+ZKINTERFACE int64_t APICALL BIOKEY_GETFINGERLINEAR(BioKeyHandle *ctx, const void *src, void *dst,
+                                                   const uint16_t *params, unsigned int flags) {
+  if (!ctx || !src || !dst || !params) {
+    return 0;
+  }
+  if (!ctx->linear) {
+    ctx->linear = new (std::nothrow) zkfp::FingerLinearMap;
+    if (!ctx->linear) {
+      return 0;
+    }
+  }
+  if (!ctx->linear->Matches(params, flags) && !ctx->linear->Build(params, flags)) {
+    return 0;
+  }
+  ctx->linear->Apply(static_cast<const uint8_t *>(src), static_cast<uint8_t *>(dst));
+  return static_cast<int64_t>(ctx->linear->Width()) * ctx->linear->Height();
+}
 
 ZKINTERFACE int64_t APICALL BIOKEY_SETTEMPLATELEN() { return 0; }
 
 ZKINTERFACE int64_t APICALL BIOKEY_SETNOISETHRESHOLD() { return 0; }
 
+// Length from the header alone; the template is neither decoded nor written.
 ZKINTERFACE int64_t APICALL BIOKEY_TEMPLATELEN(void *templ, void *, void *) {
-  unsigned int len = bio_DecodeData(templ);
-  if (len) {
-    len = BiokeyInterGetTemplateLen(templ);
-    bio_EncodeData(templ);
-  }
-  return len;
+  return zkfp::TemplateLength(static_cast<const uint8_t *>(templ), 0x680);
 }
 
+// Merges `count` templates into one multi-finger template in `out` (see
+// zkfp::MergeTemplates); the inputs are left as they were. Returns its length,
+// or 0.
 ZKINTERFACE int64_t APICALL BIOKEY_MERGE_TEMPLATE(const void **temps, int count, void *out) {
-  std::vector<uint8_t> s(0x4000);
-  std::memset(s.data(), 0, s.size());
-  std::memcpy(s.data(), "ICRS21", 6);
-  s[16] = static_cast<uint8_t>(-59);
-  s[18] = static_cast<uint8_t>(-59);
-
   if (count <= 0 || !out || !temps) {
     return 0;
   }
+  return static_cast<int64_t>(zkfp::MergeTemplates(reinterpret_cast<const uint8_t *const *>(temps),
+                                                   static_cast<size_t>(count), static_cast<uint8_t *>(out),
+                                                   zkfp::kMergedTemplateMax));
+}
 
-  for (int i = 0; i < count; ++i) {
-    bio_DecodeData(const_cast<void *>(temps[i]));
-  }
-
-  const uint16_t *first = reinterpret_cast<const uint16_t *>(temps[0]);
-  if (std::memcmp(temps[0], "ICRS2", 5)) {
-    for (int i = 0; i < count; ++i) {
-      bio_EncodeData(const_cast<void *>(temps[i]));
-    }
+// Splits `templ` into one template per finger, out[i] of sizes[i] bytes, and
+// leaves it as it was. Returns the finger count, also stored to *count, or 0.
+ZKINTERFACE int64_t APICALL BIOKEY_SPLIT_TEMPLATE(unsigned char *templ, void **out, unsigned int *count, int *sizes) {
+  if (!templ || !out || !count || !sizes) {
     return 0;
   }
-
-  int v10 = 24;
-  if (count == 1) {
-    v10 = (static_cast<const uint8_t *>(temps[0])[8] << 8) + static_cast<const uint8_t *>(temps[0])[9];
-    bio_EncodeData(const_cast<void *>(temps[0]));
-    std::memcpy(out, temps[0], v10);
-    return v10;
-  }
-
-  uint8_t v26 = 0;
-  int v27 = 0;
-  uint16_t v30 = first[10];
-  uint16_t v31 = first[11];
-
-  const void **cur = temps;
-  while (true) {
-    uint8_t v25 = static_cast<const uint8_t *>(*cur)[10];
-    if (v25) {
-      const uint8_t *v13 = static_cast<const uint8_t *>(*cur);
-      int v15 = 0;
-      int v16 = 24;
-      int v17 = v10;
-      do {
-        uint8_t *dest = s.data() + v17;
-        uint8_t v19 = static_cast<uint8_t>(v15++ + v26);
-        const_cast<uint8_t *>(v13)[26] = v19;
-        const uint8_t *src = static_cast<const uint8_t *>(*cur) + v16;
-        int v21 = (static_cast<const uint8_t *>(*cur)[8] << 8) + static_cast<const uint8_t *>(*cur)[9] - 24;
-        v16 += v21;
-        v17 += v21;
-        std::memcpy(dest, src, v21);
-      } while (v25 != v15);
-      v26 += v25;
-      v10 = v17;
-    }
-    if (++v27 >= count) {
-      break;
-    }
-    ++cur;
-    if (v30 != reinterpret_cast<const uint16_t *>(*cur)[10] || v31 != reinterpret_cast<const uint16_t *>(*cur)[11]) {
-      return 0;
-    }
+  uint32_t lens[255];
+  size_t fingers = zkfp::SplitTemplate(templ, reinterpret_cast<uint8_t *const *>(out), lens, 255);
+  for (size_t i = 0; i < fingers; ++i) {
+    sizes[i] = static_cast<int>(lens[i]);
   }
-
-  uint16_t v22 = static_cast<uint16_t>(v10 + 255);
-  s[8] = static_cast<uint8_t>(v22 >> 8);
-  s[9] = static_cast<uint8_t>(v10);
-  *reinterpret_cast<uint16_t *>(&s[20]) = v30;
-  s[10] = v26;
-  *reinterpret_cast<uint16_t *>(&s[22]) = v31;
-
-  std::memcpy(out, s.data(), v10);
-  bio_EncodeData(out);
-  for (int i = 0; i < count; ++i) {
-    bio_EncodeData(const_cast<void *>(temps[i]));
+  if (fingers) {
+    *count = static_cast<unsigned int>(fingers);
   }
-  return v10;
+  return static_cast<int64_t>(fingers);
 }
 
-ZKINTERFACE int64_t APICALL BIOKEY_SPLIT_TEMPLATE(unsigned char *templ, void **out, unsigned int *count, int *sizes) {
-  std::vector<uint8_t> s(0x4000);
-  std::memset(s.data(), 0, s.size());
-  std::memcpy(s.data(), "ICRS21", 6);
-  s[16] = static_cast<uint8_t>(-59);
-  s[18] = static_cast<uint8_t>(-59);
-
-  if (!templ || !out) {
-    return 0;
-  }
-
-  DecodeDataWithMaxLen(templ, 0x8000);
-  if (std::memcmp(templ, "ICRS2", 5)) {
-    bio_EncodeData(templ);
-    return 0;
-  }
-
-  uint16_t v21 = *reinterpret_cast<uint16_t *>(templ + 20);
-  uint16_t v22 = *reinterpret_cast<uint16_t *>(templ + 22);
-  unsigned int v23 = templ[10];
-  if (v23 > 1) {
-    int v6 = 24;
-    int *v7 = sizes;
-    void **v8 = out;
-    void **end = out + v23;
-    while (true) {
-      uint8_t *dst = static_cast<uint8_t *>(*v8);
-      uint8_t *src = templ + v6;
-      unsigned int v14 = src[4] + ((src[3] & 0xF) << 8);
-      if (v14 >= 8) {
-        std::memcpy(dst, s.data(), 24);
-        std::memcpy(dst + v14 - 8, src + v14 - 8, 8);
-      } else if (v14) {
-        dst[0] = src[0];
-        if (v14 & 2) {
-          *reinterpret_cast<uint16_t *>(dst + v14 - 2) = *reinterpret_cast<uint16_t *>(src + v14 - 2);
-        }
-      }
-      v6 += v14;
-      *reinterpret_cast<uint64_t *>(dst + 0) = *reinterpret_cast<uint64_t *>(s.data());
-      *reinterpret_cast<uint64_t *>(dst + 8) = *reinterpret_cast<uint64_t *>(s.data() + 8);
-      *reinterpret_cast<uint64_t *>(dst + 16) = *reinterpret_cast<uint64_t *>(s.data() + 16);
-      dst[8] = static_cast<uint16_t>(v14 + 24) >> 8;
-      dst[9] = static_cast<uint8_t>(v14 + 24);
-      *reinterpret_cast<uint16_t *>(dst + 20) = v21;
-      dst[10] = 1;
-      *reinterpret_cast<uint16_t *>(dst + 22) = v22;
-      dst[26] = 0;
-      bio_EncodeData(dst);
-      *v7 = v14 + 24;
-
-      ++v8;
-      ++v7;
-      if (v8 == end) {
-        *count = v23;
-        return v23;
-      }
-    }
+// Batch merge: group r is the next counts[r] entries of `temps`. The merged
+// templates are packed back to back into `out`, group r's length in sizes[r],
+// which is 0 when the group is invalid or no longer fits in `out_len`. Returns
+// the bytes of `out` used.
+ZKINTERFACE int64_t APICALL BIOKEY_MERGE_TEMPLATES(const void **temps, const int *counts, int records, void *out,
+                                                   unsigned int out_len, int *sizes) {
+  if (!temps || !counts || records <= 0 || !out || !sizes) {
+    return 0;
   }
+  auto *dst = static_cast<uint8_t *>(out);
+  size_t used = 0;
+  size_t next = 0;
+  for (int r = 0; r < records; ++r) {
+    size_t n = counts[r] > 0 ? static_cast<size_t>(counts[r]) : 0;
+    size_t len = n ? zkfp::MergeTemplates(reinterpret_cast<const uint8_t *const *>(temps + next), n, dst + used,
+                                          out_len - used)
+                   : 0;
+    sizes[r] = static_cast<int>(len);
+    used += len;
+    next += n;
+  }
+  return static_cast<int64_t>(used);
+}
 
-  bio_EncodeData(templ);
-  if (v23 != 1) {
+// Batch split: the single-finger templates of all `records` templates are
+// packed back to back into `out`, their lengths in order into `sizes` (room for
+// `max_sizes`). counts[r] receives template r's finger count, 0 when it is
+// invalid or its fingers no longer fit. Returns the fingers written.
+ZKINTERFACE int64_t APICALL BIOKEY_SPLIT_TEMPLATES(const void **templs, int records, void *out, unsigned int out_len,
+                                                   int *counts, int *sizes, unsigned int max_sizes) {
+  if (!templs || records <= 0 || !out || !counts || !sizes) {
     return 0;
   }
-
-  int len = templ[9] + (templ[8] << 8);
-  *sizes = len;
-  std::memcpy(*out, templ, len);
-  *count = 1;
-  return 1;
+  auto *dst = static_cast<uint8_t *>(out);
+  size_t used = 0;
+  size_t written = 0;
+  uint32_t lens[255];
+  uint8_t *outs[255];
+  for (int r = 0; r < records; ++r) {
+    const auto *templ = static_cast<const uint8_t *>(templs[r]);
+    size_t fingers = zkfp::SplitTemplate(templ, nullptr, lens, 255);
+    size_t need = 0;
+    for (size_t i = 0; i < fingers; ++i) {
+      outs[i] = dst + used + need;
+      need += lens[i];
+    }
+    if (!fingers || need > out_len - used || fingers > max_sizes - written) {
+      counts[r] = 0;
+      continue;
+    }
+    zkfp::SplitTemplate(templ, outs, lens, 255);
+    for (size_t i = 0; i < fingers; ++i) {
+      sizes[written++] = static_cast<int>(lens[i]);
+    }
+    counts[r] = static_cast<int>(fingers);
+    used += need;
+  }
+  return static_cast<int64_t>(written);
 }
 
 ZKINTERFACE int64_t APICALL GetTmpCnt() { return 0; }
@@ -1,12 +1,27 @@
 #include "libzkfp.h"
 #include "libzkfperrdef.h"
 
+#include "base64.h"
+#include "capture_queue.h"
+#include "db_journal.h"
+#include "image_file.h"
+#include "log.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
 #include <cstdint>
 #include <cstring>
 #include <cstdio>
+#include <memory>
+#include <mutex>
+#include <new>
 #include <string>
-#include <vector>
 #include <sys/time.h>
+#include <system_error>
+#include <thread>
+#include <unistd.h>
 
 #ifndef ZKFP_ENABLE_ALGO
 #define ZKFP_ENABLE_ALGO 1
@@ -26,7 +41,7 @@ int sensorCheckLic(void *handle, unsigned int v1, void *v2);
 
 #if ZKFP_ENABLE_ALGO
 void *BIOKEY_INIT(long a1, const void *cfg, long a3, long a4, long a5);
-int BIOKEY_CLOSE();
+int BIOKEY_CLOSE(void *db);
 int BIOKEY_SET_CHECK_CALLBACK(int (*cb)(unsigned int, void *), void *user);
 int BIOKEY_SET_PARAMETER(void *db, long code, long value);
 int BIOKEY_GET_PARAMETER(void *db, long code, int *out);
@@ -34,17 +49,30 @@ int BIOKEY_MATCHINGPARAM(void *db, long type, unsigned int value);
 int BIOKEY_DB_CLEAR(void *db);
 int BIOKEY_DB_ADD(void *db, unsigned int fid, unsigned int size, unsigned char *templ);
 int BIOKEY_DB_DEL(void *db, unsigned int fid);
-int BIOKEY_VERIFY(void *db, const unsigned char *t1, const unsigned char *t2);
-int BIOKEY_VERIFYBYID(void *db, unsigned int fid, const unsigned char *templ);
-int BIOKEY_GENTEMPLATE_SP(void *db, const unsigned char *t1, const unsigned char *t2, const unsigned char *t3,
-                          int count, unsigned char *out);
+long BIOKEY_DB_COUNT(void *db);
+long BIOKEY_DB_SAVE(void *db, const char *path, uint64_t seq);
+long BIOKEY_DB_LOAD(void *db, const char *path, int replace, uint64_t *seq);
+int BIOKEY_VERIFY_EX(void *db, const unsigned char *t1, const unsigned char *t2, int threshold);
+int BIOKEY_VERIFYBYID_EX(void *db, unsigned int fid, const unsigned char *templ, int threshold);
+int BIOKEY_GENTEMPLATE_EX(void *db, const unsigned char *const *temps, int count, unsigned char *out, int outLen);
 int BIOKEY_EXTRACT_GRAYSCALEDATA(void *db, const unsigned char *image, unsigned int width, unsigned int height,
                                  unsigned char *out, unsigned int outLen, int flag);
-int BIOKEY_IDENTIFYTEMP(void *db, const unsigned char *templ, unsigned int size, unsigned int *fid);
+int BIOKEY_EXTRACT_IMAGE(void *db, const unsigned char *pixels, unsigned int width, unsigned int height,
+                         unsigned int stride, int bottomUp, unsigned int dpi, unsigned int enhance, unsigned char *out,
+                         unsigned int outLen);
+int BIOKEY_IDENTIFYTEMP_EX(void *db, const unsigned char *templ, const char *tag, int threshold, int *fid, int *score);
+int BIOKEY_SET_STRINGTAG(void *db, unsigned int fid, const char *tag);
 int BIOKEY_GETLASTERROR();
+int BIOKEY_IMAGE_ACQUIRE(void *db, unsigned int seq, const void **bmp, unsigned int *bmpLen, unsigned int *width,
+                         unsigned int *height);
+int BIOKEY_IMAGE_RELEASE(void *db, unsigned int seq);
+int BIOKEY_IMAGE_LASTSEQ(void *db);
+int BIOKEY_TEMPLATE_CACHE_SIZE(void *db, unsigned int entries);
+uint64_t BIOKEY_TEMPLATE_CACHE_STAT(void *db, int which, int reset);
+long BIOKEY_TEMPLATELEN(void *templ, void *, void *);
 #else
 static inline void *BIOKEY_INIT(long, const void *, long, long, long) { return nullptr; }
-static inline int BIOKEY_CLOSE() { return 0; }
+static inline int BIOKEY_CLOSE(void *) { return 0; }
 static inline int BIOKEY_SET_CHECK_CALLBACK(int (*)(unsigned int, void *), void *) { return 0; }
 static inline int BIOKEY_SET_PARAMETER(void *, long, long) { return 0; }
 static inline int BIOKEY_GET_PARAMETER(void *, long, int *) { return 0; }
@@ -52,12 +80,24 @@ static inline int BIOKEY_MATCHINGPARAM(void *, long, unsigned int) { return 0; }
 static inline int BIOKEY_DB_CLEAR(void *) { return 0; }
 static inline int BIOKEY_DB_ADD(void *, unsigned int, unsigned int, unsigned char *) { return 0; }
 static inline int BIOKEY_DB_DEL(void *, unsigned int) { return 0; }
-static inline int BIOKEY_VERIFY(void *, const unsigned char *, const unsigned char *) { return 0; }
-static inline int BIOKEY_VERIFYBYID(void *, unsigned int, const unsigned char *) { return 0; }
-static inline int BIOKEY_GENTEMPLATE_SP(void *, const unsigned char *, const unsigned char *, const unsigned char *, int, unsigned char *) { return 0; }
+static inline long BIOKEY_DB_COUNT(void *) { return 0; }
+static inline long BIOKEY_DB_SAVE(void *, const char *, uint64_t) { return -1; }
+static inline long BIOKEY_DB_LOAD(void *, const char *, int, uint64_t *) { return -1; }
+static inline int BIOKEY_VERIFY_EX(void *, const unsigned char *, const unsigned char *, int) { return 0; }
+static inline int BIOKEY_VERIFYBYID_EX(void *, unsigned int, const unsigned char *, int) { return 0; }
+static inline int BIOKEY_GENTEMPLATE_EX(void *, const unsigned char *const *, int, unsigned char *, int) { return 0; }
 static inline int BIOKEY_EXTRACT_GRAYSCALEDATA(void *, const unsigned char *, unsigned int, unsigned int, unsigned char *, unsigned int, int) { return 0; }
-static inline int BIOKEY_IDENTIFYTEMP(void *, const unsigned char *, unsigned int, unsigned int *) { return 0; }
+static inline int BIOKEY_EXTRACT_IMAGE(void *, const unsigned char *, unsigned int, unsigned int, unsigned int, int,
+                                       unsigned int, unsigned int, unsigned char *, unsigned int) { return 0; }
+static inline int BIOKEY_IDENTIFYTEMP_EX(void *, const unsigned char *, const char *, int, int *, int *) { return 0; }
+static inline int BIOKEY_SET_STRINGTAG(void *, unsigned int, const char *) { return 0; }
 static inline int BIOKEY_GETLASTERROR() { return 0; }
+static inline int BIOKEY_IMAGE_ACQUIRE(void *, unsigned int, const void **, unsigned int *, unsigned int *, unsigned int *) { return 0; }
+static inline int BIOKEY_IMAGE_RELEASE(void *, unsigned int) { return 0; }
+static inline int BIOKEY_IMAGE_LASTSEQ(void *) { return 0; }
+static inline int BIOKEY_TEMPLATE_CACHE_SIZE(void *, unsigned int) { return 0; }
+static inline uint64_t BIOKEY_TEMPLATE_CACHE_STAT(void *, int, int) { return 0; }
+static inline long BIOKEY_TEMPLATELEN(void *, void *, void *) { return 0; }
 #endif
 }
 
@@ -73,15 +113,21 @@ struct DeviceHandle {
   uint32_t width;
   uint32_t height;
   uint32_t dpi;
+  // Past the original 0x20-byte layout.
+  // Started by the first ZKFPM_AcquireAndIdentify; callers hold their own
+  // reference across a Pop, so a rebuild or close never frees it under them.
+  std::shared_ptr<zkfp::CaptureQueue> prefetch;
+  uint32_t enhance;        // FP_ENHANCE_* steps run on each frame before extraction
+  std::mutex sensor_lock;  // held across every call into the sensor, the prefetch worker's included
 };
-static_assert(sizeof(DeviceHandle) == 0x20, "DeviceHandle size");
+static_assert(offsetof(DeviceHandle, prefetch) == 0x20, "DeviceHandle size");
 
 struct DBCacheHandle {
   void *db;
   uint32_t count;
   uint32_t threshold_1;
   uint32_t threshold_n;
-  uint32_t reserved0;
+  uint32_t last_seq;  // frame pinned behind last_img, released when a newer one arrives
   void *last_img;
   uint32_t last_w;
   uint32_t last_h;
@@ -89,9 +135,50 @@ struct DBCacheHandle {
 };
 static_assert(sizeof(DBCacheHandle) == 0x30, "DBCacheHandle size");
 
+// Values set through ZKFPM_DBSetParameter. They outlive InitFP/ZKFPM_Terminate so
+// a deployment can tune the cache before the first device is opened.
+struct DBTuning {
+  std::atomic<uint64_t> threshold_1{35};
+  std::atomic<uint64_t> threshold_n{55};
+  std::atomic<uint64_t> worker_threads{0};
+  std::atomic<uint64_t> shard_count{0};
+  std::atomic<uint64_t> probe_cache_size{64};
+  std::atomic<uint64_t> early_exit_score{0};
+  std::atomic<uint64_t> capture_queue_depth{2};
+  std::atomic<uint64_t> identify_budget_ms{0};
+  std::atomic<uint64_t> prefilter_keep{0};
+};
+
+struct DBCounters {
+  std::atomic<uint64_t> identify{0};
+  std::atomic<uint64_t> identify_us{0};
+  std::atomic<uint64_t> over_budget{0};
+  std::atomic<uint64_t> verify{0};
+};
+
+enum class DBParamKind { Knob, Counter };
+
+struct DBParamDesc {
+  int code;
+  DBParamKind kind;
+  uint32_t min_value;
+  uint32_t max_value;
+  std::atomic<uint64_t> *slot;
+  void (*apply)(uint32_t value);
+  uint64_t (*read)(bool reset) = nullptr;  // counters kept by the engine instead of in `slot`
+};
+
 static int g_bInited = 0;
+// Sensor being opened, for the license check BIOKEY_INIT calls back into;
+// cleared when that device closes.
 static void *g_hDevice = nullptr;
+// Frame size of the device the engine was set up for, the size headerless raw
+// files are read at.
+static uint32_t g_engine_width = 0;
+static uint32_t g_engine_height = 0;
 static DBCacheHandle g_DBCacheHandle{};
+static DBTuning g_DBTuning;
+static DBCounters g_DBCounters;
 
 static int CheckValue(unsigned int v1, void *v2) {
   return sensorCheckLic(g_hDevice, v1, v2);
@@ -103,6 +190,45 @@ static unsigned int GetTickCount() {
   return static_cast<unsigned int>(tv.tv_sec * 1000 + tv.tv_usec / 1000);
 }
 
+// Frames from a sensor that does not run at the engine's resolution are
+// rescaled on the way in.
+static void ApplySensorDpi(uint32_t dpi) {
+  if (g_DBCacheHandle.db) {
+    BIOKEY_SET_PARAMETER(g_DBCacheHandle.db, 5013, static_cast<long>(dpi));
+  }
+}
+
+// 1:N searches fan out over the algorithm's sharded gallery only when a thread
+// count above one is set: the gallery costs an engine user per enrolled fid,
+// so 0 and 1 keep the engine's own search.
+static void ApplyWorkerThreads(uint32_t threads) {
+  if (g_DBCacheHandle.db) {
+    BIOKEY_SET_PARAMETER(g_DBCacheHandle.db, 5014, threads > 1 ? static_cast<long>(threads < 64 ? threads : 64) : 0);
+  }
+}
+
+static void ApplyShardCount(uint32_t shards) {
+  if (g_DBCacheHandle.db) {
+    BIOKEY_SET_PARAMETER(g_DBCacheHandle.db, 5015, static_cast<long>(shards));
+  }
+}
+
+// Share of the enrolled users, per mille, that survives the algorithm's sketch
+// pre-screen and is fully matched.
+static void ApplyPrefilterKeep(uint32_t permille) {
+  if (g_DBCacheHandle.db) {
+    BIOKEY_SET_PARAMETER(g_DBCacheHandle.db, 5016, static_cast<long>(permille));
+  }
+}
+
+// 1:N searches over the gallery or the prefilter's candidates stop at the
+// first user scoring this much; the engine's own search always runs to the end.
+static void ApplyEarlyExitScore(uint32_t score) {
+  if (g_DBCacheHandle.db) {
+    BIOKEY_SET_PARAMETER(g_DBCacheHandle.db, 5017, static_cast<long>(score));
+  }
+}
+
 static void InitFP(int width, int height) {
 #if !ZKFP_ENABLE_ALGO
   (void)width;
@@ -125,10 +251,19 @@ static void InitFP(int width, int height) {
 
   g_DBCacheHandle.db = BIOKEY_INIT(0, cfg, 0, 0, 128);
   if (g_DBCacheHandle.db) {
-    g_DBCacheHandle.threshold_1 = 35;
-    g_DBCacheHandle.threshold_n = 55;
+    g_engine_width = static_cast<uint32_t>(width);
+    g_engine_height = static_cast<uint32_t>(height);
+    g_DBCacheHandle.threshold_1 = static_cast<uint32_t>(g_DBTuning.threshold_1.load());
+    g_DBCacheHandle.threshold_n = static_cast<uint32_t>(g_DBTuning.threshold_n.load());
     BIOKEY_SET_PARAMETER(g_DBCacheHandle.db, 4, 180);
-    BIOKEY_MATCHINGPARAM(g_DBCacheHandle.db, 0, g_DBCacheHandle.threshold_n);
+    // Park the engine's own gate at its floor; both thresholds are applied per
+    // call, so verification never has to rewrite this global parameter.
+    BIOKEY_MATCHINGPARAM(g_DBCacheHandle.db, 0, 1);
+    BIOKEY_TEMPLATE_CACHE_SIZE(g_DBCacheHandle.db, static_cast<unsigned int>(g_DBTuning.probe_cache_size.load()));
+    ApplyShardCount(static_cast<uint32_t>(g_DBTuning.shard_count.load()));
+    ApplyWorkerThreads(static_cast<uint32_t>(g_DBTuning.worker_threads.load()));
+    ApplyPrefilterKeep(static_cast<uint32_t>(g_DBTuning.prefilter_keep.load()));
+    ApplyEarlyExitScore(static_cast<uint32_t>(g_DBTuning.early_exit_score.load()));
   }
 }
 
@@ -140,70 +275,333 @@ static bool IsValidDBHandle(const void *handle) {
   return handle && handle == &g_DBCacheHandle;
 }
 
-static std::string Base64Encode(const uint8_t *data, size_t len) {
-  static const char kB64[] =
-      "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+// Pixel array of an engine BMP, located through the header's data offset.
+static const unsigned char *BmpPixels(const unsigned char *bmp, unsigned int len) {
+  if (!bmp || len < 14) {
+    return nullptr;
+  }
+  uint32_t offset = static_cast<uint32_t>(bmp[10]) | (static_cast<uint32_t>(bmp[11]) << 8) |
+                    (static_cast<uint32_t>(bmp[12]) << 16) | (static_cast<uint32_t>(bmp[13]) << 24);
+  return offset < len ? bmp + offset : nullptr;
+}
+
+static std::mutex g_pin_lock;  // guards the last_* fields of g_DBCacheHandle
+
+// Moves the cache's pin to the newest extraction image so last_img/last_w/last_h
+// always describe the frame behind the most recent template. Extractions run
+// concurrently, so the whole swap is done under g_pin_lock.
+static void PinLastExtractImage() {
+  const void *bmp = nullptr;
+  unsigned int len = 0;
+  unsigned int w = 0;
+  unsigned int h = 0;
+  std::lock_guard<std::mutex> guard(g_pin_lock);
+  unsigned int seq = static_cast<unsigned int>(BIOKEY_IMAGE_ACQUIRE(g_DBCacheHandle.db, 0, &bmp, &len, &w, &h));
+  if (!seq) {
+    return;
+  }
+  if (seq == g_DBCacheHandle.last_seq) {
+    BIOKEY_IMAGE_RELEASE(g_DBCacheHandle.db, seq);
+    return;
+  }
+  if (g_DBCacheHandle.last_seq) {
+    BIOKEY_IMAGE_RELEASE(g_DBCacheHandle.db, g_DBCacheHandle.last_seq);
+  }
+  g_DBCacheHandle.last_seq = seq;
+  g_DBCacheHandle.last_img = const_cast<unsigned char *>(BmpPixels(static_cast<const unsigned char *>(bmp), len));
+  g_DBCacheHandle.last_w = w;
+  g_DBCacheHandle.last_h = h;
+}
+
+static uint64_t NowMicros() {
+  return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+                                   std::chrono::steady_clock::now().time_since_epoch())
+                                   .count());
+}
+
+static void ApplyVerifyThreshold(uint32_t value) {
+  g_DBCacheHandle.threshold_1 = value;
+}
 
-  std::string out;
-  out.reserve(((len + 2) / 3) * 4);
-  for (size_t i = 0; i < len; i += 3) {
-    uint32_t v = data[i] << 16;
-    if (i + 1 < len) v |= data[i + 1] << 8;
-    if (i + 2 < len) v |= data[i + 2];
+static void ApplyIdentifyThreshold(uint32_t value) {
+  g_DBCacheHandle.threshold_n = value;
+}
 
-    out.push_back(kB64[(v >> 18) & 0x3F]);
-    out.push_back(kB64[(v >> 12) & 0x3F]);
-    out.push_back(i + 1 < len ? kB64[(v >> 6) & 0x3F] : '=');
-    out.push_back(i + 2 < len ? kB64[v & 0x3F] : '=');
+static void ApplyProbeCacheSize(uint32_t value) {
+  if (g_DBCacheHandle.db) {
+    BIOKEY_TEMPLATE_CACHE_SIZE(g_DBCacheHandle.db, value);
   }
-  return out;
 }
 
-static bool IsBase64Char(char c) {
-  return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') ||
-         (c >= '0' && c <= '9') || c == '+' || c == '/' || c == '=';
+static uint64_t ReadProbeCacheHits(bool reset) {
+  return g_DBCacheHandle.db ? BIOKEY_TEMPLATE_CACHE_STAT(g_DBCacheHandle.db, 0, reset) : 0;
 }
 
-static bool Base64Decode(const char *input, std::vector<uint8_t> &out) {
-  auto decode_val = [](char c) -> int {
-    if (c >= 'A' && c <= 'Z') return c - 'A';
-    if (c >= 'a' && c <= 'z') return c - 'a' + 26;
-    if (c >= '0' && c <= '9') return c - '0' + 52;
-    if (c == '+') return 62;
-    if (c == '/') return 63;
-    return -1;
-  };
+static uint64_t ReadProbeCacheMisses(bool reset) {
+  return g_DBCacheHandle.db ? BIOKEY_TEMPLATE_CACHE_STAT(g_DBCacheHandle.db, 1, reset) : 0;
+}
 
-  size_t len = std::strlen(input);
-  if ((len & 3) != 0) {
-    return false;
+static const DBParamDesc kDBParams[] = {
+    {FP_THRESHOLD_CODE, DBParamKind::Knob, 1, 100, &g_DBTuning.threshold_1, ApplyVerifyThreshold},
+    {FP_MTHRESHOLD_CODE, DBParamKind::Knob, 1, 100, &g_DBTuning.threshold_n, ApplyIdentifyThreshold},
+    {FP_WORKER_THREADS_CODE, DBParamKind::Knob, 0, 64, &g_DBTuning.worker_threads, ApplyWorkerThreads},
+    {FP_SHARD_COUNT_CODE, DBParamKind::Knob, 0, 256, &g_DBTuning.shard_count, ApplyShardCount},
+    {FP_PROBE_CACHE_SIZE_CODE, DBParamKind::Knob, 0, 65536, &g_DBTuning.probe_cache_size, ApplyProbeCacheSize},
+    {FP_EARLY_EXIT_SCORE_CODE, DBParamKind::Knob, 0, 100, &g_DBTuning.early_exit_score, ApplyEarlyExitScore},
+    {FP_CAPTURE_QUEUE_DEPTH_CODE, DBParamKind::Knob, 1, 16, &g_DBTuning.capture_queue_depth, nullptr},
+    {FP_IDENTIFY_BUDGET_CODE, DBParamKind::Knob, 0, 60000, &g_DBTuning.identify_budget_ms, nullptr},
+    {FP_PREFILTER_KEEP_CODE, DBParamKind::Knob, 0, 1000, &g_DBTuning.prefilter_keep, ApplyPrefilterKeep},
+    {FP_STAT_IDENTIFY_CODE, DBParamKind::Counter, 0, 0, &g_DBCounters.identify, nullptr},
+    {FP_STAT_IDENTIFY_US_CODE, DBParamKind::Counter, 0, 0, &g_DBCounters.identify_us, nullptr},
+    {FP_STAT_OVER_BUDGET_CODE, DBParamKind::Counter, 0, 0, &g_DBCounters.over_budget, nullptr},
+    {FP_STAT_VERIFY_CODE, DBParamKind::Counter, 0, 0, &g_DBCounters.verify, nullptr},
+    {FP_STAT_PROBE_CACHE_HIT_CODE, DBParamKind::Counter, 0, 0, nullptr, nullptr, ReadProbeCacheHits},
+    {FP_STAT_PROBE_CACHE_MISS_CODE, DBParamKind::Counter, 0, 0, nullptr, nullptr, ReadProbeCacheMisses},
+};
+
+static const DBParamDesc *FindDBParam(int code) {
+  for (const DBParamDesc &param : kDBParams) {
+    if (param.code == code) {
+      return &param;
+    }
   }
-  for (size_t i = 0; i < len; ++i) {
-    if (!IsBase64Char(input[i])) {
-      return false;
+  return nullptr;
+}
+
+// The identify budget is not enforced: a search always runs to its end, and
+// one that took longer is counted in over_budget.
+static void RecordIdentify(uint64_t elapsed_us) {
+  g_DBCounters.identify.fetch_add(1, std::memory_order_relaxed);
+  g_DBCounters.identify_us.fetch_add(elapsed_us, std::memory_order_relaxed);
+  uint64_t budget_ms = g_DBTuning.identify_budget_ms.load(std::memory_order_relaxed);
+  if (budget_ms && elapsed_us > budget_ms * 1000) {
+    g_DBCounters.over_budget.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+// 1:N search with the identify threshold, over the whole cache or only the users
+// tagged `tag`; shared by ZKFPM_Identify, ZKFPM_IdentifyByTag and the fused
+// capture path so all count against the same stats.
+static int IdentifyTemplate(const unsigned char *fpTemplate, const char *tag, unsigned int *FID, unsigned int *score) {
+  int fid = 0;
+  int best = 0;
+  int threshold = static_cast<int>(g_DBTuning.threshold_n.load(std::memory_order_relaxed));
+  uint64_t start_us = NowMicros();
+  int found = BIOKEY_IDENTIFYTEMP_EX(g_DBCacheHandle.db, fpTemplate, tag, threshold, &fid, &best);
+  RecordIdentify(NowMicros() - start_us);
+  if (!found || fid <= 0) {
+    return ZKFP_ERR_FAIL;
+  }
+  *FID = static_cast<unsigned int>(fid);
+  if (score) {
+    *score = static_cast<unsigned int>(best);
+  }
+  return ZKFP_ERR_OK;
+}
+
+// One frame read on the calling thread. It takes the sensor from the device's
+// prefetch worker, if one is running, for the length of the transfer.
+static int DeviceCapture(DeviceHandle *dev, unsigned char *image, unsigned int size) {
+  std::lock_guard<std::mutex> guard(dev->sensor_lock);
+  return sensorCapture(dev->sensor, image, size);
+}
+
+static std::mutex g_prefetch_lock;
+
+// Stops the device's capture queue and lets go of it; a caller still inside
+// Pop gets no frame and frees the queue when it returns.
+static void DropPrefetchLocked(DeviceHandle *dev) {
+  if (dev->prefetch) {
+    dev->prefetch->Stop();
+    dev->prefetch.reset();
+  }
+}
+
+// The device's capture queue, (re)built when the frame size or the configured
+// depth changed since.
+static std::shared_ptr<zkfp::CaptureQueue> DevicePrefetch(DeviceHandle *dev) {
+  std::lock_guard<std::mutex> guard(g_prefetch_lock);
+  size_t frame_bytes = static_cast<size_t>(dev->width) * dev->height;
+  size_t depth = static_cast<size_t>(g_DBTuning.capture_queue_depth.load(std::memory_order_relaxed));
+  if (dev->prefetch && (dev->prefetch->FrameBytes() != frame_bytes || dev->prefetch->Depth() != depth)) {
+    DropPrefetchLocked(dev);
+  }
+  if (!dev->prefetch && frame_bytes) {
+    dev->prefetch.reset(zkfp::CaptureQueue::Create(sensorCapture, dev->sensor, &dev->sensor_lock, frame_bytes, depth));
+  }
+  return dev->prefetch;
+}
+
+// Journal size past which a write kicks off a background compaction.
+constexpr uint64_t kCompactJournalBytes = 64ull << 20;
+
+// Durable cache opened by ZKFPM_DBOpenJournal: a snapshot plus the journal of
+// every change made since it was written.
+struct DBJournalState {
+  std::shared_ptr<zkfp::DBJournal> log;
+  std::string snapshot_path;
+  std::thread compactor;
+};
+
+static std::mutex g_db_write_lock;   // orders engine changes with their journal records; guards g_journal.log
+static std::mutex g_compact_lock;    // one snapshot rewrite at a time; taken before g_db_write_lock
+static std::mutex g_compactor_lock;  // guards g_journal.compactor
+static std::atomic<bool> g_compacting{false};
+static DBJournalState g_journal;
+
+static void ReplayJournalRecord(const zkfp::JournalRecord &rec, void *db) {
+  switch (rec.op) {
+  case zkfp::JournalOp::Add: {
+    // Adds are journaled with every byte the engine read (see
+    // ZKFPM_AddRegTemplateToDBCache), so a record that claims more is damaged.
+    auto *templ = const_cast<unsigned char *>(rec.data);
+    if (rec.len >= 13 && static_cast<unsigned long>(BIOKEY_TEMPLATELEN(templ, nullptr, nullptr)) <= rec.len) {
+      BIOKEY_DB_ADD(db, rec.fid, rec.len, templ);
     }
+    break;
+  }
+  case zkfp::JournalOp::Del:
+    BIOKEY_DB_DEL(db, rec.fid);
+    break;
+  case zkfp::JournalOp::Clear:
+    BIOKEY_DB_CLEAR(db);
+    break;
   }
+}
 
-  out.clear();
-  out.reserve((len / 4) * 3);
+// Folds the journal into a fresh snapshot. Caller holds g_compact_lock. Writers
+// wait for the save, so the snapshot holds exactly the records up to `seq` and
+// replay never applies a change twice.
+static int CompactJournal(const std::shared_ptr<zkfp::DBJournal> &log, const std::string &snapshot_path) {
+  uint64_t seq;
+  {
+    std::lock_guard<std::mutex> guard(g_db_write_lock);
+    seq = log->LastSeq();  // everything up to here is already in the engine
+    if (BIOKEY_DB_SAVE(g_DBCacheHandle.db, snapshot_path.c_str(), seq) < 0) {
+      return ZKFP_ERR_FAIL;
+    }
+  }
+  return log->Truncate(seq) ? ZKFP_ERR_OK : ZKFP_ERR_FAIL;
+}
 
-  for (size_t i = 0; i < len; i += 4) {
-    int v0 = decode_val(input[i]);
-    int v1 = decode_val(input[i + 1]);
-    if (v0 < 0 || v1 < 0) return false;
-    int v2 = input[i + 2] == '=' ? -1 : decode_val(input[i + 2]);
-    int v3 = input[i + 3] == '=' ? -1 : decode_val(input[i + 3]);
-    if ((v2 < 0 && input[i + 2] != '=') || (v3 < 0 && input[i + 3] != '=')) {
-      return false;
+static void StartBackgroundCompaction(const std::shared_ptr<zkfp::DBJournal> &log) {
+  if (g_compacting.exchange(true)) {
+    return;
+  }
+  std::lock_guard<std::mutex> guard(g_compactor_lock);
+  std::string snapshot_path;
+  {
+    std::lock_guard<std::mutex> write(g_db_write_lock);
+    if (g_journal.log != log) {  // closed in the meantime
+      g_compacting = false;
+      return;
     }
+    snapshot_path = g_journal.snapshot_path;
+  }
+  if (g_journal.compactor.joinable()) {
+    g_journal.compactor.join();
+  }
+  try {
+    g_journal.compactor = std::thread([log, snapshot_path] {
+      {
+        std::lock_guard<std::mutex> compact(g_compact_lock);
+        CompactJournal(log, snapshot_path);
+      }
+      g_compacting = false;
+    });
+  } catch (const std::system_error &) {
+    g_compacting = false;
+  }
+}
 
-    uint32_t triple = (v0 << 18) | (v1 << 12) | ((v2 < 0 ? 0 : v2) << 6) | (v3 < 0 ? 0 : v3);
-    out.push_back((triple >> 16) & 0xFF);
-    if (input[i + 2] != '=') out.push_back((triple >> 8) & 0xFF);
-    if (input[i + 3] != '=') out.push_back(triple & 0xFF);
+// Detaches the journal, waits out a running compaction and flushes what is
+// still queued.
+static void CloseJournal() {
+  std::shared_ptr<zkfp::DBJournal> log;
+  {
+    std::lock_guard<std::mutex> guard(g_compactor_lock);
+    {
+      std::lock_guard<std::mutex> write(g_db_write_lock);
+      log = std::move(g_journal.log);
+      g_journal.snapshot_path.clear();
+    }
+    if (g_journal.compactor.joinable()) {
+      g_journal.compactor.join();
+    }
+  }
+}
+
+// Replaces the cache with the snapshot at `path` and, with a journal open,
+// makes it the journal's new base. Caller holds g_compact_lock and
+// g_db_write_lock.
+static int LoadSnapshotLocked(const char *path, uint64_t *seq) {
+  long loaded = BIOKEY_DB_LOAD(g_DBCacheHandle.db, path, 1, seq);
+  if (loaded < 0) {
+    return ZKFP_ERR_FAIL;
+  }
+  g_DBCacheHandle.count = static_cast<uint32_t>(loaded);
+  if (g_journal.log) {
+    // The loaded image replaces everything journaled so far.
+    uint64_t base = g_journal.log->LastSeq();
+    if (BIOKEY_DB_SAVE(g_DBCacheHandle.db, g_journal.snapshot_path.c_str(), base) < 0 ||
+        !g_journal.log->Truncate(base)) {
+      return ZKFP_ERR_FAIL;
+    }
   }
+  return ZKFP_ERR_OK;
+}
+
+// A peer's change log being applied as one batch: every record goes into the
+// engine and the local journal under a single hold of the write lock, and the
+// caller waits once for the last of them to reach disk.
+struct PeerBatch {
+  std::shared_ptr<zkfp::DBJournal> log;
+  uint64_t last_seq = 0;
+  bool failed = false;
+};
 
-  return true;
+static void ApplyPeerRecord(const zkfp::JournalRecord &rec, void *user) {
+  auto *batch = static_cast<PeerBatch *>(user);
+  ReplayJournalRecord(rec, g_DBCacheHandle.db);
+  if (batch->log) {
+    uint64_t seq = batch->log->Append(rec.op, rec.fid, rec.data, rec.len);
+    if (seq) {
+      batch->last_seq = seq;
+    } else {
+      batch->failed = true;
+    }
+  }
+}
+
+// Applies a change to the engine and, with a journal open, logs it. The record
+// is queued under the write lock so journal order matches engine order, and
+// waited on outside it so concurrent writers share one fdatasync.
+template <typename Apply>
+static int CommitDBChange(zkfp::JournalOp op, unsigned int fid, const unsigned char *data, unsigned int len,
+                          Apply apply) {
+  std::shared_ptr<zkfp::DBJournal> log;
+  uint64_t seq = 0;
+  {
+    std::lock_guard<std::mutex> guard(g_db_write_lock);
+    int ret = apply();
+    if (ret != ZKFP_ERR_OK) {
+      return ret;
+    }
+    log = g_journal.log;
+    if (log) {
+      seq = log->Append(op, fid, data, len);
+    }
+  }
+  if (!log) {
+    return ZKFP_ERR_OK;
+  }
+  if (!seq || !log->WaitDurable(seq)) {
+    return ZKFP_ERR_FAIL;
+  }
+  if (log->Bytes() > kCompactJournalBytes) {
+    StartBackgroundCompaction(log);
+  }
+  return ZKFP_ERR_OK;
 }
 
 } // namespace
@@ -229,11 +627,14 @@ int APICALL ZKFPM_Init() {
 int APICALL ZKFPM_Terminate() {
   if (g_bInited) {
 #if ZKFP_ENABLE_ALGO
+    CloseJournal();
     if (g_DBCacheHandle.db) {
-      BIOKEY_CLOSE();
+      BIOKEY_CLOSE(g_DBCacheHandle.db);
     }
 #endif
     std::memset(&g_DBCacheHandle, 0, sizeof(g_DBCacheHandle));
+    g_engine_width = 0;
+    g_engine_height = 0;
     sensorFree();
     g_bInited = 0;
   }
@@ -260,22 +661,27 @@ HANDLE APICALL ZKFPM_OpenDevice(int index) {
     return nullptr;
   }
 
-  auto *dev = static_cast<DeviceHandle *>(operator new(sizeof(DeviceHandle)));
-  std::memset(dev, 0, sizeof(DeviceHandle));
+  auto *dev = new (std::nothrow) DeviceHandle();
+  if (!dev) {
+    sensorClose(sensor);
+    return nullptr;
+  }
   dev->magic = kDeviceMagic;
   dev->sensor = sensor;
   dev->width = static_cast<uint32_t>(sensorGetParameter(sensor, 1));
   dev->height = static_cast<uint32_t>(sensorGetParameter(sensor, 2));
+  dev->dpi = static_cast<uint32_t>(sensorGetParameter(sensor, 3));
 
   g_hDevice = sensor;
   InitFP(static_cast<int>(dev->width), static_cast<int>(dev->height));
+  ApplySensorDpi(dev->dpi);
 #if ZKFP_ENABLE_ALGO
   if (g_DBCacheHandle.db) {
     return dev;
   }
 
-  std::puts("Init zkfinger10 failed");
-  operator delete(dev);
+  zkfp::LogError("Init zkfinger10 failed");
+  delete dev;
   return nullptr;
 #else
   return dev;
@@ -294,8 +700,15 @@ int APICALL ZKFPM_CloseDevice(HANDLE hDevice) {
     return ZKFP_ERR_INIT;
   }
 
+  {
+    std::lock_guard<std::mutex> guard(g_prefetch_lock);
+    DropPrefetchLocked(dev);
+  }
+  if (g_hDevice == dev->sensor) {
+    g_hDevice = nullptr;
+  }
   sensorClose(dev->sensor);
-  operator delete(dev);
+  delete dev;
   return ZKFP_ERR_OK;
 }
 
@@ -328,12 +741,26 @@ int APICALL ZKFPM_SetParameters(HANDLE hDevice, int nParamCode, unsigned char *p
     BIOKEY_SET_PARAMETER(g_DBCacheHandle.db, 5010, val);
     return ZKFP_ERR_OK;
   }
+  if (nParamCode == FP_ENHANCE_CODE) {
+    if (cbParamValue < 4 || !paramValue) {
+      return ZKFP_ERR_INVALID_PARAM;
+    }
+    uint32_t val;
+    std::memcpy(&val, paramValue, sizeof(val));
+    if (val & ~static_cast<uint32_t>(FP_ENHANCE_ALL)) {
+      return ZKFP_ERR_INVALID_PARAM;
+    }
+    dev->enhance = val;
+    return ZKFP_ERR_OK;
+  }
 
+  std::lock_guard<std::mutex> sensor(dev->sensor_lock);
   int ret = sensorSetParameterEx(dev->sensor, nParamCode, paramValue, cbParamValue);
   if (ret == 0 && nParamCode == 3) {
     dev->width = static_cast<uint32_t>(sensorGetParameter(dev->sensor, 1));
     dev->height = static_cast<uint32_t>(sensorGetParameter(dev->sensor, 2));
     dev->dpi = static_cast<uint32_t>(sensorGetParameter(dev->sensor, 3));
+    ApplySensorDpi(dev->dpi);
   }
   return ret;
 }
@@ -361,7 +788,16 @@ int APICALL ZKFPM_GetParameters(HANDLE hDevice, int nParamCode, unsigned char *p
     *cbParamValue = 4;
     return ZKFP_ERR_OK;
   }
+  if (nParamCode == FP_ENHANCE_CODE) {
+    if (!cbParamValue || *cbParamValue < 4 || !paramValue) {
+      return ZKFP_ERR_INVALID_PARAM;
+    }
+    std::memcpy(paramValue, &dev->enhance, sizeof(dev->enhance));
+    *cbParamValue = 4;
+    return ZKFP_ERR_OK;
+  }
 
+  std::lock_guard<std::mutex> sensor(dev->sensor_lock);
   return sensorGetParameterEx(dev->sensor, nParamCode, paramValue, cbParamValue);
 }
 
@@ -411,7 +847,7 @@ int APICALL ZKFPM_AcquireFingerprintImage(HANDLE hDevice, unsigned char *fpImage
 
   std::memset(fpImage, 0, cbFPImage);
   unsigned int start = GetTickCount();
-  while (sensorCapture(dev->sensor, fpImage, cbFPImage) <= 0) {
+  while (DeviceCapture(dev, fpImage, cbFPImage) <= 0) {
     if (GetTickCount() - start > 0x1F4) {
       return ZKFP_ERR_CAPTURE;
     }
@@ -426,7 +862,7 @@ int APICALL ZKFPM_AcquireFingerprint(HANDLE hDevice, unsigned char *fpImage, uns
 #endif
 
   auto *dev = static_cast<DeviceHandle *>(hDevice);
-  if (!dev || !fpImage || !fpTemplate || !cbTemplate || *cbTemplate <= 0) {
+  if (!dev || !cbTemplate) {
     return ZKFP_ERR_INVALID_PARAM;
   }
   if (!IsValidDeviceHandle(dev)) {
@@ -435,25 +871,80 @@ int APICALL ZKFPM_AcquireFingerprint(HANDLE hDevice, unsigned char *fpImage, uns
   if (!g_bInited) {
     return ZKFP_ERR_INIT;
   }
+  if (!fpTemplate) {
+    // Size query: the largest template extraction can produce.
+    *cbTemplate = static_cast<unsigned int>(
+        BIOKEY_EXTRACT_GRAYSCALEDATA(g_DBCacheHandle.db, nullptr, dev->width, dev->height, nullptr, 0, 0));
+    return ZKFP_ERR_OK;
+  }
+  if (!fpImage || *cbTemplate <= 0) {
+    return ZKFP_ERR_INVALID_PARAM;
+  }
 
-  if (sensorCapture(dev->sensor, fpImage, cbFPImage) <= 0) {
+  if (DeviceCapture(dev, fpImage, cbFPImage) <= 0) {
     return ZKFP_ERR_CAPTURE;
   }
 
-  unsigned char tmp[2048] = {0};
   int len = BIOKEY_EXTRACT_GRAYSCALEDATA(g_DBCacheHandle.db, fpImage, dev->width, dev->height,
-                                        tmp, 2048, 0);
-  if (len <= 0) {
-    return ZKFP_ERR_EXTRACT_FP;
-  }
-  if (len > static_cast<int>(*cbTemplate)) {
+                                        fpTemplate, *cbTemplate, static_cast<int>(dev->enhance));
+  PinLastExtractImage();
+  if (len < 0) {
+    *cbTemplate = static_cast<unsigned int>(-len);
     return ZKFP_ERR_MEMORY_NOT_ENOUGH;
   }
-  std::memcpy(fpTemplate, tmp, static_cast<size_t>(len));
+  if (len == 0) {
+    return ZKFP_ERR_EXTRACT_FP;
+  }
   *cbTemplate = static_cast<unsigned int>(len);
   return ZKFP_ERR_OK;
 }
 
+int APICALL ZKFPM_AcquireAndIdentify(HANDLE hDevice, HANDLE hDBCache, unsigned char *fpImage, unsigned int cbFPImage,
+                                     unsigned int *FID, unsigned int *score) {
+#if !ZKFP_ENABLE_ALGO
+  return ZKFP_ERR_NOT_SUPPORT;
+#endif
+
+  auto *dev = static_cast<DeviceHandle *>(hDevice);
+  if (!dev || !FID) {
+    return ZKFP_ERR_INVALID_PARAM;
+  }
+  if (!IsValidDeviceHandle(dev) || !IsValidDBHandle(hDBCache)) {
+    return ZKFP_ERR_INVALID_HANDLE;
+  }
+  if (!g_bInited) {
+    return ZKFP_ERR_INIT;
+  }
+  if (fpImage && dev->width * dev->height > cbFPImage) {
+    return ZKFP_ERR_INVALID_PARAM;
+  }
+
+  std::shared_ptr<zkfp::CaptureQueue> queue = DevicePrefetch(dev);
+  if (!queue) {
+    return ZKFP_ERR_MEMORY_NOT_ENOUGH;
+  }
+  // Same 500 ms window as ZKFPM_AcquireFingerprintImage.
+  zkfp::CaptureQueue::Frame *frame = queue->Pop(0x1F4);
+  if (!frame) {
+    return ZKFP_ERR_CAPTURE;
+  }
+
+  // The worker is already filling the next free frame while this one is
+  // extracted; the template never leaves this stack buffer.
+  unsigned char templ[MAX_TEMPLATE_SIZE];
+  int len = BIOKEY_EXTRACT_GRAYSCALEDATA(g_DBCacheHandle.db, frame->image.data(), dev->width, dev->height, templ,
+                                        sizeof(templ), static_cast<int>(dev->enhance));
+  PinLastExtractImage();
+  if (fpImage) {
+    std::memcpy(fpImage, frame->image.data(), frame->image.size());
+  }
+  queue->Recycle(frame);
+  if (len <= 0) {
+    return ZKFP_ERR_EXTRACT_FP;
+  }
+  return IdentifyTemplate(templ, nullptr, FID, score);
+}
+
 HANDLE APICALL ZKFPM_DBInit() {
 #if !ZKFP_ENABLE_ALGO
   return nullptr;
@@ -470,20 +961,67 @@ int APICALL ZKFPM_DBFree(HANDLE hDBCache) {
   return ZKFPM_CloseDBCache(hDBCache);
 }
 
-int APICALL ZKFPM_DBSetParameter(HANDLE, int, unsigned char *, unsigned int) {
+int APICALL ZKFPM_DBSetParameter(HANDLE hDBCache, int nParamCode, unsigned char *paramValue, unsigned int cbParamValue) {
 #if !ZKFP_ENABLE_ALGO
   return ZKFP_ERR_NOT_SUPPORT;
 #endif
 
-  return ZKFP_ERR_NOT_SUPPORT;
+  if (!IsValidDBHandle(hDBCache)) {
+    return ZKFP_ERR_INVALID_HANDLE;
+  }
+  const DBParamDesc *param = FindDBParam(nParamCode);
+  if (!param) {
+    return ZKFP_ERR_NOT_SUPPORT;
+  }
+  if (!paramValue || cbParamValue < sizeof(uint32_t)) {
+    return ZKFP_ERR_INVALID_PARAM;
+  }
+
+  uint32_t val = *reinterpret_cast<uint32_t *>(paramValue);
+  if (param->kind == DBParamKind::Counter) {
+    if (val != 0) {
+      return ZKFP_ERR_INVALID_PARAM;
+    }
+    if (param->read) {
+      param->read(true);
+    } else {
+      param->slot->store(0);
+    }
+    return ZKFP_ERR_OK;
+  }
+  if (val < param->min_value || val > param->max_value) {
+    return ZKFP_ERR_INVALID_PARAM;
+  }
+  param->slot->store(val);
+  if (param->apply) {
+    param->apply(val);
+  }
+  return ZKFP_ERR_OK;
 }
 
-int APICALL ZKFPM_DBGetParameter(HANDLE, int, unsigned char *, unsigned int) {
+int APICALL ZKFPM_DBGetParameter(HANDLE hDBCache, int nParamCode, unsigned char *paramValue, unsigned int cbParamValue) {
 #if !ZKFP_ENABLE_ALGO
   return ZKFP_ERR_NOT_SUPPORT;
 #endif
 
-  return ZKFP_ERR_NOT_SUPPORT;
+  if (!IsValidDBHandle(hDBCache)) {
+    return ZKFP_ERR_INVALID_HANDLE;
+  }
+  const DBParamDesc *param = FindDBParam(nParamCode);
+  if (!param) {
+    return ZKFP_ERR_NOT_SUPPORT;
+  }
+  if (!paramValue || cbParamValue < sizeof(uint32_t)) {
+    return ZKFP_ERR_INVALID_PARAM;
+  }
+
+  uint64_t val = param->read ? param->read(false) : param->slot->load();
+  if (param->kind == DBParamKind::Counter && cbParamValue >= sizeof(uint64_t)) {
+    std::memcpy(paramValue, &val, sizeof(uint64_t));
+  } else {
+    *reinterpret_cast<uint32_t *>(paramValue) = static_cast<uint32_t>(val);
+  }
+  return ZKFP_ERR_OK;
 }
 
 int APICALL ZKFPM_DBMerge(HANDLE hDBCache, unsigned char *temp1, unsigned char *temp2, unsigned char *temp3,
@@ -545,12 +1083,47 @@ int APICALL ZKFPM_DBMatch(HANDLE hDBCache, unsigned char *template1, unsigned in
   return ZKFPM_MatchFinger(hDBCache, template1, cbTemplate1, template2, cbTemplate2);
 }
 
-int APICALL ZKFPM_ExtractFromImage(HANDLE, const char *, unsigned int, unsigned char *, unsigned int *) {
+int APICALL ZKFPM_ExtractFromImage(HANDLE hDBCache, const char *lpFilePathName, unsigned int DPI,
+                                   unsigned char *fpTemplate, unsigned int *cbTemplate) {
 #if !ZKFP_ENABLE_ALGO
   return ZKFP_ERR_NOT_SUPPORT;
 #endif
 
-  return ZKFP_ERR_NOT_SUPPORT;
+  if (!IsValidDBHandle(hDBCache)) {
+    return ZKFP_ERR_INVALID_HANDLE;
+  }
+  if (!cbTemplate) {
+    return ZKFP_ERR_INVALID_PARAM;
+  }
+  if (!fpTemplate) {
+    *cbTemplate = static_cast<unsigned int>(
+        BIOKEY_EXTRACT_IMAGE(g_DBCacheHandle.db, nullptr, 0, 0, 0, 0, 0, 0, nullptr, 0));
+    return ZKFP_ERR_OK;
+  }
+  if (!lpFilePathName || *cbTemplate <= 0) {
+    return ZKFP_ERR_INVALID_PARAM;
+  }
+
+  // Headerless raw files are taken at the frame size the engine was set up
+  // for, which stays valid after that device is closed.
+  zkfp::ImageFile file;
+  if (!file.Open(lpFilePathName, static_cast<int>(g_engine_width), static_cast<int>(g_engine_height))) {
+    return ZKFP_ERR_LOADIMAGE;
+  }
+  const zkfp::ImageView &view = file.View();
+  int len = BIOKEY_EXTRACT_IMAGE(g_DBCacheHandle.db, view.pixels, static_cast<unsigned int>(view.width),
+                                 static_cast<unsigned int>(view.height), static_cast<unsigned int>(view.stride),
+                                 view.bottom_up, DPI, 0, fpTemplate, *cbTemplate);
+  PinLastExtractImage();
+  if (len < 0) {
+    *cbTemplate = static_cast<unsigned int>(-len);
+    return ZKFP_ERR_MEMORY_NOT_ENOUGH;
+  }
+  if (len == 0) {
+    return ZKFP_ERR_EXTRACT_FP;
+  }
+  *cbTemplate = static_cast<unsigned int>(len);
+  return ZKFP_ERR_OK;
 }
 
 HANDLE APICALL ZKFPM_CreateDBCache() {
@@ -569,6 +1142,9 @@ int APICALL ZKFPM_CloseDBCache(HANDLE hDBCache) {
   if (!IsValidDBHandle(hDBCache)) {
     return ZKFP_ERR_INVALID_HANDLE;
   }
+  // Closing only drops the in-memory copy; a journaled cache stays on disk.
+  CloseJournal();
+  std::lock_guard<std::mutex> guard(g_db_write_lock);
   BIOKEY_DB_CLEAR(g_DBCacheHandle.db);
   g_DBCacheHandle.count = 0;
   return ZKFP_ERR_OK;
@@ -582,9 +1158,11 @@ int APICALL ZKFPM_ClearDBCache(HANDLE hDBCache) {
   if (!IsValidDBHandle(hDBCache)) {
     return ZKFP_ERR_INVALID_HANDLE;
   }
-  BIOKEY_DB_CLEAR(g_DBCacheHandle.db);
-  g_DBCacheHandle.count = 0;
-  return ZKFP_ERR_OK;
+  return CommitDBChange(zkfp::JournalOp::Clear, 0, nullptr, 0, [] {
+    BIOKEY_DB_CLEAR(g_DBCacheHandle.db);
+    g_DBCacheHandle.count = 0;
+    return ZKFP_ERR_OK;
+  });
 }
 
 int APICALL ZKFPM_GetDBCacheCount(HANDLE hDBCache, unsigned int *fpCount) {
@@ -602,6 +1180,204 @@ int APICALL ZKFPM_GetDBCacheCount(HANDLE hDBCache, unsigned int *fpCount) {
   return ZKFP_ERR_OK;
 }
 
+int APICALL ZKFPM_DBSave(HANDLE hDBCache, const char *path) {
+#if !ZKFP_ENABLE_ALGO
+  return ZKFP_ERR_NOT_SUPPORT;
+#endif
+
+  if (!IsValidDBHandle(hDBCache)) {
+    return ZKFP_ERR_INVALID_HANDLE;
+  }
+  if (!path || !*path) {
+    return ZKFP_ERR_INVALID_PARAM;
+  }
+  // With a journal open the snapshot is tagged with its sequence, so a peer
+  // seeded from it knows where to pick up the change log.
+  std::shared_ptr<zkfp::DBJournal> log;
+  uint64_t seq = 0;
+  {
+    std::lock_guard<std::mutex> guard(g_db_write_lock);
+    log = g_journal.log;
+    if (log) {
+      seq = log->LastSeq();
+    }
+    if (BIOKEY_DB_SAVE(g_DBCacheHandle.db, path, seq) < 0) {
+      return ZKFP_ERR_FAIL;
+    }
+  }
+  return !log || log->WaitDurable(seq) ? ZKFP_ERR_OK : ZKFP_ERR_FAIL;
+}
+
+int APICALL ZKFPM_DBLoad(HANDLE hDBCache, const char *path) {
+#if !ZKFP_ENABLE_ALGO
+  return ZKFP_ERR_NOT_SUPPORT;
+#endif
+
+  if (!IsValidDBHandle(hDBCache)) {
+    return ZKFP_ERR_INVALID_HANDLE;
+  }
+  if (!path || !*path) {
+    return ZKFP_ERR_INVALID_PARAM;
+  }
+
+  std::lock_guard<std::mutex> compact(g_compact_lock);
+  std::lock_guard<std::mutex> guard(g_db_write_lock);
+  return LoadSnapshotLocked(path, nullptr);
+}
+
+int APICALL ZKFPM_DBOpenJournal(HANDLE hDBCache, const char *dir) {
+#if !ZKFP_ENABLE_ALGO
+  return ZKFP_ERR_NOT_SUPPORT;
+#endif
+
+  if (!IsValidDBHandle(hDBCache)) {
+    return ZKFP_ERR_INVALID_HANDLE;
+  }
+  if (!dir || !*dir) {
+    return ZKFP_ERR_INVALID_PARAM;
+  }
+  std::string snapshot_path = std::string(dir) + "/zkfp.snap";
+  std::string journal_path = std::string(dir) + "/zkfp.wal";
+
+  std::lock_guard<std::mutex> compact(g_compact_lock);
+  std::lock_guard<std::mutex> guard(g_db_write_lock);
+  if (g_journal.log) {
+    return ZKFP_ERR_ALREADY_OPENED;
+  }
+
+  uint64_t seq = 0;
+  if (::access(snapshot_path.c_str(), F_OK) == 0) {
+    if (BIOKEY_DB_LOAD(g_DBCacheHandle.db, snapshot_path.c_str(), 1, &seq) < 0) {
+      return ZKFP_ERR_FAIL;
+    }
+  } else if (::access(journal_path.c_str(), F_OK) == 0) {
+    BIOKEY_DB_CLEAR(g_DBCacheHandle.db);
+  } else if (BIOKEY_DB_SAVE(g_DBCacheHandle.db, snapshot_path.c_str(), 0) < 0) {
+    // A fresh directory adopts what is in the cache now as its base.
+    return ZKFP_ERR_FAIL;
+  }
+
+  zkfp::DBJournal *log = zkfp::DBJournal::Open(journal_path.c_str(), seq, ReplayJournalRecord, g_DBCacheHandle.db);
+  if (!log) {
+    return ZKFP_ERR_FAIL;
+  }
+  g_journal.log.reset(log);
+  g_journal.snapshot_path = snapshot_path;
+  g_DBCacheHandle.count = static_cast<uint32_t>(BIOKEY_DB_COUNT(g_DBCacheHandle.db));
+  return ZKFP_ERR_OK;
+}
+
+int APICALL ZKFPM_DBCloseJournal(HANDLE hDBCache) {
+#if !ZKFP_ENABLE_ALGO
+  return ZKFP_ERR_NOT_SUPPORT;
+#endif
+
+  if (!IsValidDBHandle(hDBCache)) {
+    return ZKFP_ERR_INVALID_HANDLE;
+  }
+  CloseJournal();
+  return ZKFP_ERR_OK;
+}
+
+int APICALL ZKFPM_DBExportChanges(HANDLE hDBCache, unsigned long long afterSeq, const char *path,
+                                  unsigned long long *lastSeq) {
+#if !ZKFP_ENABLE_ALGO
+  return ZKFP_ERR_NOT_SUPPORT;
+#endif
+
+  if (!IsValidDBHandle(hDBCache)) {
+    return ZKFP_ERR_INVALID_HANDLE;
+  }
+  if (!path || !*path || !lastSeq) {
+    return ZKFP_ERR_INVALID_PARAM;
+  }
+  std::shared_ptr<zkfp::DBJournal> log;
+  {
+    std::lock_guard<std::mutex> guard(g_db_write_lock);
+    log = g_journal.log;
+  }
+  if (!log) {
+    return ZKFP_ERR_NOT_OPENED;
+  }
+
+  uint64_t last = 0;
+  switch (log->Export(afterSeq, path, &last)) {
+  case zkfp::ChangeLogStatus::Ok:
+    *lastSeq = last;
+    return ZKFP_ERR_OK;
+  case zkfp::ChangeLogStatus::Gap:
+    return ZKFP_ERR_INVALID_PARAM;
+  default:
+    return ZKFP_ERR_FAIL;
+  }
+}
+
+int APICALL ZKFPM_DBApplyChanges(HANDLE hDBCache, const char *path, unsigned long long fromSeq,
+                                 unsigned long long *lastSeq) {
+#if !ZKFP_ENABLE_ALGO
+  return ZKFP_ERR_NOT_SUPPORT;
+#endif
+
+  if (!IsValidDBHandle(hDBCache)) {
+    return ZKFP_ERR_INVALID_HANDLE;
+  }
+  if (!path || !*path || !lastSeq) {
+    return ZKFP_ERR_INVALID_PARAM;
+  }
+
+  PeerBatch batch;
+  uint64_t last = fromSeq;
+  {
+    std::lock_guard<std::mutex> compact(g_compact_lock);
+    std::lock_guard<std::mutex> guard(g_db_write_lock);
+    batch.log = g_journal.log;
+    switch (zkfp::DBJournal::ReadChangeLog(path, fromSeq, ApplyPeerRecord, &batch, &last)) {
+    case zkfp::ChangeLogStatus::Ok:
+      break;
+    case zkfp::ChangeLogStatus::Gap:
+      return ZKFP_ERR_INVALID_PARAM;
+    case zkfp::ChangeLogStatus::Foreign: {
+      // A peer snapshot: re-seed from it and continue from its sequence.
+      int ret = LoadSnapshotLocked(path, &last);
+      if (ret != ZKFP_ERR_OK) {
+        return ret;
+      }
+      break;
+    }
+    default:
+      return ZKFP_ERR_FAIL;
+    }
+    g_DBCacheHandle.count = static_cast<uint32_t>(BIOKEY_DB_COUNT(g_DBCacheHandle.db));
+  }
+  if (batch.failed || (batch.last_seq && !batch.log->WaitDurable(batch.last_seq))) {
+    return ZKFP_ERR_FAIL;
+  }
+  *lastSeq = last;
+  return ZKFP_ERR_OK;
+}
+
+int APICALL ZKFPM_DBCompact(HANDLE hDBCache) {
+#if !ZKFP_ENABLE_ALGO
+  return ZKFP_ERR_NOT_SUPPORT;
+#endif
+
+  if (!IsValidDBHandle(hDBCache)) {
+    return ZKFP_ERR_INVALID_HANDLE;
+  }
+  std::lock_guard<std::mutex> compact(g_compact_lock);
+  std::shared_ptr<zkfp::DBJournal> log;
+  std::string snapshot_path;
+  {
+    std::lock_guard<std::mutex> guard(g_db_write_lock);
+    log = g_journal.log;
+    snapshot_path = g_journal.snapshot_path;
+  }
+  if (!log) {
+    return ZKFP_ERR_NOT_OPENED;
+  }
+  return CompactJournal(log, snapshot_path);
+}
+
 int APICALL ZKFPM_AddRegTemplateToDBCache(HANDLE hDBCache, unsigned int fid, unsigned char *fpTemplate,
                                          unsigned int cbTemplate) {
 #if !ZKFP_ENABLE_ALGO
@@ -615,13 +1391,19 @@ int APICALL ZKFPM_AddRegTemplateToDBCache(HANDLE hDBCache, unsigned int fid, uns
     return ZKFP_ERR_INVALID_PARAM;
   }
 
-  int ret = BIOKEY_DB_ADD(g_DBCacheHandle.db, fid, cbTemplate, fpTemplate);
-  BIOKEY_GETLASTERROR();
-  if (ret <= 0) {
-    return ZKFP_ERR_ADD_FINGER;
-  }
-  g_DBCacheHandle.count += 1;
-  return ZKFP_ERR_OK;
+  // BIOKEY_DB_ADD goes by the length in the template header, which may run up
+  // to 7 bytes past cbTemplate; the journal keeps all the bytes it read.
+  unsigned int consumed = static_cast<unsigned int>(BIOKEY_TEMPLATELEN(fpTemplate, nullptr, nullptr));
+  unsigned int journaled = std::max(cbTemplate, consumed);
+  return CommitDBChange(zkfp::JournalOp::Add, fid, fpTemplate, journaled, [&] {
+    int ret = BIOKEY_DB_ADD(g_DBCacheHandle.db, fid, cbTemplate, fpTemplate);
+    BIOKEY_GETLASTERROR();
+    if (ret <= 0) {
+      return ZKFP_ERR_ADD_FINGER;
+    }
+    g_DBCacheHandle.count += 1;
+    return ZKFP_ERR_OK;
+  });
 }
 
 int APICALL ZKFPM_DelRegTemplateFromDBCache(HANDLE hDBCache, unsigned int fid) {
@@ -632,9 +1414,11 @@ int APICALL ZKFPM_DelRegTemplateFromDBCache(HANDLE hDBCache, unsigned int fid) {
   if (!IsValidDBHandle(hDBCache)) {
     return ZKFP_ERR_INVALID_HANDLE;
   }
-  BIOKEY_DB_DEL(g_DBCacheHandle.db, fid);
-  g_DBCacheHandle.count -= 1;
-  return ZKFP_ERR_OK;
+  return CommitDBChange(zkfp::JournalOp::Del, fid, nullptr, 0, [&] {
+    BIOKEY_DB_DEL(g_DBCacheHandle.db, fid);
+    g_DBCacheHandle.count -= 1;
+    return ZKFP_ERR_OK;
+  });
 }
 
 int APICALL ZKFPM_GenRegTemplate(HANDLE hDBCache, unsigned char *temp1, unsigned char *temp2,
@@ -646,19 +1430,28 @@ int APICALL ZKFPM_GenRegTemplate(HANDLE hDBCache, unsigned char *temp1, unsigned
   if (!IsValidDBHandle(hDBCache)) {
     return ZKFP_ERR_INVALID_HANDLE;
   }
-  if (!temp1 || !temp2 || !temp3 || !regTemp || !cbRegTemp) {
+  if (!cbRegTemp) {
     return ZKFP_ERR_INVALID_PARAM;
   }
-
-  unsigned char tmp[2048] = {0};
-  int len = BIOKEY_GENTEMPLATE_SP(g_DBCacheHandle.db, temp1, temp2, temp3, 3, tmp);
-  if (len <= 0) {
-    return ZKFP_ERR_MERGE;
+  if (!regTemp) {
+    // Size query, same bound as template extraction.
+    *cbRegTemp = static_cast<unsigned int>(
+        BIOKEY_EXTRACT_GRAYSCALEDATA(g_DBCacheHandle.db, nullptr, 0, 0, nullptr, 0, 0));
+    return ZKFP_ERR_OK;
   }
-  if (len > static_cast<int>(*cbRegTemp)) {
+  if (!temp1 || !temp2 || !temp3) {
+    return ZKFP_ERR_INVALID_PARAM;
+  }
+
+  const unsigned char *temps[3] = {temp1, temp2, temp3};
+  int len = BIOKEY_GENTEMPLATE_EX(g_DBCacheHandle.db, temps, 3, regTemp, static_cast<int>(*cbRegTemp));
+  if (len < 0) {
+    *cbRegTemp = static_cast<unsigned int>(-len);
     return ZKFP_ERR_MEMORY_NOT_ENOUGH;
   }
-  std::memcpy(regTemp, tmp, static_cast<size_t>(len));
+  if (len == 0) {
+    return ZKFP_ERR_MERGE;
+  }
   *cbRegTemp = static_cast<unsigned int>(len);
   return ZKFP_ERR_OK;
 }
@@ -679,17 +1472,55 @@ int APICALL ZKFPM_Identify(HANDLE hDBCache, unsigned char *fpTemplate, unsigned
     return ZKFP_ERR_INVALID_PARAM;
   }
 
-  int ret = BIOKEY_IDENTIFYTEMP(g_DBCacheHandle.db, fpTemplate, cbTemplate, FID);
-  if (ret > 0) {
-    if (*FID == 0) {
-      return ZKFP_ERR_FAIL;
-    }
-    if (score) {
-      *score = static_cast<unsigned int>(ret);
+  return IdentifyTemplate(fpTemplate, nullptr, FID, score);
+}
+
+// Tags become engine column names ("F" + tag), so they are kept to identifier
+// characters.
+static bool IsValidTag(const char *tag) {
+  size_t len = 0;
+  for (; tag[len]; ++len) {
+    char c = tag[len];
+    bool ok = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+    if (!ok || len == FP_TAG_MAX_LEN) {
+      return false;
     }
-    return ZKFP_ERR_OK;
   }
-  return ZKFP_ERR_FAIL;
+  return len > 0;
+}
+
+int APICALL ZKFPM_DBSetTag(HANDLE hDBCache, unsigned int fid, const char *tag) {
+#if !ZKFP_ENABLE_ALGO
+  return ZKFP_ERR_NOT_SUPPORT;
+#endif
+
+  if (!IsValidDBHandle(hDBCache)) {
+    return ZKFP_ERR_INVALID_HANDLE;
+  }
+  if (!fid || !tag || !IsValidTag(tag)) {
+    return ZKFP_ERR_INVALID_PARAM;
+  }
+  if (BIOKEY_SET_STRINGTAG(g_DBCacheHandle.db, fid, tag) <= 0) {
+    BIOKEY_GETLASTERROR();
+    return ZKFP_ERR_FAIL;
+  }
+  return ZKFP_ERR_OK;
+}
+
+int APICALL ZKFPM_IdentifyByTag(HANDLE hDBCache, const char *tag, unsigned char *fpTemplate, unsigned int cbTemplate,
+                                unsigned int *FID, unsigned int *score) {
+#if !ZKFP_ENABLE_ALGO
+  return ZKFP_ERR_NOT_SUPPORT;
+#endif
+
+  if (!IsValidDBHandle(hDBCache)) {
+    return ZKFP_ERR_INVALID_HANDLE;
+  }
+  if (!tag || !IsValidTag(tag) || !fpTemplate || !cbTemplate || !FID) {
+    return ZKFP_ERR_INVALID_PARAM;
+  }
+
+  return IdentifyTemplate(fpTemplate, tag, FID, score);
 }
 
 int APICALL ZKFPM_MatchFinger(HANDLE hDBCache, unsigned char *template1, unsigned int cbTemplate1,
@@ -705,10 +1536,9 @@ int APICALL ZKFPM_MatchFinger(HANDLE hDBCache, unsigned char *template1, unsigne
     return ZKFP_ERR_INVALID_PARAM;
   }
 
-  BIOKEY_MATCHINGPARAM(g_DBCacheHandle.db, 0, g_DBCacheHandle.threshold_1);
-  int score = BIOKEY_VERIFY(g_DBCacheHandle.db, template1, template2);
-  BIOKEY_MATCHINGPARAM(g_DBCacheHandle.db, 0, g_DBCacheHandle.threshold_n);
-  return score;
+  g_DBCounters.verify.fetch_add(1, std::memory_order_relaxed);
+  int threshold = static_cast<int>(g_DBTuning.threshold_1.load(std::memory_order_relaxed));
+  return BIOKEY_VERIFY_EX(g_DBCacheHandle.db, template1, template2, threshold);
 }
 
 int APICALL ZKFPM_VerifyByID(HANDLE hDBCache, unsigned int fid, unsigned char *fpTemplate,
@@ -724,10 +1554,9 @@ int APICALL ZKFPM_VerifyByID(HANDLE hDBCache, unsigned int fid, unsigned char *f
     return ZKFP_ERR_INVALID_PARAM;
   }
 
-  BIOKEY_MATCHINGPARAM(g_DBCacheHandle.db, 0, g_DBCacheHandle.threshold_1);
-  int score = BIOKEY_VERIFYBYID(g_DBCacheHandle.db, fid, fpTemplate);
-  BIOKEY_MATCHINGPARAM(g_DBCacheHandle.db, 0, g_DBCacheHandle.threshold_n);
-  return score;
+  g_DBCounters.verify.fetch_add(1, std::memory_order_relaxed);
+  int threshold = static_cast<int>(g_DBTuning.threshold_1.load(std::memory_order_relaxed));
+  return BIOKEY_VERIFYBYID_EX(g_DBCacheHandle.db, fid, fpTemplate, threshold);
 }
 
 int APICALL ZKFPM_GetLastExtractImage() {
@@ -735,41 +1564,230 @@ int APICALL ZKFPM_GetLastExtractImage() {
   return ZKFP_ERR_NOT_SUPPORT;
 #endif
 
-  return 0;
+  return BIOKEY_IMAGE_LASTSEQ(g_DBCacheHandle.db);
 }
 
-int APICALL ZKFPM_Base64ToBlob(const char *base64, void *outBlob, unsigned int outLen) {
-  if (!base64 || !outBlob || !outLen) {
+int APICALL ZKFPM_AcquireExtractImage(HANDLE hDBCache, unsigned int seq, TZKFPImageView *view) {
+#if !ZKFP_ENABLE_ALGO
+  return ZKFP_ERR_NOT_SUPPORT;
+#endif
+
+  if (!IsValidDBHandle(hDBCache)) {
+    return ZKFP_ERR_INVALID_HANDLE;
+  }
+  if (!view) {
     return ZKFP_ERR_INVALID_PARAM;
   }
-  if ((std::strlen(base64) & 3) != 0) {
+  std::memset(view, 0, sizeof(*view));
+
+  const void *bmp = nullptr;
+  unsigned int len = 0;
+  unsigned int w = 0;
+  unsigned int h = 0;
+  unsigned int got = static_cast<unsigned int>(BIOKEY_IMAGE_ACQUIRE(g_DBCacheHandle.db, seq, &bmp, &len, &w, &h));
+  if (!got) {
+    return ZKFP_ERR_LOADIMAGE;
+  }
+  view->seq = got;
+  view->width = w;
+  view->height = h;
+  view->bmpSize = len;
+  view->bmp = static_cast<const unsigned char *>(bmp);
+  view->pixels = BmpPixels(view->bmp, len);
+  return ZKFP_ERR_OK;
+}
+
+int APICALL ZKFPM_ReleaseExtractImage(HANDLE hDBCache, TZKFPImageView *view) {
+#if !ZKFP_ENABLE_ALGO
+  return ZKFP_ERR_NOT_SUPPORT;
+#endif
+
+  if (!IsValidDBHandle(hDBCache)) {
+    return ZKFP_ERR_INVALID_HANDLE;
+  }
+  if (!view || !view->seq) {
+    return ZKFP_ERR_INVALID_PARAM;
+  }
+  if (!BIOKEY_IMAGE_RELEASE(g_DBCacheHandle.db, view->seq)) {
+    return ZKFP_ERR_INVALID_PARAM;
+  }
+  std::memset(view, 0, sizeof(*view));
+  return ZKFP_ERR_OK;
+}
+
+int APICALL ZKFPM_Base64ToBlob(const char *base64, void *outBlob, unsigned int outLen) {
+  if (!base64 || (outBlob && !outLen)) {
     return ZKFP_ERR_INVALID_PARAM;
   }
 
-  std::vector<uint8_t> decoded;
-  if (!Base64Decode(base64, decoded)) {
+  size_t len = std::strlen(base64);
+  if ((len & 3) != 0) {
     return ZKFP_ERR_INVALID_PARAM;
   }
-  if (outLen < decoded.size()) {
+  size_t decoded_len = zkfp::Base64DecodedLen(base64, len);
+  if (!outBlob) {
+    return static_cast<int>(decoded_len);
+  }
+  if (outLen < decoded_len) {
     return ZKFP_ERR_MEMORY_NOT_ENOUGH;
   }
-  std::memcpy(outBlob, decoded.data(), decoded.size());
-  return static_cast<int>(decoded.size());
+  if (!zkfp::Base64Decode(base64, len, static_cast<uint8_t *>(outBlob))) {
+    return ZKFP_ERR_INVALID_PARAM;
+  }
+  return static_cast<int>(decoded_len);
 }
 
 int APICALL ZKFPM_BlobToBase64(const void *blob, int blobLen, char *outBase64, unsigned int outLen) {
-  if (!blob || blobLen <= 0 || !outBase64 || !outLen) {
+  if (!blob || blobLen <= 0 || (outBase64 && !outLen)) {
+    return ZKFP_ERR_INVALID_PARAM;
+  }
+
+  // The size query counts the NUL, the result does not (like strlen), as
+  // libzkfp.h documents.
+  size_t encoded_len = zkfp::Base64EncodedLen(static_cast<size_t>(blobLen));
+  if (!outBase64) {
+    return static_cast<int>(encoded_len + 1);
+  }
+  if (outLen < encoded_len + 1) {
+    return ZKFP_ERR_MEMORY_NOT_ENOUGH;
+  }
+  zkfp::Base64Encode(static_cast<const uint8_t *>(blob), static_cast<size_t>(blobLen), outBase64);
+  outBase64[encoded_len] = '\0';
+  return static_cast<int>(encoded_len);
+}
+
+int APICALL ZKFPM_Base64StreamInit(TZKFPBase64Stream *stream) {
+  if (!stream) {
+    return ZKFP_ERR_INVALID_PARAM;
+  }
+  std::memset(stream, 0, sizeof(*stream));
+  return ZKFP_ERR_OK;
+}
+
+int APICALL ZKFPM_Base64EncodeUpdate(TZKFPBase64Stream *stream, const void *blob, unsigned int blobLen,
+                                     char *outBase64, unsigned int outLen) {
+  if (!stream || stream->pendingLen > 2 || (!blob && blobLen)) {
+    return ZKFP_ERR_INVALID_PARAM;
+  }
+
+  size_t total = stream->pendingLen + static_cast<size_t>(blobLen);
+  size_t need = (total / 3) * 4;
+  if (!outBase64) {
+    return static_cast<int>(need);
+  }
+  if (outLen < need) {
+    return ZKFP_ERR_MEMORY_NOT_ENOUGH;
+  }
+
+  const auto *in = static_cast<const uint8_t *>(blob);
+  size_t left = blobLen;
+  char *out = outBase64;
+  if (stream->pendingLen && total >= 3) {
+    size_t take = 3 - stream->pendingLen;
+    std::memcpy(stream->pending + stream->pendingLen, in, take);
+    zkfp::Base64Encode(stream->pending, 3, out);
+    out += 4;
+    in += take;
+    left -= take;
+    stream->pendingLen = 0;
+  }
+  size_t bulk = (left / 3) * 3;
+  zkfp::Base64Encode(in, bulk, out);
+  std::memcpy(stream->pending + stream->pendingLen, in + bulk, left - bulk);
+  stream->pendingLen += static_cast<unsigned int>(left - bulk);
+  return static_cast<int>(need);
+}
+
+int APICALL ZKFPM_Base64EncodeFinal(TZKFPBase64Stream *stream, char *outBase64, unsigned int outLen) {
+  if (!stream || stream->pendingLen > 2) {
     return ZKFP_ERR_INVALID_PARAM;
   }
 
-  const auto *data = static_cast<const uint8_t *>(blob);
-  std::string encoded = Base64Encode(data, static_cast<size_t>(blobLen));
-  if (outLen < encoded.size() + 1) {
+  size_t need = stream->pendingLen ? 4 : 0;
+  if (!outBase64) {
+    return static_cast<int>(need);
+  }
+  if (outLen < need) {
     return ZKFP_ERR_MEMORY_NOT_ENOUGH;
   }
-  std::memcpy(outBase64, encoded.data(), encoded.size());
-  outBase64[encoded.size()] = '\0';
-  return static_cast<int>(encoded.size());
+  zkfp::Base64Encode(stream->pending, stream->pendingLen, outBase64);
+  std::memset(stream, 0, sizeof(*stream));
+  return static_cast<int>(need);
+}
+
+int APICALL ZKFPM_Base64DecodeUpdate(TZKFPBase64Stream *stream, const char *base64, unsigned int base64Len,
+                                     void *outBlob, unsigned int outLen) {
+  if (!stream || stream->pendingLen > 3 || (!base64 && base64Len)) {
+    return ZKFP_ERR_INVALID_PARAM;
+  }
+  if (stream->finished && base64Len) {
+    return ZKFP_ERR_INVALID_PARAM;
+  }
+
+  size_t total = stream->pendingLen + static_cast<size_t>(base64Len);
+  size_t quads = total / 4;
+  size_t need = 0;
+  if (quads) {
+    // Padding can only sit in the last complete quad of this chunk.
+    char last[4];
+    size_t last_at = (quads - 1) * 4;
+    for (size_t i = 0; i < 4; ++i) {
+      size_t pos = last_at + i;
+      last[i] = pos < stream->pendingLen ? static_cast<char>(stream->pending[pos])
+                                         : base64[pos - stream->pendingLen];
+    }
+    need = (quads - 1) * 3 + zkfp::Base64DecodedLen(last, 4);
+    if (last[3] == '=' && total != quads * 4) {
+      return ZKFP_ERR_INVALID_PARAM;
+    }
+  }
+  if (!outBlob) {
+    return static_cast<int>(need);
+  }
+  if (outLen < need) {
+    return ZKFP_ERR_MEMORY_NOT_ENOUGH;
+  }
+
+  const char *in = base64;
+  size_t left = base64Len;
+  auto *out = static_cast<uint8_t *>(outBlob);
+  unsigned char pending[4];
+  unsigned int pending_len = stream->pendingLen;
+  std::memcpy(pending, stream->pending, sizeof(pending));
+  if (pending_len && total >= 4) {
+    size_t take = 4 - pending_len;
+    std::memcpy(pending + pending_len, in, take);
+    const char *quad = reinterpret_cast<const char *>(pending);
+    if ((quad[3] == '=' && left != take) || !zkfp::Base64Decode(quad, 4, out)) {
+      return ZKFP_ERR_INVALID_PARAM;
+    }
+    out += zkfp::Base64DecodedLen(quad, 4);
+    in += take;
+    left -= take;
+    pending_len = 0;
+  }
+  size_t bulk = left & ~static_cast<size_t>(3);
+  if (bulk && !zkfp::Base64Decode(in, bulk, out)) {
+    return ZKFP_ERR_INVALID_PARAM;
+  }
+  std::memcpy(pending + pending_len, in + bulk, left - bulk);
+  pending_len += static_cast<unsigned int>(left - bulk);
+
+  std::memcpy(stream->pending, pending, sizeof(pending));
+  stream->pendingLen = pending_len;
+  if (quads && need < quads * 3) {
+    stream->finished = 1;
+  }
+  return static_cast<int>(need);
+}
+
+int APICALL ZKFPM_Base64DecodeFinal(TZKFPBase64Stream *stream) {
+  if (!stream) {
+    return ZKFP_ERR_INVALID_PARAM;
+  }
+  int ret = stream->pendingLen ? ZKFP_ERR_INVALID_PARAM : ZKFP_ERR_OK;
+  std::memset(stream, 0, sizeof(*stream));
+  return ret;
 }
 
 } // extern "C"
@@ -0,0 +1,185 @@
+// Base64 round trips through the codec and the ZKFPM entry points, one-shot
+// and streamed in chunks split anywhere, at lengths that reach every kernel's
+// bulk loop and tail.
+#include "base64.h"
+#include "libzkfp.h"
+#include "libzkfperrdef.h"
+#include "test_util.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+std::vector<uint8_t> RandomBytes(size_t len, std::mt19937 &rng) {
+  std::vector<uint8_t> out(len);
+  for (uint8_t &b : out) {
+    b = static_cast<uint8_t>(rng());
+  }
+  return out;
+}
+
+std::string Encode(const std::vector<uint8_t> &in) {
+  std::string out(zkfp::Base64EncodedLen(in.size()), '\0');
+  zkfp::Base64Encode(in.data(), in.size(), out.data());
+  return out;
+}
+
+bool Decode(const std::string &in, std::vector<uint8_t> *out) {
+  out->assign(zkfp::Base64DecodedLen(in.data(), in.size()), 0);
+  return zkfp::Base64Decode(in.data(), in.size(), out->data());
+}
+
+void TestKnownVectors() {
+  // RFC 4648, section 10.
+  const char *kPlain[] = {"", "f", "fo", "foo", "foob", "fooba", "foobar"};
+  const char *kEncoded[] = {"", "Zg==", "Zm8=", "Zm9v", "Zm9vYg==", "Zm9vYmE=", "Zm9vYmFy"};
+  for (size_t i = 0; i < sizeof(kPlain) / sizeof(kPlain[0]); ++i) {
+    std::vector<uint8_t> plain(kPlain[i], kPlain[i] + std::strlen(kPlain[i]));
+    CHECK(Encode(plain) == kEncoded[i]);
+    std::vector<uint8_t> back;
+    CHECK(Decode(kEncoded[i], &back) && back == plain);
+  }
+}
+
+void TestRoundTrips(std::mt19937 &rng) {
+  std::vector<size_t> lens;
+  for (size_t len = 0; len <= 200; ++len) {
+    lens.push_back(len);
+  }
+  for (size_t len : {511, 512, 513, 1663, 1664, 4096, 65537}) {
+    lens.push_back(len);
+  }
+  for (size_t len : lens) {
+    std::vector<uint8_t> in = RandomBytes(len, rng);
+    std::string text = Encode(in);
+    std::vector<uint8_t> back;
+    if (!CHECK(Decode(text, &back) && back == in)) {
+      std::fprintf(stderr, "  length %zu (%s kernel)\n", len, zkfp::Base64Kernel());
+    }
+  }
+}
+
+void TestRejects(std::mt19937 &rng) {
+  std::string text = Encode(RandomBytes(300, rng));
+  std::vector<uint8_t> out(zkfp::Base64DecodedLen(text.data(), text.size()));
+  // A bad character anywhere, in the vector body and in the tail.
+  for (size_t at : {size_t{0}, size_t{37}, size_t{200}, text.size() - 1}) {
+    std::string bad = text;
+    bad[at] = '*';
+    CHECK(!zkfp::Base64Decode(bad.data(), bad.size(), out.data()));
+  }
+  std::string early_pad = text;
+  early_pad[8] = '=';
+  CHECK(!zkfp::Base64Decode(early_pad.data(), early_pad.size(), out.data()));
+  CHECK(zkfp::Base64DecodedLen(text.data(), text.size() - 1) == 0);
+  CHECK(!zkfp::Base64Decode(text.data(), text.size() - 1, out.data()));
+}
+
+void TestBlobApi(std::mt19937 &rng) {
+  std::vector<uint8_t> blob = RandomBytes(1000, rng);
+  int need = ZKFPM_BlobToBase64(blob.data(), static_cast<int>(blob.size()), nullptr, 0);
+  CHECK(need == static_cast<int>(zkfp::Base64EncodedLen(blob.size()) + 1));
+  std::vector<char> text(static_cast<size_t>(need));
+  CHECK(ZKFPM_BlobToBase64(blob.data(), static_cast<int>(blob.size()), text.data(), need - 1) ==
+        ZKFP_ERR_MEMORY_NOT_ENOUGH);
+  CHECK(ZKFPM_BlobToBase64(blob.data(), static_cast<int>(blob.size()), text.data(), need) == need - 1);
+  CHECK(text.back() == '\0');
+
+  int size = ZKFPM_Base64ToBlob(text.data(), nullptr, 0);
+  CHECK(size == static_cast<int>(blob.size()));
+  std::vector<uint8_t> back(blob.size());
+  CHECK(ZKFPM_Base64ToBlob(text.data(), back.data(), static_cast<unsigned int>(back.size()) - 1) ==
+        ZKFP_ERR_MEMORY_NOT_ENOUGH);
+  CHECK(ZKFPM_Base64ToBlob(text.data(), back.data(), static_cast<unsigned int>(back.size())) == size);
+  CHECK(back == blob);
+  CHECK(ZKFPM_Base64ToBlob("Zm9v!A==", back.data(), static_cast<unsigned int>(back.size())) ==
+        ZKFP_ERR_INVALID_PARAM);
+  CHECK(ZKFPM_Base64ToBlob("Zm9", back.data(), static_cast<unsigned int>(back.size())) == ZKFP_ERR_INVALID_PARAM);
+}
+
+// Chunk sizes 0..max, so splits fall inside and between quads and triplets.
+std::vector<size_t> RandomSplits(size_t total, size_t max, std::mt19937 &rng) {
+  std::vector<size_t> chunks;
+  for (size_t at = 0; at < total;) {
+    size_t n = std::min(total - at, static_cast<size_t>(rng() % (max + 1)));
+    chunks.push_back(n);
+    at += n;
+  }
+  return chunks;
+}
+
+void TestStreams(std::mt19937 &rng) {
+  for (size_t len : {0, 1, 2, 3, 4, 5, 97, 1664, 10000}) {
+    std::vector<uint8_t> blob = RandomBytes(len, rng);
+    std::string whole = Encode(blob);
+    for (size_t max : {1, 2, 5, 64, 3000}) {
+      TZKFPBase64Stream enc;
+      CHECK(ZKFPM_Base64StreamInit(&enc) == ZKFP_ERR_OK);
+      std::string text;
+      size_t at = 0;
+      bool ok = true;
+      for (size_t n : RandomSplits(len, max, rng)) {
+        int need = ZKFPM_Base64EncodeUpdate(&enc, blob.data() + at, static_cast<unsigned int>(n), nullptr, 0);
+        std::vector<char> out(static_cast<size_t>(need) + 1);
+        int wrote = ZKFPM_Base64EncodeUpdate(&enc, blob.data() + at, static_cast<unsigned int>(n), out.data(),
+                                             static_cast<unsigned int>(out.size()));
+        ok = ok && wrote == need;
+        text.append(out.data(), static_cast<size_t>(wrote > 0 ? wrote : 0));
+        at += n;
+      }
+      char tail[4];
+      int wrote = ZKFPM_Base64EncodeFinal(&enc, tail, sizeof(tail));
+      text.append(tail, static_cast<size_t>(wrote > 0 ? wrote : 0));
+      if (!CHECK(ok && text == whole)) {
+        std::fprintf(stderr, "  encode: length %zu, chunks up to %zu\n", len, max);
+      }
+
+      TZKFPBase64Stream dec;
+      CHECK(ZKFPM_Base64StreamInit(&dec) == ZKFP_ERR_OK);
+      std::vector<uint8_t> back;
+      at = 0;
+      ok = true;
+      for (size_t n : RandomSplits(whole.size(), max, rng)) {
+        std::vector<uint8_t> out(n + 3);
+        int got = ZKFPM_Base64DecodeUpdate(&dec, whole.data() + at, static_cast<unsigned int>(n), out.data(),
+                                           static_cast<unsigned int>(out.size()));
+        ok = ok && got >= 0;
+        back.insert(back.end(), out.begin(), out.begin() + (got > 0 ? got : 0));
+        at += n;
+      }
+      ok = ok && ZKFPM_Base64DecodeFinal(&dec) == ZKFP_ERR_OK;
+      if (!CHECK(ok && back == blob)) {
+        std::fprintf(stderr, "  decode: length %zu, chunks up to %zu\n", len, max);
+      }
+    }
+  }
+
+  // A stream cut off mid-quad, or carrying on after its padding, is refused.
+  TZKFPBase64Stream dec;
+  uint8_t out[16];
+  ZKFPM_Base64StreamInit(&dec);
+  CHECK(ZKFPM_Base64DecodeUpdate(&dec, "Zm9vYg", 6, out, sizeof(out)) == 3);
+  CHECK(ZKFPM_Base64DecodeFinal(&dec) == ZKFP_ERR_INVALID_PARAM);
+  ZKFPM_Base64StreamInit(&dec);
+  CHECK(ZKFPM_Base64DecodeUpdate(&dec, "Zg==Zm9v", 8, out, sizeof(out)) == ZKFP_ERR_INVALID_PARAM);
+  ZKFPM_Base64StreamInit(&dec);
+  CHECK(ZKFPM_Base64DecodeUpdate(&dec, "Zg==", 4, out, sizeof(out)) == 1);
+  CHECK(ZKFPM_Base64DecodeUpdate(&dec, "Zm9v", 4, out, sizeof(out)) == ZKFP_ERR_INVALID_PARAM);
+}
+
+} // namespace
+
+int main() {
+  std::mt19937 rng(5);
+  TestKnownVectors();
+  TestRoundTrips(rng);
+  TestRejects(rng);
+  TestBlobApi(rng);
+  TestStreams(rng);
+  return zkfp_test::TestResult();
+}
@@ -0,0 +1,123 @@
+// Journal crash recovery: a child process journals adds and deletes, with or
+// without compactions running alongside, records what identification returns,
+// then dies without closing anything. Reopening the journal directory must
+// rebuild a cache that identifies exactly the same.
+#include "engine_fixture.h"
+#include "test_util.h"
+
+#include <atomic>
+#include <cstdio>
+#include <thread>
+
+namespace {
+
+using zkfp_test::Gallery;
+using zkfp_test::GalleryResults;
+
+constexpr unsigned int kUsers = zkfp_test::kGalleryFingers;
+constexpr unsigned int kDeleted = 7;
+
+// Every other template is handed over 6 bytes short of its header length,
+// which BIOKEY_DB_ADD accepts and reads in full anyway.
+unsigned int AddedLength(unsigned int fid) {
+  return fid % 2 ? zkfp_test::kTemplateLen - 6 : zkfp_test::kTemplateLen;
+}
+
+bool AddUser(HANDLE db, const Gallery &g, unsigned int fid, unsigned int finger) {
+  std::vector<unsigned char> t = zkfp_test::MakeTemplate(g.fingers[finger]);
+  return ZKFPM_DBAdd(db, fid, t.data(), AddedLength(fid)) == ZKFP_ERR_OK;
+}
+
+// Journals adds and a delete.
+bool WriteChanges(HANDLE db, const Gallery &g) {
+  bool ok = true;
+  for (unsigned int fid = 1; ok && fid <= kUsers; ++fid) {
+    ok = AddUser(db, g, fid, fid - 1);
+  }
+  return ok && ZKFPM_DBDel(db, kDeleted) == ZKFP_ERR_OK;
+}
+
+// Journals the same end state through churn while another thread compacts
+// over and over, so snapshots land between every kind of change.
+bool WriteChangesWhileCompacting(HANDLE db, const Gallery &g) {
+  std::atomic<bool> done{false};
+  bool compacted = true;
+  std::thread compactor([&] {
+    while (!done) {
+      compacted = ZKFPM_DBCompact(db) == ZKFP_ERR_OK && compacted;
+    }
+  });
+  bool ok = true;
+  for (int round = 0; ok && round < 3; ++round) {
+    for (unsigned int fid = 1; ok && fid <= kUsers; ++fid) {
+      // Re-adding an enrolled fid fails; the delete makes room.
+      ok = (!round || ZKFPM_DBDel(db, fid) == ZKFP_ERR_OK) && AddUser(db, g, fid, (fid - 1 + round * 5) % kUsers);
+    }
+  }
+  for (unsigned int fid = 1; ok && fid <= kUsers; ++fid) {
+    ok = ZKFPM_DBDel(db, fid) == ZKFP_ERR_OK && AddUser(db, g, fid, fid - 1);
+  }
+  ok = ok && ZKFPM_DBDel(db, kDeleted) == ZKFP_ERR_OK;
+  done = true;
+  compactor.join();
+  return ok && compacted;
+}
+
+using WriteFn = bool (*)(HANDLE db, const Gallery &g);
+
+// Runs `write` in a child that crashes, then recovers its journal directory
+// here and checks the cache identifies as it did before the crash.
+void TestRecovery(const Gallery &g, WriteFn write) {
+  zkfp_test::TempDir dir;
+  if (!CHECK(dir.Ok())) {
+    return;
+  }
+  GalleryResults before{};
+  bool ran = zkfp_test::RunInChild(
+      [&](GalleryResults *out) {
+        zkfp_test::Session s;
+        if (!s.Ok() || ZKFPM_DBOpenJournal(s.Db(), dir.Path().c_str()) != ZKFP_ERR_OK || !write(s.Db(), g)) {
+          return false;
+        }
+        *out = zkfp_test::IdentifyAll(s.Db(), g);
+        return true;
+      },
+      &before);
+  if (!CHECK(ran)) {
+    return;
+  }
+
+  // The child's view makes sense on its own.
+  for (unsigned int fid = 1; fid <= kUsers; ++fid) {
+    const zkfp_test::IdentifyResult &r = before.r[fid - 1];
+    CHECK(fid == kDeleted ? r.fid != kDeleted : r.ret == ZKFP_ERR_OK && r.fid == fid);
+  }
+
+  zkfp_test::Session s;
+  if (!CHECK(s.Ok())) {
+    return;
+  }
+  CHECK(ZKFPM_DBOpenJournal(s.Db(), dir.Path().c_str()) == ZKFP_ERR_OK);
+  unsigned int count = 0;
+  CHECK(ZKFPM_DBCount(s.Db(), &count) == ZKFP_ERR_OK);
+  CHECK(count == kUsers - 1);
+  GalleryResults after = zkfp_test::IdentifyAll(s.Db(), g);
+  for (unsigned int i = 0; i < zkfp_test::kGalleryProbes; ++i) {
+    const zkfp_test::IdentifyResult &b = before.r[i];
+    const zkfp_test::IdentifyResult &a = after.r[i];
+    if (!CHECK(a == b)) {
+      std::fprintf(stderr, "  probe %u: ret %d fid %u score %u before the crash, ret %d fid %u score %u after\n", i,
+                   b.ret, b.fid, b.score, a.ret, a.fid, a.score);
+    }
+  }
+  CHECK(ZKFPM_DBCloseJournal(s.Db()) == ZKFP_ERR_OK);
+}
+
+} // namespace
+
+int main() {
+  Gallery g = zkfp_test::MakeGallery(11);
+  TestRecovery(g, WriteChanges);
+  TestRecovery(g, WriteChangesWhileCompacting);
+  return zkfp_test::TestResult();
+}
@@ -0,0 +1,166 @@
+// Replication between nodes that share nothing but a directory, standing in
+// for the network: node A journals its changes and exports them there, node B
+// applies each change log on top of its own journal, and a late node C seeds
+// from a snapshot A exported after compacting. Each step runs in its own
+// process, as it would on its own machine, and every node must identify like
+// A did when it exported.
+#include "engine_fixture.h"
+#include "test_util.h"
+
+namespace {
+
+using zkfp_test::Gallery;
+using zkfp_test::GalleryResults;
+
+struct NodeReport {
+  unsigned long long last;
+  unsigned int count;
+  GalleryResults results;
+};
+
+// Opens a journal in `dir`, runs `step` on it and reports what it leaves.
+template <typename Step>
+bool RunNode(const std::string &dir, const Gallery &g, Step step, NodeReport *report) {
+  return zkfp_test::RunInChild(
+      [&](NodeReport *out) {
+        zkfp_test::Session s;
+        if (!s.Ok() || ZKFPM_DBOpenJournal(s.Db(), dir.c_str()) != ZKFP_ERR_OK || !step(s.Db(), out)) {
+          return false;
+        }
+        out->results = zkfp_test::IdentifyAll(s.Db(), g);
+        return ZKFPM_DBCount(s.Db(), &out->count) == ZKFP_ERR_OK && ZKFPM_DBCloseJournal(s.Db()) == ZKFP_ERR_OK;
+      },
+      report);
+}
+
+bool AddUser(HANDLE db, const Gallery &g, unsigned int fid) {
+  std::vector<unsigned char> t = zkfp_test::MakeTemplate(g.fingers[fid - 1]);
+  return ZKFPM_DBAdd(db, fid, t.data(), static_cast<unsigned int>(t.size())) == ZKFP_ERR_OK;
+}
+
+void CheckSame(const NodeReport &node, const NodeReport &source) {
+  CHECK(node.last == source.last);
+  CHECK(node.count == source.count);
+  CHECK(node.results == source.results);
+}
+
+} // namespace
+
+int main() {
+  zkfp_test::TempDir root;
+  if (!CHECK(root.Ok())) {
+    return 1;
+  }
+  std::string node_a = root.File("a");
+  std::string node_b = root.File("b");
+  std::string node_c = root.File("c");
+  std::string shared = root.File("shared");
+  for (const std::string &dir : {node_a, node_b, node_c, shared}) {
+    std::filesystem::create_directory(dir);
+  }
+  std::string log1 = shared + "/changes-1.log";
+  std::string log2 = shared + "/changes-2.log";
+  std::string stale = shared + "/stale.log";
+  std::string seed = shared + "/seed.snap";
+  Gallery g = zkfp_test::MakeGallery(23);
+
+  // A enrolls 30 users and exports everything.
+  NodeReport a1{};
+  bool ok = RunNode(
+      node_a, g,
+      [&](HANDLE db, NodeReport *out) {
+        for (unsigned int fid = 1; fid <= 30; ++fid) {
+          if (!AddUser(db, g, fid)) {
+            return false;
+          }
+        }
+        return ZKFPM_DBExportChanges(db, 0, log1.c_str(), &out->last) == ZKFP_ERR_OK;
+      },
+      &a1);
+  if (!CHECK(ok)) {
+    return zkfp_test::TestResult();
+  }
+  CHECK(a1.count == 30);
+  CHECK(a1.last >= 30);
+  for (unsigned int fid = 1; fid <= 30; ++fid) {
+    CHECK(a1.results.r[fid - 1].fid == fid);
+  }
+
+  // B starts empty and catches up.
+  NodeReport b1{};
+  CHECK(RunNode(
+      node_b, g,
+      [&](HANDLE db, NodeReport *out) {
+        return ZKFPM_DBApplyChanges(db, log1.c_str(), 0, &out->last) == ZKFP_ERR_OK;
+      },
+      &b1));
+  CheckSame(b1, a1);
+
+  // A deletes one user and enrolls two more; only those changes travel.
+  NodeReport a2{};
+  CHECK(RunNode(
+      node_a, g,
+      [&](HANDLE db, NodeReport *out) {
+        return ZKFPM_DBDel(db, 4) == ZKFP_ERR_OK && AddUser(db, g, 31) && AddUser(db, g, 32) &&
+               ZKFPM_DBExportChanges(db, a1.last, log2.c_str(), &out->last) == ZKFP_ERR_OK;
+      },
+      &a2));
+  CHECK(a2.count == 31);
+  CHECK(a2.results.r[3].fid != 4);
+  CHECK(a2.results.r[31].fid == 32);
+
+  // B resumes from its own journal: a log that does not start where B left
+  // off is refused untouched, the right one applies.
+  NodeReport b2{};
+  CHECK(RunNode(
+      node_b, g,
+      [&](HANDLE db, NodeReport *out) {
+        unsigned long long last = 0;
+        return ZKFPM_DBApplyChanges(db, log2.c_str(), 0, &last) == ZKFP_ERR_INVALID_PARAM &&
+               ZKFPM_DBApplyChanges(db, log2.c_str(), a1.last, &out->last) == ZKFP_ERR_OK;
+      },
+      &b2));
+  CheckSame(b2, a2);
+
+  // A compacts, which drops the old journal, then hands out a seed snapshot.
+  NodeReport a3{};
+  CHECK(RunNode(
+      node_a, g,
+      [&](HANDLE db, NodeReport *out) {
+        unsigned long long last = 0;
+        if (ZKFPM_DBCompact(db) != ZKFP_ERR_OK ||
+            ZKFPM_DBExportChanges(db, 0, stale.c_str(), &last) != ZKFP_ERR_INVALID_PARAM) {
+          return false;
+        }
+        if (!AddUser(db, g, 33) || ZKFPM_DBSave(db, seed.c_str()) != ZKFP_ERR_OK) {
+          return false;
+        }
+        return ZKFPM_DBExportChanges(db, a2.last, stale.c_str(), &out->last) == ZKFP_ERR_OK;
+      },
+      &a3));
+  CHECK(a3.count == 32);
+  CHECK(a3.last == a2.last + 1);
+
+  // C joins late: the change log from 0 is gone, so it seeds from the
+  // snapshot and lands on the sequence A saved it at.
+  NodeReport c1{};
+  CHECK(RunNode(
+      node_c, g,
+      [&](HANDLE db, NodeReport *out) {
+        return ZKFPM_DBApplyChanges(db, seed.c_str(), 0, &out->last) == ZKFP_ERR_OK;
+      },
+      &c1));
+  CheckSame(c1, a3);
+
+  // And C's seeded state survives a restart from its own journal.
+  NodeReport c2{};
+  CHECK(RunNode(
+      node_c, g,
+      [&](HANDLE, NodeReport *out) {
+        out->last = c1.last;
+        return true;
+      },
+      &c2));
+  CheckSame(c2, a3);
+  return zkfp_test::TestResult();
+}
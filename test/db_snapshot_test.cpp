@@ -0,0 +1,157 @@
+// Snapshot round trip, and rejection of every file a crash or bit rot could
+// leave behind: one flipped byte anywhere, a truncated tail, trailing bytes.
+#include "db_snapshot.h"
+#include "test_util.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <vector>
+
+namespace {
+
+struct Entry {
+  uint32_t fid;
+  std::vector<uint8_t> templ;
+};
+
+std::vector<Entry> SampleEntries() {
+  std::vector<Entry> entries;
+  const uint32_t kLens[] = {1, 7, 8, 9, 261, 1664};
+  uint32_t fid = 100;
+  for (uint32_t len : kLens) {
+    Entry e{fid++, std::vector<uint8_t>(len)};
+    for (uint32_t i = 0; i < len; ++i) {
+      e.templ[i] = static_cast<uint8_t>(i * 31 + len);
+    }
+    entries.push_back(std::move(e));
+  }
+  return entries;
+}
+
+bool Write(const std::string &path, const std::vector<Entry> &entries, uint64_t seq) {
+  zkfp::SnapshotWriter writer;
+  if (!writer.Open(path.c_str())) {
+    return false;
+  }
+  for (const Entry &e : entries) {
+    if (!writer.Append(e.fid, e.templ.data(), static_cast<uint32_t>(e.templ.size()))) {
+      return false;
+    }
+  }
+  return writer.Commit(seq);
+}
+
+std::vector<char> ReadFile(const std::string &path) {
+  std::ifstream in(path, std::ios::binary);
+  return std::vector<char>(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+void WriteFile(const std::string &path, const std::vector<char> &bytes) {
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  out.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+}
+
+bool Opens(const std::string &path) {
+  zkfp::SnapshotReader reader;
+  return reader.Open(path.c_str());
+}
+
+void TestRoundTrip(const zkfp_test::TempDir &dir) {
+  std::string path = dir.File("db.snap");
+  std::vector<Entry> entries = SampleEntries();
+  CHECK(Write(path, entries, 42));
+  CHECK(!std::filesystem::exists(path + ".tmp"));
+
+  zkfp::SnapshotReader reader;
+  if (!CHECK(reader.Open(path.c_str()))) {
+    return;
+  }
+  CHECK(reader.Count() == entries.size());
+  CHECK(reader.Seq() == 42);
+  zkfp::SnapshotRecord rec;
+  for (const Entry &e : entries) {
+    if (!CHECK(reader.Next(&rec))) {
+      return;
+    }
+    CHECK(rec.fid == e.fid);
+    CHECK(rec.len == e.templ.size());
+    CHECK(std::vector<uint8_t>(rec.templ, rec.templ + rec.len) == e.templ);
+  }
+  CHECK(!reader.Next(&rec));
+}
+
+void TestEmpty(const zkfp_test::TempDir &dir) {
+  std::string path = dir.File("empty.snap");
+  CHECK(Write(path, {}, 0));
+  zkfp::SnapshotReader reader;
+  CHECK(reader.Open(path.c_str()));
+  CHECK(reader.Count() == 0);
+  zkfp::SnapshotRecord rec;
+  CHECK(!reader.Next(&rec));
+}
+
+void TestCorruptionRejected(const zkfp_test::TempDir &dir) {
+  std::string good = dir.File("good.snap");
+  std::string bad = dir.File("bad.snap");
+  CHECK(Write(good, SampleEntries(), 7));
+  std::vector<char> bytes = ReadFile(good);
+  if (!CHECK(bytes.size() > sizeof(zkfp::SnapshotHeader))) {
+    return;
+  }
+
+  // Every byte of the file is covered by one of the two checksums.
+  for (size_t at = 0; at < bytes.size(); ++at) {
+    std::vector<char> flipped = bytes;
+    flipped[at] ^= 0x01;
+    WriteFile(bad, flipped);
+    if (!CHECK(!Opens(bad))) {
+      std::fprintf(stderr, "  flipped byte %zu was accepted\n", at);
+    }
+  }
+
+  WriteFile(bad, std::vector<char>(bytes.begin(), bytes.end() - 1));
+  CHECK(!Opens(bad));
+  WriteFile(bad, std::vector<char>(bytes.begin(), bytes.begin() + sizeof(zkfp::SnapshotHeader) - 1));
+  CHECK(!Opens(bad));
+  std::vector<char> longer = bytes;
+  longer.insert(longer.end(), 8, 0);
+  WriteFile(bad, longer);
+  CHECK(!Opens(bad));
+  CHECK(!Opens(dir.File("missing.snap")));
+
+  // The untouched file still loads.
+  CHECK(Opens(good));
+}
+
+void TestFailedSaveKeepsOld(const zkfp_test::TempDir &dir) {
+  std::string path = dir.File("keep.snap");
+  CHECK(Write(path, SampleEntries(), 3));
+  {
+    // Abandoned before Commit: the old snapshot stays and no temp file lingers.
+    zkfp::SnapshotWriter writer;
+    CHECK(writer.Open(path.c_str()));
+    uint8_t one = 1;
+    CHECK(writer.Append(1, &one, 1));
+  }
+  CHECK(!std::filesystem::exists(path + ".tmp"));
+  zkfp::SnapshotReader reader;
+  CHECK(reader.Open(path.c_str()));
+  CHECK(reader.Seq() == 3);
+  CHECK(reader.Count() == SampleEntries().size());
+}
+
+} // namespace
+
+int main() {
+  zkfp_test::TempDir dir;
+  if (!CHECK(dir.Ok())) {
+    return 1;
+  }
+  TestRoundTrip(dir);
+  TestEmpty(dir);
+  TestCorruptionRejected(dir);
+  TestFailedSaveKeepsOld(dir);
+  return zkfp_test::TestResult();
+}
@@ -0,0 +1,157 @@
+#ifndef ZKFP_TEST_ENGINE_FIXTURE_H
+#define ZKFP_TEST_ENGINE_FIXTURE_H
+
+#include "libzkfp.h"
+#include "libzkfperrdef.h"
+#include "template_codec.h"
+
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <vector>
+
+// Helpers for tests that run the ZKFPM entry points against the mock IEngine
+// and the stub sensor (test/sensor_stub.cpp).
+namespace zkfp_test {
+
+// Mock template layout: 24-byte ICRS2 header, one 'M' record of a 16x16 grid
+// (see bench/prefilter_eval.cpp).
+constexpr int kFeatures = 256;
+constexpr int kRecordLen = 5 + kFeatures;
+constexpr int kTemplateLen = 24 + kRecordLen;
+
+using Finger = std::vector<int8_t>;
+
+inline std::vector<unsigned char> MakeTemplate(const Finger &features, uint8_t quality = 80) {
+  std::vector<unsigned char> t(kTemplateLen, 0);
+  std::memcpy(t.data(), "ICRS21", 6);
+  t[8] = static_cast<uint8_t>(kTemplateLen >> 8);
+  t[9] = static_cast<uint8_t>(kTemplateLen);
+  t[10] = 1;
+  t[16] = 0xC5;
+  t[18] = 0xC5;
+  t[20] = 0x18;
+  t[22] = 0x68;
+  uint8_t *r = t.data() + 24;
+  r[0] = 'M';
+  r[1] = quality;
+  r[3] = static_cast<uint8_t>(kRecordLen >> 8);
+  r[4] = static_cast<uint8_t>(kRecordLen);
+  std::memcpy(r + 5, features.data(), kFeatures);
+  zkfp::EncodeTemplate(t.data(), t.size());
+  return t;
+}
+
+inline Finger RandomFinger(std::mt19937 &rng) {
+  std::uniform_int_distribution<int> feature(-100, 100);
+  Finger f(kFeatures);
+  for (int8_t &v : f) {
+    v = static_cast<int8_t>(feature(rng));
+  }
+  return f;
+}
+
+// `f` with every feature moved by up to +-noise.
+inline Finger Noisy(const Finger &f, int noise, std::mt19937 &rng) {
+  std::uniform_int_distribution<int> jitter(-noise, noise);
+  Finger out(f.size());
+  for (size_t i = 0; i < f.size(); ++i) {
+    int v = f[i] + jitter(rng);
+    out[i] = static_cast<int8_t>(v > 127 ? 127 : v < -127 ? -127 : v);
+  }
+  return out;
+}
+
+// Init + device + DB cache, torn down in reverse. The cache needs an open
+// device: opening one is what starts the engine.
+class Session {
+public:
+  Session() {
+    if (ZKFPM_Init() != ZKFP_ERR_OK) {
+      return;
+    }
+    inited_ = true;
+    device_ = ZKFPM_OpenDevice(0);
+    if (device_) {
+      db_ = ZKFPM_CreateDBCache();
+    }
+  }
+  ~Session() {
+    if (db_) {
+      ZKFPM_CloseDBCache(db_);
+    }
+    if (device_) {
+      ZKFPM_CloseDevice(device_);
+    }
+    if (inited_) {
+      ZKFPM_Terminate();
+    }
+  }
+
+  Session(const Session &) = delete;
+  Session &operator=(const Session &) = delete;
+
+  bool Ok() const { return db_ != nullptr; }
+  HANDLE Db() const { return db_; }
+
+private:
+  bool inited_ = false;
+  HANDLE device_ = nullptr;
+  HANDLE db_ = nullptr;
+};
+
+struct IdentifyResult {
+  int ret;
+  unsigned int fid;
+  unsigned int score;
+
+  bool operator==(const IdentifyResult &) const = default;
+};
+
+inline IdentifyResult Identify(HANDLE db, std::vector<unsigned char> probe) {
+  IdentifyResult r{0, 0, 0};
+  r.ret = ZKFPM_Identify(db, probe.data(), static_cast<unsigned int>(probe.size()), &r.fid, &r.score);
+  return r;
+}
+
+// `kGalleryFingers` random fingers, a noisy probe of each in the same order,
+// and one impostor probe last.
+constexpr unsigned int kGalleryFingers = 40;
+constexpr unsigned int kGalleryProbes = kGalleryFingers + 1;
+
+struct Gallery {
+  std::vector<Finger> fingers;
+  std::vector<std::vector<unsigned char>> probes;
+};
+
+inline Gallery MakeGallery(unsigned int seed) {
+  std::mt19937 rng(seed);
+  Gallery g;
+  for (unsigned int i = 0; i < kGalleryFingers; ++i) {
+    g.fingers.push_back(RandomFinger(rng));
+  }
+  for (unsigned int i = 0; i < kGalleryFingers; ++i) {
+    g.probes.push_back(MakeTemplate(Noisy(g.fingers[i], 40, rng)));
+  }
+  g.probes.push_back(MakeTemplate(RandomFinger(rng)));
+  return g;
+}
+
+// Identifies every probe of `g`; fixed size so a child process can report it.
+struct GalleryResults {
+  IdentifyResult r[kGalleryProbes];
+
+  bool operator==(const GalleryResults &) const = default;
+};
+
+inline GalleryResults IdentifyAll(HANDLE db, const Gallery &g) {
+  GalleryResults out{};
+  for (unsigned int i = 0; i < kGalleryProbes; ++i) {
+    out.r[i] = Identify(db, g.probes[i]);
+  }
+  return out;
+}
+
+} // namespace zkfp_test
+
+#endif
@@ -0,0 +1,176 @@
+// Prefilter index against a brute-force reference: after any mix of puts,
+// replacements and removals, Candidates returns exactly the `keep` fids whose
+// nearest finger is closest to the probe, ties to the lower fid, whichever
+// distance kernel runs. Sketching reads no further than the bound it is given.
+#include "engine_fixture.h"
+#include "prefilter_index.h"
+#include "test_util.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <random>
+#include <utility>
+#include <vector>
+
+namespace {
+
+using zkfp::FingerSketch;
+using zkfp::kSketchLanes;
+
+constexpr uint32_t kFormat = 0x18006800;
+constexpr uint32_t kFids = 600;
+
+using Users = std::map<uint32_t, std::vector<FingerSketch>>;
+
+// Mostly close-range lanes of one format; some far-out rows whose distance
+// saturates, and some of another format, which are never near.
+FingerSketch RandomSketch(std::mt19937 &rng) {
+  std::uniform_int_distribution<int> near(-300, 300);
+  std::uniform_int_distribution<int> far(-4095, 4095);
+  unsigned kind = rng() % 20;
+  FingerSketch s{};
+  s.format = kind == 0 ? kFormat + 1 : kFormat;
+  for (size_t l = 0; l < kSketchLanes; ++l) {
+    s.lane[l] = static_cast<int16_t>(kind == 1 ? far(rng) : near(rng));
+  }
+  return s;
+}
+
+std::vector<FingerSketch> RandomFingers(std::mt19937 &rng) {
+  std::vector<FingerSketch> out(1 + rng() % 3);
+  for (FingerSketch &s : out) {
+    s = RandomSketch(rng);
+  }
+  return out;
+}
+
+uint32_t Distance(const FingerSketch &a, const FingerSketch &b) {
+  if (a.format != b.format) {
+    return 0xFFFF;
+  }
+  uint32_t d = 0;
+  for (size_t l = 0; l < kSketchLanes; ++l) {
+    int diff = a.lane[l] - b.lane[l];
+    d += static_cast<uint32_t>(diff < 0 ? -diff : diff);
+  }
+  return std::min<uint32_t>(d, 0xFFFF);
+}
+
+std::vector<uint32_t> Nearest(const Users &users, const std::vector<FingerSketch> &probe, size_t keep) {
+  std::vector<std::pair<uint32_t, uint32_t>> ranked;  // (distance, fid)
+  for (const auto &[fid, fingers] : users) {
+    uint32_t best = 0xFFFF;
+    for (const FingerSketch &f : fingers) {
+      for (const FingerSketch &p : probe) {
+        best = std::min(best, Distance(f, p));
+      }
+    }
+    ranked.emplace_back(best, fid);
+  }
+  std::sort(ranked.begin(), ranked.end());
+  std::vector<uint32_t> out;
+  for (size_t i = 0; i < ranked.size() && i < keep; ++i) {
+    out.push_back(ranked[i].second);
+  }
+  std::sort(out.begin(), out.end());
+  return out;
+}
+
+void CheckQueries(zkfp::PrefilterIndex &index, const Users &users, std::mt19937 &rng) {
+  CHECK(index.Users() == users.size());
+  for (int q = 0; q < 40; ++q) {
+    std::vector<FingerSketch> probe = RandomFingers(rng);
+    for (size_t keep : {size_t{1}, size_t{16}, size_t{100}, users.size(), users.size() + 50}) {
+      std::vector<uint32_t> got;
+      CHECK(index.Candidates(probe.data(), probe.size(), keep, &got));
+      std::sort(got.begin(), got.end());
+      if (!CHECK(got == Nearest(users, probe, keep))) {
+        std::fprintf(stderr, "  query %d keep %zu: %zu fids (%s kernel)\n", q, keep, got.size(),
+                     zkfp::PrefilterKernel());
+      }
+    }
+  }
+}
+
+void TestCandidates(std::mt19937 &rng) {
+  zkfp::PrefilterIndex index;
+  std::vector<uint32_t> out{1};
+  FingerSketch one = RandomSketch(rng);
+  // Not ready: puts are dropped and nothing can be told.
+  index.Put(1, &one, 1);
+  CHECK(!index.Candidates(&one, 1, 10, &out) && out.empty());
+  index.Reset(true);
+  CHECK(index.Users() == 0);
+  CHECK(index.Candidates(&one, 1, 10, &out) && out.empty());
+
+  Users users;
+  for (uint32_t fid = 1; fid <= kFids; ++fid) {
+    users[fid] = RandomFingers(rng);
+    index.Put(fid, users[fid].data(), users[fid].size());
+  }
+  CheckQueries(index, users, rng);
+
+  // Replacements, removals (including by an empty put) and unknown fids, so
+  // rows move around.
+  for (int i = 0; i < 200; ++i) {
+    uint32_t fid = 1 + rng() % (kFids + 20);
+    switch (rng() % 3) {
+      case 0:
+        users[fid] = RandomFingers(rng);
+        index.Put(fid, users[fid].data(), users[fid].size());
+        break;
+      case 1:
+        users.erase(fid);
+        index.Remove(fid);
+        break;
+      default:
+        users.erase(fid);
+        index.Put(fid, nullptr, 0);
+        break;
+    }
+  }
+  CheckQueries(index, users, rng);
+
+  index.Reset(false);
+  CHECK(!index.Ready());
+  CHECK(!index.Candidates(&one, 1, 10, &out));
+}
+
+void TestSketchBounds(std::mt19937 &rng) {
+  zkfp_test::Finger f = zkfp_test::RandomFinger(rng);
+  std::vector<unsigned char> t = zkfp_test::MakeTemplate(f, 80);
+  FingerSketch s[4];
+  CHECK(zkfp::SketchTemplate(t.data(), t.size(), s, 4) == 1);
+  CHECK(s[0].format == kFormat);
+  CHECK(s[0].lane[0] == zkfp_test::kRecordLen >> 2);
+  CHECK(s[0].lane[1] == 80 >> 2);
+  // First band: the first 256 * 1 / 14 minutiae bytes.
+  int sum = 0;
+  for (int i = 0; i < 18; ++i) {
+    sum += f[static_cast<size_t>(i)];
+  }
+  CHECK(s[0].lane[2] == sum * 4 / 18);
+
+  // The decoded form sketches the same.
+  FingerSketch d[4];
+  std::vector<unsigned char> plain = t;
+  CHECK(zkfp::DecodeTemplate(plain.data(), plain.size()));
+  CHECK(zkfp::SketchTemplate(plain.data(), plain.size(), d, 4) == 1);
+  CHECK(std::equal(d[0].lane, d[0].lane + kSketchLanes, s[0].lane));
+
+  // A bound short of the template's length, or too few slots, sketches nothing.
+  CHECK(zkfp::SketchTemplate(t.data(), t.size() - 1, s, 4) == 0);
+  CHECK(zkfp::SketchTemplate(t.data(), t.size(), s, 0) == 0);
+  CHECK(zkfp::SketchTemplate(nullptr, t.size(), s, 4) == 0);
+}
+
+} // namespace
+
+int main() {
+  std::mt19937 rng(17);
+  TestCandidates(rng);
+  TestSketchBounds(rng);
+  return zkfp_test::TestResult();
+}
@@ -0,0 +1,80 @@
+// Identification with the prefilter on and every user kept answers exactly like
+// the full search, both from the sketches taken at enrollment and after the
+// index was dropped and re-sketched from the templates the engine exports.
+#include "engine_fixture.h"
+#include "test_util.h"
+
+#include <cstdint>
+
+namespace {
+
+using zkfp_test::Gallery;
+using zkfp_test::GalleryResults;
+
+constexpr unsigned int kUsers = zkfp_test::kGalleryFingers;
+constexpr unsigned int kEmptyFid = 1000;
+
+bool SetKeep(HANDLE db, uint32_t permille) {
+  return ZKFPM_DBSetParameter(db, FP_PREFILTER_KEEP_CODE, reinterpret_cast<unsigned char *>(&permille),
+                              sizeof(permille)) == ZKFP_ERR_OK;
+}
+
+// Full search first, then the prefilter keeping everyone.
+void CheckSameAsFull(HANDLE db, const Gallery &g, const char *when) {
+  CHECK(SetKeep(db, 0));
+  GalleryResults full = zkfp_test::IdentifyAll(db, g);
+  CHECK(SetKeep(db, 1000));
+  GalleryResults kept = zkfp_test::IdentifyAll(db, g);
+  for (unsigned int i = 0; i < zkfp_test::kGalleryProbes; ++i) {
+    const zkfp_test::IdentifyResult &f = full.r[i];
+    const zkfp_test::IdentifyResult &k = kept.r[i];
+    if (!CHECK(f == k)) {
+      std::fprintf(stderr, "  %s, probe %u: ret %d fid %u score %u in full, ret %d fid %u score %u kept\n", when, i,
+                   f.ret, f.fid, f.score, k.ret, k.fid, k.score);
+    }
+  }
+}
+
+// A template without finger records: the mock engine enrolls it, but it can
+// neither be sketched nor exported.
+std::vector<unsigned char> EmptyTemplate(const Gallery &g) {
+  std::vector<unsigned char> t = zkfp_test::MakeTemplate(g.fingers[0]);
+  zkfp::DecodeTemplate(t.data(), t.size());
+  t[10] = 0;
+  zkfp::EncodeTemplate(t.data(), t.size());
+  return t;
+}
+
+} // namespace
+
+int main() {
+  Gallery g = zkfp_test::MakeGallery(41);
+  zkfp_test::Session s;
+  if (!CHECK(s.Ok())) {
+    return 1;
+  }
+  for (unsigned int fid = 1; fid <= kUsers; ++fid) {
+    std::vector<unsigned char> t = zkfp_test::MakeTemplate(g.fingers[fid - 1]);
+    CHECK(ZKFPM_DBAdd(s.Db(), fid, t.data(), static_cast<unsigned int>(t.size())) == ZKFP_ERR_OK);
+  }
+  CheckSameAsFull(s.Db(), g, "enrolled");
+  for (unsigned int fid = 1; fid <= kUsers; ++fid) {
+    CHECK(zkfp_test::Identify(s.Db(), g.probes[fid - 1]).fid == fid);
+  }
+
+  // The empty user drops the index, and keeps it from being re-sketched while
+  // enrolled; searches fall back to the engine meanwhile.
+  std::vector<unsigned char> empty = EmptyTemplate(g);
+  if (CHECK(ZKFPM_DBAdd(s.Db(), kEmptyFid, empty.data(), static_cast<unsigned int>(empty.size())) ==
+            ZKFP_ERR_OK)) {
+    CheckSameAsFull(s.Db(), g, "unsketchable user");
+    CHECK(ZKFPM_DBDel(s.Db(), kEmptyFid) == ZKFP_ERR_OK);
+  }
+
+  // The next search sketches every user from the engine's own templates.
+  CHECK(ZKFPM_DBDel(s.Db(), 9) == ZKFP_ERR_OK);
+  CheckSameAsFull(s.Db(), g, "re-sketched");
+  CHECK(zkfp_test::Identify(s.Db(), g.probes[8]).fid != 9);
+  CHECK(zkfp_test::Identify(s.Db(), g.probes[10]).fid == 11);
+  return zkfp_test::TestResult();
+}
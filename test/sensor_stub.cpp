@@ -0,0 +1,94 @@
+// Sensor backend for the tests: one device that is always there and returns a
+// fixed synthetic frame, so the ZKFPM entry points can run without USB. Links
+// in place of sensor_libusb.cpp.
+#include <cstdint>
+#include <cstring>
+
+namespace {
+
+struct StubSensor {
+  int width = 300;
+  int height = 400;
+  int dpi = 500;
+};
+
+StubSensor g_sensor;
+
+} // namespace
+
+extern "C" {
+
+int sensorInit() {
+  return 0;
+}
+
+int sensorFree() {
+  return 0;
+}
+
+int sensorGetCount() {
+  return 1;
+}
+
+void *sensorOpen(unsigned int index) {
+  return index == 0 ? &g_sensor : nullptr;
+}
+
+int sensorClose(void *) {
+  return 0;
+}
+
+int sensorCapture(void *handle, unsigned char *image, unsigned int size) {
+  auto *s = static_cast<StubSensor *>(handle);
+  if (!s || !image) {
+    return -2;
+  }
+  for (unsigned int i = 0; i < size; ++i) {
+    unsigned int x = i % static_cast<unsigned int>(s->width);
+    unsigned int y = i / static_cast<unsigned int>(s->width);
+    image[i] = static_cast<unsigned char>(((x / 6 + y / 9) & 1) ? 70 : 190);
+  }
+  return static_cast<int>(size);
+}
+
+int sensorSetParameterEx(void *handle, int paramCode, unsigned char *paramValue, unsigned int cbParamValue) {
+  auto *s = static_cast<StubSensor *>(handle);
+  if (!s || !paramValue || cbParamValue < sizeof(uint32_t)) {
+    return -2;
+  }
+  uint32_t val;
+  std::memcpy(&val, paramValue, sizeof(val));
+  int *field = paramCode == 1 ? &s->width : paramCode == 2 ? &s->height : paramCode == 3 ? &s->dpi : nullptr;
+  if (!field) {
+    return -5;
+  }
+  *field = static_cast<int>(val);
+  return 0;
+}
+
+int sensorGetParameter(void *handle, int paramCode) {
+  auto *s = static_cast<StubSensor *>(handle);
+  if (!s) {
+    return -2;
+  }
+  return paramCode == 1 ? s->width : paramCode == 2 ? s->height : paramCode == 3 ? s->dpi : -5;
+}
+
+int sensorGetParameterEx(void *handle, int paramCode, unsigned char *paramValue, unsigned int *cbParamValue) {
+  if (!handle || !paramValue || !cbParamValue || *cbParamValue < sizeof(uint32_t)) {
+    return -2;
+  }
+  int val = sensorGetParameter(handle, paramCode);
+  if (val < 0) {
+    return val;
+  }
+  std::memcpy(paramValue, &val, sizeof(val));
+  *cbParamValue = sizeof(val);
+  return 0;
+}
+
+int sensorCheckLic(void *, unsigned int v1, void *) {
+  return static_cast<int>((100u * v1) ^ 0x85948B9Au);
+}
+
+} // extern "C"
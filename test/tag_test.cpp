@@ -0,0 +1,120 @@
+// Tagged identification: ZKFPM_IdentifyByTag only finds users in the tag's
+// partition, and re-adding or deleting a user takes it out. Underneath, the
+// BIOKEY tagged search keeps the engine's gate like the untagged one, so a
+// probe that matches nobody in the partition reports no user even with no
+// threshold of its own.
+#include "engine_fixture.h"
+#include "test_util.h"
+
+#include <cstdint>
+
+extern "C" {
+int64_t BIOKEY_INIT(int64_t a1, uint16_t *cfg, int64_t, int64_t, int64_t a5);
+int64_t BIOKEY_CLOSE(void *ctx);
+int BIOKEY_MATCHINGPARAM(void *ctx, int64_t, int val);
+int BIOKEY_DB_ADD(void *ctx, unsigned int uid, int len, void *templ);
+int64_t BIOKEY_SET_STRINGTAG(void *ctx, unsigned int uid, const char *tag);
+int64_t BIOKEY_IDENTIFYTEMP_EX(void *ctx, const char *templ, const char *tag, int threshold, int *uid, int *score);
+}
+
+namespace {
+
+using zkfp_test::Gallery;
+using zkfp_test::IdentifyResult;
+
+constexpr unsigned int kUsers = zkfp_test::kGalleryFingers;
+constexpr unsigned int kImpostor = zkfp_test::kGalleryFingers;  // probe index
+
+IdentifyResult IdentifyByTag(HANDLE db, const char *tag, std::vector<unsigned char> probe) {
+  IdentifyResult r{0, 0, 0};
+  r.ret = ZKFPM_IdentifyByTag(db, tag, probe.data(), static_cast<unsigned int>(probe.size()), &r.fid, &r.score);
+  return r;
+}
+
+bool AddUser(HANDLE db, const Gallery &g, unsigned int fid) {
+  std::vector<unsigned char> t = zkfp_test::MakeTemplate(g.fingers[fid - 1]);
+  return ZKFPM_DBAdd(db, fid, t.data(), static_cast<unsigned int>(t.size())) == ZKFP_ERR_OK;
+}
+
+// Odd fids are tagged "odd", fids 1..10 also "door1".
+void TestPartitions(const Gallery &g) {
+  zkfp_test::Session s;
+  if (!CHECK(s.Ok())) {
+    return;
+  }
+  for (unsigned int fid = 1; fid <= kUsers; ++fid) {
+    CHECK(AddUser(s.Db(), g, fid));
+    if (fid % 2) {
+      CHECK(ZKFPM_DBSetTag(s.Db(), fid, "odd") == ZKFP_ERR_OK);
+    }
+    if (fid <= 10) {
+      CHECK(ZKFPM_DBSetTag(s.Db(), fid, "door1") == ZKFP_ERR_OK);
+    }
+  }
+  CHECK(ZKFPM_DBSetTag(s.Db(), 1, "no spaces") == ZKFP_ERR_INVALID_PARAM);
+  CHECK(ZKFPM_DBSetTag(s.Db(), kUsers + 1, "odd") == ZKFP_ERR_FAIL);
+
+  for (unsigned int fid = 1; fid <= kUsers; ++fid) {
+    const std::vector<unsigned char> &probe = g.probes[fid - 1];
+    IdentifyResult odd = IdentifyByTag(s.Db(), "odd", probe);
+    IdentifyResult door = IdentifyByTag(s.Db(), "door1", probe);
+    bool ok = fid % 2 ? odd.ret == ZKFP_ERR_OK && odd.fid == fid : odd.ret == ZKFP_ERR_FAIL;
+    ok = ok && (fid <= 10 ? door.ret == ZKFP_ERR_OK && door.fid == fid : door.ret == ZKFP_ERR_FAIL);
+    if (!CHECK(ok)) {
+      std::fprintf(stderr, "  fid %u: odd ret %d fid %u, door1 ret %d fid %u\n", fid, odd.ret, odd.fid, door.ret,
+                   door.fid);
+    }
+  }
+  CHECK(IdentifyByTag(s.Db(), "odd", g.probes[kImpostor]).ret == ZKFP_ERR_FAIL);
+  CHECK(IdentifyByTag(s.Db(), "nobody", g.probes[0]).ret == ZKFP_ERR_FAIL);
+
+  // Re-adding drops the user's tags, deleting drops the user.
+  CHECK(ZKFPM_DBDel(s.Db(), 3) == ZKFP_ERR_OK);
+  CHECK(AddUser(s.Db(), g, 3));
+  CHECK(ZKFPM_DBDel(s.Db(), 5) == ZKFP_ERR_OK);
+  CHECK(IdentifyByTag(s.Db(), "odd", g.probes[2]).ret == ZKFP_ERR_FAIL);
+  CHECK(IdentifyByTag(s.Db(), "door1", g.probes[4]).ret == ZKFP_ERR_FAIL);
+  IdentifyResult untagged = zkfp_test::Identify(s.Db(), g.probes[2]);
+  CHECK(untagged.ret == ZKFP_ERR_OK && untagged.fid == 3);
+  IdentifyResult kept = IdentifyByTag(s.Db(), "odd", g.probes[6]);
+  CHECK(kept.ret == ZKFP_ERR_OK && kept.fid == 7);
+}
+
+// Everyone tagged, the engine gated at the identification threshold, and no
+// threshold passed to the search itself.
+void TestGate(const Gallery &g) {
+  uint16_t cfg[36] = {0};
+  cfg[0] = cfg[20] = 300;
+  cfg[1] = cfg[21] = 400;
+  void *ctx = reinterpret_cast<void *>(BIOKEY_INIT(0, cfg, 0, 0, 128));
+  if (!CHECK(ctx)) {
+    return;
+  }
+  BIOKEY_MATCHINGPARAM(ctx, 0, 55);
+  for (unsigned int fid = 1; fid <= kUsers; ++fid) {
+    std::vector<unsigned char> t = zkfp_test::MakeTemplate(g.fingers[fid - 1]);
+    CHECK(BIOKEY_DB_ADD(ctx, fid, static_cast<int>(t.size()), t.data()));
+    CHECK(BIOKEY_SET_STRINGTAG(ctx, fid, "all"));
+  }
+
+  for (const char *tag : {static_cast<const char *>(nullptr), "all"}) {
+    int uid = -1;
+    int score = -1;
+    const char *probe = reinterpret_cast<const char *>(g.probes[kImpostor].data());
+    if (!CHECK(BIOKEY_IDENTIFYTEMP_EX(ctx, probe, tag, 0, &uid, &score) == 0 && uid == 0)) {
+      std::fprintf(stderr, "  impostor %s: uid %d score %d\n", tag ? "tagged" : "untagged", uid, score);
+    }
+    probe = reinterpret_cast<const char *>(g.probes[0].data());
+    CHECK(BIOKEY_IDENTIFYTEMP_EX(ctx, probe, tag, 0, &uid, &score) == 1 && uid == 1);
+  }
+  BIOKEY_CLOSE(ctx);
+}
+
+} // namespace
+
+int main() {
+  Gallery g = zkfp_test::MakeGallery(31);
+  TestPartitions(g);
+  TestGate(g);
+  return zkfp_test::TestResult();
+}
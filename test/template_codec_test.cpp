@@ -0,0 +1,143 @@
+// Template codec round trips at lengths around the keystream block, header
+// reads that agree on both forms, rejection of anything that is not a
+// template, and re-keying body bytes from one template into another.
+#include "template_codec.h"
+#include "test_util.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <vector>
+
+namespace {
+
+constexpr size_t kMaxLen = 0x680;
+
+// A decoded template: "ICRS2", the big-endian length at 8..9, random bytes
+// everywhere else (the key is whatever sits at 10..17).
+std::vector<uint8_t> RandomTemplate(size_t len, std::mt19937 &rng) {
+  std::vector<uint8_t> t(len);
+  for (uint8_t &b : t) {
+    b = static_cast<uint8_t>(rng());
+  }
+  std::memcpy(t.data(), "ICRS2", 5);
+  t[8] = static_cast<uint8_t>(len >> 8);
+  t[9] = static_cast<uint8_t>(len);
+  return t;
+}
+
+void TestRoundTrips(std::mt19937 &rng) {
+  const size_t kLens[] = {50, 51, 159, 160, 161, 170, 319, 320, 321, 1000, 1663, kMaxLen};
+  for (size_t len : kLens) {
+    std::vector<uint8_t> plain = RandomTemplate(len, rng);
+    // Slack past the template must never be touched.
+    std::vector<uint8_t> buf = plain;
+    buf.resize(len + 32, 0xA5);
+    CHECK(zkfp::EncodeTemplate(buf.data(), kMaxLen));
+    CHECK(std::memcmp(buf.data(), "ICRS2", 5) != 0);
+    CHECK(zkfp::TemplateLength(buf.data(), kMaxLen) == len);
+    CHECK(zkfp::TemplateLength(plain.data(), kMaxLen) == len);
+
+    uint8_t header[zkfp::kTemplateHeaderLen];
+    uint8_t key[zkfp::kTemplateKeyLen];
+    CHECK(zkfp::PeekTemplate(buf.data(), kMaxLen, header, key));
+    CHECK(std::memcmp(header, plain.data(), zkfp::kTemplateHeaderLen) == 0);
+    CHECK(std::memcmp(key, plain.data() + 8, zkfp::kTemplateKeyLen) == 0);
+
+    CHECK(zkfp::DecodeTemplate(buf.data(), kMaxLen));
+    if (!CHECK(std::equal(plain.begin(), plain.end(), buf.begin()))) {
+      std::fprintf(stderr, "  length %zu (%s kernel)\n", len, zkfp::TemplateCodecKernel());
+    }
+    for (size_t i = len; i < buf.size(); ++i) {
+      CHECK(buf[i] == 0xA5);
+    }
+    // Decoding a decoded template leaves it alone.
+    CHECK(zkfp::DecodeTemplate(buf.data(), kMaxLen));
+    CHECK(std::equal(plain.begin(), plain.end(), buf.begin()));
+  }
+}
+
+void TestRejects(std::mt19937 &rng) {
+  std::vector<uint8_t> t = RandomTemplate(300, rng);
+  CHECK(zkfp::EncodeTemplate(t.data(), kMaxLen));
+  std::vector<uint8_t> encoded = t;
+
+  // Too long for the caller's limit: refused untouched.
+  CHECK(!zkfp::DecodeTemplate(t.data(), 299));
+  CHECK(t == encoded);
+  CHECK(zkfp::TemplateLength(t.data(), 299) == 0);
+
+  // A damaged magic no longer decodes.
+  t[2] ^= 0x40;
+  CHECK(!zkfp::DecodeTemplate(t.data(), kMaxLen));
+  CHECK(zkfp::TemplateLength(t.data(), kMaxLen) == 0);
+  uint8_t header[zkfp::kTemplateHeaderLen];
+  uint8_t key[zkfp::kTemplateKeyLen];
+  CHECK(!zkfp::PeekTemplate(t.data(), kMaxLen, header, key));
+
+  // Encoding wants a decoded template.
+  CHECK(!zkfp::EncodeTemplate(encoded.data(), kMaxLen));
+  std::vector<uint8_t> junk(64, 0);
+  CHECK(!zkfp::DecodeTemplate(junk.data(), kMaxLen));
+  CHECK(!zkfp::DecodeTemplate(nullptr, kMaxLen));
+}
+
+void TestBatchDecode(std::mt19937 &rng) {
+  std::vector<std::vector<uint8_t>> plain;
+  std::vector<std::vector<uint8_t>> bufs;
+  for (size_t i = 0; i < 9; ++i) {
+    plain.push_back(RandomTemplate(60 + i * 97, rng));
+    bufs.push_back(plain.back());
+    if (i % 3 != 2) {
+      zkfp::EncodeTemplate(bufs.back().data(), kMaxLen);
+    }
+  }
+  bufs[4][0] ^= 0xFF;  // neither form any more
+  std::vector<uint8_t *> ptrs;
+  for (std::vector<uint8_t> &b : bufs) {
+    ptrs.push_back(b.data());
+  }
+  bool ok[9];
+  CHECK(zkfp::DecodeTemplates(ptrs.data(), ptrs.size(), kMaxLen, ok) == 8);
+  for (size_t i = 0; i < bufs.size(); ++i) {
+    CHECK(ok[i] == (i != 4));
+    if (i != 4) {
+      CHECK(bufs[i] == plain[i]);
+    }
+  }
+}
+
+void TestRekey(std::mt19937 &rng) {
+  std::vector<uint8_t> src_plain = RandomTemplate(400, rng);
+  std::vector<uint8_t> dst_plain = RandomTemplate(500, rng);
+  std::vector<uint8_t> src = src_plain;
+  std::vector<uint8_t> dst = dst_plain;
+  zkfp::EncodeTemplate(src.data(), kMaxLen);
+  zkfp::EncodeTemplate(dst.data(), kMaxLen);
+  const uint8_t *src_key = src_plain.data() + 8;
+  const uint8_t *dst_key = dst_plain.data() + 8;
+
+  // Offsets off the key period, so the two keystreams are out of phase.
+  zkfp::RekeyTemplateBytes(src.data(), 37, src_key, dst.data(), 203, dst_key, 150);
+  std::memcpy(dst_plain.data() + 203, src_plain.data() + 37, 150);
+  CHECK(zkfp::DecodeTemplate(dst.data(), kMaxLen));
+  CHECK(dst == dst_plain);
+
+  // Into a decoded template: a zero key.
+  const uint8_t zero[zkfp::kTemplateKeyLen] = {};
+  std::vector<uint8_t> flat = RandomTemplate(300, rng);
+  zkfp::RekeyTemplateBytes(src.data(), 24, src_key, flat.data(), 100, zero, 120);
+  CHECK(std::memcmp(flat.data() + 100, src_plain.data() + 24, 120) == 0);
+}
+
+} // namespace
+
+int main() {
+  std::mt19937 rng(9);
+  TestRoundTrips(rng);
+  TestRejects(rng);
+  TestBatchDecode(rng);
+  TestRekey(rng);
+  return zkfp_test::TestResult();
+}
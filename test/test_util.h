@@ -0,0 +1,102 @@
+#ifndef ZKFP_TEST_UTIL_H
+#define ZKFP_TEST_UTIL_H
+
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <string>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// Just enough for the behaviour tests under test/: a failed CHECK prints the
+// expression and the test keeps going; main returns TestResult().
+namespace zkfp_test {
+
+inline int g_failures = 0;
+
+inline bool Check(bool ok, const char *expr, const char *file, int line) {
+  if (!ok) {
+    std::fprintf(stderr, "%s:%d: CHECK failed: %s\n", file, line, expr);
+    ++g_failures;
+  }
+  return ok;
+}
+
+inline int TestResult() {
+  if (g_failures) {
+    std::fprintf(stderr, "%d check(s) failed\n", g_failures);
+    return 1;
+  }
+  return 0;
+}
+
+// A fresh directory under the system temp dir, removed with its contents on
+// destruction.
+class TempDir {
+public:
+  TempDir() {
+    std::string tmpl = (std::filesystem::temp_directory_path() / "zkfp_test_XXXXXX").string();
+    if (::mkdtemp(tmpl.data())) {
+      path_ = tmpl;
+    }
+  }
+  ~TempDir() {
+    if (!path_.empty()) {
+      std::error_code ec;
+      std::filesystem::remove_all(path_, ec);
+    }
+  }
+
+  TempDir(const TempDir &) = delete;
+  TempDir &operator=(const TempDir &) = delete;
+
+  bool Ok() const { return !path_.empty(); }
+  std::string File(const char *name) const { return path_ + "/" + name; }
+  const std::string &Path() const { return path_; }
+
+private:
+  std::string path_;
+};
+
+// Runs `fn` in a forked child, standing in for another process or machine,
+// and returns whether it exited cleanly after fn returned true. `fn` writes
+// what the parent should see into `report`, a POD the parent reads back.
+template <typename Report, typename Fn>
+bool RunInChild(Fn fn, Report *report) {
+  int fds[2];
+  if (::pipe(fds) != 0) {
+    return false;
+  }
+  pid_t pid = ::fork();
+  if (pid < 0) {
+    ::close(fds[0]);
+    ::close(fds[1]);
+    return false;
+  }
+  if (pid == 0) {
+    ::close(fds[0]);
+    Report out{};
+    bool ok = fn(&out) && ::write(fds[1], &out, sizeof(out)) == static_cast<ssize_t>(sizeof(out));
+    // Skips atexit handlers and destructors: the child ends as if killed.
+    ::_exit(ok ? 0 : 1);
+  }
+  ::close(fds[1]);
+  size_t got = 0;
+  while (got < sizeof(Report)) {
+    ssize_t n = ::read(fds[0], reinterpret_cast<char *>(report) + got, sizeof(Report) - got);
+    if (n <= 0) {
+      break;
+    }
+    got += static_cast<size_t>(n);
+  }
+  ::close(fds[0]);
+  int status = 0;
+  return ::waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0 &&
+         got == sizeof(Report);
+}
+
+} // namespace zkfp_test
+
+#define CHECK(cond) ::zkfp_test::Check(static_cast<bool>(cond), #cond, __FILE__, __LINE__)
+
+#endif